@@ -0,0 +1,154 @@
+#include "benchmark.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+
+//The camera paths stay outside of the floor cube every scene stands on
+const BenchmarkScene benchmarkScenes[] = {
+    {"primitives","scenes/primitives.scene",glm::vec3(0.0f,0.3f,0.0f),3.5f,1.2f},
+    {"mandelbulb","scenes/mandelbulb.scene",glm::vec3(0.0f,0.8f,0.0f),3.5f,0.8f},
+    {"mandelbox","scenes/mandelbox.scene",glm::vec3(0.0f,0.5f,0.0f),3.5f,1.0f},
+    {"julia","scenes/julia.scene",glm::vec3(0.0f,0.8f,0.0f),3.5f,0.8f},
+    {"room","scenes/room.scene",glm::vec3(0.0f,0.8f,0.0f),3.5f,1.0f},
+    {"csgmandelbox","scenes/csgmandelbox.scene",glm::vec3(0.0f,0.5f,0.0f),3.5f,1.0f},
+    {"csgroom","scenes/csgroom.scene",glm::vec3(0.0f,0.8f,0.0f),3.5f,1.0f},
+    {"glass","scenes/glass.scene",glm::vec3(0.0f,0.4f,0.0f),3.5f,1.2f}
+};
+
+const int NUM_BENCHMARK_SCENES = sizeof(benchmarkScenes)/sizeof(benchmarkScenes[0]);
+
+Camera getBenchmarkCamera(const BenchmarkScene& scene, float progress, float fov){
+    float angle = glm::radians(360.0f*progress);
+    glm::vec3 position = scene.target + glm::vec3(scene.radius*std::sin(angle),scene.height,scene.radius*std::cos(angle));
+
+    //Inverse of the front vector Camera builds from yaw and pitch
+    glm::vec3 front = glm::normalize(scene.target - position);
+    float yaw = glm::degrees(std::atan2(front.z,front.x));
+    float pitch = glm::degrees(std::asin(front.y));
+
+    Camera camera(position,front,glm::vec3(0.0f,1.0f,0.0f),yaw,pitch,fov,0.0f);
+    camera.updateYawAndPitch(0.0f);
+    return camera;
+}
+
+double RmseEstimate::getRmse() const {
+    if(m_pixels == 0 || m_unknownPixels*100 > m_pixels + m_unknownPixels) return std::numeric_limits<double>::infinity();
+    return std::sqrt(m_sumOfVariances/m_pixels);
+}
+
+void BenchmarkResult::addPathFrame(double milliseconds, double rays, double marchedSteps){
+    m_pathFrameTimes.push_back(milliseconds);
+    m_rays += rays;
+    m_marchedSteps += marchedSteps;
+}
+
+void BenchmarkResult::addStaticFrame(double milliseconds, float samplesPerPixel, double rmse){
+    double seconds = milliseconds/1000.0;
+    if(!m_convergence.empty()) seconds += m_convergence.back().seconds;
+    m_staticFrameTimes.push_back(milliseconds);
+    m_convergence.push_back({seconds,samplesPerPixel,rmse});
+}
+
+double BenchmarkResult::getTimeToRmse(double targetRmse) const {
+    for(unsigned int i = 0; i < m_convergence.size(); i++){
+        if(m_convergence[i].rmse <= targetRmse) return m_convergence[i].seconds;
+    }
+    return -1.0;
+}
+
+//Nearest rank percentile of frame times that are already sorted
+static double getPercentile(const std::vector<double>& sortedTimes, double percentile){
+    if(sortedTimes.empty()) return 0.0;
+    int rank = (int)std::ceil(percentile/100.0*sortedTimes.size());
+    return sortedTimes[glm::clamp(rank - 1,0,(int)sortedTimes.size() - 1)];
+}
+
+double BenchmarkResult::getPathFramePercentile(double percentile) const {
+    std::vector<double> times = m_pathFrameTimes;
+    std::sort(times.begin(),times.end());
+    return getPercentile(times,percentile);
+}
+
+double BenchmarkResult::getRaysPerSecond() const {
+    double seconds = 0.0;
+    for(unsigned int i = 0; i < m_pathFrameTimes.size(); i++)
+        seconds += m_pathFrameTimes[i]/1000.0;
+    return seconds > 0.0 ? m_rays/seconds : 0.0;
+}
+
+static void writeFrameTimes(FILE* file, const char* name, std::vector<double> times){
+    std::sort(times.begin(),times.end());
+    double total = 0.0;
+    for(unsigned int i = 0; i < times.size(); i++)
+        total += times[i];
+    fprintf(file,"      \"%s\": {\"frames\": %d, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+        name,(int)times.size(),times.empty() ? 0.0 : total/times.size(),getPercentile(times,50.0),getPercentile(times,90.0),getPercentile(times,99.0),times.empty() ? 0.0 : times.back());
+}
+
+//JSON has no infinity, unknown values are written as null
+static void writeNumber(FILE* file, double value){
+    if(std::isfinite(value) && value >= 0.0) fprintf(file,"%.6g",value);
+    else fprintf(file,"null");
+}
+
+static void writeString(FILE* file, const std::string& value){
+    fputc('"',file);
+    for(unsigned int i = 0; i < value.size(); i++){
+        if(value[i] == '"' || value[i] == '\\') fputc('\\',file);
+        if((unsigned char)value[i] >= 0x20) fputc(value[i],file);
+    }
+    fputc('"',file);
+}
+
+void BenchmarkResult::writeJson(FILE* file, double targetRmse) const {
+    fprintf(file,"    {\n      \"name\": ");
+    writeString(file,m_scene->name);
+    fprintf(file,",\n      \"file\": ");
+    writeString(file,m_scene->fileName);
+    fprintf(file,",\n");
+    writeFrameTimes(file,"pathFrameMs",m_pathFrameTimes);
+    writeFrameTimes(file,"staticFrameMs",m_staticFrameTimes);
+    fprintf(file,"      \"raysPerSecond\": ");
+    writeNumber(file,getRaysPerSecond());
+    fprintf(file,",\n      \"stepsPerRay\": ");
+    writeNumber(file,getStepsPerRay());
+    fprintf(file,",\n      \"timeToTargetRmseSeconds\": ");
+    writeNumber(file,getTimeToRmse(targetRmse));
+    fprintf(file,",\n      \"finalRmse\": ");
+    writeNumber(file,getLastRmse());
+
+    //Seconds since the camera stopped, samples per pixel and estimated RMSE after every static frame
+    fprintf(file,",\n      \"convergence\": [");
+    for(unsigned int i = 0; i < m_convergence.size(); i++){
+        fprintf(file,"%s[%.4f, %.2f, ",i == 0 ? "" : ", ",m_convergence[i].seconds,m_convergence[i].samplesPerPixel);
+        writeNumber(file,m_convergence[i].rmse);
+        fprintf(file,"]");
+    }
+    fprintf(file,"]\n    }");
+}
+
+bool writeBenchmarkJson(const std::string& fileName, const std::string& backend, const std::string& device, int width, int height, double targetRmse, const std::vector<BenchmarkResult>& results){
+    FILE* file = fopen(fileName.c_str(),"w");
+    if(file == NULL){
+        std::cerr << "Unable to write benchmark results: " << fileName << std::endl;
+        return false;
+    }
+
+    fprintf(file,"{\n  \"backend\": ");
+    writeString(file,backend);
+    fprintf(file,",\n  \"device\": ");
+    writeString(file,device);
+    fprintf(file,",\n  \"width\": %d,\n  \"height\": %d,\n  \"pathFrames\": %d,\n  \"targetRmse\": ",width,height,BENCHMARK_PATH_FRAMES);
+    writeNumber(file,targetRmse);
+    fprintf(file,",\n  \"scenes\": [\n");
+    for(unsigned int i = 0; i < results.size(); i++){
+        results[i].writeJson(file,targetRmse);
+        fprintf(file,i + 1 < results.size() ? ",\n" : "\n");
+    }
+    fprintf(file,"  ]\n}\n");
+
+    bool isWritten = fclose(file) == 0;
+    if(!isWritten) std::cerr << "Unable to write benchmark results: " << fileName << std::endl;
+    return isWritten;
+}
@@ -0,0 +1,95 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+
+//Canonical scene of the benchmark suite and the orbit its camera path follows
+struct BenchmarkScene {
+    const char* name;
+    const char* fileName;
+    glm::vec3 target; //The camera orbits around this point and keeps looking at it
+    float radius;
+    float height; //Above the target
+};
+
+extern const BenchmarkScene benchmarkScenes[];
+extern const int NUM_BENCHMARK_SCENES;
+
+//Frames rendered along the camera path of every scene, each one restarts the accumulation
+static const int BENCHMARK_PATH_FRAMES = 120;
+
+//Camera on the path of a scene at a progress from 0 to 1, a full orbit around its target
+Camera getBenchmarkCamera(const BenchmarkScene& scene, float progress, float fov);
+
+//Root mean squared error of the mean luminance of an accumulated image, estimated from the variance of every pixel.
+//It measures the noise left, the bias of the renderer is not known without a reference image.
+class RmseEstimate {
+    public:
+        RmseEstimate() : m_sumOfVariances(0.0), m_pixels(0), m_unknownPixels(0) {}
+        void addPixel(double squaredDeviations, double samples){
+            //The variance of a pixel with less than two samples is unknown
+            if(samples < 2.0){
+                m_unknownPixels++;
+            } else {
+                m_sumOfVariances += squaredDeviations/(samples - 1.0)/samples;
+                m_pixels++;
+            }
+        }
+        //Infinite while more than 1% of the pixels have less than two samples. A few pixels whose every
+        //sample is dropped as not finite never get any, they are left out.
+        double getRmse() const;
+    private:
+        double m_sumOfVariances;
+        long long m_pixels;
+        long long m_unknownPixels;
+};
+
+//Measurements of one scene: the frames along its camera path and the convergence at the end of it
+class BenchmarkResult {
+    public:
+        BenchmarkResult(const BenchmarkScene& scene) : m_scene(&scene), m_rays(0.0), m_marchedSteps(0.0) {}
+        void addPathFrame(double milliseconds, double rays, double marchedSteps);
+        //Frames rendered with the camera standing still at the end of the path
+        void addStaticFrame(double milliseconds, float samplesPerPixel, double rmse);
+        const BenchmarkScene& getScene() const {
+            return *m_scene;
+        }
+        //Nearest rank percentile of the frame times along the path in milliseconds
+        double getPathFramePercentile(double percentile) const;
+        //Rays marched per second and march steps per ray along the path, bounces and shadow rays included
+        double getRaysPerSecond() const;
+        double getStepsPerRay() const {
+            return m_rays > 0.0 ? m_marchedSteps/m_rays : 0.0;
+        }
+        //Seconds of static frames until the estimated RMSE first reached the target, negative if it never did
+        double getTimeToRmse(double targetRmse) const;
+        double getStaticSeconds() const {
+            return m_convergence.empty() ? 0.0 : m_convergence.back().seconds;
+        }
+        double getLastRmse() const {
+            return m_convergence.empty() ? -1.0 : m_convergence.back().rmse;
+        }
+        void writeJson(FILE* file, double targetRmse) const;
+    private:
+        struct ConvergencePoint {
+            double seconds;
+            float samplesPerPixel;
+            double rmse;
+        };
+
+        const BenchmarkScene* m_scene;
+        std::vector<double> m_pathFrameTimes;
+        std::vector<double> m_staticFrameTimes;
+        std::vector<ConvergencePoint> m_convergence;
+        double m_rays;
+        double m_marchedSteps;
+};
+
+//Writes the results of a run, one entry per scene. The backend is "gl" or "cpu" and the device describes what it ran on.
+bool writeBenchmarkJson(const std::string& fileName, const std::string& backend, const std::string& device, int width, int height, double targetRmse, const std::vector<BenchmarkResult>& results);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,289 @@
+#include "bluenoise.h"
+#include "imagewriter.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static const float SPATIAL_SIGMA = 1.9f; //Width of the Gaussians that measure how clustered the points are, in pixels
+static const float TEMPORAL_SIGMA = 1.9f; //and in slices
+static const float KERNEL_RADIUS = 3.5f; //In sigmas, further away a point adds less than 0.3% of the energy it adds to its own pixel
+static const float INITIAL_POINT_RATIO = 0.1f; //Share of pixels set in the initial binary pattern
+static const int TILE_SIZE = 8; //Pixels per side of the leaves of the trees
+
+//A point placed or removed during a step, its energy in time is added once every slice took its step
+struct Move {
+    int pixel;
+    float sign;
+};
+
+//State of every slice of every channel while the mask is generated. Besides the energy of its pixels each slice keeps
+//two tournament trees over tiles of them, one finds the point with the most energy and the other the empty pixel with
+//the least. The nodes keep the energy of their winner next to it so the matches never look up the pixels.
+struct VoidAndCluster {
+    int size, depth, pixels;
+    int tilesPerSide, leaves;
+    int window; //Pixels per side of the spatial kernel
+    std::vector<float> kernel;
+    std::vector<int> temporalOffsets;
+    std::vector<float> temporalWeights;
+    std::vector<float> energy;
+    std::vector<char> isPoint;
+    std::vector<float> clusterEnergy;
+    std::vector<int> clusterTree;
+    std::vector<float> voidEnergy;
+    std::vector<int> voidTree;
+};
+
+/*
+ * Finds the winners of a tile again and replays the matches above it, up to the first node whose winner did not change.
+ */
+static void updateTile(VoidAndCluster& state, int slice, int tile){
+    const float* energy = &state.energy[(size_t)slice*state.pixels];
+    const char* isPoint = &state.isPoint[(size_t)slice*state.pixels];
+    float* clusterEnergy = &state.clusterEnergy[(size_t)slice*2*state.leaves];
+    int* clusterTree = &state.clusterTree[(size_t)slice*2*state.leaves];
+    float* voidEnergy = &state.voidEnergy[(size_t)slice*2*state.leaves];
+    int* voidTree = &state.voidTree[(size_t)slice*2*state.leaves];
+
+    int startX = tile % state.tilesPerSide * TILE_SIZE, endX = std::min(startX + TILE_SIZE,state.size);
+    int startY = tile / state.tilesPerSide * TILE_SIZE, endY = std::min(startY + TILE_SIZE,state.size);
+    float cluster = -INFINITY, largestVoid = INFINITY;
+    int clusterPixel = -1, voidPixel = -1;
+    for(int y = startY; y < endY; y++){
+        for(int pixel = y*state.size + startX; pixel < y*state.size + endX; pixel++){
+            if(isPoint[pixel]){
+                if(energy[pixel] > cluster){
+                    cluster = energy[pixel];
+                    clusterPixel = pixel;
+                }
+            } else if(energy[pixel] < largestVoid){
+                largestVoid = energy[pixel];
+                voidPixel = pixel;
+            }
+        }
+    }
+
+    int node = state.leaves + tile;
+    clusterEnergy[node] = cluster;
+    clusterTree[node] = clusterPixel;
+    voidEnergy[node] = largestVoid;
+    voidTree[node] = voidPixel;
+    for(node >>= 1; node >= 1; node >>= 1){
+        int left = 2*node, right = 2*node + 1;
+        int clusterWinner = clusterEnergy[right] > clusterEnergy[left] ? right : left;
+        int voidWinner = voidEnergy[right] < voidEnergy[left] ? right : left;
+        if(clusterTree[node] == clusterTree[clusterWinner] && clusterEnergy[node] == clusterEnergy[clusterWinner] &&
+           voidTree[node] == voidTree[voidWinner] && voidEnergy[node] == voidEnergy[voidWinner]) break;
+        clusterEnergy[node] = clusterEnergy[clusterWinner];
+        clusterTree[node] = clusterTree[clusterWinner];
+        voidEnergy[node] = voidEnergy[voidWinner];
+        voidTree[node] = voidTree[voidWinner];
+    }
+}
+
+static int getTile(const VoidAndCluster& state, int pixel){
+    return pixel / state.size / TILE_SIZE * state.tilesPerSide + pixel % state.size / TILE_SIZE;
+}
+
+/*
+ * Places or removes a point and adds or removes its energy within the slice, the kernel wraps around the edges.
+ */
+static void setPoint(VoidAndCluster& state, int slice, int pixel, bool isPoint, std::vector<Move>& moves){
+    int size = state.size, window = state.window;
+    int startX = (pixel % size - window/2 + size) % size;
+    int startY = (pixel / size - window/2 + size) % size;
+    float sign = isPoint ? 1.0f : -1.0f;
+    state.isPoint[(size_t)slice*state.pixels + pixel] = isPoint;
+
+    for(int j = 0; j < window; j++){
+        int y = (startY + j) % size;
+        float* row = &state.energy[(size_t)slice*state.pixels + y*size];
+        const float* weights = &state.kernel[j*window];
+        //The part of the kernel row past the right edge continues at the left one
+        int firstRun = std::min(window,size - startX);
+        for(int i = 0; i < firstRun; i++)
+            row[startX + i] += sign*weights[i];
+        for(int i = firstRun; i < window; i++)
+            row[i - firstRun] += sign*weights[i];
+    }
+
+    //Every tile the window overlaps, a window as wide as the slice overlaps each tile once
+    int tileWindow = std::min((window + TILE_SIZE - 2)/TILE_SIZE + 1,state.tilesPerSide);
+    int firstTileX = startX / TILE_SIZE, firstTileY = startY / TILE_SIZE;
+    for(int j = 0; j < tileWindow; j++){
+        for(int i = 0; i < tileWindow; i++)
+            updateTile(state,slice,(firstTileY + j) % state.tilesPerSide * state.tilesPerSide + (firstTileX + i) % state.tilesPerSide);
+    }
+    moves.push_back({pixel,sign});
+}
+
+/*
+ * Adds the energy in time of the points the slices placed or removed during a step to the same pixel of the slices around them.
+ */
+static void addTemporalEnergy(VoidAndCluster& state, ThreadPool& threadPool, std::vector<std::vector<Move> >& moves){
+    if(!state.temporalOffsets.empty()){
+        threadPool.parallelFor((int)moves.size(),[&](int slice){
+            int channel = slice / state.depth;
+            int time = slice % state.depth;
+            for(unsigned int i = 0; i < state.temporalOffsets.size(); i++){
+                int source = channel*state.depth + (time - state.temporalOffsets[i] + state.depth) % state.depth;
+                for(unsigned int j = 0; j < moves[source].size(); j++){
+                    const Move& move = moves[source][j];
+                    state.energy[(size_t)slice*state.pixels + move.pixel] += move.sign*state.temporalWeights[i];
+                    updateTile(state,slice,getTile(state,move.pixel));
+                }
+            }
+        });
+    }
+    for(unsigned int i = 0; i < moves.size(); i++)
+        moves[i].clear();
+}
+
+/*
+ * Kernel weights over a window of at most size offsets centered on 0, offsets past half the size would wrap onto
+ * the other side, so every offset is its own distance on the torus.
+ */
+static int getKernel(int size, float sigma, std::vector<float>& weights){
+    int window = std::min(2*(int)std::ceil(KERNEL_RADIUS*sigma) + 1,size);
+    weights.resize(window);
+    for(int i = 0; i < window; i++){
+        float distance = (float)(i - window/2);
+        weights[i] = std::exp(-distance*distance/(2.0f*sigma*sigma));
+    }
+    return window;
+}
+
+void generateBlueNoise(int size, int depth, int channels, unsigned int seed, ThreadPool& threadPool, std::vector<float>& mask){
+    VoidAndCluster state;
+    state.size = size;
+    state.depth = depth;
+    state.pixels = size*size;
+    state.tilesPerSide = (size + TILE_SIZE - 1)/TILE_SIZE;
+    state.leaves = 1;
+    while(state.leaves < state.tilesPerSide*state.tilesPerSide) state.leaves *= 2;
+    int slices = channels*depth;
+
+    //The Gaussian is separable, the 2D kernel is the product of two 1D ones
+    std::vector<float> weights;
+    state.window = getKernel(size,SPATIAL_SIGMA,weights);
+    state.kernel.resize(state.window*state.window);
+    for(int y = 0; y < state.window; y++){
+        for(int x = 0; x < state.window; x++)
+            state.kernel[y*state.window + x] = weights[y]*weights[x];
+    }
+    int temporalWindow = getKernel(depth,TEMPORAL_SIGMA,weights);
+    for(int i = 0; i < temporalWindow; i++){
+        if(i == temporalWindow/2) continue;
+        state.temporalOffsets.push_back(i - temporalWindow/2);
+        state.temporalWeights.push_back(weights[i]);
+    }
+
+    state.energy.assign((size_t)slices*state.pixels,0.0f);
+    state.isPoint.assign((size_t)slices*state.pixels,0);
+    state.clusterEnergy.assign((size_t)slices*2*state.leaves,-INFINITY);
+    state.clusterTree.assign((size_t)slices*2*state.leaves,-1);
+    state.voidEnergy.assign((size_t)slices*2*state.leaves,INFINITY);
+    state.voidTree.assign((size_t)slices*2*state.leaves,-1);
+    std::vector<std::vector<Move> > moves(slices);
+    int initialPoints = std::max((int)(state.pixels*INITIAL_POINT_RATIO),1);
+
+    //Every slice starts from its own random pattern
+    threadPool.parallelFor(slices,[&](int slice){
+        for(int tile = 0; tile < state.tilesPerSide*state.tilesPerSide; tile++)
+            updateTile(state,slice,tile);
+
+        std::mt19937 random(seed*0x9e3779b9u + slice);
+        for(int points = 0; points < initialPoints;){
+            int pixel = random() % state.pixels;
+            if(state.isPoint[(size_t)slice*state.pixels + pixel]) continue;
+            setPoint(state,slice,pixel,true,moves[slice]);
+            points++;
+        }
+    });
+    addTemporalEnergy(state,threadPool,moves);
+
+    //Every move lowers the energy of the pattern, a slice is done once the point removed is the best place for it
+    std::vector<char> isRelaxed(slices,0);
+    bool isRelaxing = true;
+    for(int step = 0; step < state.pixels && isRelaxing; step++){
+        threadPool.parallelFor(slices,[&](int slice){
+            if(isRelaxed[slice]) return;
+            int cluster = state.clusterTree[(size_t)slice*2*state.leaves + 1];
+            setPoint(state,slice,cluster,false,moves[slice]);
+            int largestVoid = state.voidTree[(size_t)slice*2*state.leaves + 1];
+            setPoint(state,slice,largestVoid,true,moves[slice]);
+            if(largestVoid == cluster) isRelaxed[slice] = 1;
+        });
+        addTemporalEnergy(state,threadPool,moves);
+        isRelaxing = false;
+        for(int slice = 0; slice < slices; slice++)
+            isRelaxing |= !isRelaxed[slice];
+    }
+
+    //The points are ranked by removing the tightest clusters, the empty pixels by filling the largest voids.
+    //The largest void of the points is the tightest cluster of the empty pixels, so one fill covers both halves.
+    std::vector<int> ranks((size_t)slices*state.pixels);
+    VoidAndCluster prototype = state;
+    for(int rank = initialPoints - 1; rank >= 0; rank--){
+        threadPool.parallelFor(slices,[&](int slice){
+            int cluster = state.clusterTree[(size_t)slice*2*state.leaves + 1];
+            setPoint(state,slice,cluster,false,moves[slice]);
+            ranks[(size_t)slice*state.pixels + cluster] = rank;
+        });
+        addTemporalEnergy(state,threadPool,moves);
+    }
+
+    std::swap(state,prototype);
+    for(int rank = initialPoints; rank < state.pixels; rank++){
+        threadPool.parallelFor(slices,[&](int slice){
+            int largestVoid = state.voidTree[(size_t)slice*2*state.leaves + 1];
+            setPoint(state,slice,largestVoid,true,moves[slice]);
+            ranks[(size_t)slice*state.pixels + largestVoid] = rank;
+        });
+        addTemporalEnergy(state,threadPool,moves);
+    }
+
+    mask.resize((size_t)slices*state.pixels);
+    for(int slice = 0; slice < slices; slice++){
+        int channel = slice / depth;
+        int time = slice % depth;
+        for(int pixel = 0; pixel < state.pixels; pixel++)
+            mask[((size_t)time*state.pixels + pixel)*channels + channel] = (ranks[(size_t)slice*state.pixels + pixel] + 0.5f)/state.pixels;
+    }
+}
+
+bool writeBlueNoise(const std::string& fileName, const std::vector<float>& mask, int size, int depth, int channels){
+    std::vector<unsigned short> samples(mask.size());
+    for(unsigned int i = 0; i < mask.size(); i++)
+        samples[i] = (unsigned short)std::min((int)(mask[i]*65536.0f),65535);
+    return writePng16(fileName,samples,size,size*depth,channels);
+}
+
+bool loadBlueNoise(const std::string& fileName, std::vector<float>& mask, int& size, int& depth, int& channels){
+    FILE* file = fopen(fileName.c_str(),"rb");
+    if(file == NULL) return false;
+
+    int width, height;
+    stbi_us* data = stbi_load_from_file_16(file,&width,&height,&channels,0);
+    fclose(file);
+    if(data == NULL){
+        std::cerr << "Unable to load blue noise " << fileName << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    if(height % width != 0){
+        std::cerr << "Unable to load blue noise " << fileName << ": the slices have to be square" << std::endl;
+        stbi_image_free(data);
+        return false;
+    }
+
+    size = width;
+    depth = height/width;
+    mask.resize((size_t)width*height*channels);
+    for(unsigned int i = 0; i < mask.size(); i++)
+        mask[i] = (data[i] + 0.5f)/65536.0f;
+    stbi_image_free(data);
+    return true;
+}
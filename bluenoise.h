@@ -0,0 +1,30 @@
+#ifndef BLUENOISE_H
+#define BLUENOISE_H
+
+#include <string>
+#include <vector>
+#include "threadpool.h"
+
+//Tileable blue noise masks made with Ulichney's void and cluster method. A mask has depth slices of size x size
+//pixels, every slice is a 2D blue noise mask on its own and with more than one slice the values every pixel takes
+//along the slices are blue noise in time as well, the spatiotemporal masks of Wolfe et al. The energy of a pixel is
+//then the sum of a Gaussian of the distance to the points of its slice and a Gaussian of the distance in time to the
+//points of the same pixel in the other slices. Every channel is an independent mask.
+//
+//Values are the rank of the pixel within its slice plus a half, divided by the pixels of a slice, stored slice after
+//slice and row after row with the channels interleaved: mask[((slice*size + y)*size + x)*channels + channel]
+
+//Default file the renderers load their mask from, written by tools/bluenoise.cpp
+static const char* const BLUE_NOISE_FILE = "blue_noise.png";
+
+//The slices advance in lockstep, every step places a point in each of them, so the channels and slices of a step
+//are spread over the thread pool. The energy is updated for the points placed, never recomputed.
+void generateBlueNoise(int size, int depth, int channels, unsigned int seed, ThreadPool& threadPool, std::vector<float>& mask);
+
+//16 bit PNG with the slices stacked from top to bottom, the channels as gray, gray and alpha, RGB or RGBA
+bool writeBlueNoise(const std::string& fileName, const std::vector<float>& mask, int size, int depth, int channels);
+//Reads a mask written by writeBlueNoise, the slices are square so their amount follows from the image size.
+//Returns false without a message if there is no such file.
+bool loadBlueNoise(const std::string& fileName, std::vector<float>& mask, int& size, int& depth, int& channels);
+
+#endif // BLUENOISE_H
@@ -0,0 +1,138 @@
+#include "brickmap.h"
+#include "scene.h"
+#include "marcher.h"
+#include <cmath>
+#include <algorithm>
+
+static const int BRICK_SAMPLES = BrickMap::BRICK_SIZE*BrickMap::BRICK_SIZE*BrickMap::BRICK_SIZE;
+
+void BrickMap::clear(){
+    m_objects.clear();
+    m_cells.clear();
+    m_bricks.clear();
+}
+
+void BrickMap::build(const Scene& scene, ThreadPool& threadPool){
+    clear();
+    const std::vector<Object>& objects = scene.getObjects();
+    const int cellsPerGrid = CELLS_PER_SIDE*CELLS_PER_SIDE*CELLS_PER_SIDE;
+    const BrickMapObject noGrid = {glm::vec3(0.0f),0.0f,-1.0f,{0.0f,0.0f,0.0f}};
+    m_objects.assign(objects.size(),noGrid);
+
+    bool hasGrid = false;
+    std::vector<float> centerDistances(cellsPerGrid);
+    std::vector<int> brickCells;
+    for(unsigned int i = 0; i < objects.size(); i++){
+        const Object& object = objects[i];
+        if(!scene.isBrickMapped(object)) continue;
+        hasGrid = true;
+
+        //The grid is the cube around the bounds of the object with a cell of margin on every side,
+        //so a ray entering the grid is at least a cell away from the surface
+        glm::vec3 boundsMin, boundsMax;
+        Bvh::getObjectBounds(object,scene,boundsMin,boundsMax);
+        glm::vec3 extent = boundsMax - boundsMin;
+        float gridSize = glm::max(extent.x,glm::max(extent.y,extent.z))*CELLS_PER_SIDE/(CELLS_PER_SIDE - 2);
+        BrickMapObject grid;
+        grid.cellSize = gridSize/CELLS_PER_SIDE;
+        grid.boundsMin = (boundsMin + boundsMax)*0.5f - glm::vec3(gridSize*0.5f);
+        grid.firstCell = (float)m_cells.size();
+        grid.padding[0] = grid.padding[1] = grid.padding[2] = 0.0f;
+
+        //Every row of cells is a task
+        threadPool.parallelFor(CELLS_PER_SIDE*CELLS_PER_SIDE,[&](int row){
+            for(int x = 0; x < CELLS_PER_SIDE; x++){
+                glm::vec3 center = grid.boundsMin + (glm::vec3((float)x,(float)(row % CELLS_PER_SIDE),(float)(row / CELLS_PER_SIDE)) + 0.5f)*grid.cellSize;
+                centerDistances[row*CELLS_PER_SIDE + x] = getObjectDistance(center,object,scene);
+            }
+        });
+
+        //Cells within a cell of the surface get a brick, the bounds of the others are at least a cell.
+        //Cells entirely inside the surface keep their negative bound and are never looked up by a ray.
+        float halfDiagonal = 0.5f*std::sqrt(3.0f)*grid.cellSize;
+        int firstBrick = getBrickCount();
+        brickCells.clear();
+        for(int cell = 0; cell < cellsPerGrid; cell++){
+            BrickMapCell entry = {-1.0f,centerDistances[cell] - halfDiagonal};
+            if(entry.distance < grid.cellSize && centerDistances[cell] + halfDiagonal > -grid.cellSize){
+                entry.brick = (float)(firstBrick + (int)brickCells.size());
+                brickCells.push_back(cell);
+            }
+            m_cells.push_back(entry);
+        }
+
+        float voxelSize = grid.cellSize/(BRICK_SIZE - 1);
+        m_bricks.resize(m_bricks.size() + brickCells.size()*BRICK_SAMPLES);
+        threadPool.parallelFor((int)brickCells.size(),[&](int brick){
+            int cell = brickCells[brick];
+            glm::vec3 origin = grid.boundsMin + glm::vec3((float)(cell % CELLS_PER_SIDE),(float)(cell / CELLS_PER_SIDE % CELLS_PER_SIDE),(float)(cell / (CELLS_PER_SIDE*CELLS_PER_SIDE)))*grid.cellSize;
+            float* samples = &m_bricks[(size_t)(firstBrick + brick)*BRICK_SAMPLES];
+            for(int z = 0; z < BRICK_SIZE; z++){
+                for(int y = 0; y < BRICK_SIZE; y++){
+                    for(int x = 0; x < BRICK_SIZE; x++)
+                        *samples++ = getObjectDistance(origin + glm::vec3((float)x,(float)y,(float)z)*voxelSize,object,scene);
+                }
+            }
+        });
+
+        m_objects[i] = grid;
+    }
+
+    //Scenes without fractals have nothing to look up
+    if(!hasGrid) clear();
+}
+
+bool BrickMap::getDistanceBound(glm::vec3 point, int objectId, float& distance) const {
+    if(objectId >= (int)m_objects.size() || m_objects[objectId].firstCell < 0.0f) return false;
+    const BrickMapObject& grid = m_objects[objectId];
+
+    //A point outside of the grid is bounded through the closest point inside of it
+    glm::vec3 gridPoint = (point - grid.boundsMin)/grid.cellSize;
+    glm::vec3 insidePoint = glm::clamp(gridPoint,0.0f,(float)CELLS_PER_SIDE);
+    float outsideDistance = glm::length(gridPoint - insidePoint)*grid.cellSize;
+    //Rays that diverged to not a number have no cell to look up
+    if(!(outsideDistance >= 0.0f)) return false;
+    glm::ivec3 cell = glm::min(glm::ivec3(insidePoint),CELLS_PER_SIDE - 1);
+    const BrickMapCell& entry = m_cells[(int)grid.firstCell + (cell.z*CELLS_PER_SIDE + cell.y)*CELLS_PER_SIDE + cell.x];
+
+    float voxelSize = grid.cellSize/(BRICK_SIZE - 1);
+    float bound = entry.distance;
+    if(entry.brick >= 0.0f){
+        glm::vec3 voxel = (insidePoint - glm::vec3(cell))*(float)(BRICK_SIZE - 1);
+        glm::ivec3 corner = glm::min(glm::ivec3(voxel),BRICK_SIZE - 2);
+        glm::vec3 fraction = voxel - glm::vec3(corner);
+        const int ROW = BRICK_SIZE, LAYER = BRICK_SIZE*BRICK_SIZE;
+        const float* samples = &m_bricks[(size_t)entry.brick*BRICK_SAMPLES + (corner.z*BRICK_SIZE + corner.y)*BRICK_SIZE + corner.x];
+
+        float bottom = glm::mix(glm::mix(samples[0],samples[1],fraction.x),glm::mix(samples[ROW],samples[ROW + 1],fraction.x),fraction.y);
+        float top = glm::mix(glm::mix(samples[LAYER],samples[LAYER + 1],fraction.x),glm::mix(samples[LAYER + ROW],samples[LAYER + ROW + 1],fraction.x),fraction.y);
+        bound = glm::mix(bottom,top,fraction.z) - std::sqrt(3.0f)*voxelSize;
+    }
+
+    //The bound at the closest point less the way there bounds the distance from the point as well
+    distance = glm::max(outsideDistance,bound - outsideDistance);
+    return distance > NEAR_VOXELS*voxelSize;
+}
+
+void BrickMap::getAtlas(std::vector<float>& texels, int& width, int& height, int& depth) const {
+    //An empty map still needs a layer to be valid texture storage
+    const int bricksPerLayer = ATLAS_BRICKS*ATLAS_BRICKS;
+    int layers = std::max((getBrickCount() + bricksPerLayer - 1)/bricksPerLayer,1);
+    width = height = ATLAS_BRICKS*BRICK_SIZE;
+    depth = layers*BRICK_SIZE;
+    texels.assign((size_t)width*height*depth,0.0f);
+
+    for(int brick = 0; brick < getBrickCount(); brick++){
+        int originX = brick % ATLAS_BRICKS*BRICK_SIZE;
+        int originY = brick / ATLAS_BRICKS % ATLAS_BRICKS*BRICK_SIZE;
+        int originZ = brick / bricksPerLayer*BRICK_SIZE;
+        const float* samples = &m_bricks[(size_t)brick*BRICK_SAMPLES];
+        for(int z = 0; z < BRICK_SIZE; z++){
+            for(int y = 0; y < BRICK_SIZE; y++){
+                float* row = &texels[((size_t)(originZ + z)*height + originY + y)*width + originX];
+                std::copy(samples,samples + BRICK_SIZE,row);
+                samples += BRICK_SIZE;
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef BRICKMAP_H
+#define BRICKMAP_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "threadpool.h"
+
+class Scene;
+
+//Grid of an object, indexed by object id. The layout matches the two RGBA32F texels per object the path tracer
+//shader reads from its brickMapObjects buffer texture. Objects without a grid have a firstCell of -1.
+struct BrickMapObject {
+    glm::vec3 boundsMin;
+    float cellSize;
+    float firstCell;
+    float padding[3];
+};
+
+//Cell of a grid, one RG32F texel of the brickMapCells buffer texture. Cells far from the surface have no brick,
+//only a lower bound of the distance from anywhere inside of them. Cells near it point to a brick of samples.
+struct BrickMapCell {
+    float brick; //-1 without a brick
+    float distance;
+};
+
+//Sparse brick map of the distance fields of the objects with a fractal in them, see Scene::isBrickMapped. Every one
+//of them gets a cubic grid of cells around its bounds, the cells near the surface hold a brick of BRICK_SIZE^3 distance samples taken at the corners of its
+//voxels, so neighbouring bricks repeat their shared face and trilinear filtering never reads across bricks.
+//Trilinear interpolation of a distance field is at most a voxel diagonal above the distance, a sample minus the
+//diagonal is a lower bound. Far from the surface that bound replaces the ten iterations of the distance estimate,
+//within NEAR_VOXELS voxels of the surface the estimate is evaluated as before.
+class BrickMap {
+    public:
+        static const int CELLS_PER_SIDE = 16;
+        static const int BRICK_SIZE = 8; //Samples per side of a brick, a cell is BRICK_SIZE - 1 voxels wide
+        static const int ATLAS_BRICKS = 32; //Bricks per row and per column of every layer of the atlas
+        static constexpr float NEAR_VOXELS = 2.0f;
+
+        //Bakes the fractals of the scene, the samples are the distances the scene evaluates without a brick map
+        void build(const Scene& scene, ThreadPool& threadPool);
+        void clear();
+        bool isEmpty() const {
+            return m_objects.empty();
+        }
+        //Lower bound of the distance from a point to an object, returns false when the point is too close to the
+        //surface of the object for the bound to stand in for its distance estimate, or the object has no grid
+        bool getDistanceBound(glm::vec3 point, int objectId, float& distance) const;
+        const std::vector<BrickMapObject>& getObjects() const {
+            return m_objects;
+        }
+        const std::vector<BrickMapCell>& getCells() const {
+            return m_cells;
+        }
+        int getBrickCount() const {
+            return (int)(m_bricks.size()/(BRICK_SIZE*BRICK_SIZE*BRICK_SIZE));
+        }
+        //Bricks laid out as a 3D texture of ATLAS_BRICKS x ATLAS_BRICKS bricks per layer, brick i at
+        //(i % ATLAS_BRICKS, i / ATLAS_BRICKS % ATLAS_BRICKS, i / ATLAS_BRICKS^2) in bricks
+        void getAtlas(std::vector<float>& texels, int& width, int& height, int& depth) const;
+    private:
+        std::vector<BrickMapObject> m_objects;
+        std::vector<BrickMapCell> m_cells; //CELLS_PER_SIDE^3 per grid, x fastest
+        std::vector<float> m_bricks; //BRICK_SIZE^3 samples per brick, x fastest
+};
+
+#endif // BRICKMAP_H
@@ -0,0 +1,123 @@
+#include "bvh.h"
+#include "scene.h"
+#include <algorithm>
+
+void Bvh::getObjectBounds(const Object& object, const Scene& scene, glm::vec3& boundsMin, glm::vec3& boundsMax){
+    glm::vec3 center = object.center;
+    glm::vec3 halfSize;
+    float size = object.size;
+
+    switch(object.type){
+        case OBJECT_SPHERE:
+            halfSize = glm::vec3(size/2.0f);
+            break;
+        case OBJECT_PLANE:
+            halfSize = glm::vec3(size,0.01f,size);
+            break;
+        case OBJECT_TORUS:
+            halfSize = glm::vec3(1.5f*size,0.5f*size,1.5f*size);
+            break;
+        case OBJECT_PYRAMID:
+            //The base is always one unit wide, the size is the height above the center
+            center += glm::vec3(0.0f,size/2.0f,0.0f);
+            halfSize = glm::vec3(0.5f,glm::abs(size)/2.0f,0.5f);
+            break;
+        case OBJECT_MANDELBULB:
+            //Fractals are evaluated at ray/size, so their center is scaled as well
+            center *= size;
+            halfSize = glm::vec3(1.2f*size);
+            break;
+        case OBJECT_JULIA:
+            center *= size;
+            halfSize = glm::vec3(1.3f*size);
+            break;
+        case OBJECT_WALL:
+        case OBJECT_ROOM:
+            halfSize = glm::vec3(size,size,0.1f);
+            break;
+        case OBJECT_CYLINDER:
+            halfSize = glm::vec3(size/2.0f,size,size/2.0f);
+            break;
+        case OBJECT_CSG: {
+            //The shape is scaled by the size of the object around its center
+            const CsgShape& shape = scene.getShape(object.shape);
+            center += size*(shape.boundsMin + shape.boundsMax)*0.5f;
+            halfSize = size*(shape.boundsMax - shape.boundsMin)*0.5f;
+            break;
+        }
+        default: //cube, prism and the mandelbox, which is intersected with a cube
+            halfSize = glm::vec3(size);
+            break;
+    }
+
+    boundsMin = center - halfSize;
+    boundsMax = center + halfSize;
+}
+
+void Bvh::clear(){
+    m_nodes.clear();
+    m_objectIndices.clear();
+}
+
+void Bvh::build(const Scene& scene){
+    const std::vector<Object>& objects = scene.getObjects();
+    clear();
+    if((int)objects.size() < MIN_OBJECTS) return;
+
+    m_objectMin.resize(objects.size());
+    m_objectMax.resize(objects.size());
+    for(unsigned int i = 0; i < objects.size(); i++){
+        getObjectBounds(objects[i],scene,m_objectMin[i],m_objectMax[i]);
+        m_objectIndices.push_back((int)i);
+    }
+
+    //A binary tree with at most 2 objects per leaf never needs more than 2n nodes
+    m_nodes.reserve(objects.size()*2);
+    m_nodes.push_back(BvhNode());
+    subdivide(0,0,(int)objects.size());
+
+    m_objectMin.clear();
+    m_objectMax.clear();
+}
+
+//Splits the objects at the median of their centers along the longest axis of the node
+void Bvh::subdivide(int nodeIndex, int first, int count){
+    glm::vec3 boundsMin = glm::vec3(1e30f), boundsMax = glm::vec3(-1e30f);
+    glm::vec3 centersMin = glm::vec3(1e30f), centersMax = glm::vec3(-1e30f);
+    for(int i = first; i < first + count; i++){
+        int object = m_objectIndices[i];
+        boundsMin = glm::min(boundsMin,m_objectMin[object]);
+        boundsMax = glm::max(boundsMax,m_objectMax[object]);
+        glm::vec3 center = (m_objectMin[object] + m_objectMax[object]) * 0.5f;
+        centersMin = glm::min(centersMin,center);
+        centersMax = glm::max(centersMax,center);
+    }
+
+    m_nodes[nodeIndex].boundsMin = boundsMin;
+    m_nodes[nodeIndex].boundsMax = boundsMax;
+
+    if(count <= MAX_LEAF_OBJECTS){
+        m_nodes[nodeIndex].leftFirst = (float)first;
+        m_nodes[nodeIndex].count = (float)count;
+        return;
+    }
+
+    glm::vec3 extent = centersMax - centersMin;
+    int axis = 0;
+    if(extent.y > extent.x) axis = 1;
+    if(extent.z > extent[axis]) axis = 2;
+
+    int middle = first + count / 2;
+    std::nth_element(m_objectIndices.begin() + first,m_objectIndices.begin() + middle,m_objectIndices.begin() + first + count,[this,axis](int a, int b){
+        return m_objectMin[a][axis] + m_objectMax[a][axis] < m_objectMin[b][axis] + m_objectMax[b][axis];
+    });
+
+    int leftChild = (int)m_nodes.size();
+    m_nodes.push_back(BvhNode());
+    m_nodes.push_back(BvhNode());
+    m_nodes[nodeIndex].leftFirst = (float)leftChild;
+    m_nodes[nodeIndex].count = 0.0f;
+
+    subdivide(leftChild,first,middle - first);
+    subdivide(leftChild + 1,middle,first + count - middle);
+}
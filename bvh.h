@@ -0,0 +1,55 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Object;
+class Scene;
+
+//Node of the bounding volume hierarchy. Internal nodes have a count of 0 and their children
+//are stored next to each other at leftFirst and leftFirst + 1. Leaves reference count objects
+//starting at leftFirst in the object index list. The layout matches the two RGBA32F texels
+//per node the path tracer shader reads from its bvhNodes buffer texture.
+struct BvhNode {
+    glm::vec3 boundsMin;
+    float leftFirst;
+    glm::vec3 boundsMax;
+    float count;
+};
+
+//Bounding volume hierarchy over the scene objects, used to skip the distance functions of
+//objects whose bounds are further away than the closest distance found so far
+class Bvh {
+    public:
+        void build(const Scene& scene);
+        void clear();
+        const std::vector<BvhNode>& getNodes() const {
+            return m_nodes;
+        }
+        const std::vector<int>& getObjectIndices() const {
+            return m_objectIndices;
+        }
+        bool isEmpty() const {
+            return m_nodes.empty();
+        }
+        //World space box that contains the surface of an object, csg objects take the bounds of their shape in the scene
+        static void getObjectBounds(const Object& object, const Scene& scene, glm::vec3& boundsMin, glm::vec3& boundsMax);
+        //Distance from a point to a box, 0 inside of it. It is a lower bound of the distance to anything inside the box.
+        static float boxDistance(glm::vec3 point, glm::vec3 boundsMin, glm::vec3 boundsMax){
+            glm::vec3 outside = glm::max(glm::max(boundsMin - point,point - boundsMax),0.0f);
+            return glm::length(outside);
+        }
+    private:
+        static const int MAX_LEAF_OBJECTS = 2;
+        //Below this many objects walking the hierarchy costs more than looping over them, so none is built
+        static const int MIN_OBJECTS = 17;
+
+        void subdivide(int nodeIndex, int first, int count);
+
+        std::vector<BvhNode> m_nodes;
+        std::vector<int> m_objectIndices;
+        std::vector<glm::vec3> m_objectMin, m_objectMax;
+};
+
+#endif // BVH_H
@@ -1,5 +1,6 @@
 #include "camera.h"
 #include <iostream>
+#include <cmath>
 
 Camera::Camera(glm::vec3 position, glm::vec3 front, glm::vec3 up, float yaw, float pitch, float fov, float speed){
     m_position = position;
@@ -18,6 +19,13 @@ glm::mat4 Camera::getViewTransformation(){
     return glm::lookAt(m_position,m_position + m_front, m_up);
 }
 
+glm::mat4 Camera::getViewProjection(float aspectRatio){
+    //The rays place the image plane at a distance of the screen height over tan(fov/2), twice as far as a
+    //perspective projection with this vertical field of view would, so the one that matches is narrower
+    float verticalFov = 2.0f*std::atan(std::tan(glm::radians(m_fov)/2.0f)/2.0f);
+    return glm::perspective(verticalFov,aspectRatio,0.01f,1000.0f)*getViewTransformation();
+}
+
 void Camera::moveFront(){
     m_position += m_speed * m_front;
 }
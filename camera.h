@@ -8,6 +8,9 @@ class Camera {
     public:
         Camera(glm::vec3 position, glm::vec3 front, glm::vec3 up, float yaw, float pitch, float fov, float speed);
         glm::mat4 getViewTransformation();
+        //Projects world positions onto the pixels of a screen with the aspect ratio the path tracer renders,
+        //the inverse of the primary ray directions both backends build from the position, basis and field of view
+        glm::mat4 getViewProjection(float aspectRatio);
         void moveFront();
         void moveBack();
         void moveLeft();
@@ -0,0 +1,149 @@
+#include "cpudenoiser.h"
+#include "cpurenderer.h"
+#include <cmath>
+
+//Filter constants, the same as in the denoiser shader
+static const glm::vec3 LUMINANCE = glm::vec3(0.2126f,0.7152f,0.0722f);
+static const float KERNEL[3] = {3.0f/8.0f,1.0f/4.0f,1.0f/16.0f};
+static const float GAUSSIAN[2] = {1.0f/4.0f,1.0f/8.0f};
+static const int MIN_TEMPORAL_SAMPLES = 4; //Pixels with fewer samples estimate their variance from their neighbours
+static const int NORMAL_PHI = 64; //A power of two, the weight raises the cosine to it by repeated squaring
+static const float DEPTH_PHI = 2.0f;
+static const float LUMINANCE_PHI = 8.0f;
+
+//Images of a pass and the primary hits that guide it, lookups outside of the image are clamped to the border
+struct FilterImage {
+    const std::vector<PrimaryHit>* primaryHits;
+    int width, height;
+
+    int index(int x, int y) const {
+        return glm::clamp(y,0,height - 1)*width + glm::clamp(x,0,width - 1);
+    }
+    const PrimaryHit& hit(int x, int y) const {
+        return (*primaryHits)[index(x,y)];
+    }
+};
+
+/*
+ * Weight of a neighbour from the primary hits alone, depthGradient is the change of distance per pixel around the center.
+ */
+static float getGeometryWeight(const PrimaryHit& center, const PrimaryHit& hit, glm::vec2 offset, glm::vec2 depthGradient){
+    if(hit.objectId != center.objectId) return 0.0f;
+    float normalWeight = glm::max(glm::dot(center.normal,hit.normal),0.0f);
+    for(int power = 1; power < NORMAL_PHI; power *= 2)
+        normalWeight *= normalWeight;
+    float depthWeight = std::exp(-std::abs(center.distance-hit.distance)/(DEPTH_PHI*std::abs(glm::dot(depthGradient,offset))+1e-3f));
+    return normalWeight*depthWeight;
+}
+
+/*
+ * The smaller of the one sided differences, the larger one crosses the edge when there is one.
+ */
+static glm::vec2 getDepthGradient(const FilterImage& image, int x, int y){
+    float depth = image.hit(x,y).distance;
+    float dx = glm::min(std::abs(image.hit(x + 1,y).distance-depth),std::abs(depth-image.hit(x - 1,y).distance));
+    float dy = glm::min(std::abs(image.hit(x,y + 1).distance-depth),std::abs(depth-image.hit(x,y - 1).distance));
+    return glm::vec2(dx,dy);
+}
+
+/*
+ * Color and variance of the mean luminance of a pixel of the accumulation. Pixels with a short history
+ * take the variance of the luminance of their neighbours on the same surface instead.
+ */
+static glm::vec4 estimateVariance(const FilterImage& image, const std::vector<glm::vec3>& accumulation, const std::vector<int>& sampleCounts,
+                                  const std::vector<float>& squaredDeviations, int x, int y){
+    int pixel = image.index(x,y);
+    int samples = sampleCounts[pixel];
+    if(samples >= MIN_TEMPORAL_SAMPLES)
+        return glm::vec4(accumulation[pixel],squaredDeviations[pixel]/(samples-1.0f)/samples);
+
+    const PrimaryHit& center = image.hit(x,y);
+    if(center.objectId < 0) return glm::vec4(accumulation[pixel],0.0f);
+
+    glm::vec2 depthGradient = getDepthGradient(image,x,y);
+    glm::vec2 moments = glm::vec2(0.0f);
+    float totalWeight = 0.0f;
+    for(int offsetY = -3; offsetY <= 3; offsetY++){
+        for(int offsetX = -3; offsetX <= 3; offsetX++){
+            float weight = (offsetX == 0 && offsetY == 0) ? 1.0f : getGeometryWeight(center,image.hit(x + offsetX,y + offsetY),glm::vec2(offsetX,offsetY),depthGradient);
+            float luminance = glm::dot(accumulation[image.index(x + offsetX,y + offsetY)],LUMINANCE);
+            moments += weight*glm::vec2(luminance,luminance*luminance);
+            totalWeight += weight;
+        }
+    }
+    moments /= totalWeight;
+    return glm::vec4(accumulation[pixel],glm::max(moments.y-moments.x*moments.x,0.0f)/glm::max((float)samples,1.0f));
+}
+
+/*
+ * One iteration of the filter with taps stepSize pixels apart.
+ */
+static glm::vec4 filterPixel(const FilterImage& image, const std::vector<glm::vec4>& input, int x, int y, int stepSize){
+    glm::vec4 center = input[image.index(x,y)];
+    const PrimaryHit& centerHit = image.hit(x,y);
+
+    //The background has no noise to filter
+    if(centerHit.objectId < 0) return center;
+
+    //The variance steering the luminance weight is blurred, a single noisy estimate would stop the filter at random
+    float blurredVariance = 0.0f;
+    for(int offsetY = -1; offsetY <= 1; offsetY++){
+        for(int offsetX = -1; offsetX <= 1; offsetX++)
+            blurredVariance += input[image.index(x + offsetX,y + offsetY)].w*GAUSSIAN[std::abs(offsetX)]*GAUSSIAN[std::abs(offsetY)];
+    }
+    float luminanceScale = LUMINANCE_PHI*std::sqrt(glm::max(blurredVariance,0.0f))+1e-6f;
+    float centerLuminance = glm::dot(glm::vec3(center),LUMINANCE);
+    glm::vec2 depthGradient = getDepthGradient(image,x,y);
+
+    glm::vec3 color = glm::vec3(center)*KERNEL[0]*KERNEL[0];
+    float variance = center.w*KERNEL[0]*KERNEL[0]*KERNEL[0]*KERNEL[0];
+    float totalWeight = KERNEL[0]*KERNEL[0];
+
+    for(int offsetY = -2; offsetY <= 2; offsetY++){
+        for(int offsetX = -2; offsetX <= 2; offsetX++){
+            if(offsetX == 0 && offsetY == 0) continue;
+            int neighbourX = x + offsetX*stepSize;
+            int neighbourY = y + offsetY*stepSize;
+            if(neighbourX < 0 || neighbourY < 0 || neighbourX >= image.width || neighbourY >= image.height) continue;
+
+            const glm::vec4& neighbourColor = input[neighbourY*image.width + neighbourX];
+            float geometryWeight = getGeometryWeight(centerHit,image.hit(neighbourX,neighbourY),glm::vec2(offsetX,offsetY)*(float)stepSize,depthGradient);
+            if(geometryWeight == 0.0f) continue;
+            float luminanceWeight = std::exp(-std::abs(glm::dot(glm::vec3(neighbourColor),LUMINANCE)-centerLuminance)/luminanceScale);
+            float weight = KERNEL[std::abs(offsetX)]*KERNEL[std::abs(offsetY)]*geometryWeight*luminanceWeight;
+
+            color += weight*glm::vec3(neighbourColor);
+            variance += weight*weight*neighbourColor.w;
+            totalWeight += weight;
+        }
+    }
+
+    return glm::vec4(color/totalWeight,variance/(totalWeight*totalWeight));
+}
+
+void denoiseAtrous(const std::vector<glm::vec3>& accumulation, const std::vector<int>& sampleCounts, const std::vector<float>& squaredDeviations,
+                   const std::vector<PrimaryHit>& primaryHits, int width, int height, int iterations, ThreadPool& threadPool, std::vector<glm::vec3>& output){
+    FilterImage image = {&primaryHits,width,height};
+    std::vector<glm::vec4> passes[2];
+    passes[0].resize(width*height);
+    passes[1].resize(width*height);
+
+    threadPool.parallelFor(height,[&](int y){
+        for(int x = 0; x < width; x++)
+            passes[0][y*width + x] = estimateVariance(image,accumulation,sampleCounts,squaredDeviations,x,y);
+    });
+
+    for(int iteration = 0; iteration < iterations; iteration++){
+        const std::vector<glm::vec4>& input = passes[iteration % 2];
+        std::vector<glm::vec4>& filtered = passes[1 - iteration % 2];
+        threadPool.parallelFor(height,[&](int y){
+            for(int x = 0; x < width; x++)
+                filtered[y*width + x] = filterPixel(image,input,x,y,1 << iteration);
+        });
+    }
+
+    const std::vector<glm::vec4>& result = passes[iterations % 2];
+    output.resize(width*height);
+    for(int i = 0; i < width*height; i++)
+        output[i] = glm::vec3(result[i]);
+}
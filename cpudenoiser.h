@@ -0,0 +1,16 @@
+#ifndef CPUDENOISER_H
+#define CPUDENOISER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "threadpool.h"
+
+struct PrimaryHit;
+
+//CPU reference of the edge avoiding a-trous wavelet filter of shaders/denoiser.fs, with the same passes and weights.
+//The accumulation is filtered with the primary hits guiding the edges: a first pass estimates the variance of every
+//pixel and each of the iterations after it doubles the distance between the taps. All images are bottom row first.
+void denoiseAtrous(const std::vector<glm::vec3>& accumulation, const std::vector<int>& sampleCounts, const std::vector<float>& squaredDeviations,
+                   const std::vector<PrimaryHit>& primaryHits, int width, int height, int iterations, ThreadPool& threadPool, std::vector<glm::vec3>& output);
+
+#endif // CPUDENOISER_H
@@ -0,0 +1,600 @@
+#include "cpurenderer.h"
+#include "marcher.h"
+#include "packetmarcher.h"
+#include "cpudenoiser.h"
+#include <cmath>
+#include <atomic>
+
+//Adaptive sampling constants, the same as in the path tracer shader
+static const float RELATIVE_ERROR_FLOOR = 0.01f; //Keeps near black pixels from needing endless samples
+static const glm::vec3 LUMINANCE = glm::vec3(0.2126f,0.7152f,0.0722f);
+
+//Disocclusion tests of the reprojection, the same as in the path tracer shader
+static const float REPROJECTION_DEPTH_TOLERANCE = 0.05f; //Relative to the distance to the previous camera
+static const float REPROJECTION_NORMAL_TOLERANCE = 0.9f; //Cosine
+
+//Per pixel state of the path marching algorithm, these are globals in the path tracer shader
+struct MarchState {
+    const Scene* scene;
+    glm::vec2 fragCoord;
+    glm::vec2 resolution;
+    float pixelRadius; //see getFootprint in marcher.h, 0 for full detail
+    float time;
+    const Sampler* sampler; //NULL samples with the sin hash instead
+    int sampleIndex;
+    int sequenceSeed;
+    glm::vec3 samplePixelColor;
+    glm::vec3 glow;
+    glm::vec4 orbitTrap;
+    int marchedSteps;
+    float distanceToScene;
+    //Rays marched and the steps they took, over every sample of the tile
+    long long marchedRays;
+    long long totalMarchedSteps;
+};
+
+/*
+ * Utilizes a vec2 seed in order to produce a random floating point value
+ */
+static float random(glm::vec2 seed){
+    return glm::fract(std::sin(glm::dot(seed,glm::vec2(20.234234f,23490.234234f)))*4002.12f);
+}
+
+/*
+ * 2D sample of a bounce of the current path, from the low discrepancy sampler like the path tracer shader
+ * or from the sin hash the renderers used before it.
+ */
+static glm::vec2 getSample(const MarchState& state, int bounce, int sampleNumber){
+    if(state.sampler == NULL){
+        return glm::vec2(random(glm::vec2(state.fragCoord.y,state.fragCoord.x)*(float)sampleNumber/state.resolution*state.time/10000.0f),
+                         random(state.resolution*(float)sampleNumber/state.fragCoord*state.time/10000.0f));
+    }
+    return state.sampler->getSample((int)state.fragCoord.x,(int)state.fragCoord.y,state.sampleIndex,bounce,state.sequenceSeed);
+}
+
+/*
+ * Utilizes two random floating point values to produce a random sample of a three-dimensional
+ * vector on the normal hemisphere.
+ */
+static glm::vec3 sampleHemisphere(float u1, float u2, glm::vec3 normal){
+    glm::vec3 uu = glm::normalize(glm::cross(normal,glm::vec3(0.0f,1.0f,1.0f)));
+    glm::vec3 vv = glm::normalize(glm::cross(uu,normal));
+
+    float ra = std::sqrt(u1);
+    float rx = ra*std::cos(10.2831f*u2);
+    float ry = ra*std::sin(10.2831f*u2);
+    float rz = std::sqrt(1.0f-u1);
+    glm::vec3 rr = glm::vec3(rx*uu + ry*vv + rz*normal);
+
+    return glm::normalize(rr);
+}
+
+/*
+ * Marches a ray through the scene and counts it in the statistics of the frame.
+ */
+static SceneCollision marchRay(glm::vec3 from, glm::vec3 direction, MarchState& state, float maxLength, float relaxation, float pixelRadius){
+    SceneCollision collision = rayMarchScene(from,direction,*state.scene,state.orbitTrap,state.marchedSteps,maxLength,relaxation,pixelRadius);
+    state.marchedRays++;
+    state.totalMarchedSteps += state.marchedSteps;
+    return collision;
+}
+
+/*
+ * Marches a shadow ray towards a point maxLength away and counts it in the statistics of the frame.
+ */
+static float marchOcclusion(glm::vec3 from, glm::vec3 direction, MarchState& state, float maxLength){
+    float occluderDistance = rayMarchOcclusion(from,direction,*state.scene,state.marchedSteps,maxLength);
+    state.marchedRays++;
+    state.totalMarchedSteps += state.marchedSteps;
+    return occluderDistance;
+}
+
+/*
+ * "Path marching" algorithm.
+ * The first intersection can be passed in when it was already found by marching a ray packet.
+ * When the primary hit is cached the path starts from it, otherwise it is stored in primaryHit.
+ */
+static void march(glm::vec3 from, glm::vec3 direction, int depth, int sampleNumber, MarchState& state, const SceneCollision* primaryCollision, PrimaryHit& primaryHit, bool isPrimaryHitCached){
+    const Scene& scene = *state.scene;
+    const MarchSettings& settings = scene.getMarchSettings();
+    const float EPSILON = settings.epsilon;
+    glm::vec3 lightSource = scene.getLightSource();
+    glm::vec3 lightColor = scene.getLightColor();
+
+    bool isPrimaryRay = true;
+    int bounce = 0;
+
+    while(depth <= settings.maxMarchDepth){
+
+        int intersectedObjectId;
+        glm::vec4 storedOrbitTrap = glm::vec4(0.0f);
+        glm::vec3 hitpoint, normal;
+
+        if(isPrimaryRay && isPrimaryHitCached){
+            if(primaryHit.objectId == -1){
+                state.samplePixelColor = scene.getBackgroundColor();
+                return;
+            }
+            intersectedObjectId = primaryHit.objectId;
+            storedOrbitTrap.y = primaryHit.orbitTrap.x;
+            storedOrbitTrap.z = primaryHit.orbitTrap.y;
+            state.distanceToScene = primaryHit.distance;
+            hitpoint = from + (primaryHit.distance-2*EPSILON) * direction;
+            normal = primaryHit.normal;
+            state.samplePixelColor = primaryHit.directLight;
+        } else {
+
+            SceneCollision intersectionWithScene;
+            if(primaryCollision != NULL){
+                intersectionWithScene = *primaryCollision;
+                primaryCollision = NULL;
+            } else {
+                intersectionWithScene = marchRay(from,direction,state,settings.maxDist,settings.relaxation,state.pixelRadius);
+            }
+
+            if(intersectionWithScene.objectId == -1){
+                state.samplePixelColor = glm::mix(state.samplePixelColor,scene.getBackgroundColor(),1.0f/depth);
+                if(depth == 1){
+                    state.glow = glm::vec3(1.0f)*(float)state.marchedSteps/(float)(settings.maxMarchingSteps*8);
+                }
+                return;
+            }
+
+            intersectedObjectId = intersectionWithScene.objectId;
+            const Object& intersectedObject = scene.getObject(intersectedObjectId);
+
+            if(Scene::isFractal(intersectedObject.type) && depth == 1){
+                storedOrbitTrap = state.orbitTrap;
+            }
+
+            if(depth == 1){
+                state.distanceToScene = intersectionWithScene.distance;
+            }
+
+            hitpoint = from + (intersectionWithScene.distance-2*EPSILON) * direction;
+
+            normal = getNormal(hitpoint,intersectedObject,scene,getFootprint(state.pixelRadius,intersectionWithScene.distance));
+
+            //Next event estimation
+            glm::vec3 directionToLightSource = glm::normalize(lightSource-hitpoint);
+            float distanceToLightSource = glm::length(lightSource-hitpoint);
+            glm::vec3 shadowRayOrigin = hitpoint + normal * 4.0f * EPSILON;
+            float occluderDistance = marchOcclusion(shadowRayOrigin,directionToLightSource,state,distanceToLightSource);
+
+            bool isOccluded = occluderDistance < distanceToLightSource;
+
+            if(isOccluded){
+                //Only the occluder is evaluated with its payload, to tell whether it is glass
+                glm::vec3 glassHitpoint = hitpoint + directionToLightSource * occluderDistance;
+                SceneCollision occluder = getClosestSceneObjectAsCollision(glassHitpoint,scene,state.orbitTrap);
+                if(occluder.objectId != -1 && scene.getObject(occluder.objectId).surfaceType == SURFACE_REFRACTIVE){
+                    glm::vec3 normalAtGlass = getNormal(glassHitpoint,scene.getObject(occluder.objectId),scene);
+                    state.samplePixelColor += lightColor * std::abs(glm::clamp(glm::dot(normalAtGlass,normal),-1.0f,1.0f)) * 0.4f;
+                }
+            }
+
+            if(!isOccluded){
+                float lightIntensity = glm::clamp(glm::dot(normal,directionToLightSource),0.0f,1.0f);
+                //The light is attenuated by the distance the shadow ray reaches with all of its steps, past the light
+                //only the few until it is maxDist away from the scene are marched
+                int escapeSteps;
+                float lightAttenuation = rayMarchEscape(shadowRayOrigin,directionToLightSource,scene,escapeSteps,occluderDistance,state.marchedSteps + 1)*0.0001f;
+                state.totalMarchedSteps += escapeSteps;
+                glm::vec3 lightFactor = lightIntensity*lightColor*lightAttenuation;
+                //The shader mixes with the integer 1/depth, so only the first bounce takes the light factor
+                state.samplePixelColor = glm::mix(state.samplePixelColor,lightFactor,(float)(1/depth));
+            }
+
+            if(isPrimaryRay){
+                primaryHit.objectId = intersectionWithScene.objectId;
+                primaryHit.distance = intersectionWithScene.distance;
+                primaryHit.normal = normal;
+                primaryHit.orbitTrap = glm::vec2(storedOrbitTrap.y,storedOrbitTrap.z);
+                primaryHit.directLight = state.samplePixelColor;
+            }
+        }
+
+        const Object& intersectedObject = scene.getObject(intersectedObjectId);
+        isPrimaryRay = false;
+
+        if(intersectedObject.surfaceType == SURFACE_DIFFUSE){
+
+            glm::vec2 bounceSample = getSample(state,bounce,sampleNumber);
+            glm::vec3 newRayDirection = sampleHemisphere(bounceSample.x,bounceSample.y,normal);
+            float cost = glm::dot(newRayDirection,normal);
+            state.samplePixelColor = glm::mix(state.samplePixelColor,intersectedObject.albedo+glm::vec3(storedOrbitTrap.z,storedOrbitTrap.y,storedOrbitTrap.z),cost*0.4f/depth);
+            state.samplePixelColor *= glm::vec3(1.0f) + glm::vec3(intersectedObject.emission)/(float)depth;
+            from = hitpoint + normal * EPSILON * 4.0f;
+            direction = newRayDirection;
+
+        } else if(intersectedObject.surfaceType == SURFACE_SPECULAR){
+
+            glm::vec2 bounceSample = getSample(state,bounce,sampleNumber);
+            glm::vec3 randomUnit = sampleHemisphere(bounceSample.y,bounceSample.x,normal);
+
+            glm::vec3 newRayDirection = glm::reflect(direction,normal);
+
+            //Using emission factor as the specular roughness factor
+            newRayDirection = glm::normalize(intersectedObject.emission * randomUnit + newRayDirection);
+
+            float cost = glm::clamp(glm::dot(newRayDirection,normal),0.0f,1.0f);
+            state.samplePixelColor = glm::mix(state.samplePixelColor,intersectedObject.albedo,cost*0.4f/depth);
+
+            from = hitpoint + normal * EPSILON * 4.0f;
+            direction = newRayDirection;
+
+        } else if(intersectedObject.surfaceType == SURFACE_REFRACTIVE){
+
+            float n = settings.refractionIndex;
+
+            float R0 = (1.0f-n)/(1.0f+n);
+            R0 = R0*R0;
+
+            if(glm::dot(direction,normal) > 0.0f){
+                normal = normal*-1.0f;
+                n = 1.0f/n;
+            }
+
+            n = 1.0f/n;
+
+            float cosin = glm::dot(normal,direction)*-1.0f;
+            float Rprob = R0 + (1.0f-R0) * std::pow(1.0f-cosin,5.0f);
+            float cost2 = 1.0f-n*n*(1.0f-cosin*cosin);
+
+            float random2 = state.sampler != NULL ? getSample(state,bounce,sampleNumber).x : random(glm::vec2(cosin,cost2)*state.time/1000.0f);
+
+            if(cost2 > 0.0f && random2 > Rprob){
+                direction = glm::normalize(direction*n + normal*(n*cosin-std::sqrt(cost2)));
+                depth -= 1;
+            } else {
+                direction = glm::reflect(direction,normal);
+            }
+
+            from = hitpoint - normal * EPSILON * 4.0f;
+        }
+
+        depth += 1;
+        bounce += 1;
+    }
+}
+
+static glm::vec3 rayDirection(float fov, glm::vec2 size, glm::vec2 fragCoord, const glm::mat3& cameraMatrix){
+    glm::vec2 xy = fragCoord - size / 2.0f;
+    float z = size.y / std::tan(glm::radians(fov)/2.0f);
+    return cameraMatrix * glm::normalize(glm::vec3(xy,z));
+}
+
+CpuRenderer::CpuRenderer(int width, int height, unsigned int numThreads) : m_threadPool(numThreads){
+    m_width = width;
+    m_height = height;
+    m_accumulatedSamples = 0;
+    m_noiseThreshold = 0.0f;
+    m_maxSamples = 0;
+    m_activePixels = width*height;
+    m_marchedRays = 0;
+    m_totalMarchedSteps = 0;
+    m_accumulation.assign(width*height,glm::vec3(0.0f));
+    m_sampleCounts.assign(width*height,0);
+    m_sampleIndices.assign(width*height,0);
+    m_sequenceSeed = 0;
+    m_isHashSampling = false;
+    m_isLevelOfDetailEnabled = true;
+    m_squaredDeviations.assign(width*height,0.0f);
+    m_relativeErrors.assign(width*height,0.0f);
+    m_primaryHits.resize(width*height);
+    m_denoiseIterations = 0;
+    m_isImageDirty = true;
+    m_isReprojectionEnabled = false;
+    m_previousAccumulation.assign(width*height,glm::vec3(0.0f));
+    m_previousSampleCounts.assign(width*height,0);
+    m_previousSquaredDeviations.assign(width*height,0.0f);
+    m_previousPrimaryHits.resize(width*height);
+    m_previousViewProjection = glm::mat4(1.0f);
+    m_previousCameraPosition = glm::vec3(0.0f);
+}
+
+void CpuRenderer::setNoiseThreshold(float noiseThreshold, int maxSamples){
+    m_noiseThreshold = noiseThreshold;
+    m_maxSamples = maxSamples;
+}
+
+/*
+ * Standard error of the mean luminance of a pixel relative to its mean luminance.
+ * Until the pixel has MIN_ADAPTIVE_SAMPLES samples the estimate is not trusted and the error is huge.
+ */
+float CpuRenderer::getRelativeError(int pixel){
+    int samples = m_sampleCounts[pixel];
+    if(samples < MIN_ADAPTIVE_SAMPLES) return 1e20f;
+    float standardError = std::sqrt(m_squaredDeviations[pixel]/(samples - 1.0f)/samples);
+    return standardError/glm::max(glm::dot(m_accumulation[pixel],LUMINANCE),RELATIVE_ERROR_FLOOR);
+}
+
+/*
+ * Samples the pixel takes this frame, the same rule as main in the path tracer shader.
+ * The relative errors of the previous frame have to be up to date.
+ */
+int CpuRenderer::getSamplesThisFrame(int x, int y){
+    int pixel = y*m_width + x;
+    int samples = m_sampleCounts[pixel];
+    if(m_noiseThreshold <= 0.0f) return 1;
+    if(m_maxSamples > 0 && samples >= m_maxSamples) return 0;
+    if(samples < MIN_ADAPTIVE_SAMPLES) return 1;
+
+    //The largest error around the pixel decides. A dark pixel whose first samples all missed a rare
+    //light path has no variance and looks converged on its own, but not next to its noisy neighbours.
+    float relativeError = 0.0f;
+    for(int neighbourY = glm::max(y - 1,0); neighbourY <= glm::min(y + 1,m_height - 1); neighbourY++){
+        for(int neighbourX = glm::max(x - 1,0); neighbourX <= glm::min(x + 1,m_width - 1); neighbourX++){
+            relativeError = glm::max(relativeError,m_relativeErrors[neighbourY*m_width + neighbourX]);
+        }
+    }
+    if(relativeError < m_noiseThreshold) return 0;
+
+    int samplesThisFrame = (int)glm::min(std::ceil(relativeError/m_noiseThreshold),(float)MAX_SAMPLES_PER_FRAME);
+    if(m_maxSamples > 0) samplesThisFrame = glm::min(samplesThisFrame,m_maxSamples - samples);
+    return samplesThisFrame;
+}
+
+/*
+ * Adds a sample to the running mean of the pixel and to its squared luminance deviations with Welford's algorithm.
+ * Samples that are not finite are dropped.
+ */
+void CpuRenderer::addSample(int pixel, glm::vec3 color){
+    //A path that degenerates, e.g. on a normal of a point the march never converged to, would poison the mean for good
+    if(!std::isfinite(color.r) || !std::isfinite(color.g) || !std::isfinite(color.b)) return;
+
+    glm::vec3& mean = m_accumulation[pixel];
+    int samples = ++m_sampleCounts[pixel];
+    float previousLuminance = glm::dot(mean,LUMINANCE);
+    float sampleLuminance = glm::dot(color,LUMINANCE);
+    mean = glm::mix(mean,color,1.0f/samples);
+    m_squaredDeviations[pixel] += (sampleLuminance-previousLuminance)*(sampleLuminance-glm::dot(mean,LUMINANCE));
+}
+
+/*
+ * Merges the history of the previous frame at the primary hit of the pixel with the samples it took this frame,
+ * the same reprojection and disocclusion tests as reprojectHistory in the path tracer shader.
+ */
+void CpuRenderer::addReprojectedHistory(int pixel, glm::vec3 hitpoint, const PrimaryHit& primaryHit, int maxSamples){
+    glm::vec4 previousClip = m_previousViewProjection*glm::vec4(hitpoint,1.0f);
+    if(previousClip.w <= 0.0f) return;
+
+    //Bilinear footprint around the hit, the pixel centers are half a pixel off the integer coordinates
+    glm::vec2 previousCoord = (glm::vec2(previousClip)/previousClip.w*0.5f + 0.5f)*glm::vec2(m_width,m_height) - 0.5f;
+    glm::ivec2 corner = glm::ivec2(glm::floor(previousCoord));
+    glm::vec2 fraction = previousCoord - glm::floor(previousCoord);
+    float previousDistance = glm::distance(hitpoint,m_previousCameraPosition);
+
+    glm::vec3 historyMean = glm::vec3(0.0f);
+    float historySamples = 0.0f;
+    float historyDeviations = 0.0f;
+    float totalWeight = 0.0f;
+    for(int y = 0; y <= 1; y++){
+        for(int x = 0; x <= 1; x++){
+            int tapX = corner.x + x;
+            int tapY = corner.y + y;
+            if(tapX < 0 || tapY < 0 || tapX >= m_width || tapY >= m_height) continue;
+
+            int tap = tapY*m_width + tapX;
+            const PrimaryHit& previousHit = m_previousPrimaryHits[tap];
+            if(previousHit.objectId != primaryHit.objectId) continue;
+            if(glm::dot(previousHit.normal,primaryHit.normal) < REPROJECTION_NORMAL_TOLERANCE) continue;
+            if(std::abs(previousHit.distance-previousDistance) > REPROJECTION_DEPTH_TOLERANCE*previousDistance) continue;
+
+            float weight = (x == 1 ? fraction.x : 1.0f-fraction.x)*(y == 1 ? fraction.y : 1.0f-fraction.y);
+            historyMean += weight*m_previousAccumulation[tap];
+            historySamples += weight*m_previousSampleCounts[tap];
+            historyDeviations += weight*m_previousSquaredDeviations[tap];
+            totalWeight += weight;
+        }
+    }
+    if(totalWeight < 1e-3f) return;
+
+    historyMean /= totalWeight;
+    historySamples /= totalWeight;
+    historyDeviations /= totalWeight;
+
+    //Whole samples, the deviations shrink with the count to keep the variance
+    int reprojectedSamples = glm::min((int)std::floor(historySamples + 0.5f),maxSamples);
+    if(reprojectedSamples == 0) return;
+    historyDeviations *= reprojectedSamples/historySamples;
+
+    //Chan's update merges the statistics of the history with the ones of the samples of this frame
+    glm::vec3& mean = m_accumulation[pixel];
+    int samples = m_sampleCounts[pixel];
+    int totalSamples = reprojectedSamples + samples;
+    float delta = glm::dot(mean,LUMINANCE) - glm::dot(historyMean,LUMINANCE);
+    m_squaredDeviations[pixel] += historyDeviations + delta*delta*reprojectedSamples*samples/totalSamples;
+    mean = glm::mix(historyMean,mean,(float)samples/totalSamples);
+    m_sampleCounts[pixel] = totalSamples;
+}
+
+void CpuRenderer::render(const Scene& scene, Camera& camera, float time, bool hasCameraChanged){
+    //Same camera basis the path tracer vertex shader builds
+    glm::vec3 cameraFront = camera.getFront();
+    glm::vec3 cameraUp = camera.getUp();
+    glm::vec3 cameraRight = glm::cross(cameraFront,cameraUp);
+    glm::mat3 cameraMatrix = glm::mat3(cameraRight,cameraUp,cameraFront);
+    glm::vec3 eye = camera.getPosition();
+    float fov = camera.getFov();
+    glm::vec2 resolution = glm::vec2(m_width,m_height);
+
+    bool isHistoryReprojected = hasCameraChanged && m_isReprojectionEnabled && m_accumulatedSamples > 0;
+    if(hasCameraChanged) m_accumulatedSamples = 0;
+    //Every accumulation rotates the sequences by the next slice or another offset of the blue noise mask
+    if(m_accumulatedSamples == 0) m_sequenceSeed++;
+
+    //The first frame after a restart stores the primary hits, the frames after it start from them
+    bool isPrimaryHitCached = m_accumulatedSamples > 0;
+
+    //The history is read while this frame overwrites every pixel
+    if(isHistoryReprojected){
+        m_accumulation.swap(m_previousAccumulation);
+        m_sampleCounts.swap(m_previousSampleCounts);
+        m_squaredDeviations.swap(m_previousSquaredDeviations);
+        m_primaryHits.swap(m_previousPrimaryHits);
+    }
+
+    int tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+    std::atomic<long long> marchedRays(0), totalMarchedSteps(0);
+
+    m_threadPool.parallelFor(tilesX*tilesY,[&](int tile){
+        int startX = (tile % tilesX) * TILE_SIZE;
+        int startY = (tile / tilesX) * TILE_SIZE;
+        int endX = glm::min(startX + TILE_SIZE,m_width);
+        int endY = glm::min(startY + TILE_SIZE,m_height);
+
+        MarchState state;
+        state.scene = &scene;
+        state.resolution = resolution;
+        state.pixelRadius = m_isLevelOfDetailEnabled ? getPixelRadius(fov,m_height) : 0.0f;
+        state.time = time;
+        state.sampler = m_isHashSampling ? NULL : &m_sampler;
+        state.sequenceSeed = m_sequenceSeed;
+        state.marchedRays = 0;
+        state.totalMarchedSteps = 0;
+
+        //Primary rays of PACKET_WIDTH neighbouring pixels are marched together,
+        //the bounces that follow diverge so they are traced one pixel at a time
+        for(int y = startY; y < endY; y++){
+            for(int packetX = startX; packetX < endX; packetX += PACKET_WIDTH){
+                float directionX[PACKET_WIDTH], directionY[PACKET_WIDTH], directionZ[PACKET_WIDTH], laneMask[PACKET_WIDTH];
+                for(int i = 0; i < PACKET_WIDTH; i++){
+                    glm::vec3 direction = rayDirection(fov,resolution,glm::vec2(packetX + i + 0.5f,y + 0.5f),cameraMatrix);
+                    directionX[i] = direction.x;
+                    directionY[i] = direction.y;
+                    directionZ[i] = direction.z;
+                    laneMask[i] = packetX + i < endX ? 1.0f : 0.0f;
+                }
+
+                float distance[PACKET_WIDTH], objectId[PACKET_WIDTH], lastDistance[PACKET_WIDTH], steps[PACKET_WIDTH];
+                if(!isPrimaryHitCached){
+                    Vec3Packet directions = Vec3Packet(FloatPacket::load(directionX),FloatPacket::load(directionY),FloatPacket::load(directionZ));
+                    PacketMask active = FloatPacket::load(laneMask) > FloatPacket(0.0f);
+                    PacketCollision primary = rayMarchScenePacket(Vec3Packet(eye.x,eye.y,eye.z),directions,scene,active,state.pixelRadius);
+
+                    primary.distance.store(distance);
+                    primary.objectId.store(objectId);
+                    primary.lastDistance.store(lastDistance);
+                    primary.steps.store(steps);
+                }
+
+                for(int i = 0; i < PACKET_WIDTH && packetX + i < endX; i++){
+                    int x = packetX + i;
+                    int pixel = y*m_width + x;
+                    glm::vec3 direction = glm::vec3(directionX[i],directionY[i],directionZ[i]);
+
+                    //The statistics restart together with the accumulation
+                    if(!isPrimaryHitCached){
+                        m_accumulation[pixel] = glm::vec3(0.0f);
+                        m_sampleCounts[pixel] = 0;
+                        m_squaredDeviations[pixel] = 0.0f;
+                        m_sampleIndices[pixel] = 0;
+                    }
+
+                    //Converged pixels take no samples at all
+                    int samplesThisFrame = getSamplesThisFrame(x,y);
+                    PrimaryHit& primaryHit = m_primaryHits[pixel];
+
+                    for(int sampleNumber = 1; sampleNumber <= samplesThisFrame; sampleNumber++){
+                        //Pixel centers, with the origin at the bottom left corner like gl_FragCoord
+                        state.fragCoord = glm::vec2(x + 0.5f,y + 0.5f);
+                        state.samplePixelColor = glm::vec3(0.0f);
+                        state.glow = glm::vec3(0.0f);
+                        state.orbitTrap = glm::vec4(scene.getMarchSettings().maxDist);
+                        state.marchedSteps = 0;
+                        state.distanceToScene = scene.getMarchSettings().maxDist;
+                        //Dropped samples count too, the path that degenerated is not taken again
+                        state.sampleIndex = m_sampleIndices[pixel]++;
+
+                        if(isPrimaryHitCached || sampleNumber > 1){
+                            march(eye,direction,1,sampleNumber,state,NULL,primaryHit,true);
+                        } else {
+                            state.marchedSteps = (int)steps[i];
+                            state.marchedRays++;
+                            state.totalMarchedSteps += state.marchedSteps;
+                            primaryHit.objectId = -1;
+
+                            SceneCollision primaryCollision = {distance[i],scene.getBackgroundColor(),(int)objectId[i]};
+                            if(primaryCollision.objectId != -1){
+                                //Repeat the last scene evaluation to recover the orbit trap and color the packet march skips
+                                SceneCollision lastCollision = getClosestSceneObjectAsCollision(eye + lastDistance[i]*direction,scene,state.orbitTrap);
+                                primaryCollision.color = lastCollision.color;
+                            }
+
+                            march(eye,direction,1,sampleNumber,state,&primaryCollision,primaryHit,false);
+                        }
+
+                        addSample(pixel,state.samplePixelColor);
+                    }
+
+                    if(isHistoryReprojected && primaryHit.objectId != -1){
+                        bool isGlossy = scene.getObject(primaryHit.objectId).surfaceType != SURFACE_DIFFUSE;
+                        addReprojectedHistory(pixel,eye + primaryHit.distance*direction,primaryHit,isGlossy ? MAX_REPROJECTED_GLOSSY_SAMPLES : MAX_REPROJECTED_SAMPLES);
+                    }
+                }
+            }
+        }
+
+        marchedRays += state.marchedRays;
+        totalMarchedSteps += state.totalMarchedSteps;
+    });
+
+    m_accumulatedSamples++;
+    m_isImageDirty = true;
+    m_previousViewProjection = camera.getViewProjection((float)m_width/m_height);
+    m_previousCameraPosition = eye;
+    m_marchedRays = marchedRays;
+    m_totalMarchedSteps = totalMarchedSteps;
+
+    if(m_noiseThreshold <= 0.0f) return;
+
+    //Errors for the next frame, computed after every pixel is done since the pixels look at their neighbours
+    m_threadPool.parallelFor(m_height,[&](int y){
+        for(int x = 0; x < m_width; x++)
+            m_relativeErrors[y*m_width + x] = getRelativeError(y*m_width + x);
+    });
+    std::atomic<int> activePixels(0);
+    m_threadPool.parallelFor(m_height,[&](int y){
+        int rowActivePixels = 0;
+        for(int x = 0; x < m_width; x++){
+            if(getSamplesThisFrame(x,y) > 0) rowActivePixels++;
+        }
+        activePixels += rowActivePixels;
+    });
+    m_activePixels = activePixels;
+}
+
+float CpuRenderer::getMeanSampleCount(){
+    double samples = 0.0;
+    for(unsigned int i = 0; i < m_sampleCounts.size(); i++)
+        samples += m_sampleCounts[i];
+    return (float)(samples / m_sampleCounts.size());
+}
+
+const std::vector<glm::vec3>& CpuRenderer::getImage(){
+    if(m_denoiseIterations <= 0) return m_accumulation;
+    if(m_isImageDirty){
+        denoiseAtrous(m_accumulation,m_sampleCounts,m_squaredDeviations,m_primaryHits,m_width,m_height,m_denoiseIterations,m_threadPool,m_image);
+        m_isImageDirty = false;
+    }
+    return m_image;
+}
+
+void CpuRenderer::getPixels(std::vector<unsigned char>& pixels){
+    const std::vector<glm::vec3>& image = getImage();
+    pixels.resize(m_width*m_height*4);
+    for(int y = 0; y < m_height; y++){
+        //Flip vertically since the accumulation buffer starts at the bottom row
+        const glm::vec3* source = &image[(m_height - 1 - y)*m_width];
+        unsigned char* destination = &pixels[y*m_width*4];
+        for(int x = 0; x < m_width; x++){
+            glm::vec3 color = glm::clamp(source[x],0.0f,1.0f);
+            destination[x*4 + 0] = (unsigned char)(color.r*255.0f + 0.5f);
+            destination[x*4 + 1] = (unsigned char)(color.g*255.0f + 0.5f);
+            destination[x*4 + 2] = (unsigned char)(color.b*255.0f + 0.5f);
+            destination[x*4 + 3] = 255;
+        }
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef CPURENDERER_H
+#define CPURENDERER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "camera.h"
+#include "threadpool.h"
+#include "sampler.h"
+
+//First hit of a primary ray and the direct light found there by next event estimation. None of it depends
+//on the random numbers, so it is the same for every sample while the camera does not move.
+struct PrimaryHit {
+    int objectId; //-1 when the ray hits the background
+    float distance;
+    glm::vec3 normal;
+    glm::vec2 orbitTrap; //y and z of the orbit trap, the components the shading reads
+    glm::vec3 directLight;
+};
+
+//CPU path marching backend. It implements the same algorithm as shaders/pathTracer.fs
+//and renders the frame in square tiles distributed over a thread pool.
+class CpuRenderer {
+    public:
+        //A thread count of 0 uses every hardware thread available
+        CpuRenderer(int width, int height, unsigned int numThreads = 0);
+        //Path traces one sample per pixel and adds it to the running mean of the accumulated image,
+        //which restarts from this sample when the camera has changed. The primary hits of the restarting
+        //sample are cached, the samples after it start their paths from them.
+        //With reprojection enabled the restarting sample is merged with the history of the previous frame
+        //at its primary hit, unless the hit was not visible there.
+        void render(const Scene& scene, Camera& camera, float time, bool hasCameraChanged);
+        //Reprojects the history when the camera changes instead of discarding it, disabled by default
+        void setReprojection(bool isEnabled){
+            m_isReprojectionEnabled = isEnabled;
+        }
+        //Hits rays within the footprint of their pixel and evaluates the fractals at its detail, enabled by default.
+        //Disabled the rays hit within the epsilon of the scene and the fractals are always at full detail.
+        void setLevelOfDetail(bool isEnabled){
+            m_isLevelOfDetailEnabled = isEnabled;
+        }
+        //Samples the bounces with the sin hash the renderers used before the low discrepancy sampler, to compare against
+        void setHashSampling(bool isEnabled){
+            m_isHashSampling = isEnabled;
+        }
+        //The next frame restarts from nothing even when reprojection is enabled, e.g. because the scene changed
+        void restartAccumulation(){
+            m_accumulatedSamples = 0;
+        }
+        //Enables adaptive sampling when the threshold is above 0. Once a pixel has MIN_ADAPTIVE_SAMPLES samples
+        //the relative standard error of its mean luminance decides how many samples it takes per frame,
+        //it takes none once the error is below the threshold or it has maxSamples samples, 0 means no limit.
+        void setNoiseThreshold(float noiseThreshold, int maxSamples = 0);
+        //Pixels that still take samples after the last frame, all of them without adaptive sampling
+        int getActivePixelCount(){
+            return m_activePixels;
+        }
+        //Average amount of samples per pixel since the last restart
+        float getMeanSampleCount();
+        //Rays marched during the last frame, bounces and shadow rays included, and the steps they took
+        long long getMarchedRays(){
+            return m_marchedRays;
+        }
+        long long getTotalMarchedSteps(){
+            return m_totalMarchedSteps;
+        }
+        //Per pixel sample counts and squared luminance deviations from the mean since the last restart
+        const std::vector<int>& getSampleCounts(){
+            return m_sampleCounts;
+        }
+        const std::vector<float>& getSquaredDeviations(){
+            return m_squaredDeviations;
+        }
+        //Iterations of the a-trous filter applied to the accumulated image, 0 leaves it unfiltered
+        void setDenoiseIterations(int iterations){
+            m_denoiseIterations = iterations;
+            m_isImageDirty = true;
+        }
+        //Accumulated image after the filter, bottom row first. It is filtered when first asked for after a frame.
+        const std::vector<glm::vec3>& getImage();
+        //Converts the filtered image into 8 bit RGBA with the top row first
+        void getPixels(std::vector<unsigned char>& pixels);
+        //Accumulated image in linear floating point, bottom row first like an OpenGL texture
+        const std::vector<glm::vec3>& getAccumulation(){
+            return m_accumulation;
+        }
+        //Frames accumulated since the last restart, with adaptive sampling the pixels have their own sample counts
+        int getAccumulatedSamples(){
+            return m_accumulatedSamples;
+        }
+        int getWidth(){
+            return m_width;
+        }
+        int getHeight(){
+            return m_height;
+        }
+        unsigned int getThreadCount(){
+            return m_threadPool.getThreadCount();
+        }
+    private:
+        static const int TILE_SIZE = 16;
+        static const int MIN_ADAPTIVE_SAMPLES = 16;
+        static const int MAX_SAMPLES_PER_FRAME = 4;
+        static const int MAX_REPROJECTED_SAMPLES = 32;
+        static const int MAX_REPROJECTED_GLOSSY_SAMPLES = 4; //Specular and refractive surfaces change the most with the view
+
+        float getRelativeError(int pixel);
+        int getSamplesThisFrame(int x, int y);
+        void addSample(int pixel, glm::vec3 color);
+        void addReprojectedHistory(int pixel, glm::vec3 hitpoint, const PrimaryHit& primaryHit, int maxSamples);
+
+        int m_width, m_height;
+        int m_accumulatedSamples;
+        float m_noiseThreshold;
+        int m_maxSamples;
+        int m_activePixels;
+        long long m_marchedRays;
+        long long m_totalMarchedSteps;
+        std::vector<glm::vec3> m_accumulation;
+        std::vector<int> m_sampleCounts;
+        std::vector<int> m_sampleIndices; //Paths taken since the last restart, dropped ones included
+        std::vector<float> m_squaredDeviations;
+        std::vector<float> m_relativeErrors;
+        std::vector<PrimaryHit> m_primaryHits;
+        //History of the previous frame while a frame reprojects it, and the camera it was rendered from
+        bool m_isReprojectionEnabled;
+        std::vector<glm::vec3> m_previousAccumulation;
+        std::vector<int> m_previousSampleCounts;
+        std::vector<float> m_previousSquaredDeviations;
+        std::vector<PrimaryHit> m_previousPrimaryHits;
+        glm::mat4 m_previousViewProjection;
+        glm::vec3 m_previousCameraPosition;
+        int m_denoiseIterations;
+        bool m_isImageDirty;
+        std::vector<glm::vec3> m_image;
+        Sampler m_sampler;
+        int m_sequenceSeed;
+        bool m_isHashSampling;
+        bool m_isLevelOfDetailEnabled;
+        ThreadPool m_threadPool;
+};
+
+#endif // CPURENDERER_H
@@ -0,0 +1,341 @@
+#include "csg.h"
+#include <cmath>
+#include <cstdlib>
+
+//Operations of the shape expressions with the numbers they take before their children, a maximum of -1 has no limit
+struct CsgOperation {
+    const char* name;
+    int numbers;
+    int minChildren, maxChildren;
+};
+
+static const CsgOperation csgOperations[] = {
+    {"union",0,1,-1},
+    {"subtraction",0,2,-1},
+    {"intersection",0,1,-1},
+    {"smooth-union",1,1,-1},
+    {"smooth-subtraction",1,2,-1},
+    {"smooth-intersection",1,1,-1},
+    {"translate",3,1,1},
+    {"rotate",3,1,1},
+    {"scale",1,1,1},
+    {"sphere",1,0,0},
+    {"cube",1,0,0},
+    {"plane",1,0,0},
+    {"wall",1,0,0},
+    {"box",3,0,0},
+    {"torus",1,0,0},
+    {"prism",1,0,0},
+    {"pyramid",1,0,0},
+    {"cylinder",1,0,0},
+    {"mandelbulb",0,0,0},
+    {"mandelbox",0,0,0},
+    {"julia",0,0,0}
+};
+
+static const int NUM_CSG_OPERATIONS = sizeof(csgOperations)/sizeof(csgOperations[0]);
+
+//Node of the tree of an expression, the references to other shapes are replaced by their tree
+struct CsgNode {
+    std::string operation;
+    std::vector<float> numbers;
+    std::vector<CsgNode> children;
+};
+
+//Reads the tokens of an expression, parentheses and the words and numbers between them. Line breaks are spaces.
+class CsgReader {
+    public:
+        CsgReader(const std::string& text) : m_text(text), m_current(0) {}
+
+        bool readCharacter(char character){
+            skipSpaces();
+            if(m_current >= m_text.size() || m_text[m_current] != character) return false;
+            m_current++;
+            return true;
+        }
+        bool isNext(char character){
+            skipSpaces();
+            return m_current < m_text.size() && m_text[m_current] == character;
+        }
+        bool readWord(std::string& word){
+            skipSpaces();
+            size_t start = m_current;
+            while(m_current < m_text.size() && !isSpace(m_text[m_current]) && m_text[m_current] != '(' && m_text[m_current] != ')') m_current++;
+            word.assign(m_text,start,m_current - start);
+            return !word.empty();
+        }
+        bool readFloat(float& value){
+            size_t start = m_current;
+            std::string word;
+            if(!readWord(word)) return false;
+            char* parsedEnd;
+            value = strtof(word.c_str(),&parsedEnd);
+            if(*parsedEnd != '\0'){
+                m_current = start;
+                return false;
+            }
+            return true;
+        }
+        bool isAtEnd(){
+            skipSpaces();
+            return m_current >= m_text.size();
+        }
+    private:
+        static bool isSpace(char c){
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+        void skipSpaces(){
+            while(m_current < m_text.size() && isSpace(m_text[m_current])) m_current++;
+        }
+
+        const std::string& m_text;
+        size_t m_current;
+};
+
+static int findOperation(const std::string& name){
+    for(int i = 0; i < NUM_CSG_OPERATIONS; i++){
+        if(name == csgOperations[i].name) return i;
+    }
+    return -1;
+}
+
+static bool parseShape(const std::string& expression, const std::vector<CsgShape>& shapes, int shapeCount, CsgNode& node, std::string& error);
+
+/*
+ * Parses (operation numbers... children...). A reference (name) to one of the first shapeCount shapes is replaced by
+ * the tree of that shape, which can only refer to the shapes before it in turn.
+ */
+static bool parseNode(CsgReader& reader, const std::vector<CsgShape>& shapes, int shapeCount, CsgNode& node, std::string& error){
+    if(!reader.readCharacter('(')){
+        error = "expected (";
+        return false;
+    }
+    std::string name;
+    if(!reader.readWord(name)){
+        error = "expected an operation after (";
+        return false;
+    }
+
+    int operation = findOperation(name);
+    if(operation == -1){
+        for(int i = shapeCount - 1; i >= 0; i--){
+            if(shapes[i].name != name) continue;
+            if(!reader.readCharacter(')')){
+                error = "shape " + name + " takes no arguments";
+                return false;
+            }
+            return parseShape(shapes[i].expression,shapes,i,node,error);
+        }
+        error = "unknown operation or shape " + name;
+        return false;
+    }
+
+    const CsgOperation& info = csgOperations[operation];
+    node.operation = name;
+    node.numbers.resize(info.numbers);
+    for(int i = 0; i < info.numbers; i++){
+        if(!reader.readFloat(node.numbers[i])){
+            error = name + " takes " + std::to_string(info.numbers) + (info.numbers == 1 ? " number" : " numbers");
+            return false;
+        }
+    }
+    while(reader.isNext('(')){
+        node.children.push_back(CsgNode());
+        if(!parseNode(reader,shapes,shapeCount,node.children.back(),error)) return false;
+    }
+    if(!reader.readCharacter(')')){
+        error = "missing ) after " + name;
+        return false;
+    }
+
+    int children = (int)node.children.size();
+    if(children < info.minChildren || (info.maxChildren != -1 && children > info.maxChildren)){
+        if(info.maxChildren == 0) error = name + " is a primitive, it takes no shapes";
+        else if(info.maxChildren == 1) error = name + " takes a single shape";
+        else error = name + " takes at least " + std::to_string(info.minChildren) + (info.minChildren == 1 ? " shape" : " shapes");
+        return false;
+    }
+    if((name == "scale" || name.compare(0,7,"smooth-") == 0) && !(node.numbers[0] > 0.0f)){
+        error = "the number of " + name + " must be positive";
+        return false;
+    }
+    return true;
+}
+
+static bool parseShape(const std::string& expression, const std::vector<CsgShape>& shapes, int shapeCount, CsgNode& node, std::string& error){
+    CsgReader reader(expression);
+    if(!parseNode(reader,shapes,shapeCount,node,error)) return false;
+    if(!reader.isAtEnd()){
+        error = "unexpected text after the shape";
+        return false;
+    }
+    return true;
+}
+
+//Placement of a node in the frame of the shape, its point is rotation*(p - translation)/scale
+struct CsgTransform {
+    glm::mat3 rotation;
+    glm::vec3 translation;
+    float scale;
+    bool isRotated;
+};
+
+//Rotation of a shape by angles in degrees around the x, then the y and then the z axis
+static glm::mat3 getRotation(glm::vec3 angles){
+    glm::vec3 c = glm::cos(glm::radians(angles)), s = glm::sin(glm::radians(angles));
+    glm::mat3 x = glm::mat3(1.0f,0.0f,0.0f, 0.0f,c.x,s.x, 0.0f,-s.x,c.x);
+    glm::mat3 y = glm::mat3(c.y,0.0f,-s.y, 0.0f,1.0f,0.0f, s.y,0.0f,c.y);
+    glm::mat3 z = glm::mat3(c.z,s.z,0.0f, -s.z,c.z,0.0f, 0.0f,0.0f,1.0f);
+    return z*y*x;
+}
+
+//Opcode, parameters and bounds in its own frame of a primitive
+static void getPrimitive(const CsgNode& node, glm::vec4& instruction, glm::vec3& boundsMin, glm::vec3& boundsMax, bool& isFractal){
+    const std::string& name = node.operation;
+    float size = node.numbers.empty() ? 0.0f : node.numbers[0];
+    glm::vec3 center = glm::vec3(0.0f), halfSize;
+    isFractal = false;
+
+    if(name == "sphere"){
+        instruction = glm::vec4(CSG_SPHERE,size/2.0f,0.0f,0.0f);
+        halfSize = glm::vec3(size/2.0f);
+    } else if(name == "box" || name == "cube" || name == "wall" || name == "plane"){
+        if(name == "box") halfSize = glm::vec3(node.numbers[0],node.numbers[1],node.numbers[2]);
+        else if(name == "cube") halfSize = glm::vec3(size);
+        else if(name == "wall") halfSize = glm::vec3(size,size,0.1f);
+        else halfSize = glm::vec3(size,0.01f,size);
+        instruction = glm::vec4(CSG_BOX,halfSize);
+    } else if(name == "torus"){
+        instruction = glm::vec4(CSG_TORUS,size,size,0.0f);
+        halfSize = glm::vec3(1.5f*size,0.5f*size,1.5f*size);
+    } else if(name == "prism"){
+        instruction = glm::vec4(CSG_PRISM,size,size,0.0f);
+        halfSize = glm::vec3(size);
+    } else if(name == "pyramid"){
+        //The base is always one unit wide, the size is the height above the center
+        instruction = glm::vec4(CSG_PYRAMID,size,0.0f,0.0f);
+        center = glm::vec3(0.0f,size/2.0f,0.0f);
+        halfSize = glm::vec3(0.5f,std::abs(size)/2.0f,0.5f);
+    } else if(name == "cylinder"){
+        instruction = glm::vec4(CSG_CYLINDER,size,0.0f,0.0f);
+        halfSize = glm::vec3(size/2.0f,size,size/2.0f);
+    } else {
+        //The bounds of the mandelbox with a scale of 2.7 are 2*(2.7 + 1)/(2.7 - 1) away from its center
+        isFractal = true;
+        if(name == "mandelbulb"){
+            instruction = glm::vec4(CSG_MANDELBULB,0.0f,0.0f,0.0f);
+            halfSize = glm::vec3(1.2f);
+        } else if(name == "mandelbox"){
+            instruction = glm::vec4(CSG_MANDELBOX,0.0f,0.0f,0.0f);
+            halfSize = glm::vec3(4.4f);
+        } else {
+            instruction = glm::vec4(CSG_JULIA,0.0f,0.0f,0.0f);
+            halfSize = glm::vec3(1.3f);
+        }
+    }
+    boundsMin = center - halfSize;
+    boundsMax = center + halfSize;
+}
+
+static glm::vec4 getOperationInstruction(const std::string& name, float k){
+    if(name == "union") return glm::vec4(CSG_UNION,0.0f,0.0f,0.0f);
+    if(name == "subtraction") return glm::vec4(CSG_SUBTRACTION,0.0f,0.0f,0.0f);
+    if(name == "intersection") return glm::vec4(CSG_INTERSECTION,0.0f,0.0f,0.0f);
+    if(name == "smooth-union") return glm::vec4(CSG_SMOOTH_UNION,k,0.0f,0.0f);
+    if(name == "smooth-subtraction") return glm::vec4(CSG_SMOOTH_SUBTRACTION,k,0.0f,0.0f);
+    return glm::vec4(CSG_SMOOTH_INTERSECTION,k,0.0f,0.0f);
+}
+
+/*
+ * Appends the instructions of a node placed by a transform and returns the stack depth they need. The bounds of the
+ * node in the frame of the shape are those of its primitives: unions take the union of the bounds of their children,
+ * a smooth union swells by at most a quarter of its blend, intersections stay within every child and subtractions
+ * within the first one.
+ */
+static int compileNode(const CsgNode& node, const CsgTransform& transform, std::vector<glm::vec4>& code, glm::vec3& boundsMin, glm::vec3& boundsMax, bool& hasFractal){
+    const std::string& name = node.operation;
+
+    if(name == "translate" || name == "rotate" || name == "scale"){
+        CsgTransform child = transform;
+        if(name == "translate"){
+            glm::vec3 offset = glm::vec3(node.numbers[0],node.numbers[1],node.numbers[2]);
+            child.translation += transform.scale*(glm::transpose(transform.rotation)*offset);
+        } else if(name == "rotate"){
+            glm::vec3 angles = glm::vec3(node.numbers[0],node.numbers[1],node.numbers[2]);
+            child.rotation = glm::transpose(getRotation(angles))*transform.rotation;
+            child.isRotated = transform.isRotated || angles != glm::vec3(0.0f);
+        } else {
+            child.scale *= node.numbers[0];
+        }
+        return compileNode(node.children[0],child,code,boundsMin,boundsMax,hasFractal);
+    }
+
+    if(node.children.empty()){
+        glm::vec4 instruction;
+        glm::vec3 localMin, localMax;
+        bool isFractal;
+        getPrimitive(node,instruction,localMin,localMax,isFractal);
+        hasFractal = hasFractal || isFractal;
+        if(transform.isRotated) instruction.x += CSG_ROTATED;
+        code.push_back(instruction);
+        code.push_back(glm::vec4(transform.translation,transform.scale));
+
+        //The corners of the bounds in the frame of the primitive placed in the frame of the shape
+        glm::mat3 inverse = glm::transpose(transform.rotation);
+        boundsMin = glm::vec3(1e30f);
+        boundsMax = glm::vec3(-1e30f);
+        for(int corner = 0; corner < 8; corner++){
+            glm::vec3 local = glm::vec3((corner & 1) ? localMax.x : localMin.x,(corner & 2) ? localMax.y : localMin.y,(corner & 4) ? localMax.z : localMin.z);
+            glm::vec3 placed = transform.translation + transform.scale*(inverse*local);
+            boundsMin = glm::min(boundsMin,placed);
+            boundsMax = glm::max(boundsMax,placed);
+        }
+        //The rows of the rotation are the columns of its transpose
+        if(transform.isRotated){
+            for(int row = 0; row < 3; row++) code.push_back(glm::vec4(inverse[row],0.0f));
+        }
+        return 1;
+    }
+
+    float k = node.numbers.empty() ? 0.0f : node.numbers[0]*transform.scale;
+    glm::vec4 instruction = getOperationInstruction(name,k);
+    int depth = compileNode(node.children[0],transform,code,boundsMin,boundsMax,hasFractal);
+    for(unsigned int i = 1; i < node.children.size(); i++){
+        glm::vec3 childMin, childMax;
+        depth = glm::max(depth,1 + compileNode(node.children[i],transform,code,childMin,childMax,hasFractal));
+        code.push_back(instruction);
+        if(name == "union" || name == "smooth-union"){
+            boundsMin = glm::min(boundsMin,childMin);
+            boundsMax = glm::max(boundsMax,childMax);
+        } else if(name == "intersection" || name == "smooth-intersection"){
+            boundsMin = glm::max(boundsMin,childMin);
+            boundsMax = glm::max(glm::min(boundsMax,childMax),boundsMin);
+        }
+    }
+    if(name == "smooth-union"){
+        boundsMin -= glm::vec3(k/4.0f);
+        boundsMax += glm::vec3(k/4.0f);
+    }
+    return depth;
+}
+
+bool compileCsgShape(const std::string& name, const std::string& expression, const std::vector<CsgShape>& shapes, std::vector<glm::vec4>& code, CsgShape& shape, std::string& error){
+    CsgNode root;
+    if(!parseShape(expression,shapes,(int)shapes.size(),root,error)) return false;
+
+    std::vector<glm::vec4> program;
+    CsgTransform transform = {glm::mat3(1.0f),glm::vec3(0.0f),1.0f,false};
+    shape.hasFractal = false;
+    int depth = compileNode(root,transform,program,shape.boundsMin,shape.boundsMax,shape.hasFractal);
+    if(depth > CSG_STACK_SIZE){
+        error = "the shape needs " + std::to_string(depth) + " distances on the stack, at most " + std::to_string(CSG_STACK_SIZE) + " fit";
+        return false;
+    }
+    program.push_back(glm::vec4(CSG_END,0.0f,0.0f,0.0f));
+
+    shape.name = name;
+    shape.expression = expression;
+    shape.program = (int)code.size();
+    code.insert(code.end(),program.begin(),program.end());
+    return true;
+}
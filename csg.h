@@ -0,0 +1,60 @@
+#ifndef CSG_H
+#define CSG_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+//Constructive solid geometry. A shape is a tree of operations, transforms and primitives written as an expression
+//in the scene file, see scenes/default.scene for the syntax. It is compiled into a program for a small stack machine,
+//RGBA32F texels that the path tracer shader reads from its csgProgram buffer texture and the CPU marchers from the
+//same vector, see csginterpreter.h. The instructions are:
+//  operation   (opcode, k, 0, 0)           pops two distances and pushes their combination, k is the blend of the smooth ones
+//  primitive   (opcode, p0, p1, p2)        the parameters of the primitive, followed by a placement texel (translation, scale)
+//                                          and, if CSG_ROTATED is added to the opcode, the three rows of its rotation
+//  end         (CSG_END, 0, 0, 0)          the distance left on the stack is the distance to the shape
+//The transforms are folded into the primitives below them while compiling, so a program only evaluates primitives at
+//the point rotation*(p - translation)/scale and multiplies their distance by the scale. N-ary operations become a
+//chain of binary ones, the stack never holds more distances than the tree is deep.
+
+//The values must match the opcodes of the path tracer shader
+enum CsgOpcode {
+    CSG_END = 0,
+    CSG_UNION = 1,
+    CSG_SUBTRACTION = 2, //the distance on top of the stack is subtracted from the one below it
+    CSG_INTERSECTION = 3,
+    CSG_SMOOTH_UNION = 4,
+    CSG_SMOOTH_SUBTRACTION = 5,
+    CSG_SMOOTH_INTERSECTION = 6,
+    CSG_SPHERE = 7, //radius
+    CSG_BOX = 8, //half size, the cubes, walls and planes of a shape are boxes
+    CSG_TORUS = 9, //size of the torus object type twice
+    CSG_PRISM = 10, //size of the prism object type twice
+    CSG_PYRAMID = 11, //height
+    CSG_CYLINDER = 12, //size of the cylinder object type
+    CSG_MANDELBULB = 13,
+    CSG_MANDELBOX = 14,
+    CSG_JULIA = 15,
+    CSG_ROTATED = 16 //added to the opcode of a rotated primitive
+};
+
+//Distances a program can hold on its stack at once, the shader has room for as many
+const int CSG_STACK_SIZE = 8;
+
+//A compiled shape. The csg objects of a scene are an instance of it, scaled by their size and moved to their center.
+struct CsgShape {
+    std::string name;
+    std::string expression;
+    int program; //first instruction of its program
+    glm::vec3 boundsMin, boundsMax; //box around its surface, at a size of 1
+    bool hasFractal; //fractal primitives make the object brick mapped, like the fractal objects
+};
+
+/*
+ * Compiles the expression of a shape and appends its program to code. Expressions can refer to the shapes compiled
+ * before them by name, the last one with the name is used. On a syntax error code is left untouched, false is
+ * returned and error describes it.
+ */
+bool compileCsgShape(const std::string& name, const std::string& expression, const std::vector<CsgShape>& shapes, std::vector<glm::vec4>& code, CsgShape& shape, std::string& error);
+
+#endif // CSG_H
@@ -0,0 +1,92 @@
+#ifndef CSGINTERPRETER_H
+#define CSGINTERPRETER_H
+
+#include <glm/glm.hpp>
+#include "csg.h"
+#include "sdf.h"
+#include "sdftemplate.h"
+
+//CPU interpreter of the CSG programs of csg.h, the counterpart of getCsgDistance in shaders/pathTracer.fs.
+//It is templated on the scalar and the vector of the point: float and glm::vec3 call the functions of sdf.h like the
+//shader does, the scalars of sdftemplate.h evaluate packets of points or the gradient along with the distance.
+
+//The fractals of sdf.h take an orbit trap before their iterations, the primitives of a shape have none
+inline float getCsgMandelbulbDistance(glm::vec3 p, int iterations){ return mandelbulbFractalDistance(p,glm::vec3(0.0f),1.0f,NULL,iterations); }
+inline float getCsgMandelboxDistance(glm::vec3 p, int iterations){ return mandelboxFractalDistance(p,glm::vec3(0.0f),1.0f,NULL,iterations); }
+inline float getCsgJuliaDistance(glm::vec3 p, int iterations){ return juliaFractalDistance(p,glm::vec3(0.0f),1.0f,NULL,iterations); }
+
+template<typename Scalar>
+inline Scalar getCsgMandelbulbDistance(const Vec3Of<Scalar>& p, int iterations){ return mandelbulbFractalDistance(p,glm::vec3(0.0f),1.0f,iterations); }
+template<typename Scalar>
+inline Scalar getCsgMandelboxDistance(const Vec3Of<Scalar>& p, int iterations){ return mandelboxFractalDistance(p,glm::vec3(0.0f),1.0f,iterations); }
+template<typename Scalar>
+inline Scalar getCsgJuliaDistance(const Vec3Of<Scalar>& p, int iterations){ return juliaFractalDistance(p,glm::vec3(0.0f),1.0f,iterations); }
+
+//Distance to a primitive at the origin of its frame, fractals take the iterations of the footprint in that frame
+template<typename Scalar, typename Vector>
+inline Scalar getCsgPrimitiveDistance(int opcode, glm::vec4 instruction, const Vector& p, float footprint){
+    switch(opcode){
+        case CSG_SPHERE:
+            return sphereDistance(p,glm::vec3(0.0f),instruction.y);
+        case CSG_BOX:
+            return boxDistance(p,glm::vec3(0.0f),glm::vec3(instruction.y,instruction.z,instruction.w));
+        case CSG_TORUS:
+            return torusDistance(p,glm::vec3(0.0f),glm::vec2(instruction.y,instruction.z));
+        case CSG_PRISM:
+            return prismDistance(p,glm::vec3(0.0f),glm::vec2(instruction.y,instruction.z));
+        case CSG_PYRAMID:
+            return pyramidDistance(p,glm::vec3(0.0f),instruction.y);
+        case CSG_CYLINDER:
+            return cylinderDistance(p,glm::vec3(0.0f),instruction.y);
+        case CSG_MANDELBULB:
+            return getCsgMandelbulbDistance(p,getFractalIterations(footprint,MANDELBULB_ERROR_SCALE,MANDELBULB_ERROR_RATIO));
+        case CSG_MANDELBOX:
+            return getCsgMandelboxDistance(p,getFractalIterations(footprint,MANDELBOX_ERROR_SCALE,MANDELBOX_ERROR_RATIO));
+        case CSG_JULIA:
+            return getCsgJuliaDistance(p,getFractalIterations(footprint,JULIA_ERROR_SCALE,JULIA_ERROR_RATIO));
+    }
+    return Scalar(0.0f);
+}
+
+/*
+ * Runs a program on a point in the frame of its shape and returns the distance to the shape. The footprint is in the
+ * frame of the shape as well.
+ */
+template<typename Scalar, typename Vector>
+inline Scalar evaluateCsgProgram(const glm::vec4* program, const Vector& point, float footprint){
+    Scalar stack[CSG_STACK_SIZE];
+    int stackSize = 0;
+    for(;;){
+        glm::vec4 instruction = *program++;
+        int opcode = (int)instruction.x;
+        if(opcode == CSG_END) break;
+
+        if(opcode <= CSG_SMOOTH_INTERSECTION){
+            //The second operand is on top of the stack and the result replaces the first one
+            const Scalar& b = stack[--stackSize];
+            Scalar& a = stack[stackSize - 1];
+            switch(opcode){
+                case CSG_UNION: a = opUnion(a,b); break;
+                case CSG_SUBTRACTION: a = opSubtraction(b,a); break;
+                case CSG_INTERSECTION: a = opIntersection(a,b); break;
+                case CSG_SMOOTH_UNION: a = opSmoothUnion(a,b,instruction.y); break;
+                case CSG_SMOOTH_SUBTRACTION: a = opSmoothSubtraction(b,a,instruction.y); break;
+                case CSG_SMOOTH_INTERSECTION: a = opSmoothIntersection(a,b,instruction.y); break;
+            }
+            continue;
+        }
+
+        glm::vec4 placement = *program++;
+        Vector p = point - glm::vec3(placement);
+        if(opcode >= CSG_ROTATED){
+            const glm::vec4* rows = program;
+            p = Vector(p.x*rows[0].x + p.y*rows[0].y + p.z*rows[0].z,p.x*rows[1].x + p.y*rows[1].y + p.z*rows[1].z,p.x*rows[2].x + p.y*rows[2].y + p.z*rows[2].z);
+            program += 3;
+            opcode -= CSG_ROTATED;
+        }
+        stack[stackSize++] = getCsgPrimitiveDistance<Scalar>(opcode,instruction,p/placement.w,footprint/placement.w)*placement.w;
+    }
+    return stack[0];
+}
+
+#endif // CSGINTERPRETER_H
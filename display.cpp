@@ -3,10 +3,21 @@
 #include "GL/glew.h"
 #include <iostream>
 
-Display::Display(int width, int height, const std::string& title){
+Display::Display(int width, int height, const std::string& title, bool useOpenGL){
 
     SDL_Init(SDL_INIT_EVERYTHING);
 
+    isClosed = false;
+    isOpenGL = useOpenGL;
+    glContext = NULL;
+
+    if(!isOpenGL){
+        window = SDL_CreateWindow(title.c_str(),SDL_WINDOWPOS_CENTERED,SDL_WINDOWPOS_CENTERED,width,height,0);
+        SDL_ShowCursor(SDL_DISABLE);
+        SDL_SetRelativeMouseMode(SDL_TRUE);
+        return;
+    }
+
     //32 bit color + transparency
     SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
@@ -31,12 +42,11 @@ Display::Display(int width, int height, const std::string& title){
     if(status != GLEW_OK){
         std::cerr << "Glew failed to initialize." << std::endl;
     }
-
-    isClosed = false;
 }
 
 Display::~Display(){
-    SDL_GL_DeleteContext(glContext);
+    if(isOpenGL)
+        SDL_GL_DeleteContext(glContext);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
@@ -52,6 +62,8 @@ bool Display::ListenInput(Camera *camera){
 
     bool hasReceivedAnyInput = false;
 
+    pressedKeys.clear();
+
     const Uint8 *keystate = SDL_GetKeyboardState(NULL);
 
     int previous_mouseX = camera->m_currentMouseX, previous_mouseY = camera->m_currentMouseY;
@@ -101,6 +113,9 @@ bool Display::ListenInput(Camera *camera){
                 camera->zoom(e.wheel.y,5);
                 hasReceivedAnyInput = true; 
                 break;
+            case SDL_KEYDOWN:
+                if(!e.key.repeat) pressedKeys.push_back(e.key.keysym.scancode);
+                break;
             default: break;
         }
     }
@@ -108,12 +123,33 @@ bool Display::ListenInput(Camera *camera){
     return hasReceivedAnyInput;
 }
 
+bool Display::WasKeyPressed(SDL_Scancode key){
+    for(unsigned int i = 0; i < pressedKeys.size(); i++){
+        if(pressedKeys[i] == key) return true;
+    }
+    return false;
+}
+
 bool Display::IsClosed(){
     return isClosed;
 }
 
 void Display::Update(){
-    SDL_GL_SwapWindow(window);
+    if(isOpenGL)
+        SDL_GL_SwapWindow(window);
+}
+
+void Display::Present(const std::vector<unsigned char>& pixels, int width, int height){
+    SDL_Surface* windowSurface = SDL_GetWindowSurface(window);
+    SDL_Surface* frame = SDL_CreateRGBSurfaceWithFormatFrom((void*)pixels.data(),width,height,32,width*4,SDL_PIXELFORMAT_RGBA32);
+
+    if(windowSurface == NULL || frame == NULL){
+        std::cerr << "Unable to present frame: " << SDL_GetError() << std::endl;
+    } else {
+        SDL_BlitSurface(frame,NULL,windowSurface,NULL);
+        SDL_UpdateWindowSurface(window);
+    }
+    SDL_FreeSurface(frame);
 }
 
 
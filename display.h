@@ -2,17 +2,23 @@
 #define DISPLAY_H
 
 #include <string>
+#include <vector>
 #define SDL_MAIN_HANDLED //https://stackoverflow.com/questions/32342285/undefined-reference-to-winmain16-c-sdl-2/32343111#32343111
 #include <SDL2/SDL.h>
 #include "camera.h"
 
 class Display {
     public:
-        Display(int width, int height, const std::string& title);
+        //Without OpenGL the window is presented through SDL surfaces, which is what the CPU backend uses
+        Display(int width, int height, const std::string& title, bool useOpenGL = true);
 
         void Clear(float r, float g, float b, float a);
         void Update();
+        //Copies 8 bit RGBA pixels, top row first, into a window created without OpenGL
+        void Present(const std::vector<unsigned char>& pixels, int width, int height);
         bool ListenInput(Camera *camera);
+        //True if the key went down during the last ListenInput call
+        bool WasKeyPressed(SDL_Scancode key);
         bool IsClosed();
 
         virtual ~Display();
@@ -20,6 +26,8 @@ class Display {
         SDL_Window* window;
         SDL_GLContext glContext;
         bool isClosed;
+        bool isOpenGL;
+        std::vector<SDL_Scancode> pressedKeys;
 };
 
 #endif // DISPLAY_H
\ No newline at end of file
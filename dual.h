@@ -0,0 +1,117 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <cmath>
+#include "simd.h"
+
+//Dual numbers for forward mode automatic differentiation. A dual number carries a value along with its partial
+//derivatives by the x, y and z of the point a distance function is evaluated at, so a single evaluation of the
+//function with dual numbers gives the distance and its gradient. The value is any scalar with the arithmetic of
+//simd.h, a float or a FloatPacket, which gives the gradients of PACKET_WIDTH points at once.
+
+//Scalar counterparts of the packet helpers of simd.h, a comparison of floats is a single bool
+inline float select(bool mask, float a, float b){ return mask ? a : b; }
+inline double select(bool mask, double a, double b){ return mask ? a : b; }
+inline bool anyLane(bool mask){ return mask; }
+inline bool anyLane(PacketMask mask){ return mask.any(); }
+
+template<typename Real>
+struct Dual {
+    Real value;
+    Real dx, dy, dz;
+    Dual(){}
+    //Constants have no derivatives
+    Dual(Real constant) : value(constant), dx(0.0f), dy(0.0f), dz(0.0f) {}
+    Dual(Real v, Real x, Real y, Real z) : value(v), dx(x), dy(y), dz(z) {}
+};
+
+//Type the comparisons of a scalar give, bool for float and PacketMask for FloatPacket, and the mask with every lane set
+template<typename Scalar> struct MaskOf { typedef bool Type; static bool all(){ return true; } };
+template<> struct MaskOf<FloatPacket> { typedef PacketMask Type; static PacketMask all(){ return PacketMask::all(); } };
+template<typename Real> struct MaskOf<Dual<Real> > : MaskOf<Real> {};
+
+template<typename Real>
+inline Dual<Real> operator+(const Dual<Real>& a, const Dual<Real>& b){ return Dual<Real>(a.value+b.value,a.dx+b.dx,a.dy+b.dy,a.dz+b.dz); }
+template<typename Real>
+inline Dual<Real> operator-(const Dual<Real>& a, const Dual<Real>& b){ return Dual<Real>(a.value-b.value,a.dx-b.dx,a.dy-b.dy,a.dz-b.dz); }
+template<typename Real>
+inline Dual<Real> operator-(const Dual<Real>& a){ return Dual<Real>(-a.value,-a.dx,-a.dy,-a.dz); }
+template<typename Real>
+inline Dual<Real> operator*(const Dual<Real>& a, const Dual<Real>& b){
+    return Dual<Real>(a.value*b.value,a.dx*b.value + a.value*b.dx,a.dy*b.value + a.value*b.dy,a.dz*b.value + a.value*b.dz);
+}
+template<typename Real>
+inline Dual<Real> operator/(const Dual<Real>& a, const Dual<Real>& b){
+    Real quotient = a.value/b.value;
+    return Dual<Real>(quotient,(a.dx - quotient*b.dx)/b.value,(a.dy - quotient*b.dy)/b.value,(a.dz - quotient*b.dz)/b.value);
+}
+
+//Float constants leave out the products with their zero derivatives
+template<typename Real>
+inline Dual<Real> operator+(const Dual<Real>& a, float b){ return Dual<Real>(a.value+b,a.dx,a.dy,a.dz); }
+template<typename Real>
+inline Dual<Real> operator+(float a, const Dual<Real>& b){ return b + a; }
+template<typename Real>
+inline Dual<Real> operator-(const Dual<Real>& a, float b){ return Dual<Real>(a.value-b,a.dx,a.dy,a.dz); }
+template<typename Real>
+inline Dual<Real> operator-(float a, const Dual<Real>& b){ return Dual<Real>(a-b.value,-b.dx,-b.dy,-b.dz); }
+template<typename Real>
+inline Dual<Real> operator*(const Dual<Real>& a, float b){ return Dual<Real>(a.value*b,a.dx*b,a.dy*b,a.dz*b); }
+template<typename Real>
+inline Dual<Real> operator*(float a, const Dual<Real>& b){ return b * a; }
+template<typename Real>
+inline Dual<Real> operator/(const Dual<Real>& a, float b){ return Dual<Real>(a.value/b,a.dx/b,a.dy/b,a.dz/b); }
+template<typename Real>
+inline Dual<Real> operator/(float a, const Dual<Real>& b){
+    Real quotient = Real(a)/b.value;
+    return Dual<Real>(quotient,-quotient*b.dx/b.value,-quotient*b.dy/b.value,-quotient*b.dz/b.value);
+}
+
+//Comparisons and selections go by the value, the derivatives come along with the value picked
+template<typename Real>
+inline typename MaskOf<Real>::Type operator<(const Dual<Real>& a, const Dual<Real>& b){ return a.value < b.value; }
+template<typename Real>
+inline typename MaskOf<Real>::Type operator>(const Dual<Real>& a, const Dual<Real>& b){ return a.value > b.value; }
+template<typename Real>
+inline typename MaskOf<Real>::Type operator<(const Dual<Real>& a, float b){ return a.value < Real(b); }
+template<typename Real>
+inline typename MaskOf<Real>::Type operator>(const Dual<Real>& a, float b){ return a.value > Real(b); }
+
+template<typename Real>
+inline Dual<Real> select(typename MaskOf<Real>::Type mask, const Dual<Real>& a, const Dual<Real>& b){
+    return Dual<Real>(select(mask,a.value,b.value),select(mask,a.dx,b.dx),select(mask,a.dy,b.dy),select(mask,a.dz,b.dz));
+}
+
+template<typename Real>
+inline Dual<Real> min(const Dual<Real>& a, const Dual<Real>& b){ return select(a.value < b.value,a,b); }
+template<typename Real>
+inline Dual<Real> max(const Dual<Real>& a, const Dual<Real>& b){ return select(a.value > b.value,a,b); }
+template<typename Real>
+inline Dual<Real> clamp(const Dual<Real>& value, const Dual<Real>& low, const Dual<Real>& high){ return min(max(value,low),high); }
+template<typename Real>
+inline Dual<Real> abs(const Dual<Real>& a){ return select(a.value < Real(0.0f),-a,a); }
+
+//The sign is flat, only its value is left
+template<typename Real>
+inline Dual<Real> sign(const Dual<Real>& a){
+    return Dual<Real>(select(a.value > Real(0.0f),Real(1.0f),select(a.value < Real(0.0f),Real(-1.0f),Real(0.0f))));
+}
+
+//The square root has no derivative at 0, it is taken as 0 there. Lengths of vectors that vanish, like the part of
+//a box outside of it for points inside, then add nothing to the gradient instead of turning it into NaN.
+template<typename Real>
+inline Dual<Real> sqrt(const Dual<Real>& a){
+    using std::sqrt;
+    Real root = sqrt(a.value);
+    Real scale = select(root > Real(0.0f),Real(0.5f)/root,Real(0.0f));
+    return Dual<Real>(root,a.dx*scale,a.dy*scale,a.dz*scale);
+}
+
+template<typename Real>
+inline Dual<Real> log(const Dual<Real>& a){
+    using std::log;
+    Real inverse = Real(1.0f)/a.value;
+    return Dual<Real>(log(a.value),a.dx*inverse,a.dy*inverse,a.dz*inverse);
+}
+
+#endif // DUAL_H
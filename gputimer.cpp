@@ -0,0 +1,43 @@
+#include "gputimer.h"
+
+GpuTimer::GpuTimer(){
+    glGenQueries(NUM_QUERIES,m_queries);
+    m_oldest = 0;
+    m_pending = 0;
+    m_isTiming = false;
+}
+
+void GpuTimer::begin(int pixels){
+    if(m_pending == NUM_QUERIES) return;
+    int query = (m_oldest + m_pending) % NUM_QUERIES;
+    m_pixels[query] = pixels;
+    glBeginQuery(GL_TIME_ELAPSED,m_queries[query]);
+    m_isTiming = true;
+}
+
+void GpuTimer::end(){
+    if(!m_isTiming) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    m_isTiming = false;
+    m_pending++;
+}
+
+bool GpuTimer::poll(float& milliseconds, int& pixels){
+    if(m_pending == 0) return false;
+
+    GLint isAvailable = GL_FALSE;
+    glGetQueryObjectiv(m_queries[m_oldest],GL_QUERY_RESULT_AVAILABLE,&isAvailable);
+    if(!isAvailable) return false;
+
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(m_queries[m_oldest],GL_QUERY_RESULT,&nanoseconds);
+    milliseconds = (float)(nanoseconds/1e6);
+    pixels = m_pixels[m_oldest];
+    m_oldest = (m_oldest + 1) % NUM_QUERIES;
+    m_pending--;
+    return true;
+}
+
+GpuTimer::~GpuTimer(){
+    glDeleteQueries(NUM_QUERIES,m_queries);
+}
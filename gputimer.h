@@ -0,0 +1,29 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+//Measures the time the GPU spends on frames with timer queries. The results of a frame arrive a few frames
+//later, they are only read once available so the CPU never waits on the GPU.
+class GpuTimer {
+    public:
+        GpuTimer();
+        //Starts timing the commands of a frame that renders the given amount of pixels,
+        //does nothing while every query is still waiting for its result
+        void begin(int pixels);
+        void end();
+        //Takes the oldest finished measurement, returns false when there is none yet
+        bool poll(float& milliseconds, int& pixels);
+        virtual ~GpuTimer();
+    private:
+        static const int NUM_QUERIES = 4; //Frames that can be in flight
+
+        GLuint m_queries[NUM_QUERIES];
+        int m_pixels[NUM_QUERIES];
+        int m_oldest; //Query whose result is read next
+        int m_pending; //Queries started and not read yet
+        bool m_isTiming;
+};
+
+#endif // GPUTIMER_H
@@ -0,0 +1,223 @@
+#include "imagewriter.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static unsigned int crcTable[256];
+
+static void buildCrcTable(){
+    for(unsigned int n = 0; n < 256; n++){
+        unsigned int c = n;
+        for(int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+static unsigned int updateCrc(unsigned int crc, const unsigned char* data, size_t length){
+    for(size_t i = 0; i < length; i++)
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static void appendBigEndian(std::vector<unsigned char>& buffer, unsigned int value){
+    buffer.push_back((value >> 24) & 0xFF);
+    buffer.push_back((value >> 16) & 0xFF);
+    buffer.push_back((value >> 8) & 0xFF);
+    buffer.push_back(value & 0xFF);
+}
+
+//Appends a chunk as length, type, data and the CRC of type and data
+static void appendChunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data){
+    appendBigEndian(png,(unsigned int)data.size());
+    size_t typeStart = png.size();
+    png.insert(png.end(),type,type + 4);
+    png.insert(png.end(),data.begin(),data.end());
+    unsigned int crc = updateCrc(0xFFFFFFFFu,&png[typeStart],png.size() - typeStart);
+    appendBigEndian(png,crc ^ 0xFFFFFFFFu);
+}
+
+static bool writeFile(const std::string& fileName, const std::vector<unsigned char>& contents){
+    FILE* file = fopen(fileName.c_str(),"wb");
+    if(file == NULL){
+        std::cerr << "Unable to write image: " << fileName << std::endl;
+        return false;
+    }
+    bool isWritten = fwrite(contents.data(),1,contents.size(),file) == contents.size();
+    isWritten = fclose(file) == 0 && isWritten;
+    if(!isWritten) std::cerr << "Unable to write image: " << fileName << std::endl;
+    return isWritten;
+}
+
+/*
+ * Writes PNG scanlines, every row already starting with its filter type, as a PNG of the given bit depth and color type.
+ */
+static bool writePngRows(const std::string& fileName, const std::vector<unsigned char>& rows, int width, int height, int bitDepth, int colorType){
+    buildCrcTable();
+
+    //zlib stream made of stored deflate blocks, each holding at most 65535 bytes
+    std::vector<unsigned char> idat;
+    idat.push_back(0x78);
+    idat.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t blockSize = rows.size() - offset < 65535 ? rows.size() - offset : 65535;
+        bool isFinal = offset + blockSize == rows.size();
+        idat.push_back(isFinal ? 1 : 0);
+        idat.push_back(blockSize & 0xFF);
+        idat.push_back((blockSize >> 8) & 0xFF);
+        idat.push_back(~blockSize & 0xFF);
+        idat.push_back((~blockSize >> 8) & 0xFF);
+        idat.insert(idat.end(),rows.begin() + offset,rows.begin() + offset + blockSize);
+        offset += blockSize;
+    } while(offset < rows.size());
+
+    unsigned int a = 1, b = 0;
+    for(size_t i = 0; i < rows.size(); i++){
+        a = (a + rows[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(idat,(b << 16) | a);
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header,width);
+    appendBigEndian(header,height);
+    header.push_back(bitDepth);
+    header.push_back(colorType);
+    header.push_back(0); //deflate
+    header.push_back(0); //adaptive filtering
+    header.push_back(0); //no interlacing
+
+    const unsigned char signature[8] = {0x89,'P','N','G','\r','\n',0x1A,'\n'};
+    std::vector<unsigned char> png(signature,signature + 8);
+    appendChunk(png,"IHDR",header);
+    appendChunk(png,"IDAT",idat);
+    appendChunk(png,"IEND",std::vector<unsigned char>());
+
+    return writeFile(fileName,png);
+}
+
+bool writePng(const std::string& fileName, const std::vector<unsigned char>& pixels, int width, int height){
+    //Every row starts with filter type 0 followed by its RGB values
+    std::vector<unsigned char> rows;
+    rows.reserve((size_t)(width*3 + 1)*height);
+    for(int y = 0; y < height; y++){
+        rows.push_back(0);
+        for(int x = 0; x < width; x++){
+            const unsigned char* pixel = &pixels[(size_t)(y*width + x)*4];
+            rows.insert(rows.end(),pixel,pixel + 3);
+        }
+    }
+    return writePngRows(fileName,rows,width,height,8,2);
+}
+
+bool writePng16(const std::string& fileName, const std::vector<unsigned short>& samples, int width, int height, int channels){
+    //Gray, gray and alpha, truecolor and truecolor with alpha
+    static const int colorTypes[4] = {0,4,2,6};
+    if(channels < 1 || channels > 4){
+        std::cerr << "Unable to write image: " << fileName << ", PNG holds 1 to 4 channels" << std::endl;
+        return false;
+    }
+
+    //PNG samples are big endian
+    std::vector<unsigned char> rows;
+    rows.reserve((size_t)(width*channels*2 + 1)*height);
+    for(int y = 0; y < height; y++){
+        rows.push_back(0);
+        for(int i = 0; i < width*channels; i++){
+            unsigned short sample = samples[(size_t)y*width*channels + i];
+            rows.push_back(sample >> 8);
+            rows.push_back(sample & 0xFF);
+        }
+    }
+    return writePngRows(fileName,rows,width,height,16,colorTypes[channels - 1]);
+}
+
+//OpenEXR is little endian
+static void appendInt(std::vector<unsigned char>& buffer, unsigned int value){
+    for(int i = 0; i < 4; i++)
+        buffer.push_back((value >> (8*i)) & 0xFF);
+}
+
+static void appendFloat(std::vector<unsigned char>& buffer, float value){
+    unsigned int bits;
+    memcpy(&bits,&value,sizeof(bits));
+    appendInt(buffer,bits);
+}
+
+static void appendString(std::vector<unsigned char>& buffer, const char* value){
+    buffer.insert(buffer.end(),value,value + strlen(value) + 1);
+}
+
+static void appendAttribute(std::vector<unsigned char>& buffer, const char* name, const char* type, unsigned int size){
+    appendString(buffer,name);
+    appendString(buffer,type);
+    appendInt(buffer,size);
+}
+
+bool writeExr(const std::string& fileName, const std::vector<glm::vec3>& pixels, int width, int height){
+    //Channels have to be listed in alphabetical order, they are stored in that order in every scanline
+    const char* channelNames[3] = {"B","G","R"};
+    const int channelIndices[3] = {2,1,0};
+
+    std::vector<unsigned char> exr;
+    appendInt(exr,20000630); //magic number
+    appendInt(exr,2); //version 2, single part scanline image
+
+    appendAttribute(exr,"channels","chlist",3*18 + 1);
+    for(int c = 0; c < 3; c++){
+        appendString(exr,channelNames[c]);
+        appendInt(exr,2); //32 bit float
+        appendInt(exr,0); //pLinear and reserved bytes
+        appendInt(exr,1); //x sampling
+        appendInt(exr,1); //y sampling
+    }
+    exr.push_back(0);
+
+    appendAttribute(exr,"compression","compression",1);
+    exr.push_back(0);
+
+    for(int window = 0; window < 2; window++){
+        appendAttribute(exr,window == 0 ? "dataWindow" : "displayWindow","box2i",16);
+        appendInt(exr,0);
+        appendInt(exr,0);
+        appendInt(exr,width - 1);
+        appendInt(exr,height - 1);
+    }
+
+    appendAttribute(exr,"lineOrder","lineOrder",1);
+    exr.push_back(0); //increasing y
+
+    appendAttribute(exr,"pixelAspectRatio","float",4);
+    appendFloat(exr,1.0f);
+
+    appendAttribute(exr,"screenWindowCenter","v2f",8);
+    appendFloat(exr,0.0f);
+    appendFloat(exr,0.0f);
+
+    appendAttribute(exr,"screenWindowWidth","float",4);
+    appendFloat(exr,1.0f);
+
+    exr.push_back(0); //end of header
+
+    //Offset table with one entry per scanline, each scanline is a chunk of its own
+    unsigned int scanlineSize = (unsigned int)width*3*4;
+    size_t firstScanline = exr.size() + (size_t)height*8;
+    for(int y = 0; y < height; y++){
+        unsigned long long offset = firstScanline + (unsigned long long)y*(8 + scanlineSize);
+        appendInt(exr,(unsigned int)(offset & 0xFFFFFFFFu));
+        appendInt(exr,(unsigned int)(offset >> 32));
+    }
+
+    exr.reserve(firstScanline + (size_t)height*(8 + scanlineSize));
+    for(int y = 0; y < height; y++){
+        appendInt(exr,y);
+        appendInt(exr,scanlineSize);
+        for(int c = 0; c < 3; c++){
+            for(int x = 0; x < width; x++)
+                appendFloat(exr,pixels[(size_t)y*width + x][channelIndices[c]]);
+        }
+    }
+
+    return writeFile(fileName,exr);
+}
@@ -0,0 +1,18 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+//Writes 8 bit RGBA pixels, top row first, as an RGB PNG. The image data is stored without
+//compression so no zlib is needed, any PNG reader can still open it.
+bool writePng(const std::string& fileName, const std::vector<unsigned char>& pixels, int width, int height);
+
+//Writes 16 bit samples with 1 to 4 interleaved channels, top row first, as a gray, gray and alpha, RGB or RGBA PNG
+bool writePng16(const std::string& fileName, const std::vector<unsigned short>& samples, int width, int height, int channels);
+
+//Writes linear floating point pixels, top row first, as an uncompressed 32 bit float OpenEXR image
+bool writeExr(const std::string& fileName, const std::vector<glm::vec3>& pixels, int width, int height);
+
+#endif // IMAGEWRITER_H
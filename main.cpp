@@ -1,4 +1,9 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
 #define GLEW_STATIC
 #include <GL/glew.h>
 
@@ -6,6 +11,13 @@
 #include "mesh.h"
 #include "shader.h"
 #include "camera.h"
+#include "scene.h"
+#include "cpurenderer.h"
+#include "benchmark.h"
+#include "resolutioncontroller.h"
+#include "gputimer.h"
+#include "shadergenerator.h"
+#include "sampler.h"
 
 
 //System resolution in pixels
@@ -22,23 +34,499 @@
 #endif
 
 
+//Bakes the fractals of a scene into its brick map on every hardware thread and reports how long it took
+static void buildBrickMap(Scene& scene){
+    Uint32 startTicks = SDL_GetTicks();
+    ThreadPool threadPool;
+    scene.buildBrickMap(threadPool);
+    if(!scene.getBrickMap().isEmpty())
+        printf("Baked %d bricks in %u ms\n",scene.getBrickMap().getBrickCount(),SDL_GetTicks() - startTicks);
+}
+
+//Loads a scene file and reports how long it took, its fractals are baked unless brick maps are disabled
+static bool loadScene(Scene& scene, const std::string& fileName, bool useBrickMap){
+    Uint32 startTicks = SDL_GetTicks();
+    if(!scene.loadFromFile(fileName)) return false;
+    printf("Loaded %s: %d objects in %u ms\n",fileName.c_str(),scene.getObjectCount(),SDL_GetTicks() - startTicks);
+    if(useBrickMap) buildBrickMap(scene);
+    return true;
+}
+
+//Tab switches to the next scene given with --scene and F5 reloads the current one from disk.
+//Returns true if the scene changed.
+static bool listenSceneInput(Display& display, Scene& scene, const std::vector<std::string>& sceneFiles, unsigned int& currentScene, bool useBrickMap){
+    if(sceneFiles.empty()) return false;
+    if(display.WasKeyPressed(SDL_SCANCODE_TAB)){
+        currentScene = (currentScene + 1) % sceneFiles.size();
+        return loadScene(scene,sceneFiles[currentScene],useBrickMap);
+    }
+    if(display.WasKeyPressed(SDL_SCANCODE_F5))
+        return loadScene(scene,sceneFiles[currentScene],useBrickMap);
+    return false;
+}
+
+//Uploads the objects, hierarchy, light and march settings of a scene to the path tracer.
+//The buffers are replaced in place, so switching scenes needs neither a new context nor new shaders.
+//A specialized path tracer switches to the variant generated for the scene, compiled the first time the scene is seen.
+static void uploadScene(Shader& pathTracer, const Scene& scene, bool isSpecialized){
+    pathTracer.useVariant(isSpecialized ? generateSceneDefines(scene) : generateGenericDefines(scene));
+
+    //Three texels per object, matching getSceneObject in the path tracer shader
+    std::vector<glm::vec4> objectTexels;
+    objectTexels.reserve(scene.getObjectCount()*3);
+    for(int i = 0; i < scene.getObjectCount(); i++){
+        const Object& object = scene.getObject(i);
+        objectTexels.push_back(glm::vec4(object.center,object.size));
+        objectTexels.push_back(glm::vec4(object.albedo,object.emission));
+        int program = object.type == OBJECT_CSG ? scene.getShape(object.shape).program : -1;
+        objectTexels.push_back(glm::vec4((float)object.type,(float)object.surfaceType,(float)object.id,(float)program));
+    }
+    pathTracer.loadBufferTexture("sceneObjects",3,objectTexels.data(),objectTexels.size()*sizeof(glm::vec4),GL_RGBA32F);
+    pathTracer.setInt("sceneObjectCount",scene.getObjectCount());
+
+    //The programs of every shape, csg objects point at the first instruction of theirs
+    const std::vector<glm::vec4>& csgCode = scene.getCsgCode();
+    pathTracer.loadBufferTexture("csgProgram",13,csgCode.data(),csgCode.size()*sizeof(glm::vec4),GL_RGBA32F);
+
+    //The shader loops over every object if the hierarchy is empty
+    const Bvh& bvh = scene.getBvh();
+    pathTracer.loadBufferTexture("bvhNodes",4,bvh.getNodes().data(),bvh.getNodes().size()*sizeof(BvhNode),GL_RGBA32F);
+    pathTracer.loadBufferTexture("bvhObjects",5,bvh.getObjectIndices().data(),bvh.getObjectIndices().size()*sizeof(int),GL_R32I);
+    pathTracer.setInt("bvhNodeCount",bvh.getNodes().size());
+
+    //The shader evaluates the distance estimate of every fractal if there is no brick map
+    const BrickMap& brickMap = scene.getBrickMap();
+    std::vector<float> atlas;
+    int atlasWidth, atlasHeight, atlasDepth;
+    brickMap.getAtlas(atlas,atlasWidth,atlasHeight,atlasDepth);
+    pathTracer.loadBufferTexture("brickMapObjects",10,brickMap.getObjects().data(),brickMap.getObjects().size()*sizeof(BrickMapObject),GL_RGBA32F);
+    pathTracer.loadBufferTexture("brickMapCells",11,brickMap.getCells().data(),brickMap.getCells().size()*sizeof(BrickMapCell),GL_RG32F);
+    pathTracer.loadTexture3D("brickAtlas",12,atlas.data(),atlasWidth,atlasHeight,atlasDepth,GL_R32F);
+    pathTracer.setInt("brickMapObjectCount",brickMap.getObjects().size());
+
+    pathTracer.setVec3("lightSource",scene.getLightSource());
+    pathTracer.setVec3("lightColor",scene.getLightColor());
+    pathTracer.setVec3("sceneBackgroundColor",scene.getBackgroundColor());
+    pathTracer.setVec3("sceneFogColor",scene.getFogColor());
+
+    const MarchSettings& settings = scene.getMarchSettings();
+    pathTracer.setInt("maxMarchingSteps",settings.maxMarchingSteps);
+    pathTracer.setFloat("maxDist",settings.maxDist);
+    pathTracer.setFloat("epsilon",settings.epsilon);
+    pathTracer.setFloat("relaxation",settings.relaxation);
+    pathTracer.setInt("maxMarchDepth",settings.maxMarchDepth);
+    pathTracer.setFloat("refractionIndex",settings.refractionIndex);
+}
+
+//Uploads the low discrepancy sequences and the blue noise mask the path tracer takes the samples of its bounces from
+static void uploadSampler(Shader& pathTracer, const Sampler& sampler){
+    pathTracer.loadBufferTexture("blueNoise",0,sampler.getMask().data(),sampler.getMask().size()*sizeof(glm::vec2),GL_RG32F);
+    pathTracer.loadBufferTexture("sobolSequences",9,sampler.getSequences().data(),sampler.getSequences().size()*sizeof(glm::vec2),GL_RG32F);
+    pathTracer.setInt("blueNoiseSize",sampler.getMaskSize());
+    pathTracer.setInt("blueNoiseSlices",sampler.getMaskDepth());
+}
+
+//2D quad that occupies the whole screen for the fragment shaders to draw on
+static void getScreenQuad(Vertex vertices[4]){
+    vertices[0] = Vertex(glm::vec3(-1.0,1.0,0),glm::vec2(0.0,0.0));
+    vertices[1] = Vertex(glm::vec3(1.0,1.0,0),glm::vec2(1.0,0.0));
+    vertices[2] = Vertex(glm::vec3(-1.0,-1.0,0),glm::vec2(0.0,1.0));
+    vertices[3] = Vertex(glm::vec3(1.0,-1.0,0.0),glm::vec2(1.0,1.0));
+}
+
+//Camera and render resolution the history was rendered with
+struct FrameView {
+    Camera camera;
+    glm::vec2 resolution;
+};
+
+//Path traces one frame into the accumulation target of this frame, accumulatedSamples is 0 when the accumulation restarts.
+//A restart reprojects the history rendered from the previous view when there is one, otherwise it starts from nothing.
+//The frame covers the viewport, the resolution uniform of the path tracer has to match it.
+static void renderPathTracerFrame(Shader& pathTracer, Mesh& mesh, Camera& camera, float time, int accumulatedSamples, FrameView* previousView = NULL){
+    //The first frame after a restart marches the primary rays and stores their hits in the G-buffer,
+    //the frames after it start from the stored hits
+    bool isPrimaryHitCached = accumulatedSamples > 0;
+    bool isHistoryReprojected = !isPrimaryHitCached && previousView != NULL;
+
+    //Bind the accumulation target of this frame, the quad covers every pixel so it does not need clearing
+    glBindFramebuffer(GL_FRAMEBUFFER,isPrimaryHitCached ? pathTracer.getFrameBuffer() : pathTracer.getGBufferFrameBuffer());
+    glEnable(GL_DEPTH_TEST);
+
+    //Use path tracer
+    pathTracer.use();
+
+    //Activate the previous frame which is bound to location 1 inputTexture and its moments on location 2
+    pathTracer.bindInputTextures();
+
+    //Activate the buffers, the blue noise mask on location 0, sceneObjects on 3, bvhNodes on 4, bvhObjects on 5,
+    //the Sobol sequences on 9, the brick maps on 10 to 12 and the csg programs on 13
+    pathTracer.bindBufferTextures();
+
+    //Activate the G-buffer with the latest primary hits on locations 6 to 8, a restart reprojects from them
+    pathTracer.bindGBufferTextures();
+
+    //Pass camera parameters to path tracer shader through the use of uniforms
+    pathTracer.setVec3("cameraPosition",camera.getPosition());
+    pathTracer.setVec3("cameraUp",camera.getUp());
+    pathTracer.setVec3("cameraFront",camera.getFront());
+    pathTracer.setFloat("fov",camera.getFov());
+    pathTracer.setFloat("time",time);
+
+    pathTracer.setInt("accumulatedSamples",accumulatedSamples);
+    //Every accumulation rotates the sequences by the next slice or another offset of the blue noise mask
+    static unsigned int restarts = 0;
+    if(accumulatedSamples == 0) pathTracer.setInt("sequenceSeed",++restarts);
+    pathTracer.setInt("isPrimaryHitCached",isPrimaryHitCached);
+    pathTracer.setInt("isHistoryReprojected",isHistoryReprojected);
+    if(isHistoryReprojected){
+        glm::vec2 previousResolution = previousView->resolution;
+        pathTracer.setMat4("previousViewProjection",previousView->camera.getViewProjection(previousResolution.x/previousResolution.y));
+        pathTracer.setVec3("previousCameraPosition",previousView->camera.getPosition());
+        pathTracer.setVec2("previousResolution",previousResolution);
+    }
+
+    //Draw a quad displaying the path tracer output
+    mesh.Draw();
+
+    //Bind back to default framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    glDisable(GL_DEPTH_TEST);
+
+    //The hits just marched are the latest ones
+    if(!isPrimaryHitCached) pathTracer.swapGBuffers();
+}
+
+//Filters the frame the path tracer just rendered with the given a-trous iterations and upscales it to the screen.
+//The first pass estimates the variance of every pixel, every iteration after it doubles the spacing of the taps.
+//The passes cover the viewport, which holds the render resolution.
+static void drawDenoisedFrame(Shader& denoiser, Shader& pathTracer, Mesh& mesh, int iterations, int renderWidth, int renderHeight){
+    denoiser.use();
+    denoiser.setVec2("resolution",glm::vec2(renderWidth,renderHeight));
+
+    //The moments of the accumulation on location 1 and the primary hits of the G-buffer on locations 2 and 3
+    glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D,pathTracer.getOutputMomentsTexture());
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_2D,pathTracer.getGBufferTexture(0));
+    glActiveTexture(GL_TEXTURE0 + 3);
+    glBindTexture(GL_TEXTURE_2D,pathTracer.getGBufferTexture(1));
+
+    for(int pass = 0; pass <= iterations; pass++){
+        bool isOutput = pass == iterations;
+        glBindFramebuffer(GL_FRAMEBUFFER,denoiser.getFrameBuffer());
+
+        //The accumulation feeds the variance estimate, every iteration reads the output of the pass before it
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D,pass == 0 ? pathTracer.getOutputTexture() : denoiser.getInputTexture());
+
+        denoiser.setInt("isVarianceEstimate",pass == 0);
+        denoiser.setInt("stepSize",1 << glm::max(pass - 1,0));
+        denoiser.setInt("isOutput",isOutput);
+        mesh.Draw();
+
+        denoiser.swapAccumulationTargets();
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    //The last pass is the input of the next one now, bilinear filtering stretches it over the window
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,denoiser.getInputFrameBuffer());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER,0);
+    glBlitFramebuffer(0,0,renderWidth,renderHeight,0,0,SCREEN_WIDTH,SCREEN_HEIGHT,GL_COLOR_BUFFER_BIT,GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+}
+
+static void printBenchmarkResult(const BenchmarkResult& result, double targetRmse){
+    double timeToRmse = result.getTimeToRmse(targetRmse);
+    printf("%-12s path p50 %.1f ms, %.3g rays/s, %.1f steps per ray, ",result.getScene().name,result.getPathFramePercentile(50.0),result.getRaysPerSecond(),result.getStepsPerRay());
+    if(timeToRmse >= 0.0) printf("RMSE %g after %.2f s\n",targetRmse,timeToRmse);
+    else printf("RMSE %g after %.2f s\n",result.getLastRmse(),result.getStaticSeconds());
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Runs the camera path of every benchmark scene on the OpenGL backend. Every frame is finished before the next one
+//starts so its time is the time the GPU took, the statistics are read back outside of the measured time.
+static int runGlBenchmark(const std::string& resultsFile, int width, int height, double targetRmse, double maxStaticSeconds, float noiseThreshold, bool isSpecialized, bool useBrickMap){
+
+    Display display(width,height,"Path marcher benchmark");
+
+    Shader pathTracer("." SEPARATOR "shaders" SEPARATOR "pathTracer");
+    Vertex vertices[4];
+    getScreenQuad(vertices);
+    Mesh mesh(vertices,4);
+
+    pathTracer.setVec2("resolution",glm::vec2(width,height));
+    Sampler sampler;
+    uploadSampler(pathTracer,sampler);
+    pathTracer.createAccumulationTargets(width,height);
+    pathTracer.createGBuffer(width,height);
+    pathTracer.setFloat("noiseThreshold",noiseThreshold);
+    glViewport(0,0,width,height);
+
+    std::string device = std::string((const char*)glGetString(GL_RENDERER)) + ", " + (const char*)glGetString(GL_VERSION);
+    if(!isSpecialized) device += ", generic shader";
+    if(!useBrickMap) device += ", no brick maps";
+    printf("Benchmarking %s at %dx%d\n",device.c_str(),width,height);
+
+    std::vector<glm::vec4> pixels(width*height), moments(width*height);
+    std::vector<BenchmarkResult> results;
+
+    for(int i = 0; i < NUM_BENCHMARK_SCENES; i++){
+        Scene scene;
+        if(!loadScene(scene,benchmarkScenes[i].fileName,useBrickMap)) return 1;
+        uploadScene(pathTracer,scene,isSpecialized);
+        results.push_back(BenchmarkResult(benchmarkScenes[i]));
+        BenchmarkResult& result = results.back();
+
+        //Some drivers compile shader variants on their first draw, a restarting frame and cached frames
+        //on both accumulation targets are rendered before anything is measured
+        for(int frame = 0; frame < 3; frame++){
+            Camera camera = getBenchmarkCamera(benchmarkScenes[i],0.0f,120.0f);
+            renderPathTracerFrame(pathTracer,mesh,camera,16.0f*(frame + 1),frame);
+            pathTracer.swapAccumulationTargets();
+        }
+
+        //Every frame of the path moves the camera, the static frames after it accumulate at the end of the path
+        int accumulatedSamples = 0;
+        for(int frame = 0; ; frame++){
+            bool isPathFrame = frame < BENCHMARK_PATH_FRAMES;
+            Camera camera = getBenchmarkCamera(benchmarkScenes[i],glm::min(frame,BENCHMARK_PATH_FRAMES)/(float)BENCHMARK_PATH_FRAMES,120.0f);
+            if(isPathFrame || frame == BENCHMARK_PATH_FRAMES) accumulatedSamples = 0;
+
+            glFinish();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderPathTracerFrame(pathTracer,mesh,camera,16.0f*(frame + 1),accumulatedSamples);
+            glFinish();
+            double milliseconds = millisecondsSince(start);
+            accumulatedSamples++;
+
+            //The moments texture holds the squared deviations, rays, march steps and paths taken of every pixel
+            glBindTexture(GL_TEXTURE_2D,pathTracer.getOutputMomentsTexture());
+            glGetTexImage(GL_TEXTURE_2D,0,GL_RGBA,GL_FLOAT,moments.data());
+
+            if(isPathFrame){
+                double rays = 0.0, marchedSteps = 0.0;
+                for(unsigned int p = 0; p < moments.size(); p++){
+                    rays += moments[p].y;
+                    marchedSteps += moments[p].z;
+                }
+                result.addPathFrame(milliseconds,rays,marchedSteps);
+            } else {
+                //The accumulation holds the sample count of every pixel in alpha
+                glBindTexture(GL_TEXTURE_2D,pathTracer.getOutputTexture());
+                glGetTexImage(GL_TEXTURE_2D,0,GL_RGBA,GL_FLOAT,pixels.data());
+                RmseEstimate rmse;
+                double samples = 0.0;
+                for(unsigned int p = 0; p < pixels.size(); p++){
+                    rmse.addPixel(moments[p].x,pixels[p].w);
+                    samples += pixels[p].w;
+                }
+                result.addStaticFrame(milliseconds,(float)(samples/pixels.size()),rmse.getRmse());
+            }
+
+            pathTracer.swapAccumulationTargets();
+            display.Update();
+
+            if(!isPathFrame && (result.getLastRmse() <= targetRmse || result.getStaticSeconds() >= maxStaticSeconds)) break;
+        }
+        printBenchmarkResult(result,targetRmse);
+    }
+
+    return writeBenchmarkJson(resultsFile,"gl",device,width,height,targetRmse,results) ? 0 : 1;
+}
+
+//Runs the camera path of every benchmark scene on the CPU backend, no window is opened
+static int runCpuBenchmark(const std::string& resultsFile, int width, int height, double targetRmse, double maxStaticSeconds, float noiseThreshold, unsigned int numThreads, bool useBrickMap){
+
+    CpuRenderer renderer(width,height,numThreads);
+    renderer.setNoiseThreshold(noiseThreshold);
+
+    std::string device = std::to_string(renderer.getThreadCount()) + " threads";
+    if(!useBrickMap) device += ", no brick maps";
+    printf("Benchmarking the CPU backend on %s at %dx%d\n",device.c_str(),width,height);
+
+    std::vector<BenchmarkResult> results;
+
+    for(int i = 0; i < NUM_BENCHMARK_SCENES; i++){
+        Scene scene;
+        if(!loadScene(scene,benchmarkScenes[i].fileName,useBrickMap)) return 1;
+        results.push_back(BenchmarkResult(benchmarkScenes[i]));
+        BenchmarkResult& result = results.back();
+
+        for(int frame = 0; ; frame++){
+            bool isPathFrame = frame < BENCHMARK_PATH_FRAMES;
+            Camera camera = getBenchmarkCamera(benchmarkScenes[i],glm::min(frame,BENCHMARK_PATH_FRAMES)/(float)BENCHMARK_PATH_FRAMES,120.0f);
+            bool hasCameraChanged = frame <= BENCHMARK_PATH_FRAMES;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderer.render(scene,camera,16.0f*(frame + 1),hasCameraChanged);
+            double milliseconds = millisecondsSince(start);
+
+            if(isPathFrame){
+                result.addPathFrame(milliseconds,(double)renderer.getMarchedRays(),(double)renderer.getTotalMarchedSteps());
+            } else {
+                const std::vector<int>& sampleCounts = renderer.getSampleCounts();
+                const std::vector<float>& squaredDeviations = renderer.getSquaredDeviations();
+                RmseEstimate rmse;
+                for(unsigned int p = 0; p < sampleCounts.size(); p++)
+                    rmse.addPixel(squaredDeviations[p],sampleCounts[p]);
+                result.addStaticFrame(milliseconds,renderer.getMeanSampleCount(),rmse.getRmse());
+            }
+
+            if(!isPathFrame && (result.getLastRmse() <= targetRmse || result.getStaticSeconds() >= maxStaticSeconds)) break;
+        }
+        printBenchmarkResult(result,targetRmse);
+    }
+
+    return writeBenchmarkJson(resultsFile,"cpu",device,width,height,targetRmse,results) ? 0 : 1;
+}
+
+//Renders the scene on the CPU path marching backend and presents it without using OpenGL
+static int runCpuBackend(unsigned int numThreads, float noiseThreshold, int denoiseIterations, bool useReprojection, bool useBrickMap, Scene& scene, const std::vector<std::string>& sceneFiles){
+
+    Display display(SCREEN_WIDTH,SCREEN_HEIGHT,"Path marcher (CPU)",false);
+    unsigned int currentScene = 0;
+
+    Camera camera(glm::vec3(1.0f,0.5f,2.0f),glm::vec3(0.0f,0.0f,1.0f),glm::vec3(0.0f,1.0f,0.0f),-90.0f,0.0f,120.0f,CAMERA_SPEED);
+
+    CpuRenderer renderer(SCREEN_WIDTH,SCREEN_HEIGHT,numThreads);
+    renderer.setNoiseThreshold(noiseThreshold);
+    renderer.setDenoiseIterations(denoiseIterations);
+    renderer.setReprojection(useReprojection);
+    std::vector<unsigned char> pixels;
+
+    printf("Rendering on the CPU with %u threads\n",renderer.getThreadCount());
+
+    float startClock = 0;
+    float deltaClock = 0;
+    int currentFps = 0;
+
+    while(!display.IsClosed()){
+
+        bool hasCameraChanged = display.ListenInput(&camera);
+        if(listenSceneInput(display,scene,sceneFiles,currentScene,useBrickMap)) renderer.restartAccumulation();
+
+        renderer.render(scene,camera,startClock,hasCameraChanged);
+        renderer.getPixels(pixels);
+        display.Present(pixels,SCREEN_WIDTH,SCREEN_HEIGHT);
+
+        deltaClock = SDL_GetTicks() - startClock;
+        startClock = SDL_GetTicks();
+
+        if(deltaClock != 0){
+            currentFps = (int)(1000/deltaClock);
+            camera.updateSpeed(CAMERA_SPEED*deltaClock);
+        }
+
+        printf("FPS: %d\n",currentFps);
+    }
+
+    return 0;
+}
 
 int main(int argc, char* argv[]){
 
+    //--cpu selects the CPU path marching backend, --threads limits the amount of worker threads it uses.
+    //--scene loads a scene file, it can be given more than once to switch between scenes with Tab.
+    //--adaptive enables adaptive sampling, pixels stop sampling once their relative error is below the given threshold.
+    //--benchmark runs the benchmark scenes on the selected backend and writes the results to the given JSON file,
+    //--benchmark-size sets its resolution, --target-rmse the noise its static frames converge to and
+    //--benchmark-seconds how long they may take at most.
+    //--denoise sets the iterations of the a-trous filter applied to the image, 0 shows the accumulation unfiltered.
+    //--no-reprojection restarts the accumulation from nothing whenever the camera moves.
+    //--generic-shader renders every scene with the same path tracer instead of one generated for the scene.
+    //--frame-budget lowers the render resolution to keep the frames within the given milliseconds, the image is upscaled to the window.
+    //--no-brick-map evaluates the distance estimate of the fractals at every step instead of bounding them with a brick map far from their surface.
+    //The CPU backend bounds them by default, --brick-map bounds them on the OpenGL backend too.
+    bool useCpuBackend = false;
+    unsigned int numThreads = 0;
+    float noiseThreshold = 0.0f;
+    std::vector<std::string> sceneFiles;
+    std::string benchmarkFile;
+    int benchmarkWidth = SCREEN_WIDTH, benchmarkHeight = SCREEN_HEIGHT;
+    double targetRmse = 0.01;
+    double maxStaticSeconds = 30.0;
+    int denoiseIterations = 5;
+    bool useReprojection = true;
+    float frameBudget = 0.0f;
+    bool useSpecializedShader = true;
+    int brickMapChoice = -1; //-1 until --brick-map or --no-brick-map picks 1 or 0
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i],"--cpu") == 0){
+            useCpuBackend = true;
+        } else if(strcmp(argv[i],"--threads") == 0 && i + 1 < argc){
+            numThreads = (unsigned int)atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--scene") == 0 && i + 1 < argc){
+            sceneFiles.push_back(argv[++i]);
+        } else if(strcmp(argv[i],"--adaptive") == 0 && i + 1 < argc){
+            noiseThreshold = (float)atof(argv[++i]);
+        } else if(strcmp(argv[i],"--no-reprojection") == 0){
+            useReprojection = false;
+        } else if(strcmp(argv[i],"--generic-shader") == 0){
+            useSpecializedShader = false;
+        } else if(strcmp(argv[i],"--brick-map") == 0){
+            brickMapChoice = 1;
+        } else if(strcmp(argv[i],"--no-brick-map") == 0){
+            brickMapChoice = 0;
+        } else if(strcmp(argv[i],"--frame-budget") == 0 && i + 1 < argc){
+            frameBudget = (float)atof(argv[++i]);
+        } else if(strcmp(argv[i],"--denoise") == 0 && i + 1 < argc){
+            denoiseIterations = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--benchmark") == 0 && i + 1 < argc){
+            benchmarkFile = argv[++i];
+        } else if(strcmp(argv[i],"--benchmark-size") == 0 && i + 2 < argc){
+            benchmarkWidth = atoi(argv[i + 1]);
+            benchmarkHeight = atoi(argv[i + 2]);
+            i += 2;
+        } else if(strcmp(argv[i],"--target-rmse") == 0 && i + 1 < argc){
+            targetRmse = atof(argv[++i]);
+        } else if(strcmp(argv[i],"--benchmark-seconds") == 0 && i + 1 < argc){
+            maxStaticSeconds = atof(argv[++i]);
+        } else {
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+        }
+    }
+
+    //Shader invocations run in lockstep, a fractal is evaluated for all of them as soon as one is near its surface,
+    //so the bound only adds steps and texture reads on the OpenGL backend
+    bool useBrickMap = brickMapChoice == -1 ? useCpuBackend : brickMapChoice == 1;
+
+    if(!benchmarkFile.empty()){
+        if(useCpuBackend) return runCpuBenchmark(benchmarkFile,benchmarkWidth,benchmarkHeight,targetRmse,maxStaticSeconds,noiseThreshold,numThreads,useBrickMap);
+        return runGlBenchmark(benchmarkFile,benchmarkWidth,benchmarkHeight,targetRmse,maxStaticSeconds,noiseThreshold,useSpecializedShader,useBrickMap);
+    }
+
+    //Without scene files the default scene is rendered
+    Scene scene;
+    if(sceneFiles.empty()){
+        if(useBrickMap) buildBrickMap(scene);
+    } else if(!loadScene(scene,sceneFiles[0],useBrickMap)){
+        return 1;
+    }
+
+    if(useCpuBackend){
+        return runCpuBackend(numThreads,noiseThreshold,denoiseIterations,useReprojection,useBrickMap,scene,sceneFiles);
+    }
+
     glEnable(GL_DEPTH_TEST); //Render objects correctly on top of each other
 
     Display display(SCREEN_WIDTH,SCREEN_HEIGHT,"Path marcher");
 
+    //Compiled programs are cached, the startup times tell a cold start from a warm one
+    std::chrono::steady_clock::time_point startup = std::chrono::steady_clock::now();
     Shader denoiser("." SEPARATOR "shaders" SEPARATOR "denoiser");
-    Shader pathTracer("." SEPARATOR "shaders" SEPARATOR "pathTracer");
+    Shader pathTracer("." SEPARATOR "shaders" SEPARATOR "pathTracer",useSpecializedShader ? generateSceneDefines(scene) : generateGenericDefines(scene));
+    printf("Shaders ready in %.0f ms, %d of 2 loaded from the cache\n",millisecondsSince(startup),denoiser.isLoadedFromCache() + pathTracer.isLoadedFromCache());
+    bool isFirstFrame = true;
 
     //Create 2D quad mesh that occupies the whole screen for fragment shader to draw on
-    Vertex vertices[] = { Vertex(glm::vec3(-1.0,1.0,0),glm::vec2(0.0,0.0)),
-                          Vertex(glm::vec3(1.0,1.0,0),glm::vec2(1.0,0.0)),
-                          Vertex(glm::vec3(-1.0,-1.0,0),glm::vec2(0.0,1.0)),
-                          Vertex(glm::vec3(1.0,-1.0,0.0),glm::vec2(1.0,1.0))};
-
-    Mesh mesh(vertices,sizeof(vertices)/sizeof(vertices[0]));
+    Vertex vertices[4];
+    getScreenQuad(vertices);
+    Mesh mesh(vertices,4);
 
     Camera camera(glm::vec3(1.0f,0.5f,2.0f),glm::vec3(0.0f,0.0f,1.0f),glm::vec3(0.0f,1.0f,0.0f),-90.0f,0.0f,120.0f,CAMERA_SPEED);  
 
@@ -46,11 +534,25 @@ int main(int argc, char* argv[]){
     glm::vec2 resolution = glm::vec2(SCREEN_WIDTH,SCREEN_HEIGHT);  
     pathTracer.setVec2("resolution",resolution);
 
-    pathTracer.loadTexture("blue_noise.png","blueNoise");
+    Sampler sampler;
+    uploadSampler(pathTracer,sampler);
+
+    uploadScene(pathTracer,scene,useSpecializedShader);
+    unsigned int currentScene = 0;
+
+    //Two float targets the path tracer alternates between, it reads the previous frame from one and writes to the other
+    pathTracer.createAccumulationTargets(SCREEN_WIDTH,SCREEN_HEIGHT);
+    pathTracer.createGBuffer(SCREEN_WIDTH,SCREEN_HEIGHT);
+    pathTracer.setFloat("noiseThreshold",noiseThreshold);
+    int accumulatedSamples = 0;
 
-    //Specify output and input targets for the path tracing shader to write and read from.
-    pathTracer.createRenderTarget(SCREEN_WIDTH,SCREEN_HEIGHT);
-    pathTracer.createInputTarget(SCREEN_WIDTH,SCREEN_HEIGHT);
+    //Two float targets the denoiser alternates between while it filters, the last iteration is upscaled to the screen
+    denoiser.createFilterTargets(SCREEN_WIDTH,SCREEN_HEIGHT);
+    denoiser.use();
+    denoiser.setInt("screenTexture",0);
+    denoiser.setInt("inputMoments",1);
+    denoiser.setInt("gBufferHit",2);
+    denoiser.setInt("gBufferSurface",3);
 
     //Following variables are used in order to calculate current frames per second and change camera behaviour speed based on ellapsed time between frames
     float initialTime = (float)SDL_GetTicks();
@@ -58,55 +560,62 @@ int main(int argc, char* argv[]){
     float deltaClock = 0;
     int currentFps = 0;
 
+    //Camera and resolution the history was rendered with, the history is reprojected from them when either changes
+    FrameView previousView = {camera,resolution};
+    bool hasHistory = false;
+
+    //Without a budget the frames are rendered at the full window resolution. The render targets keep the window size,
+    //a lower resolution only renders to a corner of them so changing it never reallocates anything.
+    ResolutionController resolutionController(SCREEN_WIDTH,SCREEN_HEIGHT,frameBudget);
+    GpuTimer gpuTimer;
+
     while(!display.IsClosed()){   
 
         //Listen to input
         bool hasCameraChanged = display.ListenInput(&camera);
+        if(listenSceneInput(display,scene,sceneFiles,currentScene,useBrickMap)){
+            uploadScene(pathTracer,scene,useSpecializedShader);
+            hasHistory = false;
+        }
         
-        //Bind frame buffer with memory texture attached
-        glBindFramebuffer(GL_FRAMEBUFFER,pathTracer.getFrameBuffer());
-        glEnable(GL_DEPTH_TEST);
-
-        //Clear framebuffer content
-        display.Clear(0.0f,0.0f,0.0f,0.0f);
-        
-        //Use path tracer
-        pathTracer.use();
+        //Timings arrive a few frames late, a new resolution restarts the accumulation like a camera move
+        bool hasResolutionChanged = false;
+        float gpuMilliseconds;
+        int timedPixels;
+        while(frameBudget > 0.0f && gpuTimer.poll(gpuMilliseconds,timedPixels))
+            hasResolutionChanged |= resolutionController.addFrameTime(gpuMilliseconds,timedPixels);
+        if(hasResolutionChanged){
+            resolution = glm::vec2(resolutionController.getWidth(),resolutionController.getHeight());
+            pathTracer.use();
+            pathTracer.setVec2("resolution",resolution);
+        }
+        glViewport(0,0,(int)resolution.x,(int)resolution.y);
 
-        //Activate blue noise texture which is bound to location 0   
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D,pathTracer.getLoadedTexture());
+        //The new sample is averaged with the ones accumulated since the camera last moved, or reprojected when it moved
+        if(hasCameraChanged || hasResolutionChanged || !hasHistory) accumulatedSamples = 0;
 
-        //Activate input texture which is bound to location 1 inputTexture
-        glActiveTexture(GL_TEXTURE0 + 1);
-        glBindTexture(GL_TEXTURE_2D,pathTracer.getInputTexture());
+        if(frameBudget > 0.0f) gpuTimer.begin((int)(resolution.x*resolution.y));
+        renderPathTracerFrame(pathTracer,mesh,camera,startClock,accumulatedSamples,hasHistory && useReprojection ? &previousView : NULL);
+        accumulatedSamples++;
+        previousView.camera = camera;
+        previousView.resolution = resolution;
+        hasHistory = true;
 
-        //Pass camera parameters to path tracer shader through the use of uniforms
-        pathTracer.setVec3("cameraPosition",camera.getPosition());
-        pathTracer.setVec3("cameraUp",camera.getUp());
-        pathTracer.setVec3("cameraFront",camera.getFront());
-        pathTracer.setFloat("fov",camera.getFov());
-        pathTracer.setFloat("time",startClock);
-        pathTracer.setFloat("hasCameraChanged",hasCameraChanged ? 1.0f : 0.0f);
+        display.Clear(0.0f,0.15f,0.3f,1.0f);
 
-        //Draw a quad displaying the path tracer output
-        mesh.Draw();
-        
-        //Copy stored memory texture to the input texture of the path tracer
-        glBindTexture(GL_TEXTURE_2D,pathTracer.getInputTexture());
-        glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
-        
-        //Bind back to default framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER,0);
-        glDisable(GL_DEPTH_TEST);
+        //Filter the accumulated image and draw it to the user screen
+        drawDenoisedFrame(denoiser,pathTracer,mesh,denoiseIterations,(int)resolution.x,(int)resolution.y);
+        if(frameBudget > 0.0f) gpuTimer.end();
 
-        display.Clear(0.0f,0.15f,0.3f,1.0f);
+        //Drivers may finish compiling on the first draw, so the startup only ends with the first frame
+        if(isFirstFrame){
+            glFinish();
+            printf("First frame after %.0f ms\n",millisecondsSince(startup));
+            isFirstFrame = false;
+        }
 
-        //Start using denoiser shader and draw the memory texture to the user screen
-        denoiser.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D,pathTracer.getOutputTexture());
-        mesh.Draw();
+        //This frame becomes the input of the next one
+        pathTracer.swapAccumulationTargets();
 
         deltaClock = SDL_GetTicks() - startClock;
         startClock = SDL_GetTicks();
@@ -116,7 +625,8 @@ int main(int argc, char* argv[]){
             camera.updateSpeed(CAMERA_SPEED*deltaClock);
         }
 
-        printf("FPS: %d\n",currentFps);
+        if(frameBudget > 0.0f) printf("FPS: %d at %dx%d\n",currentFps,(int)resolution.x,(int)resolution.y);
+        else printf("FPS: %d\n",currentFps);
 
         display.Update();
     }
@@ -0,0 +1,381 @@
+#include "marcher.h"
+#include "sdf.h"
+#include "sdftemplate.h"
+#include "csginterpreter.h"
+#include <cmath>
+#include <algorithm>
+
+//Distance from the point to an object. Fractals write their orbit trap to orbitTrap unless it is NULL.
+static float evaluateObject(glm::vec3 ray, const Object& object, const Scene& scene, float footprint, glm::vec4* orbitTrap){
+    //Far from a fractal the bound of its brick map stands in for the distance estimate
+    float distanceBound;
+    if(scene.isBrickMapped(object) && scene.getBrickMap().getDistanceBound(ray,object.id,distanceBound)){
+        if(orbitTrap != NULL) *orbitTrap = glm::vec4(ORBIT_TRAP_START);
+        return distanceBound;
+    }
+
+    switch(object.type){
+        case OBJECT_SPHERE:
+            return std::abs(sphereDistance(ray,object.center,object.size/2.0f));
+        case OBJECT_CUBE:
+            return std::abs(cubeDistance(ray,object.center,object.size));
+        case OBJECT_PLANE:
+            return planeDistance(ray,object.center,object.size);
+        case OBJECT_TORUS:
+            return std::abs(torusDistance(ray,object.center,glm::vec2(object.size)));
+        case OBJECT_PRISM:
+            return std::abs(prismDistance(ray,object.center,glm::vec2(object.size)));
+        case OBJECT_PYRAMID:
+            return pyramidDistance(ray,object.center,object.size);
+        case OBJECT_MANDELBULB:
+            return object.size*mandelbulbFractalDistance(ray/object.size,object.center,object.size,orbitTrap,getFractalIterations(footprint/object.size,MANDELBULB_ERROR_SCALE,MANDELBULB_ERROR_RATIO));
+        case OBJECT_WALL:
+            return std::abs(wallDistance(ray,object.center,object.size));
+        case OBJECT_MANDELBOX:
+            return opIntersection(mandelboxFractalDistance(ray,object.center,object.size,orbitTrap,getFractalIterations(footprint,MANDELBOX_ERROR_SCALE,MANDELBOX_ERROR_RATIO)),cubeDistance(ray,object.center,object.size));
+        case OBJECT_ROOM:
+            return opSubtraction(wallDistance(ray,object.center+glm::vec3(0.0f,0.5f,0.0f),object.size/1.5f),wallDistance(ray,object.center,object.size));
+        case OBJECT_CYLINDER:
+            return std::abs(opSubtraction(cylinderDistance(ray,object.center+glm::vec3(0.0f,0.003f,0.0f),object.size),cylinderDistance(ray,object.center,object.size)));
+        case OBJECT_JULIA:
+            return object.size*juliaFractalDistance(ray/object.size,object.center,object.size,orbitTrap,getFractalIterations(footprint/object.size,JULIA_ERROR_SCALE,JULIA_ERROR_RATIO));
+        case OBJECT_CSG:
+            return object.size*evaluateCsgProgram<float>(scene.getCsgProgram(object),(ray - object.center)/object.size,footprint/object.size);
+    }
+    return scene.getMarchSettings().maxDist;
+}
+
+//evaluateObject for the scalars of sdftemplate.h, dual numbers give the gradient of the distance along with it.
+//The brick map is left out, it only stands in for the objects far from their surface.
+template<typename Scalar>
+static Scalar evaluateObjectOf(const Vec3Of<Scalar>& ray, const Object& object, const Scene& scene, float footprint){
+    switch(object.type){
+        case OBJECT_SPHERE:
+            return abs(sphereDistance(ray,object.center,object.size/2.0f));
+        case OBJECT_CUBE:
+            return abs(cubeDistance(ray,object.center,object.size));
+        case OBJECT_PLANE:
+            return planeDistance(ray,object.center,object.size);
+        case OBJECT_TORUS:
+            return abs(torusDistance(ray,object.center,glm::vec2(object.size)));
+        case OBJECT_PRISM:
+            return abs(prismDistance(ray,object.center,glm::vec2(object.size)));
+        case OBJECT_PYRAMID:
+            return pyramidDistance(ray,object.center,object.size);
+        case OBJECT_MANDELBULB:
+            return object.size*mandelbulbFractalDistance(ray/object.size,object.center,object.size,getFractalIterations(footprint/object.size,MANDELBULB_ERROR_SCALE,MANDELBULB_ERROR_RATIO));
+        case OBJECT_WALL:
+            return abs(wallDistance(ray,object.center,object.size));
+        case OBJECT_MANDELBOX:
+            return opIntersection(mandelboxFractalDistance(ray,object.center,object.size,getFractalIterations(footprint,MANDELBOX_ERROR_SCALE,MANDELBOX_ERROR_RATIO)),cubeDistance(ray,object.center,object.size));
+        case OBJECT_ROOM:
+            return opSubtraction(wallDistance(ray,object.center+glm::vec3(0.0f,0.5f,0.0f),object.size/1.5f),wallDistance(ray,object.center,object.size));
+        case OBJECT_CYLINDER:
+            return abs(opSubtraction(cylinderDistance(ray,object.center+glm::vec3(0.0f,0.003f,0.0f),object.size),cylinderDistance(ray,object.center,object.size)));
+        case OBJECT_JULIA:
+            return object.size*juliaFractalDistance(ray/object.size,object.center,object.size,getFractalIterations(footprint/object.size,JULIA_ERROR_SCALE,JULIA_ERROR_RATIO));
+        case OBJECT_CSG:
+            return object.size*evaluateCsgProgram<Scalar>(scene.getCsgProgram(object),(ray - object.center)/object.size,footprint/object.size);
+    }
+    return Scalar(scene.getMarchSettings().maxDist);
+}
+
+float getObjectDistance(glm::vec3 ray, const Object& object, const Scene& scene, float footprint){
+    return evaluateObject(ray,object,scene,footprint,NULL);
+}
+
+SceneCollision getObjectDistanceAsCollision(glm::vec3 ray, const Object& object, const Scene& scene, glm::vec4& orbitTrap, float footprint){
+    return {evaluateObject(ray,object,scene,footprint,&orbitTrap),object.albedo,object.id};
+}
+
+//The value of dual numbers of doubles is the distance evaluated in double precision, their derivatives are left unused
+double getObjectDistanceInDouble(glm::dvec3 ray, const Object& object, const Scene& scene, float footprint){
+    return evaluateObjectOf(toDualPoint(ray.x,ray.y,ray.z),object,scene,footprint).value;
+}
+
+//A node can only be skipped if its bounds are further than the closest distance so far.
+//Points inside the bounds are always evaluated since signed objects return negative distances there.
+static bool isCulled(float boundsDistance, float closestDistance){
+    return boundsDistance > 0.0f && boundsDistance >= closestDistance;
+}
+
+//Hands the objects that may be closer than closestDistance to evaluate, which keeps closestDistance at the distance
+//to the closest object so far. The BVH is walked nearest child first and only the objects of leaves that are not
+//culled are evaluated, without a BVH every object is.
+template<typename Evaluate>
+static void evaluateCandidates(glm::vec3 ray, const Scene& scene, const float& closestDistance, const Evaluate& evaluate){
+    const std::vector<Object>& objects = scene.getObjects();
+    if(scene.getBvh().isEmpty()){
+        for(unsigned int i = 0; i < objects.size(); i++) evaluate(objects[i]);
+        return;
+    }
+
+    const std::vector<BvhNode>& nodes = scene.getBvh().getNodes();
+    const std::vector<int>& objectIndices = scene.getBvh().getObjectIndices();
+
+    const int STACK_SIZE = 64;
+    int nodeStack[STACK_SIZE];
+    float distanceStack[STACK_SIZE];
+    int stackSize = 0;
+
+    nodeStack[stackSize] = 0;
+    distanceStack[stackSize++] = Bvh::boxDistance(ray,nodes[0].boundsMin,nodes[0].boundsMax);
+
+    while(stackSize > 0){
+        stackSize--;
+        if(isCulled(distanceStack[stackSize],closestDistance)) continue;
+        const BvhNode& node = nodes[nodeStack[stackSize]];
+
+        if(node.count > 0.0f){
+            int first = (int)node.leftFirst;
+            for(int i = first; i < first + (int)node.count; i++){
+                evaluate(objects[objectIndices[i]]);
+            }
+        } else {
+            int nearChild = (int)node.leftFirst, farChild = nearChild + 1;
+            float nearDistance = Bvh::boxDistance(ray,nodes[nearChild].boundsMin,nodes[nearChild].boundsMax);
+            float farDistance = Bvh::boxDistance(ray,nodes[farChild].boundsMin,nodes[farChild].boundsMax);
+            if(nearDistance > farDistance){
+                std::swap(nearChild,farChild);
+                std::swap(nearDistance,farDistance);
+            }
+            //The far child goes first on the stack so the near one is popped next
+            nodeStack[stackSize] = farChild;
+            distanceStack[stackSize++] = farDistance;
+            nodeStack[stackSize] = nearChild;
+            distanceStack[stackSize++] = nearDistance;
+        }
+    }
+}
+
+//The orbit trap left in orbitTrap is the one of the closest object
+SceneCollision getClosestSceneObjectAsCollision(glm::vec3 ray, const Scene& scene, glm::vec4& orbitTrap, float footprint){
+    SceneCollision minimumCollision = {scene.getMarchSettings().maxDist,scene.getBackgroundColor(),-1};
+    glm::vec4 closestOrbitTrap = orbitTrap;
+
+    evaluateCandidates(ray,scene,minimumCollision.distance,[&](const Object& object){
+        float distance = evaluateObject(ray,object,scene,footprint,&orbitTrap);
+        if(minimumCollision.distance > distance){
+            minimumCollision = {distance,object.albedo,object.id};
+            closestOrbitTrap = orbitTrap;
+        }
+    });
+
+    orbitTrap = closestOrbitTrap;
+    return minimumCollision;
+}
+
+float getSceneDistance(glm::vec3 ray, const Scene& scene, float footprint){
+    float minimumDistance = scene.getMarchSettings().maxDist;
+
+    evaluateCandidates(ray,scene,minimumDistance,[&](const Object& object){
+        float distance = evaluateObject(ray,object,scene,footprint,NULL);
+        if(minimumDistance > distance) minimumDistance = distance;
+    });
+    return minimumDistance;
+}
+
+/*
+ * Ray marching algorithm.
+ * Returns aprox. distance to the scene from a certain point with a certain direction.
+ * Steps are over-relaxed by the given relaxation (Keinert et al., Enhanced Sphere Tracing).
+ * When the unbounding spheres of two consecutive points do not overlap the relaxed step may have skipped
+ * a surface, the march then steps back and goes on without relaxation. Rays that run out of steps are
+ * judged by their closest approach to the scene instead of by wherever the last step left them.
+ * The scene is evaluated at the footprint of the pixel of the ray, which the ray hits at once it is closer than it.
+ * The steps only take the distance to the scene, the surface is evaluated with its color and orbit trap once it is hit.
+ */
+SceneCollision rayMarchScene(glm::vec3 from, glm::vec3 direction, const Scene& scene, glm::vec4& orbitTrap, int& marchedSteps, float maxLength, float relaxation, float pixelRadius){
+    const MarchSettings& settings = scene.getMarchSettings();
+    float totalDistance = 0.0f;
+    float distance = 0.0f, stepLength = 0.0f, previousDistance = 0.0f;
+    float closestDistance = settings.maxDist, closestTotalDistance = 0.0f;
+    int steps;
+    for(steps = 0; steps < settings.maxMarchingSteps; steps++){
+        distance = getSceneDistance(from + totalDistance * direction,scene,getFootprint(pixelRadius,totalDistance));
+
+        //A relaxed step that ended inside an object crossed its surface as well
+        float radius = std::abs(distance);
+        if(relaxation > 1.0f && stepLength > 0.0f && (radius + previousDistance < stepLength || distance < 0.0f)){
+            totalDistance += previousDistance - stepLength;
+            relaxation = 1.0f;
+            continue;
+        }
+
+        if(distance < closestDistance){
+            closestDistance = distance;
+            closestTotalDistance = totalDistance;
+        }
+        //Past maxLength the ray escapes whatever it is closest to
+        if(distance > settings.maxDist || totalDistance + distance > maxLength){
+            marchedSteps = steps;
+            return {totalDistance + distance,scene.getBackgroundColor(),-1};
+        }
+        if(distance < getHitDistance(pixelRadius,totalDistance,settings.epsilon)){
+            break;
+        }
+
+        stepLength = relaxation * distance;
+        previousDistance = radius;
+        totalDistance += stepLength;
+    }
+    marchedSteps = steps;
+
+    //A ray that ran out of steps hits where it came closest to the scene if that is within a cone of epsilon per
+    //unit of distance or of two footprints, otherwise it crept along a surface it never reaches and escapes
+    if(steps == settings.maxMarchingSteps){
+        if(closestDistance >= std::max(settings.epsilon * (1.0f + closestTotalDistance),2.0f*getFootprint(pixelRadius,closestTotalDistance))){
+            return {std::max(totalDistance,settings.maxDist),scene.getBackgroundColor(),-1};
+        }
+        totalDistance = closestTotalDistance;
+        distance = closestDistance;
+    }
+
+    //The color, id and orbit trap of the surface are only evaluated where the ray hit it
+    SceneCollision surface = getClosestSceneObjectAsCollision(from + totalDistance * direction,scene,orbitTrap,getFootprint(pixelRadius,totalDistance));
+    return {totalDistance + distance,surface.color,surface.objectId};
+}
+
+/*
+ * Occlusion query.
+ * Marches towards a point maxLength away and returns the distance to the first surface in the way, or the distance
+ * past maxLength its last unbounding sphere reached once the way is clear. Only the distance to the scene is
+ * evaluated, at full detail, and the steps are plain sphere tracing steps: a shadow ray returns at its first hit so
+ * a failed relaxed step saves nothing. A ray that runs out of steps is occluded if it came within a cone of epsilon
+ * per unit of distance of the scene.
+ */
+float rayMarchOcclusion(glm::vec3 from, glm::vec3 direction, const Scene& scene, int& marchedSteps, float maxLength){
+    const MarchSettings& settings = scene.getMarchSettings();
+    float totalDistance = 0.0f;
+    float closestDistance = settings.maxDist, closestTotalDistance = 0.0f;
+    int steps;
+    for(steps = 0; steps < settings.maxMarchingSteps; steps++){
+        float distance = getSceneDistance(from + totalDistance * direction,scene);
+        if(distance < closestDistance){
+            closestDistance = distance;
+            closestTotalDistance = totalDistance;
+        }
+        if(totalDistance + distance >= maxLength || distance > settings.maxDist){
+            marchedSteps = steps;
+            return std::max(totalDistance + distance,maxLength);
+        }
+        if(distance < settings.epsilon){
+            marchedSteps = steps;
+            return totalDistance + distance;
+        }
+        totalDistance += distance;
+    }
+    marchedSteps = steps;
+
+    if(closestDistance < settings.epsilon * (1.0f + closestTotalDistance)){
+        return closestTotalDistance + closestDistance;
+    }
+    return std::max(totalDistance,maxLength);
+}
+
+/*
+ * Returns the distance a plain sphere tracing march reaches once it has taken all the steps of the march settings,
+ * for a ray that is clear up to totalDistance after the given steps, or the distance it hits a surface at past that.
+ * The distances to the scene are capped at maxDist, so once the ray is that far from the scene every step left is
+ * maxDist long and only the steps until then are marched.
+ */
+float rayMarchEscape(glm::vec3 from, glm::vec3 direction, const Scene& scene, int& marchedSteps, float totalDistance, int steps){
+    const MarchSettings& settings = scene.getMarchSettings();
+    marchedSteps = 0;
+    for(; steps < settings.maxMarchingSteps; steps++, marchedSteps++){
+        float distance = getSceneDistance(from + totalDistance * direction,scene);
+        if(distance < settings.epsilon){
+            return totalDistance + distance;
+        }
+        if(distance >= settings.maxDist){
+            return totalDistance + (float)(settings.maxMarchingSteps - steps) * settings.maxDist;
+        }
+        totalDistance += distance;
+    }
+    return totalDistance;
+}
+
+/*
+ * Returns an aprox. normal vector a given surface point from central differences of the scene, 6 evaluations.
+ */
+glm::vec3 getCentralDifferenceNormal(glm::vec3 surfacePoint, const Scene& scene, float footprint){
+    //Detail finer than the footprint is left out of the surface, so it is left out of the differences as well
+    const float e = std::max(0.001f,footprint);
+    glm::vec3 normal = glm::vec3(
+        getSceneDistance(surfacePoint+glm::vec3(e,0,0),scene,footprint) - getSceneDistance(surfacePoint-glm::vec3(e,0,0),scene,footprint),
+        getSceneDistance(surfacePoint+glm::vec3(0,e,0),scene,footprint) - getSceneDistance(surfacePoint-glm::vec3(0,e,0),scene,footprint),
+        getSceneDistance(surfacePoint+glm::vec3(0,0,e),scene,footprint) - getSceneDistance(surfacePoint-glm::vec3(0,0,e),scene,footprint)
+    );
+    return glm::normalize(normal);
+}
+
+/*
+ * Returns an aprox. normal vector a given surface point from the differences of the scene at the corners of a
+ * tetrahedron around it, 4 evaluations. Each corner weighs its distance along its own direction, the corners are
+ * as far from the point as the central differences are.
+ */
+glm::vec3 getTetrahedralNormal(glm::vec3 surfacePoint, const Scene& scene, float footprint){
+    const float h = std::max(0.001f,footprint)/std::sqrt(3.0f);
+    const glm::vec3 corners[4] = {glm::vec3(1,-1,-1),glm::vec3(-1,-1,1),glm::vec3(-1,1,-1),glm::vec3(1,1,1)};
+    glm::vec3 normal = glm::vec3(0.0f);
+    for(int i = 0; i < 4; i++){
+        normal += corners[i]*getSceneDistance(surfacePoint+corners[i]*h,scene,footprint);
+    }
+    return glm::normalize(normal);
+}
+
+/*
+ * Returns the normal of an object at a surface point from the gradient of its distance, which a single evaluation of
+ * the object with dual numbers gives in forward mode. It is exact for the distance the object is marched by, at the
+ * detail of the footprint, and the abs of the shells turns it inwards inside of them.
+ */
+glm::vec3 getForwardModeNormal(glm::vec3 surfacePoint, const Object& object, const Scene& scene, float footprint){
+    Dual<float> distance = evaluateObjectOf(toDualPoint(surfacePoint.x,surfacePoint.y,surfacePoint.z),object,scene,footprint);
+    return glm::normalize(glm::vec3(distance.dx,distance.dy,distance.dz));
+}
+
+Vec3Packet getForwardModeNormals(const Vec3Packet& surfacePoints, const Object& object, const Scene& scene, float footprint){
+    Dual<FloatPacket> distance = evaluateObjectOf(toDualPoint(surfacePoints.x,surfacePoints.y,surfacePoints.z),object,scene,footprint);
+    Vec3Packet gradient = Vec3Packet(distance.dx,distance.dy,distance.dz);
+    return gradient/length(gradient);
+}
+
+//The objects wrapped in abs are shells, inside of them the normal faces inwards like the gradient of abs does
+static glm::vec3 getShellNormal(float distance, glm::vec3 gradient){
+    return distance < 0.0f ? -gradient : gradient;
+}
+
+/*
+ * Normal of the surface of an object hit at a surface point. The simple shapes have their gradient in closed form,
+ * the other objects take it in forward mode, which is exact where the differences of the scene blur the detail of the
+ * fractals and takes a single evaluation instead of four or six. The mandelbox keeps the differences a footprint
+ * apart: the exact gradient of its folds below the footprint shades it darker than the path tracer shader does. So do
+ * the shapes with a fractal in them, which the shader takes the differences of as well.
+ */
+glm::vec3 getNormal(glm::vec3 surfacePoint, const Object& object, const Scene& scene, float footprint){
+    switch(object.type){
+        case OBJECT_SPHERE:
+            return getShellNormal(sphereDistance(surfacePoint,object.center,object.size/2.0f),sphereGradient(surfacePoint,object.center));
+        case OBJECT_CUBE:
+            return getShellNormal(cubeDistance(surfacePoint,object.center,object.size),cubeGradient(surfacePoint,object.center,object.size));
+        case OBJECT_PLANE:
+            return planeGradient(surfacePoint,object.center,object.size);
+        case OBJECT_TORUS:
+            return getShellNormal(torusDistance(surfacePoint,object.center,glm::vec2(object.size)),torusGradient(surfacePoint,object.center,glm::vec2(object.size)));
+        case OBJECT_WALL:
+            return getShellNormal(wallDistance(surfacePoint,object.center,object.size),wallGradient(surfacePoint,object.center,object.size));
+        case OBJECT_CYLINDER: {
+            //The inner cylinder is subtracted where it is closer than the outer one
+            glm::vec3 innerCenter = object.center+glm::vec3(0.0f,0.003f,0.0f);
+            float inner = cylinderDistance(surfacePoint,innerCenter,object.size), outer = cylinderDistance(surfacePoint,object.center,object.size);
+            glm::vec3 gradient = -inner > outer ? -cylinderGradient(surfacePoint,innerCenter,object.size) : cylinderGradient(surfacePoint,object.center,object.size);
+            return getShellNormal(opSubtraction(inner,outer),gradient);
+        }
+        case OBJECT_MANDELBOX:
+            return getCentralDifferenceNormal(surfacePoint,scene,footprint);
+        case OBJECT_CSG:
+            if(scene.getShape(object.shape).hasFractal) return getCentralDifferenceNormal(surfacePoint,scene,footprint);
+            break;
+    }
+    return getForwardModeNormal(surfacePoint,object,scene,footprint);
+}
@@ -0,0 +1,63 @@
+#ifndef MARCHER_H
+#define MARCHER_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "simd.h"
+
+//Scalar scene evaluation and ray marching, the CPU counterpart of the functions with
+//the same name in shaders/pathTracer.fs. Fractal objects write their orbit trap into orbitTrap, far from
+//their surface the brick map of the scene bounds them instead and the orbit trap is left at its start value.
+//The footprint is the part of a pixel the evaluated point stands for, fractals take fewer iterations the wider it is.
+//A footprint of 0 evaluates the scene at full detail.
+
+//Share of the radius of a pixel that rays hit within and that fractals are detailed to. The shading depends on
+//detail below the pixel too, on the normals and on the crevices that occlude the bounces, at a quarter of the
+//radius the images stay as they were at full detail.
+const float FOOTPRINT_PER_PIXEL = 0.25f;
+
+//Footprint of a pixel at a distance along a ray, its pixel is pixelRadius wide per unit of distance from the origin
+//of the ray. Bounce rays start a cone of their own, the surface they leave is seen at full detail.
+inline float getFootprint(float pixelRadius, float distance){
+    return FOOTPRINT_PER_PIXEL*pixelRadius*distance;
+}
+//Distance to the scene a ray hits at, epsilon near its origin and the footprint of its pixel further away
+inline float getHitDistance(float pixelRadius, float distance, float epsilon){
+    return glm::max(epsilon,getFootprint(pixelRadius,distance));
+}
+
+//Radius of a pixel at a unit of distance from the camera, one pixel is tan(fov/2)/height wide there
+inline float getPixelRadius(float fov, int height){
+    return 0.5f*std::tan(glm::radians(fov)/2.0f)/(float)height;
+}
+
+//The distances alone, without the color, id and orbit trap of the object, are what the marches step by
+float getObjectDistance(glm::vec3 ray, const Object& object, const Scene& scene, float footprint = 0.0f);
+//The same distance evaluated in double precision, the reference the accuracy of the normals is measured against
+double getObjectDistanceInDouble(glm::dvec3 ray, const Object& object, const Scene& scene, float footprint = 0.0f);
+float getSceneDistance(glm::vec3 ray, const Scene& scene, float footprint = 0.0f);
+//The distance with the color, id and orbit trap of the object, for the surface a ray hit
+SceneCollision getObjectDistanceAsCollision(glm::vec3 ray, const Object& object, const Scene& scene, glm::vec4& orbitTrap, float footprint = 0.0f);
+SceneCollision getClosestSceneObjectAsCollision(glm::vec3 ray, const Scene& scene, glm::vec4& orbitTrap, float footprint = 0.0f);
+//Returns the total distance marched and the object hit, or -1 if the ray escaped. A ray escapes once it is more than
+//maxDist away from the scene or once it marched maxLength. Camera and bounce rays are maxDist long and take the
+//relaxation of the march settings, a relaxation of 1 marches plain sphere tracing steps. A ray hits once it is
+//within its hit distance, rays with a pixel radius of 0 hit within epsilon and see the fractals at full detail.
+SceneCollision rayMarchScene(glm::vec3 from, glm::vec3 direction, const Scene& scene, glm::vec4& orbitTrap, int& marchedSteps, float maxLength, float relaxation, float pixelRadius);
+//Returns the distance to the first surface between from and the point maxLength away along direction, or a distance
+//past maxLength if nothing is in the way. Shadow rays are marched with it, they stop at their light and at their first hit.
+float rayMarchOcclusion(glm::vec3 from, glm::vec3 direction, const Scene& scene, int& marchedSteps, float maxLength);
+//Returns the distance a ray that is clear up to totalDistance after the given steps reaches once it took all of its
+//steps. The shadow rays of the path tracer always did, the light they reach is attenuated by that distance.
+float rayMarchEscape(glm::vec3 from, glm::vec3 direction, const Scene& scene, int& marchedSteps, float totalDistance, int steps);
+//The differences are taken a footprint apart, at least 0.001
+glm::vec3 getCentralDifferenceNormal(glm::vec3 surfacePoint, const Scene& scene, float footprint = 0.0f);
+glm::vec3 getTetrahedralNormal(glm::vec3 surfacePoint, const Scene& scene, float footprint = 0.0f);
+//Normal of an object from the gradient of its distance in forward mode, for a point or for a packet of points on it
+glm::vec3 getForwardModeNormal(glm::vec3 surfacePoint, const Object& object, const Scene& scene, float footprint = 0.0f);
+Vec3Packet getForwardModeNormals(const Vec3Packet& surfacePoints, const Object& object, const Scene& scene, float footprint = 0.0f);
+//Normal of the object a ray hit, in closed form for the simple shapes and in forward mode otherwise
+glm::vec3 getNormal(glm::vec3 surfacePoint, const Object& object, const Scene& scene, float footprint = 0.0f);
+
+#endif // MARCHER_H
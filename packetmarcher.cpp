@@ -0,0 +1,239 @@
+#include "packetmarcher.h"
+#include "sdfpacket.h"
+#include "marcher.h"
+#include "csginterpreter.h"
+#include <algorithm>
+#include <limits>
+
+//Evaluates an object type without a vectorized distance function one lane at a time
+static FloatPacket getObjectDistanceByLane(const Vec3Packet& ray, const Object& object, const Scene& scene, PacketMask active, float footprint){
+    float x[PACKET_WIDTH], y[PACKET_WIDTH], z[PACKET_WIDTH], distance[PACKET_WIDTH];
+    ray.x.store(x);
+    ray.y.store(y);
+    ray.z.store(z);
+
+    for(int i = 0; i < PACKET_WIDTH; i++){
+        if(active.lane(i)){
+            distance[i] = getObjectDistance(glm::vec3(x[i],y[i],z[i]),object,scene,footprint);
+        } else {
+            distance[i] = scene.getMarchSettings().maxDist;
+        }
+    }
+    return FloatPacket::load(distance);
+}
+
+//Lanes far from a fractal take the bound of its brick map, the others are -1
+static FloatPacket getDistanceBounds(const Vec3Packet& ray, const Object& object, const Scene& scene){
+    float x[PACKET_WIDTH], y[PACKET_WIDTH], z[PACKET_WIDTH], bound[PACKET_WIDTH];
+    ray.x.store(x);
+    ray.y.store(y);
+    ray.z.store(z);
+    for(int i = 0; i < PACKET_WIDTH; i++){
+        if(!scene.getBrickMap().getDistanceBound(glm::vec3(x[i],y[i],z[i]),object.id,bound[i])) bound[i] = -1.0f;
+    }
+    return FloatPacket::load(bound);
+}
+
+static FloatPacket getObjectDistance(const Vec3Packet& ray, const Object& object, const Scene& scene, PacketMask active, float footprint){
+    switch(object.type){
+        case OBJECT_SPHERE:
+            return abs(sphereDistance(ray,object.center,object.size/2.0f));
+        case OBJECT_CUBE:
+            return abs(cubeDistance(ray,object.center,object.size));
+        case OBJECT_PLANE:
+            return planeDistance(ray,object.center,object.size);
+        case OBJECT_TORUS:
+            return abs(torusDistance(ray,object.center,glm::vec2(object.size)));
+        case OBJECT_PRISM:
+            return abs(prismDistance(ray,object.center,glm::vec2(object.size)));
+        case OBJECT_PYRAMID:
+            return pyramidDistance(ray,object.center,object.size);
+        case OBJECT_MANDELBULB: {
+            int iterations = getFractalIterations(footprint/object.size,MANDELBULB_ERROR_SCALE,MANDELBULB_ERROR_RATIO);
+            if(scene.getBrickMap().isEmpty())
+                return FloatPacket(object.size)*mandelbulbFractalDistance(ray/FloatPacket(object.size),object.center,object.size,NULL,iterations);
+            //The distance estimate only runs when a lane is near the surface
+            FloatPacket bound = getDistanceBounds(ray,object,scene);
+            PacketMask isBounded = bound > FloatPacket(0.0f);
+            if(!(active & !isBounded).any()) return bound;
+            return select(isBounded,bound,FloatPacket(object.size)*mandelbulbFractalDistance(ray/FloatPacket(object.size),object.center,object.size,NULL,iterations));
+        }
+        case OBJECT_WALL:
+            return abs(wallDistance(ray,object.center,object.size));
+        case OBJECT_ROOM:
+            return max(-wallDistance(ray,object.center+glm::vec3(0.0f,0.5f,0.0f),object.size/1.5f),wallDistance(ray,object.center,object.size));
+        case OBJECT_CYLINDER:
+            return abs(max(-cylinderDistance(ray,object.center+glm::vec3(0.0f,0.003f,0.0f),object.size),cylinderDistance(ray,object.center,object.size)));
+        case OBJECT_CSG: {
+            const Vec3Of<FloatPacket> point = (Vec3Of<FloatPacket>(ray.x,ray.y,ray.z) - object.center)/object.size;
+            if(!scene.isBrickMapped(object) || scene.getBrickMap().isEmpty())
+                return FloatPacket(object.size)*evaluateCsgProgram<FloatPacket>(scene.getCsgProgram(object),point,footprint/object.size);
+            FloatPacket bound = getDistanceBounds(ray,object,scene);
+            PacketMask isBounded = bound > FloatPacket(0.0f);
+            if(!(active & !isBounded).any()) return bound;
+            return select(isBounded,bound,FloatPacket(object.size)*evaluateCsgProgram<FloatPacket>(scene.getCsgProgram(object),point,footprint/object.size));
+        }
+    }
+    return getObjectDistanceByLane(ray,object,scene,active,footprint);
+}
+
+//Distance from every lane to a box, 0 inside of it
+static FloatPacket boundsDistance(const Vec3Packet& ray, glm::vec3 boundsMin, glm::vec3 boundsMax){
+    const FloatPacket zero = FloatPacket(0.0f);
+    FloatPacket x = max(max(FloatPacket(boundsMin.x) - ray.x,ray.x - FloatPacket(boundsMax.x)),zero);
+    FloatPacket y = max(max(FloatPacket(boundsMin.y) - ray.y,ray.y - FloatPacket(boundsMax.y)),zero);
+    FloatPacket z = max(max(FloatPacket(boundsMin.z) - ray.z,ray.z - FloatPacket(boundsMax.z)),zero);
+    return sqrt(x*x + y*y + z*z);
+}
+
+//A node is skipped only when no active lane can find anything closer inside of it
+static bool isCulled(FloatPacket distance, FloatPacket minimumDistance, PacketMask active){
+    PacketMask isNeeded = (distance <= FloatPacket(0.0f)) | (distance < minimumDistance);
+    return !(active & isNeeded).any();
+}
+
+static float sumLanes(FloatPacket value){
+    float lanes[PACKET_WIDTH];
+    value.store(lanes);
+    float sum = 0.0f;
+    for(int i = 0; i < PACKET_WIDTH; i++) sum += lanes[i];
+    return sum;
+}
+
+static float minimumActiveLane(FloatPacket value, PacketMask active){
+    float lanes[PACKET_WIDTH];
+    value.store(lanes);
+    float minimum = std::numeric_limits<float>::infinity();
+    for(int i = 0; i < PACKET_WIDTH; i++){
+        if(active.lane(i)) minimum = std::min(minimum,lanes[i]);
+    }
+    return minimum;
+}
+
+static void updateClosest(const Vec3Packet& ray, const Object& object, const Scene& scene, PacketMask active, float footprint, FloatPacket& minimumDistance, FloatPacket& objectId){
+    FloatPacket distance = getObjectDistance(ray,object,scene,active,footprint);
+    PacketMask isCloser = distance < minimumDistance;
+    minimumDistance = select(isCloser,distance,minimumDistance);
+    objectId = select(isCloser,FloatPacket((float)object.id),objectId);
+}
+
+//Same traversal as the scalar marcher, the packet goes down every node any of its active lanes needs
+static FloatPacket getClosestSceneObjectDistanceInBvh(const Vec3Packet& ray, const Scene& scene, PacketMask active, FloatPacket& objectId, float footprint){
+    const std::vector<Object>& objects = scene.getObjects();
+    const std::vector<BvhNode>& nodes = scene.getBvh().getNodes();
+    const std::vector<int>& objectIndices = scene.getBvh().getObjectIndices();
+
+    FloatPacket minimumDistance = FloatPacket(scene.getMarchSettings().maxDist);
+    objectId = FloatPacket(-1.0f);
+
+    const int STACK_SIZE = 64;
+    int nodeStack[STACK_SIZE];
+    FloatPacket distanceStack[STACK_SIZE];
+    int stackSize = 0;
+
+    nodeStack[stackSize] = 0;
+    distanceStack[stackSize++] = boundsDistance(ray,nodes[0].boundsMin,nodes[0].boundsMax);
+
+    while(stackSize > 0){
+        stackSize--;
+        if(isCulled(distanceStack[stackSize],minimumDistance,active)) continue;
+        const BvhNode& node = nodes[nodeStack[stackSize]];
+
+        if(node.count > 0.0f){
+            int first = (int)node.leftFirst;
+            for(int i = first; i < first + (int)node.count; i++)
+                updateClosest(ray,objects[objectIndices[i]],scene,active,footprint,minimumDistance,objectId);
+        } else {
+            int nearChild = (int)node.leftFirst, farChild = nearChild + 1;
+            FloatPacket nearDistance = boundsDistance(ray,nodes[nearChild].boundsMin,nodes[nearChild].boundsMax);
+            FloatPacket farDistance = boundsDistance(ray,nodes[farChild].boundsMin,nodes[farChild].boundsMax);
+            if(sumLanes(nearDistance) > sumLanes(farDistance)){
+                std::swap(nearChild,farChild);
+                std::swap(nearDistance,farDistance);
+            }
+            nodeStack[stackSize] = farChild;
+            distanceStack[stackSize++] = farDistance;
+            nodeStack[stackSize] = nearChild;
+            distanceStack[stackSize++] = nearDistance;
+        }
+    }
+    return minimumDistance;
+}
+
+FloatPacket getClosestSceneObjectDistance(const Vec3Packet& ray, const Scene& scene, PacketMask active, FloatPacket& objectId, float footprint){
+    if(!scene.getBvh().isEmpty())
+        return getClosestSceneObjectDistanceInBvh(ray,scene,active,objectId,footprint);
+
+    const std::vector<Object>& objects = scene.getObjects();
+
+    FloatPacket minimumDistance = FloatPacket(scene.getMarchSettings().maxDist);
+    objectId = FloatPacket(-1.0f);
+
+    for(unsigned int i = 0; i < objects.size(); i++)
+        updateClosest(ray,objects[i],scene,active,footprint,minimumDistance,objectId);
+    return minimumDistance;
+}
+
+PacketCollision rayMarchScenePacket(const Vec3Packet& from, const Vec3Packet& direction, const Scene& scene, PacketMask active, float pixelRadius){
+    const MarchSettings& settings = scene.getMarchSettings();
+    const FloatPacket maxDist = FloatPacket(settings.maxDist);
+    const FloatPacket epsilon = FloatPacket(settings.epsilon);
+    const FloatPacket footprintPerDistance = FloatPacket(FOOTPRINT_PER_PIXEL*pixelRadius);
+    const FloatPacket one = FloatPacket(1.0f);
+    const FloatPacket zero = FloatPacket(0.0f);
+
+    PacketCollision collision;
+    collision.distance = zero;
+    collision.objectId = FloatPacket(-1.0f);
+    collision.lastDistance = zero;
+    collision.steps = zero;
+
+    //Every lane relaxes its steps until its first failed step, as rayMarchScene does
+    FloatPacket relaxation = FloatPacket(settings.relaxation);
+    FloatPacket totalDistance = zero, stepLength = zero, previousDistance = zero;
+    FloatPacket closestDistance = maxDist, closestTotalDistance = zero, closestObjectId = FloatPacket(-1.0f);
+
+    for(int step = 0; step < settings.maxMarchingSteps && active.any(); step++){
+        Vec3Packet ray = from + direction * totalDistance;
+
+        //The scene is evaluated at the detail of the lane with the smallest footprint, every lane hits at its own
+        FloatPacket footprint = footprintPerDistance * totalDistance;
+        FloatPacket objectId;
+        FloatPacket distance = getClosestSceneObjectDistance(ray,scene,active,objectId,minimumActiveLane(footprint,active));
+
+        FloatPacket unbounding = abs(distance);
+        PacketMask isFailed = active & (relaxation > one) & (stepLength > zero) & ((unbounding + previousDistance < stepLength) | (distance < zero));
+        totalDistance = select(isFailed,totalDistance + previousDistance - stepLength,totalDistance);
+        relaxation = select(isFailed,one,relaxation);
+        PacketMask isStepped = active & !isFailed;
+
+        PacketMask isCloser = isStepped & (distance < closestDistance);
+        closestDistance = select(isCloser,distance,closestDistance);
+        closestTotalDistance = select(isCloser,totalDistance,closestTotalDistance);
+        closestObjectId = select(isCloser,objectId,closestObjectId);
+
+        //Finished lanes keep the values of the step they stopped at
+        //Camera rays are maxDist long
+        PacketMask isEscaped = isStepped & (totalDistance + distance > maxDist);
+        PacketMask isDone = isEscaped | (isStepped & (distance < max(epsilon,footprint)));
+        collision.lastDistance = select(isDone,totalDistance,collision.lastDistance);
+        collision.distance = select(isDone,totalDistance + distance,collision.distance);
+        collision.objectId = select(isEscaped,FloatPacket(-1.0f),select(isDone,objectId,collision.objectId));
+
+        PacketMask isMoving = isStepped & !isDone;
+        stepLength = select(isMoving,relaxation * distance,stepLength);
+        previousDistance = select(isMoving,unbounding,previousDistance);
+        totalDistance = select(isMoving,totalDistance + stepLength,totalDistance);
+
+        active = active & !isDone;
+        collision.steps = collision.steps + select(active,one,zero);
+    }
+
+    //Lanes that ran out of steps hit at their closest approach to the scene if it is close enough, see rayMarchScene
+    PacketMask isNear = closestDistance < max(epsilon * (one + closestTotalDistance),FloatPacket(2.0f) * footprintPerDistance * closestTotalDistance);
+    PacketMask isHit = active & isNear, isLost = active & !isNear;
+    collision.lastDistance = select(isHit,closestTotalDistance,select(isLost,totalDistance,collision.lastDistance));
+    collision.distance = select(isHit,closestTotalDistance + closestDistance,select(isLost,max(totalDistance,maxDist),collision.distance));
+    collision.objectId = select(isHit,closestObjectId,select(isLost,FloatPacket(-1.0f),collision.objectId));
+    return collision;
+}
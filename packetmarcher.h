@@ -0,0 +1,24 @@
+#ifndef PACKETMARCHER_H
+#define PACKETMARCHER_H
+
+#include "scene.h"
+#include "simd.h"
+
+//Result of marching PACKET_WIDTH rays at once, one value per lane
+struct PacketCollision {
+    FloatPacket distance; //total distance marched
+    FloatPacket objectId; //object hit, -1 if the ray escaped
+    FloatPacket lastDistance; //distance along the ray where the scene was evaluated last
+    FloatPacket steps; //marching steps taken
+};
+
+//Distance to the closest object for every lane, the id of that object is written to objectId.
+//Only lanes in the active mask are guaranteed to be evaluated. Fractals are evaluated at the detail of the footprint.
+FloatPacket getClosestSceneObjectDistance(const Vec3Packet& ray, const Scene& scene, PacketMask active, FloatPacket& objectId, float footprint = 0.0f);
+
+//Marches a packet of rays through the scene with the over-relaxed steps of rayMarchScene. Lanes are masked off
+//as soon as they hit a surface, escape the scene or run out of steps, and the march ends once every lane is done.
+//The rays hit within the footprint of their pixel of the given radius, see getHitDistance in marcher.h.
+PacketCollision rayMarchScenePacket(const Vec3Packet& from, const Vec3Packet& direction, const Scene& scene, PacketMask active, float pixelRadius);
+
+#endif // PACKETMARCHER_H
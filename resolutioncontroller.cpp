@@ -0,0 +1,54 @@
+#include "resolutioncontroller.h"
+#include <cmath>
+#include <glm/glm.hpp>
+
+static const float MIN_SCALE = 0.25f;
+static const float SCALE_STEP = 1.0f/32.0f; //Scales are rounded to steps so the sizes repeat
+static const float UPPER_BAND = 1.05f; //Relative to the budget
+static const float LOWER_BAND = 0.8f;
+static const float SMOOTHING = 0.3f; //Weight of the newest frame in the moving average
+
+ResolutionController::ResolutionController(int maxWidth, int maxHeight, float budgetMilliseconds){
+    m_maxWidth = maxWidth;
+    m_maxHeight = maxHeight;
+    m_width = maxWidth;
+    m_height = maxHeight;
+    m_scale = 1.0f;
+    m_budget = budgetMilliseconds;
+    m_millisecondsPerPixel = 0.0f;
+    m_framesOverBudget = 0;
+    m_framesUnderBudget = 0;
+}
+
+bool ResolutionController::addFrameTime(float milliseconds, int pixels){
+    if(pixels <= 0) return false;
+    float millisecondsPerPixel = milliseconds/pixels;
+    m_millisecondsPerPixel = m_millisecondsPerPixel == 0.0f ? millisecondsPerPixel : glm::mix(m_millisecondsPerPixel,millisecondsPerPixel,SMOOTHING);
+
+    //Single frames decide whether the frame time left the band, the average decides how far to go
+    float frameTime = millisecondsPerPixel*m_width*m_height;
+    if(frameTime > m_budget*UPPER_BAND){
+        m_framesOverBudget++;
+        m_framesUnderBudget = 0;
+    } else if(frameTime < m_budget*LOWER_BAND){
+        m_framesUnderBudget++;
+        m_framesOverBudget = 0;
+    } else {
+        m_framesOverBudget = 0;
+        m_framesUnderBudget = 0;
+    }
+    if(m_framesOverBudget < FRAMES_OVER_BUDGET && m_framesUnderBudget < FRAMES_UNDER_BUDGET) return false;
+    m_framesOverBudget = 0;
+    m_framesUnderBudget = 0;
+
+    //The frame time grows with the amount of pixels, the square of the scale
+    float pixelBudget = m_budget/m_millisecondsPerPixel;
+    float scale = std::sqrt(pixelBudget/((float)m_maxWidth*m_maxHeight));
+    scale = glm::clamp(std::floor(scale/SCALE_STEP)*SCALE_STEP,MIN_SCALE,1.0f);
+    if(scale == m_scale) return false;
+
+    m_scale = scale;
+    m_width = glm::max((int)std::round(m_maxWidth*scale),1);
+    m_height = glm::max((int)std::round(m_maxHeight*scale),1);
+    return true;
+}
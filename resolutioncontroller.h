@@ -0,0 +1,37 @@
+#ifndef RESOLUTIONCONTROLLER_H
+#define RESOLUTIONCONTROLLER_H
+
+//Picks the internal render resolution that holds the frame time within a budget, the image is upscaled to the window.
+//Frame times are measured per pixel, so timings of frames rendered before a change still tell the cost at the new size.
+//The resolution only changes once the frame time stayed out of a band around the budget for a few frames in a row,
+//so noise in the timings does not make it flicker between two sizes.
+class ResolutionController {
+    public:
+        ResolutionController(int maxWidth, int maxHeight, float budgetMilliseconds);
+        //Adds the time a frame of the given amount of pixels took, from a GPU timer query or a CPU clock.
+        //Returns true when the render resolution changed.
+        bool addFrameTime(float milliseconds, int pixels);
+        int getWidth(){
+            return m_width;
+        }
+        int getHeight(){
+            return m_height;
+        }
+        //Render width relative to the maximum width
+        float getScale(){
+            return m_scale;
+        }
+    private:
+        static const int FRAMES_OVER_BUDGET = 2; //Frames over the band before the resolution drops
+        static const int FRAMES_UNDER_BUDGET = 8; //Frames under the band before it rises, slower since a rise costs a restart
+
+        int m_maxWidth, m_maxHeight;
+        int m_width, m_height;
+        float m_scale;
+        float m_budget;
+        float m_millisecondsPerPixel; //Exponential moving average
+        int m_framesOverBudget;
+        int m_framesUnderBudget;
+};
+
+#endif // RESOLUTIONCONTROLLER_H
@@ -0,0 +1,110 @@
+#include "sampler.h"
+#include <cstdint>
+#include <iostream>
+
+/*
+ * Integer hash with a good avalanche, the same as hashInteger in the path tracer shader.
+ */
+static uint32_t hashInteger(uint32_t x){
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t reverseBits(uint32_t x){
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+/*
+ * Hash whose every bit only depends on the bits below it, Laine and Karras' variant tuned by Burley.
+ */
+static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed){
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+/*
+ * Owen scrambling: every bit is flipped depending on the bits above it, which keeps the stratification of the points.
+ */
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed){
+    return reverseBits(laineKarrasPermutation(reverseBits(x),seed));
+}
+
+/*
+ * First two dimensions of the Sobol sequence as 32 bit fractions.
+ */
+static uint32_t sobol(uint32_t index, int dimension){
+    if(dimension == 0) return reverseBits(index);
+
+    uint32_t result = 0;
+    for(uint32_t direction = 0x80000000u; index != 0; index >>= 1, direction ^= direction >> 1){
+        if(index & 1) result ^= direction;
+    }
+    return result;
+}
+
+static float toUnitFloat(uint32_t x){
+    //24 bits, the most a float below 1 keeps
+    return (x >> 8) * (1.0f/16777216.0f);
+}
+
+Sampler::Sampler(const std::string& blueNoiseFile){
+    //The shuffle is an Owen scramble of the index, which maps every power of two sized block of the sequence to
+    //another one, so the first 2^n points of a shuffled sequence still are a stratified set
+    m_sequences.resize(SEQUENCE_COUNT*SEQUENCE_LENGTH);
+    for(int sequence = 0; sequence < SEQUENCE_COUNT; sequence++){
+        uint32_t shuffleSeed = hashInteger(3*sequence + 1);
+        uint32_t seedX = hashInteger(3*sequence + 2);
+        uint32_t seedY = hashInteger(3*sequence + 3);
+        for(int i = 0; i < SEQUENCE_LENGTH; i++){
+            uint32_t index = nestedUniformScramble(i,shuffleSeed) % SEQUENCE_LENGTH;
+            m_sequences[sequence*SEQUENCE_LENGTH + i] = glm::vec2(toUnitFloat(nestedUniformScramble(sobol(index,0),seedX)),
+                                                                  toUnitFloat(nestedUniformScramble(sobol(index,1),seedY)));
+        }
+    }
+
+    std::vector<float> mask;
+    int channels;
+    m_isMaskLoaded = loadBlueNoise(blueNoiseFile,mask,m_maskSize,m_maskDepth,channels);
+    if(m_isMaskLoaded && channels < 2){
+        std::cerr << "Blue noise " << blueNoiseFile << " has one channel, two are needed" << std::endl;
+        m_isMaskLoaded = false;
+    }
+    if(!m_isMaskLoaded){
+        //A mask this small takes a fraction of a second on one thread
+        ThreadPool threadPool(1);
+        m_maskSize = MASK_SIZE;
+        m_maskDepth = 1;
+        channels = 2;
+        generateBlueNoise(MASK_SIZE,1,channels,1,threadPool,mask);
+    }
+
+    m_mask.resize((size_t)m_maskSize*m_maskSize*m_maskDepth);
+    for(unsigned int i = 0; i < m_mask.size(); i++)
+        m_mask[i] = glm::vec2(mask[i*channels],mask[i*channels + 1]);
+}
+
+glm::vec2 Sampler::getSample(int x, int y, int sampleIndex, int bounce, int seed) const {
+    glm::vec2 point = m_sequences[(bounce % SEQUENCE_COUNT)*SEQUENCE_LENGTH + sampleIndex % SEQUENCE_LENGTH];
+
+    //Consecutive accumulations take consecutive slices at the same offset. Every bounce, cycle through the
+    //slices and pass over the sequence reads the mask at another offset
+    uint32_t size = m_maskSize;
+    uint32_t slice = (uint32_t)seed % m_maskDepth;
+    uint32_t offset = hashInteger((uint32_t)seed/m_maskDepth*0x9e3779b9u ^ (uint32_t)bounce*0x85ebca6bu ^ (uint32_t)(sampleIndex/SEQUENCE_LENGTH)*0xc2b2ae35u);
+    uint32_t maskX = ((uint32_t)x + offset % size) % size;
+    uint32_t maskY = ((uint32_t)y + offset / size % size) % size;
+    return glm::fract(point + m_mask[(slice*size + maskY)*size + maskX]);
+}
@@ -0,0 +1,54 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "bluenoise.h"
+
+//Low discrepancy samples shared by the path tracer shader and the CPU renderer. Every bounce of a path takes its
+//2D sample from its own copy of an Owen scrambled Sobol sequence, each copy scrambled and shuffled with another seed
+//so the bounces are decorrelated. The pixels rotate the points by a blue noise mask (a Cranley-Patterson rotation)
+//read at an offset that depends on the bounce and the seed of the accumulation, so neighbouring pixels take
+//different points of the sequence and what error remains is spread as blue noise. With a spatiotemporal mask
+//consecutive accumulations take consecutive slices of it, so the error of every pixel is blue noise in time as well.
+class Sampler {
+    public:
+        static const int SEQUENCE_LENGTH = 4096; //Longer accumulations repeat the points at another rotation
+        static const int SEQUENCE_COUNT = 8; //Bounces past it reuse the sequences at another rotation
+        static const int MASK_SIZE = 64; //Of the mask generated when there is no file
+
+        //Generates the sequences and loads the mask from the file, made by tools/bluenoise.cpp. Without the file
+        //a 2D mask is generated, the same one on every run. The first two channels of the mask are used.
+        Sampler(const std::string& blueNoiseFile = BLUE_NOISE_FILE);
+        //Sample of a bounce of a pixel, the same one getSample in the path tracer shader returns. The sample index
+        //counts the paths of the pixel since the accumulation restarted and the seed counts the restarts.
+        glm::vec2 getSample(int x, int y, int sampleIndex, int bounce, int seed) const;
+        //SEQUENCE_COUNT rows of SEQUENCE_LENGTH points
+        const std::vector<glm::vec2>& getSequences() const {
+            return m_sequences;
+        }
+        //Slices of square rows of rotations, x and y come from two independent masks
+        const std::vector<glm::vec2>& getMask() const {
+            return m_mask;
+        }
+        //Pixels per side of a slice of the mask
+        int getMaskSize() const {
+            return m_maskSize;
+        }
+        int getMaskDepth() const {
+            return m_maskDepth;
+        }
+        //Whether the mask came from the file
+        bool isMaskLoaded() const {
+            return m_isMaskLoaded;
+        }
+    private:
+        std::vector<glm::vec2> m_sequences;
+        std::vector<glm::vec2> m_mask;
+        int m_maskSize;
+        int m_maskDepth;
+        bool m_isMaskLoaded;
+};
+
+#endif // SAMPLER_H
@@ -0,0 +1,315 @@
+#include "scene.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+const char* const Scene::objectTypeNames[NUM_OBJECT_TYPES] = {
+    "sphere","cube","plane","torus","prism","pyramid","mandelbulb","wall","mandelbox","room","cylinder","julia","csg"
+};
+
+const char* const Scene::surfaceTypeNames[3] = {"diffuse","specular","refractive"};
+
+Scene::Scene(){
+    m_lightSource = glm::vec3(5.0f,10.0f,40.0f);
+    m_lightColor = glm::vec3(0.977f,0.836f,0.645f);
+    m_backgroundColor = glm::vec3(0.792f,0.882f,1.0f);
+    m_fogColor = glm::vec3(1.0f,1.0f,1.0f);
+
+    addObject(glm::vec3(0.0f,-2.0f,0.0f),2.0f,OBJECT_CUBE,glm::vec3(1.2f,1.2f,1.2f),0.0f,SURFACE_DIFFUSE);
+    addObject(glm::vec3(0.0f,0.5f,0.0f),1.75f,OBJECT_MANDELBOX,glm::vec3(0.0f,0.0f,0.0f),0.4f,SURFACE_SPECULAR);
+
+    buildBvh();
+}
+
+void Scene::clear(){
+    m_objects.clear();
+    m_shapes.clear();
+    m_csgCode.clear();
+    m_bvh.clear();
+    m_brickMap.clear();
+}
+
+void Scene::buildBvh(){
+    m_bvh.build(*this);
+}
+
+void Scene::buildBrickMap(ThreadPool& threadPool){
+    //The samples are the exact distances, so the map is built while the scene has none
+    m_brickMap.clear();
+    BrickMap brickMap;
+    brickMap.build(*this,threadPool);
+    m_brickMap = brickMap;
+}
+
+//Adds an object to the scene and returns its id
+int Scene::addObject(glm::vec3 center, float size, int type, glm::vec3 albedo, float emission, int surfaceType, int shape){
+    Object object;
+    object.center = center;
+    object.size = size;
+    object.type = type;
+    object.albedo = albedo;
+    object.emission = emission;
+    object.surfaceType = surfaceType;
+    object.id = (int)m_objects.size();
+    object.shape = shape;
+    m_objects.push_back(object);
+    m_brickMap.clear();
+    return object.id;
+}
+
+int Scene::addShape(const std::string& name, const std::string& expression, std::string& error){
+    CsgShape shape;
+    if(!compileCsgShape(name,expression,m_shapes,m_csgCode,shape,error)) return -1;
+    m_shapes.push_back(shape);
+    return (int)m_shapes.size() - 1;
+}
+
+int Scene::findShape(const std::string& name) const {
+    for(int i = (int)m_shapes.size() - 1; i >= 0; i--){
+        if(m_shapes[i].name == name) return i;
+    }
+    return -1;
+}
+
+void Scene::setLight(glm::vec3 position, glm::vec3 color){
+    m_lightSource = position;
+    m_lightColor = color;
+}
+
+void Scene::setBackgroundColor(glm::vec3 color){
+    m_backgroundColor = color;
+}
+
+void Scene::setFogColor(glm::vec3 color){
+    m_fogColor = color;
+}
+
+void Scene::setMarchSettings(const MarchSettings& settings){
+    m_marchSettings = settings;
+}
+
+//Material of an object as written in a scene file
+struct SceneMaterial {
+    glm::vec3 albedo;
+    float emission;
+    int surfaceType;
+};
+
+//Reads the whitespace separated tokens of a single line of a scene file
+class SceneLineReader {
+    public:
+        SceneLineReader(const char* line, const char* end) : m_current(line), m_end(end) {}
+
+        bool readWord(std::string& word){
+            skipSpaces();
+            const char* start = m_current;
+            while(m_current < m_end && !isSpace(*m_current)) m_current++;
+            word.assign(start,m_current);
+            return !word.empty();
+        }
+        bool readFloat(float& value){
+            skipSpaces();
+            if(m_current >= m_end) return false;
+            char* parsedEnd;
+            value = strtof(m_current,&parsedEnd);
+            if(parsedEnd == m_current || parsedEnd > m_end) return false;
+            m_current = parsedEnd;
+            return true;
+        }
+        bool readInt(int& value){
+            float number;
+            if(!readFloat(number) || number != (float)(int)number) return false;
+            value = (int)number;
+            return true;
+        }
+        bool readVec3(glm::vec3& value){
+            return readFloat(value.x) && readFloat(value.y) && readFloat(value.z);
+        }
+        //True if the next token is a number, without consuming it
+        bool isNumberNext(){
+            skipSpaces();
+            if(m_current >= m_end) return false;
+            char* parsedEnd;
+            strtof(m_current,&parsedEnd);
+            return parsedEnd != m_current;
+        }
+        bool isAtEnd(){
+            skipSpaces();
+            return m_current >= m_end;
+        }
+        void readRest(std::string& rest){
+            skipSpaces();
+            rest.assign(m_current,m_end);
+            m_current = m_end;
+        }
+    private:
+        static bool isSpace(char c){
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+        void skipSpaces(){
+            while(m_current < m_end && isSpace(*m_current)) m_current++;
+        }
+
+        const char* m_current;
+        const char* m_end;
+};
+
+//Moves line to the start of the next line and returns the end of the statement on this one, where its comment starts
+static const char* readLine(const char*& line, const char* textEnd){
+    const char* lineEnd = (const char*)memchr(line,'\n',textEnd - line);
+    if(lineEnd == NULL) lineEnd = textEnd;
+    const char* comment = (const char*)memchr(line,'#',lineEnd - line);
+    line = lineEnd + 1;
+    return comment != NULL ? comment : lineEnd;
+}
+
+//Parentheses opened and not closed yet
+static int getOpenParentheses(const std::string& text){
+    int open = 0;
+    for(unsigned int i = 0; i < text.size(); i++){
+        if(text[i] == '(') open++;
+        else if(text[i] == ')') open--;
+    }
+    return open;
+}
+
+static int findName(const char* const names[], int count, const std::string& name){
+    for(int i = 0; i < count; i++){
+        if(name == names[i]) return i;
+    }
+    return -1;
+}
+
+static bool readMaterial(SceneLineReader& reader, SceneMaterial& material){
+    std::string surfaceName;
+    if(!reader.readVec3(material.albedo) || !reader.readFloat(material.emission) || !reader.readWord(surfaceName)) return false;
+    material.surfaceType = findName(Scene::surfaceTypeNames,3,surfaceName);
+    return material.surfaceType != -1;
+}
+
+/*
+ * Parses a scene file. Every line holds one statement, # starts a comment. Shape expressions go on over the lines
+ * after them until their parentheses are closed:
+ *   light x y z r g b
+ *   background r g b
+ *   fog r g b
+ *   maxMarchingSteps n | maxDist d | epsilon e | relaxation r | maxMarchDepth n | refractionIndex i
+ *   material name r g b emission surface
+ *   shape name expression
+ *   object type x y z size (r g b emission surface | material name)
+ *   object csg shape x y z size (r g b emission surface | material name)
+ */
+bool Scene::loadFromFile(const std::string& fileName){
+    std::ifstream file(fileName.c_str(),std::ios::in | std::ios::binary);
+    if(!file.is_open()){
+        std::cerr << "Unable to open scene: " << fileName << std::endl;
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const std::string text = contents.str();
+
+    Scene scene;
+    scene.clear();
+    std::map<std::string,SceneMaterial> materials;
+
+    std::string keyword, name;
+    int lineNumber = 0;
+    const char* line = text.c_str();
+    const char* textEnd = line + text.size();
+
+    while(line < textEnd){
+        const char* statement = line;
+        SceneLineReader reader(statement,readLine(line,textEnd));
+        lineNumber++;
+
+        if(!reader.readWord(keyword)) continue;
+
+        bool isValid = true;
+        glm::vec3 position, color;
+        MarchSettings& settings = scene.m_marchSettings;
+
+        if(keyword == "object"){
+            int type, shape = -1;
+            float size;
+            SceneMaterial material;
+            isValid = reader.readWord(name) && (type = findName(objectTypeNames,NUM_OBJECT_TYPES,name)) != -1;
+            if(isValid && type == OBJECT_CSG){
+                isValid = reader.readWord(name);
+                if(isValid && (shape = scene.findShape(name)) == -1){
+                    std::cerr << fileName << ":" << lineNumber << ": unknown shape " << name << std::endl;
+                    return false;
+                }
+            }
+            isValid = isValid && reader.readVec3(position) && reader.readFloat(size);
+            if(isValid && reader.isNumberNext()){
+                isValid = readMaterial(reader,material);
+            } else if(isValid && reader.readWord(name)){
+                std::map<std::string,SceneMaterial>::const_iterator found = materials.find(name);
+                if(found == materials.end()){
+                    std::cerr << fileName << ":" << lineNumber << ": unknown material " << name << std::endl;
+                    return false;
+                }
+                material = found->second;
+            } else {
+                isValid = false;
+            }
+            if(isValid) scene.addObject(position,size,type,material.albedo,material.emission,material.surfaceType,shape);
+        } else if(keyword == "shape"){
+            std::string expression, error;
+            int statementLine = lineNumber;
+            isValid = reader.readWord(name) && !reader.isAtEnd();
+            reader.readRest(expression);
+            while(isValid && getOpenParentheses(expression) > 0 && line < textEnd){
+                statement = line;
+                const char* statementEnd = readLine(line,textEnd);
+                expression += "\n" + std::string(statement,statementEnd);
+                lineNumber++;
+            }
+            if(isValid && scene.addShape(name,expression,error) == -1){
+                std::cerr << fileName << ":" << statementLine << ": invalid shape " << name << ", " << error << std::endl;
+                return false;
+            }
+        } else if(keyword == "material"){
+            SceneMaterial material;
+            isValid = reader.readWord(name) && readMaterial(reader,material);
+            if(isValid) materials[name] = material;
+        } else if(keyword == "light"){
+            isValid = reader.readVec3(position) && reader.readVec3(color);
+            if(isValid) scene.setLight(position,color);
+        } else if(keyword == "background"){
+            isValid = reader.readVec3(color);
+            if(isValid) scene.setBackgroundColor(color);
+        } else if(keyword == "fog"){
+            isValid = reader.readVec3(color);
+            if(isValid) scene.setFogColor(color);
+        } else if(keyword == "maxMarchingSteps"){
+            isValid = reader.readInt(settings.maxMarchingSteps) && settings.maxMarchingSteps > 0;
+        } else if(keyword == "maxDist"){
+            isValid = reader.readFloat(settings.maxDist) && settings.maxDist > 0.0f;
+        } else if(keyword == "epsilon"){
+            isValid = reader.readFloat(settings.epsilon) && settings.epsilon > 0.0f;
+        } else if(keyword == "relaxation"){
+            isValid = reader.readFloat(settings.relaxation) && settings.relaxation >= 1.0f && settings.relaxation < 2.0f;
+        } else if(keyword == "maxMarchDepth"){
+            isValid = reader.readInt(settings.maxMarchDepth) && settings.maxMarchDepth > 0;
+        } else if(keyword == "refractionIndex"){
+            isValid = reader.readFloat(settings.refractionIndex) && settings.refractionIndex > 0.0f;
+        } else {
+            std::cerr << fileName << ":" << lineNumber << ": unknown statement " << keyword << std::endl;
+            return false;
+        }
+
+        if(!isValid || !reader.isAtEnd()){
+            std::cerr << fileName << ":" << lineNumber << ": invalid " << keyword << " statement" << std::endl;
+            return false;
+        }
+    }
+
+    scene.buildBvh();
+    *this = scene;
+    return true;
+}
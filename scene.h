@@ -0,0 +1,148 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "bvh.h"
+#include "brickmap.h"
+#include "csg.h"
+
+//Object types, the values must match the type ids used by the path tracer shader
+enum ObjectType {
+    OBJECT_SPHERE = 0,
+    OBJECT_CUBE = 1,
+    OBJECT_PLANE = 2,
+    OBJECT_TORUS = 3,
+    OBJECT_PRISM = 4,
+    OBJECT_PYRAMID = 5,
+    OBJECT_MANDELBULB = 6,
+    OBJECT_WALL = 7,
+    OBJECT_MANDELBOX = 8,
+    OBJECT_ROOM = 9,
+    OBJECT_CYLINDER = 10,
+    OBJECT_JULIA = 11,
+    OBJECT_CSG = 12, //instance of a shape of the scene, see csg.h
+    NUM_OBJECT_TYPES
+};
+
+//Surface types, the values must match the surface ids used by the path tracer shader
+enum SurfaceType {
+    SURFACE_DIFFUSE = 0,
+    SURFACE_SPECULAR = 1,
+    SURFACE_REFRACTIVE = 2
+};
+
+//Represents an object, same layout as the Object struct of the path tracer shader
+struct Object {
+    glm::vec3 center;
+    float size;
+    int type;
+    glm::vec3 albedo; //color of the object
+    float emission; //if non 0 it is a light source (roughness for specular objects)
+    int surfaceType;
+    int id; //object id, equal to its index in the scene
+    int shape; //shape of csg objects, -1 for the other types
+};
+
+struct SceneCollision {
+    float distance;
+    glm::vec3 color;
+    int objectId;
+};
+
+//Ray marching and path marching constants
+struct MarchSettings {
+    int maxMarchingSteps = 128;
+    float maxDist = 100.0f; //length of the rays
+    float epsilon = 0.001f;
+    float relaxation = 1.2f; //over-relaxation of the sphere tracing steps, 1 disables it
+    int maxMarchDepth = 4; //bounces
+    float refractionIndex = 1.33f;
+};
+
+class Scene {
+    public:
+        //Creates the default scene, which is the same one the path tracer shader has hard-coded
+        Scene();
+        //Replaces the scene with the one described in a scene file, see scenes/default.scene for the format.
+        //On a syntax error the error is reported with its line number, the scene is left untouched and false is returned.
+        bool loadFromFile(const std::string& fileName);
+        void clear();
+        //Objects added after the last buildBvh call are not seen by the BVH until it is rebuilt
+        int addObject(glm::vec3 center, float size, int type, glm::vec3 albedo, float emission, int surfaceType, int shape = -1);
+        //Compiles a shape expression and returns its id for the csg objects, or -1 with the syntax error in error.
+        //Expressions can refer to the shapes added before them by name.
+        int addShape(const std::string& name, const std::string& expression, std::string& error);
+        //Last shape added with a name, -1 if there is none
+        int findShape(const std::string& name) const;
+        const CsgShape& getShape(int id) const {
+            return m_shapes[id];
+        }
+        //Instructions of the programs of every shape, uploaded as they are to the shader
+        const std::vector<glm::vec4>& getCsgCode() const {
+            return m_csgCode;
+        }
+        const glm::vec4* getCsgProgram(const Object& object) const {
+            return &m_csgCode[m_shapes[object.shape].program];
+        }
+        const std::vector<Object>& getObjects() const {
+            return m_objects;
+        }
+        const Object& getObject(int id) const {
+            return m_objects[id];
+        }
+        int getObjectCount() const {
+            return (int)m_objects.size();
+        }
+        glm::vec3 getLightSource() const {
+            return m_lightSource;
+        }
+        glm::vec3 getLightColor() const {
+            return m_lightColor;
+        }
+        glm::vec3 getBackgroundColor() const {
+            return m_backgroundColor;
+        }
+        glm::vec3 getFogColor() const {
+            return m_fogColor;
+        }
+        const MarchSettings& getMarchSettings() const {
+            return m_marchSettings;
+        }
+        const Bvh& getBvh() const {
+            return m_bvh;
+        }
+        void buildBvh();
+        const BrickMap& getBrickMap() const {
+            return m_brickMap;
+        }
+        //Bakes the fractals into a brick map, which the marchers bound the fractals with far from their surface.
+        //Scenes have none until it is built, it is dropped when the objects change.
+        void buildBrickMap(ThreadPool& threadPool);
+        void setLight(glm::vec3 position, glm::vec3 color);
+        void setBackgroundColor(glm::vec3 color);
+        void setFogColor(glm::vec3 color);
+        void setMarchSettings(const MarchSettings& settings);
+        static bool isFractal(int type){
+            return type == OBJECT_MANDELBULB || type == OBJECT_MANDELBOX || type == OBJECT_JULIA;
+        }
+        //The fractals and the csg objects with a fractal in their shape are bounded by the brick map
+        bool isBrickMapped(const Object& object) const {
+            return isFractal(object.type) || (object.type == OBJECT_CSG && m_shapes[object.shape].hasFractal);
+        }
+        //Names used by scene files, indexed by type
+        static const char* const objectTypeNames[NUM_OBJECT_TYPES];
+        static const char* const surfaceTypeNames[3];
+    private:
+        std::vector<Object> m_objects;
+        std::vector<CsgShape> m_shapes;
+        std::vector<glm::vec4> m_csgCode;
+        glm::vec3 m_lightSource, m_lightColor;
+        glm::vec3 m_backgroundColor, m_fogColor;
+        MarchSettings m_marchSettings;
+        Bvh m_bvh;
+        BrickMap m_brickMap;
+};
+
+#endif // SCENE_H
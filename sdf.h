@@ -0,0 +1,294 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+//CPU version of the signed distance function library of shaders/pathTracer.fs.
+//Every function mirrors its GLSL counterpart so both backends render the same scene.
+
+//Orbit traps start at MAX_DIST, just like the shader does
+const float ORBIT_TRAP_START = 100.0f;
+const int COLOR_ITERATIONS = 5;
+//Iterations of the fractals at full detail, far away they take fewer, see getFractalIterations
+const int FRACTAL_ITERATIONS = 10;
+//The orbit trap is taken over the first iterations, so the color of a fractal never depends on its detail
+const int MIN_FRACTAL_ITERATIONS = COLOR_ITERATIONS;
+
+//Near the surface the distance estimate after n iterations is within errorScale*errorRatio^-n of the one at full
+//detail, measured for every fractal in units of its distance estimate
+const float MANDELBULB_ERROR_SCALE = 1.0f, MANDELBULB_ERROR_RATIO = 3.5f;
+const float MANDELBOX_ERROR_SCALE = 2.2f, MANDELBOX_ERROR_RATIO = 2.7f;
+const float JULIA_ERROR_SCALE = 0.19f, JULIA_ERROR_RATIO = 1.44f;
+
+inline float sdfSign(float value){
+    return (float)((value > 0.0f) - (value < 0.0f));
+}
+
+//SDF operations
+
+inline float opUnion(float d1, float d2){ return glm::min(d1,d2); }
+
+inline float opSubtraction(float d1, float d2){ return glm::max(-d1,d2); }
+
+inline float opIntersection(float d1, float d2){ return glm::max(d1,d2); }
+
+//Smooth operations blend the surfaces where both distances are within k of each other, with a polynomial that bends
+//the union in by at most k/4 (Quilez). Like in the shader the mix is written out as d2*(1 - h) + d1*h.
+
+inline float opSmoothUnion(float d1, float d2, float k){
+    float h = glm::clamp(0.5f + 0.5f*(d2-d1)/k,0.0f,1.0f);
+    return d2*(1.0f-h) + d1*h - k*h*(1.0f-h);
+}
+
+inline float opSmoothSubtraction(float d1, float d2, float k){
+    float h = glm::clamp(0.5f - 0.5f*(d2+d1)/k,0.0f,1.0f);
+    return d2*(1.0f-h) - d1*h + k*h*(1.0f-h);
+}
+
+inline float opSmoothIntersection(float d1, float d2, float k){
+    float h = glm::clamp(0.5f - 0.5f*(d2-d1)/k,0.0f,1.0f);
+    return d2*(1.0f-h) + d1*h + k*h*(1.0f-h);
+}
+
+//Simple shapes
+
+inline float boxDistance(glm::vec3 currentPoint, glm::vec3 center, glm::vec3 halfSize){
+    glm::vec3 q = glm::abs(currentPoint-center) - halfSize;
+    return glm::length(glm::max(q,0.0f)) + glm::min(glm::max(q.x,glm::max(q.y,q.z)),0.0f);
+}
+
+//Gradients of the simple shapes, the unit normal of the surface closest to the point. Outside of a box it points
+//away from the closest point of the box, inside of it along the axis of the closest face.
+inline glm::vec3 boxGradient(glm::vec3 currentPoint, glm::vec3 center, glm::vec3 halfSize){
+    glm::vec3 offset = currentPoint-center;
+    glm::vec3 q = glm::abs(offset) - halfSize;
+    glm::vec3 gradient;
+    if(glm::max(q.x,glm::max(q.y,q.z)) > 0.0f){
+        gradient = glm::normalize(glm::max(q,0.0f));
+    } else if(q.x > q.y && q.x > q.z){
+        gradient = glm::vec3(1.0f,0.0f,0.0f);
+    } else {
+        gradient = q.y > q.z ? glm::vec3(0.0f,1.0f,0.0f) : glm::vec3(0.0f,0.0f,1.0f);
+    }
+    return gradient*glm::vec3(sdfSign(offset.x),sdfSign(offset.y),sdfSign(offset.z));
+}
+
+inline glm::vec3 sphereGradient(glm::vec3 currentPoint, glm::vec3 center){
+    return glm::normalize(currentPoint-center);
+}
+
+inline float sphereDistance(glm::vec3 currentPoint, glm::vec3 center, float radius){
+    return glm::length(currentPoint-center) - radius;
+}
+
+inline float cubeDistance(glm::vec3 currentPoint, glm::vec3 center, float sideLength){
+    return boxDistance(currentPoint,center,glm::vec3(sideLength));
+}
+
+inline glm::vec3 cubeGradient(glm::vec3 currentPoint, glm::vec3 center, float sideLength){
+    return boxGradient(currentPoint,center,glm::vec3(sideLength));
+}
+
+inline float wallDistance(glm::vec3 currentPoint, glm::vec3 center, float sideLength){
+    return boxDistance(currentPoint,center,glm::vec3(sideLength,sideLength,0.1f));
+}
+
+inline glm::vec3 wallGradient(glm::vec3 currentPoint, glm::vec3 center, float sideLength){
+    return boxGradient(currentPoint,center,glm::vec3(sideLength,sideLength,0.1f));
+}
+
+inline float planeDistance(glm::vec3 currentPoint, glm::vec3 center, float size){
+    return boxDistance(currentPoint,center,glm::vec3(size,0.01f,size));
+}
+
+inline glm::vec3 planeGradient(glm::vec3 currentPoint, glm::vec3 center, float size){
+    return boxGradient(currentPoint,center,glm::vec3(size,0.01f,size));
+}
+
+inline float torusDistance(glm::vec3 currentPoint, glm::vec3 center, glm::vec2 size){
+    currentPoint = currentPoint - center;
+    glm::vec2 q = glm::vec2(glm::length(glm::vec2(currentPoint.x,currentPoint.z))-size.x,currentPoint.y);
+    return glm::length(q)-size.y/2.0f;
+}
+
+//Away from the closest point of the ring through the middle of the torus
+inline glm::vec3 torusGradient(glm::vec3 currentPoint, glm::vec3 center, glm::vec2 size){
+    currentPoint = currentPoint - center;
+    glm::vec2 radial = glm::vec2(currentPoint.x,currentPoint.z);
+    glm::vec2 ring = glm::normalize(radial)*size.x;
+    return glm::normalize(currentPoint - glm::vec3(ring.x,0.0f,ring.y));
+}
+
+inline float prismDistance(glm::vec3 currentPoint, glm::vec3 center, glm::vec2 size){
+    currentPoint = currentPoint - center;
+    const float k = std::sqrt(3.0f);
+    size.x *= 0.5f*k;
+    currentPoint.x /= size.x;
+    currentPoint.y /= size.x;
+    currentPoint.x = std::abs(currentPoint.x) - 1.0f;
+    currentPoint.y = currentPoint.y + 1.0f/k;
+    if(currentPoint.x+k*currentPoint.y > 0.0f){
+        glm::vec2 folded = glm::vec2(currentPoint.x-k*currentPoint.y,-k*currentPoint.x-currentPoint.y)/2.0f;
+        currentPoint.x = folded.x;
+        currentPoint.y = folded.y;
+    }
+    currentPoint.x -= glm::clamp(currentPoint.x,-2.0f,0.0f);
+    float d1 = glm::length(glm::vec2(currentPoint.x,currentPoint.y))*sdfSign(-currentPoint.y)*size.x;
+    float d2 = std::abs(currentPoint.z)-size.y;
+    return glm::length(glm::max(glm::vec2(d1,d2),0.0f)) + glm::min(glm::max(d1,d2),0.0f);
+}
+
+inline float pyramidDistance(glm::vec3 currentPoint, glm::vec3 center, float size){
+    currentPoint = currentPoint - center;
+    float m2 = size*size + 0.25f;
+
+    currentPoint.x = std::abs(currentPoint.x);
+    currentPoint.z = std::abs(currentPoint.z);
+    if(currentPoint.z > currentPoint.x){
+        float swap = currentPoint.x;
+        currentPoint.x = currentPoint.z;
+        currentPoint.z = swap;
+    }
+    currentPoint.x -= 0.5f;
+    currentPoint.z -= 0.5f;
+
+    glm::vec3 q = glm::vec3(currentPoint.z, size*currentPoint.y - 0.5f*currentPoint.x, size*currentPoint.x + 0.5f*currentPoint.y);
+
+    float s = glm::max(-q.x,0.0f);
+    float t = glm::clamp((q.y-0.5f*currentPoint.z)/(m2+0.25f),0.0f,1.0f);
+
+    float a = m2*(q.x+s)*(q.x+s) + q.y*q.y;
+    float b = m2*(q.x+0.5f*t)*(q.x+0.5f*t) + (q.y-m2*t)*(q.y-m2*t);
+
+    float d2 = glm::min(q.y,-q.x*m2-q.y*0.5f) > 0.0f ? 0.0f : glm::min(a,b);
+
+    return std::sqrt((d2+q.z*q.z)/m2) * sdfSign(glm::max(q.z,-currentPoint.y));
+}
+
+inline float cylinderDistance(glm::vec3 currentPoint, glm::vec3 center, float size){
+    float height = size;
+    float radius = size/2.0f;
+    currentPoint = currentPoint - center;
+    glm::vec2 d = glm::abs(glm::vec2(glm::length(glm::vec2(currentPoint.x,currentPoint.z)),currentPoint.y)) - glm::vec2(radius,height);
+    return glm::min(glm::max(d.x,d.y),0.0f) + glm::length(glm::max(d,0.0f));
+}
+
+//The gradient of the box distance in the plane through the axis and the point, turned around the axis
+inline glm::vec3 cylinderGradient(glm::vec3 currentPoint, glm::vec3 center, float size){
+    currentPoint = currentPoint - center;
+    glm::vec2 radial = glm::normalize(glm::vec2(currentPoint.x,currentPoint.z));
+    glm::vec2 d = glm::abs(glm::vec2(glm::length(glm::vec2(currentPoint.x,currentPoint.z)),currentPoint.y)) - glm::vec2(size/2.0f,size);
+    glm::vec2 gradient;
+    if(glm::max(d.x,d.y) > 0.0f){
+        gradient = glm::normalize(glm::max(d,0.0f));
+    } else {
+        gradient = d.x > d.y ? glm::vec2(1.0f,0.0f) : glm::vec2(0.0f,1.0f);
+    }
+    return glm::vec3(gradient.x*radial.x,gradient.y*sdfSign(currentPoint.y),gradient.x*radial.y);
+}
+
+/*
+ * Fewest iterations whose error stays below a tenth of the footprint of a pixel. The normals are differences
+ * about a footprint apart, an error close to it would already turn them. A footprint of 0 asks for full detail.
+ */
+inline int getFractalIterations(float footprint, float errorScale, float errorRatio){
+    if(footprint <= 0.0f) return FRACTAL_ITERATIONS;
+    int iterations = (int)std::ceil(std::log(errorScale/(0.1f*footprint))/std::log(errorRatio));
+    return glm::clamp(iterations,MIN_FRACTAL_ITERATIONS,FRACTAL_ITERATIONS);
+}
+
+//Fractals, each one writes its orbit trap which is used to color the fractal surface. The orbit trap is only
+//computed when one is passed in, the march steps by the distance alone.
+//Fewer iterations give a smoother surface that stays within the distance estimate of the full one.
+
+inline float juliaFractalDistance(glm::vec3 currentPoint, glm::vec3 center, float size, glm::vec4* orbitTrap = NULL, int iterations = FRACTAL_ITERATIONS){
+    currentPoint = currentPoint - center;
+    if(orbitTrap != NULL) *orbitTrap = glm::vec4(ORBIT_TRAP_START);
+    const float BAILOUT = 10.0f;
+    glm::vec4 p = glm::vec4(currentPoint,0.0f);
+    glm::vec4 dp = glm::vec4(1.0f,0.0f,0.0f,0.0f);
+    for(int i = 0; i < iterations; i++){
+        glm::vec3 pyzw = glm::vec3(p.y,p.z,p.w);
+        glm::vec3 dpyzw = glm::vec3(dp.y,dp.z,dp.w);
+        glm::vec3 dpImaginary = p.x*dpyzw + dp.x*pyzw + glm::cross(pyzw,dpyzw);
+        dp = 2.0f*glm::vec4(p.x*dp.x-glm::dot(pyzw,dpyzw),dpImaginary);
+        p = glm::vec4(p.x*p.x-glm::dot(pyzw,pyzw),2.0f*p.x*pyzw) - 0.38f;
+        float p2 = glm::dot(p,p);
+        if(orbitTrap != NULL && i < COLOR_ITERATIONS) *orbitTrap = glm::min(*orbitTrap,glm::abs(glm::vec4(p.x,p.y,p.z,p2)));
+        if(p2 > BAILOUT) break;
+    }
+    float r = glm::length(p);
+    return 0.5f * r * std::log(r) / glm::length(dp);
+}
+
+inline float mandelboxFractalDistance(glm::vec3 currentPoint, glm::vec3 center, float size, glm::vec4* orbitTrap = NULL, int iterations = FRACTAL_ITERATIONS){
+    currentPoint = currentPoint - center;
+    const float SCALE = 2.7f;
+    const float MR2 = 0.1f;
+
+    if(orbitTrap != NULL) *orbitTrap = glm::vec4(ORBIT_TRAP_START);
+
+    glm::vec4 scalevec = glm::vec4(SCALE,SCALE,SCALE,std::abs(SCALE)) / MR2;
+    float C1 = std::abs(SCALE-1.0f), C2 = std::pow(std::abs(SCALE),(float)(1-iterations));
+
+    //Distance estimate
+    glm::vec4 p = glm::vec4(currentPoint,1.0f), p0 = glm::vec4(currentPoint,1.0f);
+
+    for(int i = 0; i < iterations; i++){
+        glm::vec3 xyz = glm::vec3(p);
+        xyz = glm::clamp(xyz,-1.0f,1.0f) * 2.0f - xyz; //box fold
+        p = glm::vec4(xyz,p.w);
+        float r2 = glm::dot(xyz,xyz);
+        if(orbitTrap != NULL && i < COLOR_ITERATIONS) *orbitTrap = glm::min(*orbitTrap,glm::abs(glm::vec4(xyz,r2)));
+        p *= glm::clamp(glm::max(MR2/r2,MR2),0.0f,1.0f); //sphere fold
+        p = p*scalevec + p0;
+    }
+    return ((glm::length(glm::vec3(p)) - C1) / p.w) - C2;
+}
+
+//Power 8 mandelbulb iteration in triplex algebra, the polar angle and the azimuth are rotated
+//by expanding (z + i*rho)^8 and (x + i*y)^8 instead of going through acos, atan, sin and cos
+inline float mandelbulbFractalDistance(glm::vec3 currentPoint, glm::vec3 center, float size, glm::vec4* orbitTrap = NULL, int iterations = FRACTAL_ITERATIONS){
+    currentPoint = currentPoint - center;
+    const float BAILOUT = 10.0f;
+
+    if(orbitTrap != NULL) *orbitTrap = glm::vec4(ORBIT_TRAP_START);
+
+    glm::vec3 z = currentPoint;
+    float dr = 1.0f;
+    float r = 0.0f;
+    for(int i = 0; i < iterations; i++){
+        float r2 = glm::dot(z,z);
+        r = std::sqrt(r2);
+
+        if(r > BAILOUT) break;
+
+        dr = r2*r2*r2*r*8.0f*dr + 1.0f;
+
+        //Azimuth: (x + i*y)^8 on the unit circle gives cos(8*phi) and sin(8*phi)
+        float rho2 = z.x*z.x + z.y*z.y;
+        float rho = std::sqrt(rho2);
+        float ax = rho2 > 0.0f ? z.x/rho : 0.0f;
+        float ay = rho2 > 0.0f ? z.y/rho : 0.0f;
+        float ax2 = ax*ax, ay2 = ay*ay;
+        float cos8Phi = ax2*ax2*ax2*ax2 - 28.0f*ax2*ax2*ax2*ay2 + 70.0f*ax2*ax2*ay2*ay2 - 28.0f*ax2*ay2*ay2*ay2 + ay2*ay2*ay2*ay2;
+        float sin8Phi = 8.0f*ax*ay*(ax2-ay2)*(ax2*ax2 - 6.0f*ax2*ay2 + ay2*ay2);
+
+        //Polar angle: (z + i*rho)^8 gives r^8*cos(8*theta) and r^8*sin(8*theta)
+        float z2 = z.z*z.z;
+        float z4 = z2*z2;
+        float rho4 = rho2*rho2;
+        float zr8Cos = z4*z4 - 28.0f*z4*z2*rho2 + 70.0f*z4*rho4 - 28.0f*z2*rho4*rho2 + rho4*rho4;
+        float zr8Sin = 8.0f*z.z*rho*(z4*z2 - 7.0f*z4*rho2 + 7.0f*z2*rho4 - rho4*rho2);
+
+        z = glm::vec3(zr8Sin*cos8Phi,zr8Sin*sin8Phi,zr8Cos);
+
+        z += currentPoint;
+
+        if(orbitTrap != NULL && i < COLOR_ITERATIONS) *orbitTrap = glm::min(*orbitTrap,glm::abs(glm::vec4(z.x,z.y,z.z,r2)));
+    }
+    return 0.5f*std::log(r)*r/dr;
+}
+
+#endif // SDF_H
@@ -0,0 +1,160 @@
+#ifndef SDFPACKET_H
+#define SDFPACKET_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include "simd.h"
+#include "sdf.h"
+
+//Vectorized versions of the simple shapes of sdf.h. Each function evaluates
+//PACKET_WIDTH points at once and mirrors its scalar counterpart lane by lane.
+
+inline Vec3Packet toPacket(glm::vec3 value){
+    return Vec3Packet(FloatPacket(value.x),FloatPacket(value.y),FloatPacket(value.z));
+}
+
+inline FloatPacket boxDistance(const Vec3Packet& currentPoint, glm::vec3 center, glm::vec3 halfSize){
+    FloatPacket qx = abs(currentPoint.x - FloatPacket(center.x)) - FloatPacket(halfSize.x);
+    FloatPacket qy = abs(currentPoint.y - FloatPacket(center.y)) - FloatPacket(halfSize.y);
+    FloatPacket qz = abs(currentPoint.z - FloatPacket(center.z)) - FloatPacket(halfSize.z);
+    FloatPacket zero = FloatPacket(0.0f);
+    FloatPacket outside = length(Vec3Packet(max(qx,zero),max(qy,zero),max(qz,zero)));
+    return outside + min(max(qx,max(qy,qz)),zero);
+}
+
+inline FloatPacket sphereDistance(const Vec3Packet& currentPoint, glm::vec3 center, float radius){
+    return length(currentPoint - toPacket(center)) - FloatPacket(radius);
+}
+
+inline FloatPacket cubeDistance(const Vec3Packet& currentPoint, glm::vec3 center, float sideLength){
+    return boxDistance(currentPoint,center,glm::vec3(sideLength));
+}
+
+inline FloatPacket wallDistance(const Vec3Packet& currentPoint, glm::vec3 center, float sideLength){
+    return boxDistance(currentPoint,center,glm::vec3(sideLength,sideLength,0.1f));
+}
+
+inline FloatPacket planeDistance(const Vec3Packet& currentPoint, glm::vec3 center, float size){
+    return boxDistance(currentPoint,center,glm::vec3(size,0.01f,size));
+}
+
+inline FloatPacket torusDistance(const Vec3Packet& currentPoint, glm::vec3 center, glm::vec2 size){
+    Vec3Packet p = currentPoint - toPacket(center);
+    FloatPacket qx = sqrt(p.x*p.x + p.z*p.z) - FloatPacket(size.x);
+    return sqrt(qx*qx + p.y*p.y) - FloatPacket(size.y/2.0f);
+}
+
+inline FloatPacket prismDistance(const Vec3Packet& currentPoint, glm::vec3 center, glm::vec2 size){
+    Vec3Packet p = currentPoint - toPacket(center);
+    const float k = std::sqrt(3.0f);
+    FloatPacket scale = FloatPacket(size.x*0.5f*k);
+    FloatPacket px = abs(p.x/scale) - FloatPacket(1.0f);
+    FloatPacket py = p.y/scale + FloatPacket(1.0f/k);
+    PacketMask isFolded = px + FloatPacket(k)*py > FloatPacket(0.0f);
+    FloatPacket foldedX = (px - FloatPacket(k)*py) * FloatPacket(0.5f);
+    FloatPacket foldedY = (-FloatPacket(k)*px - py) * FloatPacket(0.5f);
+    px = select(isFolded,foldedX,px);
+    py = select(isFolded,foldedY,py);
+    px = px - clamp(px,FloatPacket(-2.0f),FloatPacket(0.0f));
+    FloatPacket d1 = sqrt(px*px + py*py)*sign(-py)*scale;
+    FloatPacket d2 = abs(p.z) - FloatPacket(size.y);
+    FloatPacket zero = FloatPacket(0.0f);
+    FloatPacket o1 = max(d1,zero), o2 = max(d2,zero);
+    return sqrt(o1*o1 + o2*o2) + min(max(d1,d2),zero);
+}
+
+inline FloatPacket pyramidDistance(const Vec3Packet& currentPoint, glm::vec3 center, float size){
+    Vec3Packet p = currentPoint - toPacket(center);
+    FloatPacket h = FloatPacket(size);
+    FloatPacket m2 = FloatPacket(size*size + 0.25f);
+    FloatPacket half = FloatPacket(0.5f);
+    FloatPacket zero = FloatPacket(0.0f);
+
+    FloatPacket ax = abs(p.x), az = abs(p.z);
+    PacketMask isSwapped = az > ax;
+    FloatPacket px = select(isSwapped,az,ax) - half;
+    FloatPacket pz = select(isSwapped,ax,az) - half;
+    FloatPacket py = p.y;
+
+    FloatPacket qx = pz;
+    FloatPacket qy = h*py - half*px;
+    FloatPacket qz = h*px + half*py;
+
+    FloatPacket s = max(-qx,zero);
+    FloatPacket t = clamp((qy - half*pz)/(m2 + FloatPacket(0.25f)),zero,FloatPacket(1.0f));
+
+    FloatPacket a = m2*(qx+s)*(qx+s) + qy*qy;
+    FloatPacket ta = qx + half*t, tb = qy - m2*t;
+    FloatPacket b = m2*ta*ta + tb*tb;
+
+    FloatPacket d2 = select(min(qy,-qx*m2 - qy*half) > zero,zero,min(a,b));
+
+    return sqrt((d2 + qz*qz)/m2) * sign(max(qz,-py));
+}
+
+inline FloatPacket cylinderDistance(const Vec3Packet& currentPoint, glm::vec3 center, float size){
+    Vec3Packet p = currentPoint - toPacket(center);
+    FloatPacket dx = abs(sqrt(p.x*p.x + p.z*p.z)) - FloatPacket(size/2.0f);
+    FloatPacket dy = abs(p.y) - FloatPacket(size);
+    FloatPacket zero = FloatPacket(0.0f);
+    FloatPacket ox = max(dx,zero), oy = max(dy,zero);
+    return min(max(dx,dy),zero) + sqrt(ox*ox + oy*oy);
+}
+
+//Vectorized triplex mandelbulb, lanes that pass the bailout radius stop iterating while the rest continue.
+//The orbit trap is only computed when a four packet array is passed in.
+inline FloatPacket mandelbulbFractalDistance(const Vec3Packet& currentPoint, glm::vec3 center, float size, FloatPacket* orbitTrap = NULL, int iterations = FRACTAL_ITERATIONS){
+    const Vec3Packet c = currentPoint - toPacket(center);
+    const FloatPacket BAILOUT = FloatPacket(10.0f);
+    const FloatPacket zero = FloatPacket(0.0f);
+
+    if(orbitTrap != NULL){
+        for(int i = 0; i < 4; i++)
+            orbitTrap[i] = FloatPacket(ORBIT_TRAP_START);
+    }
+
+    Vec3Packet z = c;
+    FloatPacket dr = FloatPacket(1.0f);
+    FloatPacket r = zero;
+    PacketMask active = PacketMask::all();
+    for(int i = 0; i < iterations; i++){
+        FloatPacket r2 = dot(z,z);
+        r = select(active,sqrt(r2),r);
+
+        active = active & !(r > BAILOUT);
+        if(!active.any()) break;
+
+        dr = select(active,r2*r2*r2*r*FloatPacket(8.0f)*dr + FloatPacket(1.0f),dr);
+
+        //Azimuth: (x + i*y)^8 on the unit circle gives cos(8*phi) and sin(8*phi)
+        FloatPacket rho2 = z.x*z.x + z.y*z.y;
+        FloatPacket rho = sqrt(rho2);
+        PacketMask isOffAxis = rho2 > zero;
+        FloatPacket ax = select(isOffAxis,z.x/rho,zero);
+        FloatPacket ay = select(isOffAxis,z.y/rho,zero);
+        FloatPacket ax2 = ax*ax, ay2 = ay*ay;
+        FloatPacket cos8Phi = ax2*ax2*ax2*ax2 - FloatPacket(28.0f)*ax2*ax2*ax2*ay2 + FloatPacket(70.0f)*ax2*ax2*ay2*ay2 - FloatPacket(28.0f)*ax2*ay2*ay2*ay2 + ay2*ay2*ay2*ay2;
+        FloatPacket sin8Phi = FloatPacket(8.0f)*ax*ay*(ax2-ay2)*(ax2*ax2 - FloatPacket(6.0f)*ax2*ay2 + ay2*ay2);
+
+        //Polar angle: (z + i*rho)^8 gives r^8*cos(8*theta) and r^8*sin(8*theta)
+        FloatPacket z2 = z.z*z.z;
+        FloatPacket z4 = z2*z2;
+        FloatPacket rho4 = rho2*rho2;
+        FloatPacket zr8Cos = z4*z4 - FloatPacket(28.0f)*z4*z2*rho2 + FloatPacket(70.0f)*z4*rho4 - FloatPacket(28.0f)*z2*rho4*rho2 + rho4*rho4;
+        FloatPacket zr8Sin = FloatPacket(8.0f)*z.z*rho*(z4*z2 - FloatPacket(7.0f)*z4*rho2 + FloatPacket(7.0f)*z2*rho4 - rho4*rho2);
+
+        z.x = select(active,zr8Sin*cos8Phi + c.x,z.x);
+        z.y = select(active,zr8Sin*sin8Phi + c.y,z.y);
+        z.z = select(active,zr8Cos + c.z,z.z);
+
+        if(orbitTrap != NULL && i < COLOR_ITERATIONS){
+            orbitTrap[0] = select(active,min(orbitTrap[0],abs(z.x)),orbitTrap[0]);
+            orbitTrap[1] = select(active,min(orbitTrap[1],abs(z.y)),orbitTrap[1]);
+            orbitTrap[2] = select(active,min(orbitTrap[2],abs(z.z)),orbitTrap[2]);
+            orbitTrap[3] = select(active,min(orbitTrap[3],r2),orbitTrap[3]);
+        }
+    }
+    return FloatPacket(0.5f)*log(r)*r/dr;
+}
+
+#endif // SDFPACKET_H
@@ -0,0 +1,278 @@
+#ifndef SDFTEMPLATE_H
+#define SDFTEMPLATE_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include "simd.h"
+#include "dual.h"
+#include "sdf.h"
+
+//The signed distance functions of sdf.h templated on their scalar, for the scalars with the arithmetic of simd.h:
+//FloatPacket, Dual<float> and Dual<FloatPacket>. With dual numbers a single evaluation gives the distance and its
+//gradient, with packets it is done for PACKET_WIDTH points at once. Branches are selections, like in sdfpacket.h,
+//so every lane and every derivative follows the branch of its own value. Plain floats keep using sdf.h, which
+//mirrors the shader, and the orbit traps are left to it as well since a gradient does not need them.
+
+//Vector of three scalars
+template<typename Scalar>
+struct Vec3Of {
+    Scalar x, y, z;
+    Vec3Of(){}
+    Vec3Of(Scalar px, Scalar py, Scalar pz) : x(px), y(py), z(pz) {}
+    Vec3Of(glm::vec3 value) : x(value.x), y(value.y), z(value.z) {}
+};
+
+template<typename Scalar>
+inline Vec3Of<Scalar> operator+(const Vec3Of<Scalar>& a, const Vec3Of<Scalar>& b){ return Vec3Of<Scalar>(a.x+b.x,a.y+b.y,a.z+b.z); }
+template<typename Scalar>
+inline Vec3Of<Scalar> operator-(const Vec3Of<Scalar>& a, const Vec3Of<Scalar>& b){ return Vec3Of<Scalar>(a.x-b.x,a.y-b.y,a.z-b.z); }
+template<typename Scalar>
+inline Vec3Of<Scalar> operator-(const Vec3Of<Scalar>& a, glm::vec3 b){ return Vec3Of<Scalar>(a.x-b.x,a.y-b.y,a.z-b.z); }
+template<typename Scalar>
+inline Vec3Of<Scalar> operator*(const Vec3Of<Scalar>& a, const Scalar& s){ return Vec3Of<Scalar>(a.x*s,a.y*s,a.z*s); }
+template<typename Scalar>
+inline Vec3Of<Scalar> operator*(const Vec3Of<Scalar>& a, float s){ return Vec3Of<Scalar>(a.x*s,a.y*s,a.z*s); }
+template<typename Scalar>
+inline Vec3Of<Scalar> operator/(const Vec3Of<Scalar>& a, float s){ return Vec3Of<Scalar>(a.x/s,a.y/s,a.z/s); }
+template<typename Scalar>
+inline Scalar dot(const Vec3Of<Scalar>& a, const Vec3Of<Scalar>& b){ return a.x*b.x + a.y*b.y + a.z*b.z; }
+template<typename Scalar>
+inline Vec3Of<Scalar> cross(const Vec3Of<Scalar>& a, const Vec3Of<Scalar>& b){
+    return Vec3Of<Scalar>(a.y*b.z - a.z*b.y,a.z*b.x - a.x*b.z,a.x*b.y - a.y*b.x);
+}
+template<typename Scalar>
+inline Scalar length(const Vec3Of<Scalar>& a){ return sqrt(dot(a,a)); }
+
+//The point as the variables of a gradient, each coordinate has a derivative of 1 by itself and 0 by the others
+template<typename Real>
+inline Vec3Of<Dual<Real> > toDualPoint(const Real& x, const Real& y, const Real& z){
+    return Vec3Of<Dual<Real> >(Dual<Real>(x,Real(1.0f),Real(0.0f),Real(0.0f)),Dual<Real>(y,Real(0.0f),Real(1.0f),Real(0.0f)),Dual<Real>(z,Real(0.0f),Real(0.0f),Real(1.0f)));
+}
+
+//SDF operations
+
+template<typename Scalar>
+inline Scalar opUnion(const Scalar& d1, const Scalar& d2){ return min(d1,d2); }
+
+template<typename Scalar>
+inline Scalar opSubtraction(const Scalar& d1, const Scalar& d2){ return max(-d1,d2); }
+
+template<typename Scalar>
+inline Scalar opIntersection(const Scalar& d1, const Scalar& d2){ return max(d1,d2); }
+
+template<typename Scalar>
+inline Scalar opSmoothUnion(const Scalar& d1, const Scalar& d2, float k){
+    Scalar h = clamp(0.5f + 0.5f*(d2-d1)/k,Scalar(0.0f),Scalar(1.0f));
+    return d2*(1.0f-h) + d1*h - k*h*(1.0f-h);
+}
+
+template<typename Scalar>
+inline Scalar opSmoothSubtraction(const Scalar& d1, const Scalar& d2, float k){
+    Scalar h = clamp(0.5f - 0.5f*(d2+d1)/k,Scalar(0.0f),Scalar(1.0f));
+    return d2*(1.0f-h) - d1*h + k*h*(1.0f-h);
+}
+
+template<typename Scalar>
+inline Scalar opSmoothIntersection(const Scalar& d1, const Scalar& d2, float k){
+    Scalar h = clamp(0.5f - 0.5f*(d2-d1)/k,Scalar(0.0f),Scalar(1.0f));
+    return d2*(1.0f-h) + d1*h + k*h*(1.0f-h);
+}
+
+//Simple shapes
+
+template<typename Scalar>
+inline Scalar boxDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, glm::vec3 halfSize){
+    const Scalar zero = Scalar(0.0f);
+    Scalar qx = abs(currentPoint.x - center.x) - halfSize.x;
+    Scalar qy = abs(currentPoint.y - center.y) - halfSize.y;
+    Scalar qz = abs(currentPoint.z - center.z) - halfSize.z;
+    return length(Vec3Of<Scalar>(max(qx,zero),max(qy,zero),max(qz,zero))) + min(max(qx,max(qy,qz)),zero);
+}
+
+template<typename Scalar>
+inline Scalar sphereDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float radius){
+    return length(currentPoint - center) - radius;
+}
+
+template<typename Scalar>
+inline Scalar cubeDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float sideLength){
+    return boxDistance(currentPoint,center,glm::vec3(sideLength));
+}
+
+template<typename Scalar>
+inline Scalar wallDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float sideLength){
+    return boxDistance(currentPoint,center,glm::vec3(sideLength,sideLength,0.1f));
+}
+
+template<typename Scalar>
+inline Scalar planeDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float size){
+    return boxDistance(currentPoint,center,glm::vec3(size,0.01f,size));
+}
+
+template<typename Scalar>
+inline Scalar torusDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, glm::vec2 size){
+    Vec3Of<Scalar> p = currentPoint - center;
+    Scalar qx = sqrt(p.x*p.x + p.z*p.z) - size.x;
+    return sqrt(qx*qx + p.y*p.y) - size.y/2.0f;
+}
+
+template<typename Scalar>
+inline Scalar prismDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, glm::vec2 size){
+    Vec3Of<Scalar> p = currentPoint - center;
+    const float k = std::sqrt(3.0f);
+    const float scale = size.x*0.5f*k;
+    Scalar px = abs(p.x/scale) - 1.0f;
+    Scalar py = p.y/scale + 1.0f/k;
+    typename MaskOf<Scalar>::Type isFolded = px + k*py > 0.0f;
+    Scalar foldedX = (px - k*py)*0.5f;
+    Scalar foldedY = (-k*px - py)*0.5f;
+    px = select(isFolded,foldedX,px);
+    py = select(isFolded,foldedY,py);
+    px = px - clamp(px,Scalar(-2.0f),Scalar(0.0f));
+    Scalar d1 = sqrt(px*px + py*py)*sign(-py)*scale;
+    Scalar d2 = abs(p.z) - size.y;
+    const Scalar zero = Scalar(0.0f);
+    Scalar o1 = max(d1,zero), o2 = max(d2,zero);
+    return sqrt(o1*o1 + o2*o2) + min(max(d1,d2),zero);
+}
+
+template<typename Scalar>
+inline Scalar pyramidDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float size){
+    Vec3Of<Scalar> p = currentPoint - center;
+    const float h = size;
+    const float m2 = size*size + 0.25f;
+    const Scalar zero = Scalar(0.0f);
+
+    Scalar ax = abs(p.x), az = abs(p.z);
+    typename MaskOf<Scalar>::Type isSwapped = az > ax;
+    Scalar px = select(isSwapped,az,ax) - 0.5f;
+    Scalar pz = select(isSwapped,ax,az) - 0.5f;
+    Scalar py = p.y;
+
+    Scalar qx = pz;
+    Scalar qy = h*py - 0.5f*px;
+    Scalar qz = h*px + 0.5f*py;
+
+    Scalar s = max(-qx,zero);
+    Scalar t = clamp((qy - 0.5f*pz)/(m2 + 0.25f),zero,Scalar(1.0f));
+
+    Scalar a = m2*(qx+s)*(qx+s) + qy*qy;
+    Scalar ta = qx + 0.5f*t, tb = qy - m2*t;
+    Scalar b = m2*ta*ta + tb*tb;
+
+    Scalar d2 = select(min(qy,-qx*m2 - qy*0.5f) > 0.0f,zero,min(a,b));
+
+    return sqrt((d2 + qz*qz)/m2) * sign(max(qz,-py));
+}
+
+template<typename Scalar>
+inline Scalar cylinderDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float size){
+    Vec3Of<Scalar> p = currentPoint - center;
+    Scalar dx = sqrt(p.x*p.x + p.z*p.z) - size/2.0f;
+    Scalar dy = abs(p.y) - size;
+    const Scalar zero = Scalar(0.0f);
+    Scalar ox = max(dx,zero), oy = max(dy,zero);
+    return min(max(dx,dy),zero) + sqrt(ox*ox + oy*oy);
+}
+
+//Fractals, lanes that pass the bailout stop iterating while the rest continue
+
+template<typename Scalar>
+inline Scalar juliaFractalDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float size, int iterations = FRACTAL_ITERATIONS){
+    const float BAILOUT = 10.0f;
+    //The quaternion p and its derivative dp, split into their real parts and the vectors of their imaginary parts
+    Vec3Of<Scalar> p = currentPoint - center;
+    Scalar pReal = p.x;
+    Vec3Of<Scalar> pImaginary = Vec3Of<Scalar>(p.y,p.z,Scalar(0.0f));
+    Scalar dpReal = Scalar(1.0f);
+    Vec3Of<Scalar> dpImaginary = Vec3Of<Scalar>(glm::vec3(0.0f));
+    typename MaskOf<Scalar>::Type active = MaskOf<Scalar>::all();
+    for(int i = 0; i < iterations; i++){
+        if(!anyLane(active)) break;
+        Vec3Of<Scalar> nextDpImaginary = (pImaginary*dpReal + dpImaginary*pReal + cross(pImaginary,dpImaginary))*2.0f;
+        Scalar nextDpReal = (pReal*dpReal - dot(pImaginary,dpImaginary))*2.0f;
+        Scalar nextPReal = pReal*pReal - dot(pImaginary,pImaginary) - 0.38f;
+        Vec3Of<Scalar> nextPImaginary = pImaginary*(2.0f*pReal);
+        nextPImaginary = Vec3Of<Scalar>(nextPImaginary.x - 0.38f,nextPImaginary.y - 0.38f,nextPImaginary.z - 0.38f);
+
+        dpReal = select(active,nextDpReal,dpReal);
+        dpImaginary = Vec3Of<Scalar>(select(active,nextDpImaginary.x,dpImaginary.x),select(active,nextDpImaginary.y,dpImaginary.y),select(active,nextDpImaginary.z,dpImaginary.z));
+        pReal = select(active,nextPReal,pReal);
+        pImaginary = Vec3Of<Scalar>(select(active,nextPImaginary.x,pImaginary.x),select(active,nextPImaginary.y,pImaginary.y),select(active,nextPImaginary.z,pImaginary.z));
+
+        Scalar p2 = pReal*pReal + dot(pImaginary,pImaginary);
+        active = active & !(p2 > BAILOUT);
+    }
+    Scalar r = sqrt(pReal*pReal + dot(pImaginary,pImaginary));
+    return 0.5f * r * log(r) / sqrt(dpReal*dpReal + dot(dpImaginary,dpImaginary));
+}
+
+template<typename Scalar>
+inline Scalar mandelboxFractalDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float size, int iterations = FRACTAL_ITERATIONS){
+    const float SCALE = 2.7f;
+    const float MR2 = 0.1f;
+    const Scalar one = Scalar(1.0f);
+
+    const float scale = SCALE/MR2, scaleW = std::abs(SCALE)/MR2;
+    const float C1 = std::abs(SCALE-1.0f), C2 = std::pow(std::abs(SCALE),(float)(1-iterations));
+
+    //Distance estimate, the fourth component of the point is its derivative w
+    const Vec3Of<Scalar> p0 = currentPoint - center;
+    Vec3Of<Scalar> p = p0;
+    Scalar w = one;
+
+    for(int i = 0; i < iterations; i++){
+        p = Vec3Of<Scalar>(clamp(p.x,-one,one),clamp(p.y,-one,one),clamp(p.z,-one,one))*2.0f - p; //box fold
+        Scalar r2 = dot(p,p);
+        Scalar fold = clamp(max(MR2/r2,Scalar(MR2)),Scalar(0.0f),one); //sphere fold
+        p = p*fold*scale + p0;
+        w = w*fold*scaleW + 1.0f;
+    }
+    return ((length(p) - C1) / w) - C2;
+}
+
+//Power 8 mandelbulb iteration in triplex algebra, see the scalar version in sdf.h
+template<typename Scalar>
+inline Scalar mandelbulbFractalDistance(const Vec3Of<Scalar>& currentPoint, glm::vec3 center, float size, int iterations = FRACTAL_ITERATIONS){
+    const Vec3Of<Scalar> c = currentPoint - center;
+    const float BAILOUT = 10.0f;
+    const Scalar zero = Scalar(0.0f);
+
+    Vec3Of<Scalar> z = c;
+    Scalar dr = Scalar(1.0f);
+    Scalar r = zero;
+    typename MaskOf<Scalar>::Type active = MaskOf<Scalar>::all();
+    for(int i = 0; i < iterations; i++){
+        Scalar r2 = dot(z,z);
+        r = select(active,sqrt(r2),r);
+
+        active = active & !(r > BAILOUT);
+        if(!anyLane(active)) break;
+
+        dr = select(active,r2*r2*r2*r*8.0f*dr + 1.0f,dr);
+
+        //Azimuth: (x + i*y)^8 on the unit circle gives cos(8*phi) and sin(8*phi)
+        Scalar rho2 = z.x*z.x + z.y*z.y;
+        Scalar rho = sqrt(rho2);
+        typename MaskOf<Scalar>::Type isOffAxis = rho2 > 0.0f;
+        Scalar ax = select(isOffAxis,z.x/rho,zero);
+        Scalar ay = select(isOffAxis,z.y/rho,zero);
+        Scalar ax2 = ax*ax, ay2 = ay*ay;
+        Scalar cos8Phi = ax2*ax2*ax2*ax2 - 28.0f*ax2*ax2*ax2*ay2 + 70.0f*ax2*ax2*ay2*ay2 - 28.0f*ax2*ay2*ay2*ay2 + ay2*ay2*ay2*ay2;
+        Scalar sin8Phi = 8.0f*ax*ay*(ax2-ay2)*(ax2*ax2 - 6.0f*ax2*ay2 + ay2*ay2);
+
+        //Polar angle: (z + i*rho)^8 gives r^8*cos(8*theta) and r^8*sin(8*theta)
+        Scalar z2 = z.z*z.z;
+        Scalar z4 = z2*z2;
+        Scalar rho4 = rho2*rho2;
+        Scalar zr8Cos = z4*z4 - 28.0f*z4*z2*rho2 + 70.0f*z4*rho4 - 28.0f*z2*rho4*rho2 + rho4*rho4;
+        Scalar zr8Sin = 8.0f*z.z*rho*(z4*z2 - 7.0f*z4*rho2 + 7.0f*z2*rho4 - rho4*rho2);
+
+        z.x = select(active,zr8Sin*cos8Phi + c.x,z.x);
+        z.y = select(active,zr8Sin*sin8Phi + c.y,z.y);
+        z.z = select(active,zr8Cos + c.z,z.z);
+    }
+    return 0.5f*log(r)*r/dr;
+}
+
+#endif // SDFTEMPLATE_H
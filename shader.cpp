@@ -1,120 +1,255 @@
 #include "shader.h"
+#include <cstdio>
+#include <iterator>
 #include "glm/gtc/type_ptr.hpp"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 
+static GLuint CreateProgram(const std::string& vertexSource, const std::string& fragmentSource, const std::string& cacheFile, bool& isLoadedFromCache);
 static GLuint CreateShader(const std::string& text, GLenum shaderType);
 static std::string LoadShader(const std::string& fileName);
+static std::string AddDefines(const std::string& source, const std::string& defines);
+static std::string GetProgramCacheFile(const std::string& fileName, const std::string& vertexSource, const std::string& fragmentSource);
+static bool LoadProgramBinary(GLuint program, const std::string& cacheFile);
+static void SaveProgramBinary(GLuint program, const std::string& cacheFile);
 static void CheckShaderError(GLuint shader, GLuint flag, bool isProgram, const std::string& errorMessage);
 
-Shader::Shader(const std::string& fileName){
+Shader::Shader(const std::string& fileName, const std::string& defines){
 
-    program = glCreateProgram();
-    shaders[0] = CreateShader(LoadShader(fileName + ".vs"),GL_VERTEX_SHADER);
-    shaders[1] = CreateShader(LoadShader(fileName + ".fs"),GL_FRAGMENT_SHADER);
+    framebuffers[0] = framebuffers[1] = 0;
+    accumulationTextures[0] = accumulationTextures[1] = 0;
+    momentTextures[0] = momentTextures[1] = 0;
+    for(int i = 0; i < 2; i++){
+        gBufferFramebuffers[i][0] = gBufferFramebuffers[i][1] = 0;
+        for(unsigned int j = 0; j < NUM_GBUFFER_TEXTURES; j++)
+            gBufferTextures[i][j] = 0;
+    }
+    currentTarget = 0;
+    currentGBuffer = 0;
 
-    for(unsigned int i = 0; i < NUM_SHADERS; i++)
-        glAttachShader(program,shaders[i]);
+    this->fileName = fileName;
+    vertexSource = LoadShader(fileName + ".vs");
+    fragmentSource = LoadShader(fileName + ".fs");
+    program = 0;
+    useVariant(defines);
+}
 
-    glLinkProgram(program);
-    CheckShaderError(program,GL_LINK_STATUS,true,"Error in shader, linking failed: ");   
+void Shader::useVariant(const std::string& defines){
+    std::map<std::string,GLuint>::iterator variant = variants.find(defines);
+    if(variant != variants.end() && variant->second == program) return;
 
-    glValidateProgram(program);
-    CheckShaderError(program,GL_VALIDATE_STATUS,true,"Error in shader, validation failed: ");   
+    if(variant == variants.end()){
+        std::string variantVertexSource = AddDefines(vertexSource,defines);
+        std::string variantFragmentSource = AddDefines(fragmentSource,defines);
+        std::string cacheFile = GetProgramCacheFile(fileName,variantVertexSource,variantFragmentSource);
+        variant = variants.insert(std::make_pair(defines,CreateProgram(variantVertexSource,variantFragmentSource,cacheFile,loadedFromCache))).first;
+    }
+    program = variant->second;
+
+    //Uniform values belong to a program, the new one gets the values set so far
+    glUseProgram(program);
+    for(std::map<std::string,UniformValue>::iterator uniform = uniforms.begin(); uniform != uniforms.end(); ++uniform)
+        applyUniform(uniform->first,uniform->second);
 }
 
 Shader::~Shader(){
-    for(unsigned int i = 0; i < NUM_SHADERS; i++){
-        glDetachShader(program,shaders[i]);
-        glDeleteShader(shaders[i]);
+    glDeleteFramebuffers(2,framebuffers);
+    glDeleteTextures(2,accumulationTextures);
+    glDeleteTextures(2,momentTextures);
+    glDeleteFramebuffers(4,&gBufferFramebuffers[0][0]);
+    glDeleteTextures(2*NUM_GBUFFER_TEXTURES,&gBufferTextures[0][0]);
+    for(unsigned int i = 0; i < bufferTextures.size(); i++){
+        glDeleteTextures(1,&bufferTextures[i].texture);
+        glDeleteBuffers(1,&bufferTextures[i].buffer);
     }
-    glDeleteProgram(program);
+    for(std::map<std::string,GLuint>::iterator variant = variants.begin(); variant != variants.end(); ++variant)
+        glDeleteProgram(variant->second);
 }
 
 void Shader::setInt(const GLchar* name, unsigned const int value){
-    glUseProgram(program);
-    GLint uniformLocation = glGetUniformLocation(program,name);
-    glUniform1f(uniformLocation,value);
+    UniformValue uniform;
+    uniform.type = GL_INT;
+    uniform.intValue = value;
+    setUniform(name,uniform);
 }
 
 void Shader::setFloat(const GLchar* name, const float value){
-    glUseProgram(program);
-    GLint uniformLocation = glGetUniformLocation(program,name);
-    glUniform1f(uniformLocation,value);
+    UniformValue uniform;
+    uniform.type = GL_FLOAT;
+    uniform.floatValues[0][0] = value;
+    setUniform(name,uniform);
 }
 
 void Shader::setMat4(const GLchar* name, glm::mat4 value){
-    glUseProgram(program);
-    GLint uniformLocation = glGetUniformLocation(program,name);
-    glUniformMatrix4fv(uniformLocation,1,GL_FALSE,glm::value_ptr(value));
+    UniformValue uniform;
+    uniform.type = GL_FLOAT_MAT4;
+    uniform.floatValues = value;
+    setUniform(name,uniform);
 }
 
 void Shader::setVec2(const GLchar* name, glm::vec2 value){
-    glUseProgram(program);
-    GLint uniformLocation = glGetUniformLocation(program,name);
-    glUniform2f(uniformLocation,value.x,value.y);
+    UniformValue uniform;
+    uniform.type = GL_FLOAT_VEC2;
+    uniform.floatValues[0] = glm::vec4(value,0.0f,0.0f);
+    setUniform(name,uniform);
 }
 
 void Shader::setVec3(const GLchar* name, glm::vec3 value){
+    UniformValue uniform;
+    uniform.type = GL_FLOAT_VEC3;
+    uniform.floatValues[0] = glm::vec4(value,0.0f);
+    setUniform(name,uniform);
+}
+
+void Shader::setUniform(const std::string& name, const UniformValue& value){
+    uniforms[name] = value;
     glUseProgram(program);
-    GLint uniformLocation = glGetUniformLocation(program,name);
-    glUniform3f(uniformLocation,value.x,value.y,value.z);
-}
-
-void Shader::loadTexture(const GLchar* pathname, const GLchar* name){
-    glGenTextures(1, &this->loadedTexture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D,this->loadedTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(pathname, &width, &height, &nrChannels, 0); 
-
-    if(data){
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glUseProgram(program);
-        GLint uniformLocation = glGetUniformLocation(program,name);
-        glUniform1i(uniformLocation,0);
-    } else {
-        std::cout << "Failed to load texture" << std::endl;
+    applyUniform(name,value);
+}
+
+void Shader::applyUniform(const std::string& name, const UniformValue& value){
+    GLint uniformLocation = glGetUniformLocation(program,name.c_str());
+    switch(value.type){
+        case GL_INT:
+            glUniform1i(uniformLocation,value.intValue);
+            break;
+        case GL_FLOAT:
+            glUniform1f(uniformLocation,value.floatValues[0][0]);
+            break;
+        case GL_FLOAT_VEC2:
+            glUniform2f(uniformLocation,value.floatValues[0][0],value.floatValues[0][1]);
+            break;
+        case GL_FLOAT_VEC3:
+            glUniform3f(uniformLocation,value.floatValues[0][0],value.floatValues[0][1],value.floatValues[0][2]);
+            break;
+        case GL_FLOAT_MAT4:
+            glUniformMatrix4fv(uniformLocation,1,GL_FALSE,glm::value_ptr(value.floatValues));
+            break;
     }
-    stbi_image_free(data);
 }
 
-void Shader::createRenderTarget(const int screenWidth, const int screenHeight){
-    //Create Frame buffer object:
-    glGenFramebuffers(1,&this->framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER,this->framebuffer);
+//Texture loaded under a name, created the first time the name is loaded
+Shader::BufferTexture* Shader::findBufferTexture(const GLchar* name, const GLenum target){
+    for(unsigned int i = 0; i < bufferTextures.size(); i++){
+        if(bufferTextures[i].name == name)
+            return &bufferTextures[i];
+    }
+    bufferTextures.push_back(BufferTexture());
+    BufferTexture* bufferTexture = &bufferTextures.back();
+    bufferTexture->name = name;
+    bufferTexture->target = target;
+    bufferTexture->buffer = 0;
+    if(target == GL_TEXTURE_BUFFER) glGenBuffers(1,&bufferTexture->buffer);
+    glGenTextures(1,&bufferTexture->texture);
+    return bufferTexture;
+}
 
-    //Create empty OUTPUT texture which will contain the RGB output of the shader
-    glGenTextures(1,&this->outputTexture);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, this->outputTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, screenWidth, screenHeight, 0,GL_RGB, GL_UNSIGNED_BYTE, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glUseProgram(program);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->outputTexture, 0);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+void Shader::loadBufferTexture(const GLchar* name, const GLuint textureUnit, const void* data, const GLsizeiptr size, const GLenum internalFormat){
+    BufferTexture* bufferTexture = findBufferTexture(name,GL_TEXTURE_BUFFER);
+    bufferTexture->textureUnit = textureUnit;
+
+    //Empty buffers are not valid texture storage, keep at least one element around
+    glBindBuffer(GL_TEXTURE_BUFFER,bufferTexture->buffer);
+    glBufferData(GL_TEXTURE_BUFFER,size > 0 ? size : 16,size > 0 ? data : NULL,GL_STATIC_DRAW);
+
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER,bufferTexture->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER,internalFormat,bufferTexture->buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER,0);
+
+    setInt(name,textureUnit);
 }
 
-void Shader::createInputTarget(const int screenWidth, const int screenHeight){
-    //Create empty texture which will contain the RGB input of the shader
-    glGenTextures(1,&this->inputTexture);
-    glActiveTexture(GL_TEXTURE0 + 2);
-    glBindTexture(GL_TEXTURE_2D, this->inputTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, screenWidth, screenHeight, 0,GL_RGB, GL_UNSIGNED_BYTE, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    GLint uniformLocation = glGetUniformLocation(program,"inputTexture");
-    glUniform1i(uniformLocation,1);
+void Shader::loadTexture3D(const GLchar* name, const GLuint textureUnit, const float* data, const int width, const int height, const int depth, const GLenum internalFormat){
+    BufferTexture* texture = findBufferTexture(name,GL_TEXTURE_3D);
+    texture->textureUnit = textureUnit;
+
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_3D,texture->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    glTexImage3D(GL_TEXTURE_3D,0,internalFormat,width,height,depth,0,GL_RED,GL_FLOAT,data);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
+
+    setInt(name,textureUnit);
+}
+
+void Shader::bindBufferTextures(){
+    for(unsigned int i = 0; i < bufferTextures.size(); i++){
+        glActiveTexture(GL_TEXTURE0 + bufferTextures[i].textureUnit);
+        glBindTexture(bufferTextures[i].target,bufferTextures[i].texture);
+    }
+}
+
+void Shader::createAccumulationTargets(const int screenWidth, const int screenHeight){
+    static const GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0,GL_COLOR_ATTACHMENT1};
+
+    glGenFramebuffers(2,this->framebuffers);
+    glGenTextures(2,this->accumulationTextures);
+    glGenTextures(2,this->momentTextures);
+
+    for(int i = 0; i < 2; i++){
+        //Float storage so the running mean keeps converging instead of stalling at 8 bit precision
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, this->accumulationTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA32F, screenWidth, screenHeight, 0,GL_RGBA, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        //Squared luminance deviations from the mean, the variance estimate of adaptive sampling,
+        //followed by the rays and march steps of the last frame which the benchmark reads back
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_2D, this->momentTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA32F, screenWidth, screenHeight, 0,GL_RGBA, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER,this->framebuffers[i]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->accumulationTextures[i], 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, this->momentTextures[i], 0);
+        glDrawBuffers(2,drawBuffers);
+
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Accumulation target is incomplete." << std::endl;
+
+        glClearColor(0.0f,0.0f,0.0f,0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    currentTarget = 0;
+
+    //The previous frame is always read from texture unit 1 and its moments from unit 2
+    setInt("inputTexture",1);
+    setInt("inputMoments",2);
+}
+
+void Shader::createFilterTargets(const int screenWidth, const int screenHeight){
+    glGenFramebuffers(2,this->framebuffers);
+    glGenTextures(2,this->accumulationTextures);
+
+    for(int i = 0; i < 2; i++){
+        glBindTexture(GL_TEXTURE_2D, this->accumulationTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA32F, screenWidth, screenHeight, 0,GL_RGBA, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER,this->framebuffers[i]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->accumulationTextures[i], 0);
+
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Filter target is incomplete." << std::endl;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    currentTarget = 0;
 }
 
-void Shader::copyOutputToInputTexture(const int screenWidth, const int screenHeight){
-    glCopyTextureSubImage2D(this->outputTexture,0,0,0,0,0,screenWidth,screenHeight);
+void Shader::bindInputTextures(){
+    glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D,this->accumulationTextures[1 - currentTarget]);
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_2D,this->momentTextures[1 - currentTarget]);
 }
 
 static GLuint CreateShader(const std::string& text, GLenum shaderType){
@@ -156,6 +291,104 @@ static std::string LoadShader(const std::string& fileName){
     return output;
 }
 
+//Links a program from its sources, or loads it from the binary cache when it was linked before
+static GLuint CreateProgram(const std::string& vertexSource, const std::string& fragmentSource, const std::string& cacheFile, bool& isLoadedFromCache){
+    GLuint program = glCreateProgram();
+    isLoadedFromCache = LoadProgramBinary(program,cacheFile);
+
+    if(!isLoadedFromCache){
+        //A binary the driver rejected may leave the program in any state, start over with a new one
+        glDeleteProgram(program);
+        program = glCreateProgram();
+        GLuint shaders[2];
+        shaders[0] = CreateShader(vertexSource,GL_VERTEX_SHADER);
+        shaders[1] = CreateShader(fragmentSource,GL_FRAGMENT_SHADER);
+
+        for(unsigned int i = 0; i < 2; i++)
+            glAttachShader(program,shaders[i]);
+
+        glProgramParameteri(program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+        glLinkProgram(program);
+        CheckShaderError(program,GL_LINK_STATUS,true,"Error in shader, linking failed: ");   
+        SaveProgramBinary(program,cacheFile);
+
+        //The linked program does not need its shader objects anymore
+        for(unsigned int i = 0; i < 2; i++){
+            glDetachShader(program,shaders[i]);
+            glDeleteShader(shaders[i]);
+        }
+    }
+
+    glValidateProgram(program);
+    CheckShaderError(program,GL_VALIDATE_STATUS,true,"Error in shader, validation failed: ");   
+    return program;
+}
+
+//Inserts the defines after the #version line, which has to stay the first line of the source
+static std::string AddDefines(const std::string& source, const std::string& defines){
+    if(defines.empty()) return source;
+    std::string::size_type versionEnd = source.find('\n');
+    if(versionEnd == std::string::npos || source.compare(0,8,"#version") != 0) return defines + "\n" + source;
+    return source.substr(0,versionEnd + 1) + defines + "\n" + source.substr(versionEnd + 1);
+}
+
+//64 bit FNV-1a
+static unsigned long long HashString(const std::string& text, unsigned long long hash = 14695981039346656037ULL){
+    for(std::string::size_type i = 0; i < text.size(); i++){
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//Names the binary after a hash of the driver and the sources with their defines, so a change to any of them misses the cache
+static std::string GetProgramCacheFile(const std::string& fileName, const std::string& vertexSource, const std::string& fragmentSource){
+    std::string driver = std::string((const char*)glGetString(GL_VENDOR)) + "\n" + (const char*)glGetString(GL_RENDERER) + "\n" + (const char*)glGetString(GL_VERSION);
+    unsigned long long hash = HashString(driver);
+    hash = HashString(std::string(1,'\0') + vertexSource,hash);
+    hash = HashString(std::string(1,'\0') + fragmentSource,hash);
+
+    char hashText[17];
+    snprintf(hashText,sizeof(hashText),"%016llx",hash);
+    return fileName + "." + hashText + ".bin";
+}
+
+//Loads a cached binary into the program, false when there is none or the driver no longer accepts it
+static bool LoadProgramBinary(GLuint program, const std::string& cacheFile){
+    std::ifstream file(cacheFile.c_str(),std::ios::binary);
+    if(!file.is_open()) return false;
+
+    GLenum binaryFormat = 0;
+    if(!file.read((char*)&binaryFormat,sizeof(binaryFormat))) return false;
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+    if(binary.empty()) return false;
+
+    glProgramBinary(program,binaryFormat,binary.data(),(GLsizei)binary.size());
+    GLint success = GL_FALSE;
+    glGetProgramiv(program,GL_LINK_STATUS,&success);
+    return success == GL_TRUE;
+}
+
+//Writes the binary of a linked program to the cache, drivers without binary formats leave it empty
+static void SaveProgramBinary(GLuint program, const std::string& cacheFile){
+    GLint success = GL_FALSE, length = 0;
+    glGetProgramiv(program,GL_LINK_STATUS,&success);
+    glGetProgramiv(program,GL_PROGRAM_BINARY_LENGTH,&length);
+    if(success == GL_FALSE || length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program,length,NULL,&binaryFormat,binary.data());
+
+    std::ofstream file(cacheFile.c_str(),std::ios::binary);
+    if(!file.is_open()){
+        std::cerr << "Unable to write shader cache: " << cacheFile << std::endl;
+        return;
+    }
+    file.write((const char*)&binaryFormat,sizeof(binaryFormat));
+    file.write(binary.data(),binary.size());
+}
+
 //Reports any shader errors
 static void CheckShaderError(GLuint shader, GLuint flag, bool isProgram, const std::string& errorMessage){
     GLint success = 0;
@@ -172,4 +405,49 @@ static void CheckShaderError(GLuint shader, GLuint flag, bool isProgram, const s
         else
             glGetShaderInfoLog(shader,sizeof(error),NULL,error);
     }
-}
\ No newline at end of file
+}
+void Shader::createGBuffer(const int screenWidth, const int screenHeight){
+    static const GLchar* samplerNames[NUM_GBUFFER_TEXTURES] = {"gBufferHit","gBufferSurface","gBufferLight"};
+    static const GLenum drawBuffers[NUM_GBUFFER_TEXTURES + 2] = {GL_COLOR_ATTACHMENT0,GL_COLOR_ATTACHMENT1,GL_COLOR_ATTACHMENT2,GL_COLOR_ATTACHMENT3,GL_COLOR_ATTACHMENT4};
+
+    glGenTextures(2*NUM_GBUFFER_TEXTURES,&this->gBufferTextures[0][0]);
+    for(int i = 0; i < 2; i++){
+        for(unsigned int j = 0; j < NUM_GBUFFER_TEXTURES; j++){
+            //Float storage so the cached hit distance is exactly the one marched
+            glBindTexture(GL_TEXTURE_2D, this->gBufferTextures[i][j]);
+            glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA32F, screenWidth, screenHeight, 0,GL_RGBA, GL_FLOAT, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    //Every accumulation target can be rendered together with either G-buffer, only the frames that march the primary rays write one
+    glGenFramebuffers(4,&this->gBufferFramebuffers[0][0]);
+    for(int i = 0; i < 2; i++){
+        for(int j = 0; j < 2; j++){
+            glBindFramebuffer(GL_FRAMEBUFFER,this->gBufferFramebuffers[i][j]);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->accumulationTextures[i], 0);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, this->momentTextures[i], 0);
+            for(unsigned int k = 0; k < NUM_GBUFFER_TEXTURES; k++)
+                glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2 + k, this->gBufferTextures[j][k], 0);
+            glDrawBuffers(NUM_GBUFFER_TEXTURES + 2,drawBuffers);
+
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cerr << "G-buffer target is incomplete." << std::endl;
+        }
+    }
+    currentGBuffer = 0;
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+
+    for(unsigned int i = 0; i < NUM_GBUFFER_TEXTURES; i++)
+        setInt(samplerNames[i],6 + i);
+}
+
+void Shader::bindGBufferTextures(){
+    //The G-buffer rendered to is never the one bound, sampling a texture attached to the framebuffer being rendered is undefined
+    for(unsigned int i = 0; i < NUM_GBUFFER_TEXTURES; i++){
+        glActiveTexture(GL_TEXTURE0 + 6 + i);
+        glBindTexture(GL_TEXTURE_2D,this->gBufferTextures[currentGBuffer][i]);
+    }
+}
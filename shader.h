@@ -4,6 +4,8 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <vector>
+#include <map>
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -11,44 +13,122 @@
 
 class Shader{
     public:
-        Shader(const std::string& fileName);
+        //Compiles fileName.vs and fileName.fs, the defines are inserted after their #version line.
+        //Linked programs are cached on disk next to the sources, a later run with the same sources,
+        //defines and driver loads the binary instead of compiling.
+        Shader(const std::string& fileName, const std::string& defines = "");
+        //Switches to the program compiled with other defines, variants are kept by their defines so switching back
+        //to one is free. The uniforms set so far are set on the variant, the textures and targets are shared.
+        void useVariant(const std::string& defines);
         void setInt(const GLchar* name, unsigned const int value);
         void setFloat(const GLchar* name, const float value);
         void setMat4(const GLchar* name, glm::mat4 value);
         void setVec2(const GLchar* name, glm::vec2 value);
         void setVec3(const GLchar* name, glm::vec3 value);
-        void loadTexture(const GLchar* pathname, const GLchar* name);
         void useTexture(GLuint *inputTexture);
-        void createRenderTarget(const int screenWidth, const int screenHeight);
-        void createInputTarget(const int screenWidth, const int screenHeight);
-        void copyOutputToInputTexture(const int screenWidth, const int screenHeight);
+        //Uploads data to a buffer texture the shader reads with texelFetch, replacing any buffer already loaded under that name
+        void loadBufferTexture(const GLchar* name, const GLuint textureUnit, const void* data, const GLsizeiptr size, const GLenum internalFormat);
+        //Uploads single channel floats to a 3D texture the shader samples with trilinear filtering, replacing any texture
+        //already loaded under that name. It is bound together with the buffer textures.
+        void loadTexture3D(const GLchar* name, const GLuint textureUnit, const float* data, const int width, const int height, const int depth, const GLenum internalFormat);
+        void bindBufferTextures();
+        //Creates two RGBA32F targets that swap roles every frame: the shader renders into one
+        //while it reads the previous frame from the other through its inputTexture sampler.
+        //Each target has an RGBA32F moments texture next to it, read through the inputMoments sampler.
+        void createAccumulationTargets(const int screenWidth, const int screenHeight);
+        void swapAccumulationTargets(){
+            currentTarget = 1 - currentTarget;
+        }
+        //Creates two G-buffers that cache the first hit of every primary ray. Frames that march the primary
+        //rays render into one together with the accumulation target while they read the other, which holds
+        //the hits of the frame before them. The frames after them read the new hits back.
+        //The accumulation targets have to be created first.
+        void createGBuffer(const int screenWidth, const int screenHeight);
+        //The G-buffer just rendered to holds the latest primary hits
+        void swapGBuffers(){
+            currentGBuffer = 1 - currentGBuffer;
+        }
+        //Binds the G-buffer holding the latest primary hits to texture units 6 to 8
+        void bindGBufferTextures();
+        //Binds the previous frame to texture unit 1 and its moments to texture unit 2
+        void bindInputTextures();
+        //Creates two RGBA32F targets for filter passes that read the output of the pass before them,
+        //they swap roles like the accumulation targets but have no moments next to them
+        void createFilterTargets(const int screenWidth, const int screenHeight);
         void use(){
             glUseProgram(this->program);
         }
         GLuint getProgram(){
             return this->program;
         }
+        //Whether the latest variant was loaded from the binary cache instead of compiled
+        bool isLoadedFromCache(){
+            return this->loadedFromCache;
+        }
+        //Framebuffer of the target rendered to this frame
         GLuint getFrameBuffer(){
-            return this->framebuffer;
+            return this->framebuffers[currentTarget];
+        }
+        //Framebuffer of the target holding the previous frame
+        GLuint getInputFrameBuffer(){
+            return this->framebuffers[1 - currentTarget];
         }
+        //Framebuffer that renders this frame to both the accumulation target and the G-buffer not holding the latest hits
+        GLuint getGBufferFrameBuffer(){
+            return this->gBufferFramebuffers[currentTarget][1 - currentGBuffer];
+        }
+        //Texture holding the previous frame
         GLuint getInputTexture(){
-            return this->inputTexture;
+            return this->accumulationTextures[1 - currentTarget];
         }
+        //Texture rendered to this frame
         GLuint getOutputTexture(){
-            return this->outputTexture;
+            return this->accumulationTextures[currentTarget];
+        }
+        //Moments rendered to this frame
+        GLuint getOutputMomentsTexture(){
+            return this->momentTextures[currentTarget];
         }
-        GLuint getLoadedTexture(){
-            return this->loadedTexture;
+        //Hit, surface or direct light texture of the G-buffer holding the latest primary hits
+        GLuint getGBufferTexture(const unsigned int index){
+            return this->gBufferTextures[currentGBuffer][index];
         }
         virtual ~Shader();
     private:
-        static const unsigned int NUM_SHADERS = 2; //Vertex and Fragment shader
+        //Last value set to a uniform, stored as a matrix for every float type
+        struct UniformValue {
+            GLenum type;
+            GLint intValue;
+            glm::mat4 floatValues;
+        };
+        void setUniform(const std::string& name, const UniformValue& value);
+        void applyUniform(const std::string& name, const UniformValue& value);
+
+        std::string fileName;
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::map<std::string,GLuint> variants; //Programs by their defines, program is one of them
+        std::map<std::string,UniformValue> uniforms;
         GLuint program;
-        GLuint framebuffer;
-        GLuint outputTexture;
-        GLuint inputTexture;
-        GLuint loadedTexture;
-        GLuint shaders[NUM_SHADERS];
+        bool loadedFromCache;
+        GLuint framebuffers[2];
+        GLuint accumulationTextures[2];
+        GLuint momentTextures[2];
+        static const unsigned int NUM_GBUFFER_TEXTURES = 3; //Hit, surface and direct light
+        GLuint gBufferFramebuffers[2][2]; //Indexed by accumulation target and G-buffer
+        GLuint gBufferTextures[2][NUM_GBUFFER_TEXTURES];
+        int currentTarget;
+        int currentGBuffer;
+
+        struct BufferTexture {
+            std::string name;
+            GLuint textureUnit;
+            GLuint buffer; //0 for a 3D texture
+            GLuint texture;
+            GLenum target;
+        };
+        BufferTexture* findBufferTexture(const GLchar* name, const GLenum target);
+        std::vector<BufferTexture> bufferTextures;
 };
 
 
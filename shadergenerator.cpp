@@ -0,0 +1,188 @@
+#include "shadergenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+//Distance functions every object type calls, matching the SCENE_USES_ guards of the path tracer shader.
+//Csg objects call the ones of the primitives of their shape.
+static const char* const usedFunctions[NUM_OBJECT_TYPES] = {
+    "SPHERE","CUBE","PLANE","TORUS","PRISM","PYRAMID","MANDELBULB","WALL","MANDELBOX CUBE","WALL","CYLINDER","JULIA",""
+};
+
+//Guard of every primitive of a shape and distance function of the ones that are not fractals, indexed by opcode from
+//CSG_SPHERE. Fractal primitives go through getCsgFractalDistance with the opcode CSG_ and their guard.
+static const char* const csgUsedFunctions[] = {
+    "SPHERE","BOX","TORUS","PRISM","PYRAMID","CYLINDER","MANDELBULB","MANDELBOX","JULIA"
+};
+static const char* const csgPrimitiveFunctions[] = {
+    "sphereDistance","boxDistance","torusDistance","prismDistance","pyramidDistance","cylinderDistance"
+};
+
+/*
+ * Shortest GLSL float literal that reads back as exactly the same float.
+ */
+static std::string floatLiteral(float value){
+    char text[32];
+    for(int precision = 6; precision <= 9; precision++){
+        snprintf(text,sizeof(text),"%.*g",precision,value);
+        if(strtof(text,NULL) == value) break;
+    }
+    //Without a point or an exponent GLSL reads an integer
+    if(strpbrk(text,".e") == NULL) strcat(text,".0");
+    return text;
+}
+
+static std::string vec3Literal(glm::vec3 value){
+    return "vec3(" + floatLiteral(value.x) + "," + floatLiteral(value.y) + "," + floatLiteral(value.z) + ")";
+}
+
+/*
+ * Distance expression of a csg object, the program of its shape unrolled into nested calls with the center and size of
+ * the object folded into the placement of every primitive. Primitives that are neither rotated nor scaled take the
+ * same call as the types written by hand. The functions the primitives call are appended to usedNames.
+ */
+static std::string getCsgExpression(const Object& object, const Scene& scene, std::string& usedNames){
+    const glm::vec4* program = scene.getCsgProgram(object);
+    std::vector<std::string> stack;
+    for(;;){
+        glm::vec4 instruction = *program++;
+        int opcode = (int)instruction.x;
+        if(opcode == CSG_END) break;
+
+        if(opcode <= CSG_SMOOTH_INTERSECTION){
+            std::string b = stack.back();
+            stack.pop_back();
+            std::string& a = stack.back();
+            std::string k = floatLiteral(object.size*instruction.y);
+            switch(opcode){
+                case CSG_UNION: a = "opUnion(" + a + "," + b + ")"; break;
+                case CSG_SUBTRACTION: a = "opSubtraction(" + b + "," + a + ")"; break;
+                case CSG_INTERSECTION: a = "opIntersection(" + a + "," + b + ")"; break;
+                case CSG_SMOOTH_UNION: a = "opSmoothUnion(" + a + "," + b + "," + k + ")"; break;
+                case CSG_SMOOTH_SUBTRACTION: a = "opSmoothSubtraction(" + b + "," + a + "," + k + ")"; break;
+                case CSG_SMOOTH_INTERSECTION: a = "opSmoothIntersection(" + a + "," + b + "," + k + ")"; break;
+            }
+            continue;
+        }
+
+        glm::vec4 placement = *program++;
+        glm::vec3 translation = object.center + object.size*glm::vec3(placement);
+        float scale = object.size*placement.w;
+        bool isRotated = opcode >= CSG_ROTATED;
+        std::string point = "ray", center = vec3Literal(translation);
+        if(isRotated){
+            //A vector times a matrix takes the dot products with its columns, so the columns are the rows of the rotation
+            point = "(ray-" + center + ")*mat3(";
+            for(int i = 0; i < 9; i++) point += floatLiteral(program[i/3][i%3]) + (i < 8 ? "," : ")");
+            program += 3;
+            opcode -= CSG_ROTATED;
+        }
+        bool isFractal = opcode >= CSG_MANDELBULB;
+        if(isRotated || isFractal || scale != 1.0f){
+            if(!isRotated && translation != glm::vec3(0.0f)) point = "(ray-" + center + ")";
+            if(scale != 1.0f) point = (isRotated ? "(" + point + ")" : point) + "/" + floatLiteral(scale);
+            center = "vec3(0.0)";
+        }
+
+        std::string call;
+        switch(opcode){
+            case CSG_SPHERE:
+            case CSG_PYRAMID:
+            case CSG_CYLINDER:
+                call = std::string(csgPrimitiveFunctions[opcode - CSG_SPHERE]) + "(" + point + "," + center + "," + floatLiteral(instruction.y) + ")";
+                break;
+            case CSG_BOX:
+                call = "boxDistance(" + point + "," + center + "," + vec3Literal(glm::vec3(instruction.y,instruction.z,instruction.w)) + ")";
+                break;
+            case CSG_TORUS:
+            case CSG_PRISM:
+                call = std::string(csgPrimitiveFunctions[opcode - CSG_SPHERE]) + "(" + point + "," + center + ",vec2(" + floatLiteral(instruction.y) + "," + floatLiteral(instruction.z) + "))";
+                break;
+            default:
+                call = "getCsgFractalDistance(CSG_" + std::string(csgUsedFunctions[opcode - CSG_SPHERE]) + "," + point + (scale != 1.0f ? ",footprint/" + floatLiteral(scale) : ",footprint") + ")";
+                break;
+        }
+        stack.push_back(scale != 1.0f ? floatLiteral(scale) + "*" + call : call);
+        usedNames += std::string(" ") + csgUsedFunctions[opcode - CSG_SPHERE];
+    }
+    return stack.back();
+}
+
+/*
+ * Distance expression of an object at the point ray, the same as the case for its type in
+ * getObjectDistance with the arithmetic on constants done here. Fractals pass ORBIT_TRAPPED, which the shader
+ * defines differently where it expands the expressions for the distance alone.
+ */
+static std::string getDistanceExpression(const Object& object){
+    std::string center = vec3Literal(object.center);
+    std::string size = floatLiteral(object.size);
+
+    switch(object.type){
+        case OBJECT_SPHERE:
+            return "abs(sphereDistance(ray," + center + "," + floatLiteral(object.size/2) + "))";
+        case OBJECT_CUBE:
+            return "abs(cubeDistance(ray," + center + "," + size + "))";
+        case OBJECT_PLANE:
+            return "planeDistance(ray," + center + "," + size + ")";
+        case OBJECT_TORUS:
+            return "abs(torusDistance(ray," + center + ",vec2(" + size + ")))";
+        case OBJECT_PRISM:
+            return "abs(prismDistance(ray," + center + ",vec2(" + size + ")))";
+        case OBJECT_PYRAMID:
+            return "pyramidDistance(ray," + center + "," + size + ")";
+        case OBJECT_MANDELBULB:
+            return size + "*mandelbulbFractalDistance(ray/" + size + "," + center + "," + size + ",ORBIT_TRAPPED)";
+        case OBJECT_WALL:
+            return "abs(wallDistance(ray," + center + "," + size + "))";
+        case OBJECT_MANDELBOX:
+            return "opIntersection(mandelboxFractalDistance(ray," + center + "," + size + ",ORBIT_TRAPPED),cubeDistance(ray," + center + "," + size + "))";
+        case OBJECT_ROOM:
+            return "opSubtraction(wallDistance(ray," + vec3Literal(object.center + glm::vec3(0.0f,0.5f,0.0f)) + "," + floatLiteral(object.size/1.5f) + "),"
+                   "wallDistance(ray," + center + "," + size + "))";
+        case OBJECT_CYLINDER:
+            return "abs(opSubtraction(cylinderDistance(ray," + vec3Literal(object.center + glm::vec3(0.0f,0.003f,0.0f)) + "," + size + "),"
+                   "cylinderDistance(ray," + center + "," + size + ")))";
+        case OBJECT_JULIA:
+            return size + "*juliaFractalDistance(ray/" + size + "," + center + "," + size + ",ORBIT_TRAPPED)";
+    }
+    return floatLiteral(0.0f);
+}
+
+std::string generateGenericDefines(const Scene& scene){
+    const std::vector<Object>& objects = scene.getObjects();
+    for(unsigned int i = 0; i < objects.size(); i++){
+        if(objects[i].type == OBJECT_CSG) return "#define SCENE_USES_CSG\n";
+    }
+    return "";
+}
+
+std::string generateSceneDefines(const Scene& scene){
+    if(!scene.getBvh().isEmpty() || scene.getObjectCount() == 0) return generateGenericDefines(scene);
+
+    std::ostringstream defines;
+    std::string objectList, usedFunctionList;
+
+    const std::vector<Object>& objects = scene.getObjects();
+    for(unsigned int i = 0; i < objects.size(); i++){
+        const Object& object = objects[i];
+        if(object.type < 0 || object.type >= NUM_OBJECT_TYPES) continue;
+        usedFunctionList += std::string(" ") + usedFunctions[object.type];
+        std::string expression = object.type == OBJECT_CSG ? getCsgExpression(object,scene,usedFunctionList) : getDistanceExpression(object);
+        defines << "#define SCENE_OBJECT_" << i << (scene.isBrickMapped(object) ? " SCENE_FRACTAL(" : " SCENE_OBJECT(") << expression << ","
+                << vec3Literal(object.albedo) << "," << object.id << ")\n";
+        objectList += " SCENE_OBJECT_" + std::to_string(i);
+    }
+    defines << "#define SCENE_OBJECT_DISTANCES" << objectList << "\n";
+
+    //A function used by several objects is defined once
+    std::string usedNames;
+    std::istringstream names(usedFunctionList);
+    std::string name;
+    while(names >> name){
+        if(usedNames.find(" " + name + " ") != std::string::npos) continue;
+        usedNames += " " + name + " ";
+        defines << "#define SCENE_USES_" << name << "\n";
+    }
+    return defines.str();
+}
@@ -0,0 +1,20 @@
+#ifndef SHADERGENERATOR_H
+#define SHADERGENERATOR_H
+
+#include <string>
+#include "scene.h"
+
+//Generates the defines that specialize shaders/pathTracer.fs to a scene. Every object becomes a SCENE_OBJECT line
+//that calls its distance function with the center, size and albedo folded in as constants, fractals a SCENE_FRACTAL
+//line that only calls it where their brick map does not bound them. Csg objects have the program of their shape
+//unrolled into nested calls instead of running the interpreter. Only the distance functions the scene uses are
+//compiled. Scenes with a bounding volume hierarchy get no defines, walking the hierarchy skips more work than
+//unrolling their objects saves, so they keep the generic shader.
+//Scenes of the same structure generate the same defines, which makes them the key of the shader variant.
+std::string generateSceneDefines(const Scene& scene);
+
+//Generates the defines of the generic shader for a scene, which only compiles the csg interpreter if the scene has
+//csg objects.
+std::string generateGenericDefines(const Scene& scene);
+
+#endif // SHADERGENERATOR_H
@@ -1,9 +1,153 @@
 #version 410 core
 
+//One iteration of an edge avoiding a-trous wavelet filter, in the spirit of spatiotemporal variance guided filtering.
+//Each iteration spreads a 5x5 B3 spline kernel stepSize pixels apart, so five iterations reach 62 pixels away.
+//Neighbours only contribute when they belong to the same object, face the same way, lie at the same depth and have
+//a luminance that the noise of the pixel explains. The variance is filtered along with the color so the later,
+//wider iterations trust the luminance less as the noise goes down.
+
 in vec2 texCoords;
 
-uniform sampler2D screenTexture;
+layout(location = 0) out vec4 fragColor;
+
+uniform sampler2D screenTexture; // accumulated mean and sample count for the variance estimate, color and variance after it
+uniform sampler2D inputMoments; // squared luminance deviations of the accumulation
+uniform sampler2D gBufferHit; // normal, distance along the primary ray
+uniform sampler2D gBufferSurface; // object id or -1 for the background
+
+uniform bool isVarianceEstimate; // first pass, on its own it passes the accumulation through unfiltered
+uniform int stepSize; // pixels between the taps of an iteration
+uniform bool isOutput; // the last pass, its result is upscaled to the screen
+uniform vec2 resolution; // render resolution, the targets can be larger
+
+const vec3 LUMINANCE = vec3(0.2126,0.7152,0.0722);
+const float KERNEL[3] = float[3](3.0/8.0,1.0/4.0,1.0/16.0);
+const float GAUSSIAN[2] = float[2](1.0/4.0,1.0/8.0);
+
+//Pixels with fewer samples estimate their variance from their neighbours
+const float MIN_TEMPORAL_SAMPLES = 4.0;
+
+const float NORMAL_PHI = 64.0;
+const float DEPTH_PHI = 2.0;
+const float LUMINANCE_PHI = 8.0;
+
+ivec2 lastPixel = ivec2(0);
+
+vec4 fetchInput(ivec2 pixel){
+    return texelFetch(screenTexture,clamp(pixel,ivec2(0),lastPixel),0);
+}
+
+vec4 fetchHit(ivec2 pixel){
+    return texelFetch(gBufferHit,clamp(pixel,ivec2(0),lastPixel),0);
+}
+
+float fetchObjectId(ivec2 pixel){
+    return texelFetch(gBufferSurface,clamp(pixel,ivec2(0),lastPixel),0).x;
+}
+
+/*
+ * Weight of a neighbour from the primary hits alone, depthGradient is the change of distance per pixel around the center.
+ */
+float getGeometryWeight(vec4 centerHit, float centerId, vec4 hit, float objectId, vec2 offset, vec2 depthGradient){
+    if(objectId != centerId) return 0.0;
+    float normalWeight = pow(max(dot(centerHit.xyz,hit.xyz),0.0),NORMAL_PHI);
+    float depthWeight = exp(-abs(centerHit.w-hit.w)/(DEPTH_PHI*abs(dot(depthGradient,offset))+1e-3));
+    return normalWeight*depthWeight;
+}
+
+/*
+ * The smaller of the one sided differences, the larger one crosses the edge when there is one.
+ */
+vec2 getDepthGradient(ivec2 pixel, float depth){
+    float dx = min(abs(fetchHit(pixel+ivec2(1,0)).w-depth),abs(depth-fetchHit(pixel-ivec2(1,0)).w));
+    float dy = min(abs(fetchHit(pixel+ivec2(0,1)).w-depth),abs(depth-fetchHit(pixel-ivec2(0,1)).w));
+    return vec2(dx,dy);
+}
+
+/*
+ * Color and variance of the mean luminance of a pixel of the accumulation. Pixels with a short history
+ * take the variance of the luminance of their neighbours on the same surface instead.
+ */
+vec4 estimateVariance(ivec2 pixel, vec4 centerHit, float centerId){
+    vec4 accumulated = fetchInput(pixel);
+    float samples = accumulated.w;
+    if(samples >= MIN_TEMPORAL_SAMPLES){
+        float squaredDeviations = texelFetch(inputMoments,pixel,0).x;
+        return vec4(accumulated.rgb,squaredDeviations/(samples-1.0)/samples);
+    }
+    if(centerId < 0.0) return vec4(accumulated.rgb,0.0);
+
+    vec2 depthGradient = getDepthGradient(pixel,centerHit.w);
+    vec2 moments = vec2(0.0);
+    float totalWeight = 0.0;
+    for(int y = -3; y <= 3; y++){
+        for(int x = -3; x <= 3; x++){
+            ivec2 neighbour = pixel + ivec2(x,y);
+            float weight = (x == 0 && y == 0) ? 1.0 : getGeometryWeight(centerHit,centerId,fetchHit(neighbour),fetchObjectId(neighbour),vec2(x,y),depthGradient);
+            float luminance = dot(fetchInput(neighbour).rgb,LUMINANCE);
+            moments += weight*vec2(luminance,luminance*luminance);
+            totalWeight += weight;
+        }
+    }
+    moments /= totalWeight;
+    return vec4(accumulated.rgb,max(moments.y-moments.x*moments.x,0.0)/max(samples,1.0));
+}
 
 void main(){
-    gl_FragColor = texture(screenTexture,texCoords);
-}
\ No newline at end of file
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    lastPixel = ivec2(resolution) - 1;
+
+    vec4 centerHit = texelFetch(gBufferHit,pixel,0);
+    float centerId = texelFetch(gBufferSurface,pixel,0).x;
+
+    if(isVarianceEstimate){
+        vec4 center = estimateVariance(pixel,centerHit,centerId);
+        fragColor = vec4(center.rgb,isOutput ? 1.0 : center.w);
+        return;
+    }
+
+    //The background has no noise to filter
+    vec4 center = fetchInput(pixel);
+    if(centerId < 0.0){
+        fragColor = vec4(center.rgb,isOutput ? 1.0 : center.w);
+        return;
+    }
+
+    //The variance steering the luminance weight is blurred, a single noisy estimate would stop the filter at random
+    float blurredVariance = 0.0;
+    for(int y = -1; y <= 1; y++){
+        for(int x = -1; x <= 1; x++){
+            blurredVariance += fetchInput(pixel + ivec2(x,y)).w*GAUSSIAN[abs(x)]*GAUSSIAN[abs(y)];
+        }
+    }
+    float luminanceScale = LUMINANCE_PHI*sqrt(max(blurredVariance,0.0))+1e-6;
+    float centerLuminance = dot(center.rgb,LUMINANCE);
+    vec2 depthGradient = getDepthGradient(pixel,centerHit.w);
+
+    vec3 color = center.rgb*KERNEL[0]*KERNEL[0];
+    float variance = center.w*KERNEL[0]*KERNEL[0]*KERNEL[0]*KERNEL[0];
+    float totalWeight = KERNEL[0]*KERNEL[0];
+
+    for(int y = -2; y <= 2; y++){
+        for(int x = -2; x <= 2; x++){
+            if(x == 0 && y == 0) continue;
+            ivec2 offset = ivec2(x,y)*stepSize;
+            ivec2 neighbour = pixel + offset;
+            if(any(lessThan(neighbour,ivec2(0))) || any(greaterThan(neighbour,lastPixel))) continue;
+
+            vec4 neighbourColor = texelFetch(screenTexture,neighbour,0);
+            float geometryWeight = getGeometryWeight(centerHit,centerId,texelFetch(gBufferHit,neighbour,0),texelFetch(gBufferSurface,neighbour,0).x,vec2(offset),depthGradient);
+            float luminanceWeight = exp(-abs(dot(neighbourColor.rgb,LUMINANCE)-centerLuminance)/luminanceScale);
+            float weight = KERNEL[abs(x)]*KERNEL[abs(y)]*geometryWeight*luminanceWeight;
+
+            color += weight*neighbourColor.rgb;
+            variance += weight*weight*neighbourColor.w;
+            totalWeight += weight;
+        }
+    }
+
+    color /= totalWeight;
+    variance /= totalWeight*totalWeight;
+
+    fragColor = vec4(color,isOutput ? 1.0 : variance);
+}
@@ -2,28 +2,68 @@
 
 in vec4 gl_FragCoord;
 
-//layout(location = 0) out vec3 color;
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 momentsOutput;
+layout(location = 2) out vec4 gBufferHitOutput;
+layout(location = 3) out vec4 gBufferSurfaceOutput;
+layout(location = 4) out vec4 gBufferLightOutput;
 
 layout (location = 2) in vec2 texCoords;
 
-uniform sampler2D blueNoise;
-uniform sampler2D inputTexture;
+uniform sampler2D inputTexture; // previous frame, mean color of the pixel and its sample count
+uniform sampler2D inputMoments; // previous frame, sum of squared luminance deviations from the mean and paths taken
+uniform int accumulatedSamples; // 0 restarts the accumulation after the camera moved, from the reprojected history if there is one
+
+//Adaptive sampling, disabled when noiseThreshold is 0. Once a pixel has MIN_ADAPTIVE_SAMPLES samples the
+//relative standard error of its mean luminance decides how many samples it takes per frame, pixels below
+//the threshold are converged and skip path tracing entirely.
+uniform float noiseThreshold;
+const int MIN_ADAPTIVE_SAMPLES = 16;
+const int MAX_SAMPLES_PER_FRAME = 4;
+const float RELATIVE_ERROR_FLOOR = 0.01; // keeps near black pixels from needing endless samples
+const vec3 LUMINANCE = vec3(0.2126,0.7152,0.0722);
+
+//The primary ray does not depend on the random numbers, so while the camera is static its first hit,
+//the normal there and the direct light found by next event estimation are the same for every sample.
+//They are written to the G-buffer when the accumulation restarts and read back by the frames after it.
+uniform bool isPrimaryHitCached;
+uniform sampler2D gBufferHit; // normal, distance along the primary ray
+uniform sampler2D gBufferSurface; // object id or -1 for the background, y and z of the orbit trap
+uniform sampler2D gBufferLight; // direct light at the hit
+vec4 primaryHit = vec4(0.0);
+vec4 primarySurface = vec4(-1.0,0.0,0.0,0.0);
+vec4 primaryLight = vec4(0.0);
+
+//Temporal reprojection. When the camera moves, a pixel carries over the history of the pixels its primary hit
+//covered in the previous frame, found by projecting the hit with the previous view projection. The G-buffer bound
+//then still holds the hits of the previous frame, taps that saw another object, a surface facing elsewhere or
+//something at another depth were disoccluded and are left out. The history is capped so the shading can follow
+//what changes with the view and the resampling does not blur the image for good. Specular and refractive
+//surfaces change the most with the view, they keep far less.
+uniform bool isHistoryReprojected;
+uniform mat4 previousViewProjection;
+uniform vec3 previousCameraPosition;
+uniform vec2 previousResolution; // differs from the resolution after the render resolution changed
+const float MAX_REPROJECTED_SAMPLES = 32.0;
+const float MAX_REPROJECTED_GLOSSY_SAMPLES = 4.0;
+const float REPROJECTION_DEPTH_TOLERANCE = 0.05; // relative to the distance to the previous camera
+const float REPROJECTION_NORMAL_TOLERANCE = 0.9; // cosine
 
 varying vec2 v_resolution;
 varying vec3 v_cameraPosition;
 varying mat3 v_cameraMatrix;
 varying float v_fov;
 varying float v_time;
-varying float v_hasCameraChanged;
 
 //Math constantszcxcx
 const float PI = 3.1415926;
 
-//Ray Marching constants
-const int MAX_MARCHING_STEPS = 128;
+//Ray Marching constants, set from the scene march settings
+uniform int maxMarchingSteps;
 const float MIN_DIST = 0.0;
-const float MAX_DIST = 100.0;
-const float EPSILON = 0.001;
+uniform float maxDist;
+uniform float epsilon;
+uniform float relaxation; // over-relaxation of the sphere tracing steps, 1 disables it
 const bool hasFog = true;
 const bool hasGlow = true;
 const vec3 fogColor = vec3(0.792,0.882,1.0);
@@ -32,50 +72,65 @@ const vec3 glowColor = vec3(1.0,1.0,1.0);
 vec3 glow = vec3(0.0,0.0,0.0);
 
 //Path marching constants and globals
-const int MAX_MARCH_DEPTH = 4; // bounces
+uniform int maxMarchDepth; // bounces
 vec3 samplePixelColor = vec3(0.0,0.0,0.0);
-vec3 pixelColor = vec3(0.0,0.0,0.0);
 int marchedSteps = 0;
-float distanceToScene = MAX_DIST;
-const float refractionIndex = 1.33;
 
-vec4 orbitTrap = vec4(MAX_DIST); // Orbit trapping in order to shade or color fractals
+//Rays marched by this fragment and the steps they took, written next to the moments for the benchmark
+int marchedRays = 0;
+int totalMarchedSteps = 0;
+
+float distanceToScene;
+uniform float refractionIndex;
+
+vec4 orbitTrap; // Orbit trapping in order to shade or color fractals
 const int COLORITERATIONS = 5;
 
+//Level of detail, see marcher.h and sdf.h. A ray hits within the footprint of its pixel and the fractals take the
+//fewest iterations whose error stays below a tenth of it. Bounce rays start a cone of their own at their origin.
+const float FOOTPRINT_PER_PIXEL = 0.25; // share of the radius of a pixel, finer detail still shades the image
+const int FRACTAL_ITERATIONS = 10;
+const int MIN_FRACTAL_ITERATIONS = COLORITERATIONS; // the orbit trap, and so the color, never loses detail
+const vec2 MANDELBULB_ERROR = vec2(1.0,3.5); // error scale and ratio, within scale*ratio^-n after n iterations
+const vec2 MANDELBOX_ERROR = vec2(2.2,2.7);
+const vec2 JULIA_ERROR = vec2(0.19,1.44);
+float pixelRadius; // radius of a pixel at a unit of distance from the camera
+float footprint = 0.0; // the scene is evaluated at it, rayMarchScene leaves it at the footprint of the hit
+
 //Constants for multi sampling
 const int NUM_OF_SAMPLES = 1;
 
 
-//Scene constants
-const int sceneObjectNumber = 2;
-const vec3 sceneBackgroundColor = vec3(0.792,0.882,1.0);
-const vec3 sceneFogColor = vec3(1.0,1.0,1.0);
+//Scene parameters, uploaded by the host from the loaded scene
+uniform int sceneObjectCount;
+uniform vec3 sceneBackgroundColor;
+uniform vec3 sceneFogColor;
 const bool isFractalMode = false;
 
 //Represents an object
 struct Object {
 	vec3 center;
 	float size;
-	int type; //0 for sphere, 1 for cube, 2 for plane, 3 for torus, 4 for prism, 5 for pyramid, 6 for mandelbulb, 7 for wall, 8 for mandelbox, 9 for room, 10 for cylinder, 11 for julia
+	int type; //0 for sphere, 1 for cube, 2 for plane, 3 for torus, 4 for prism, 5 for pyramid, 6 for mandelbulb, 7 for wall, 8 for mandelbox, 9 for room, 10 for cylinder, 11 for julia, 12 for csg
 	vec3 albedo; //color of the object 
 	double emission; //if non 0 it is a light source
 	int surfaceType; //diffuse 0, specular 1 or refractive 2 
 	int id; //object id
+	int program; //first instruction of the program of the shape of csg objects
 };
 
-//Represents the current scene
-struct Scene {
-	Object sceneObjects[sceneObjectNumber];
-};
+//Scene objects, three texels per object: (center, size), (albedo, emission), (type, surfaceType, id, program)
+uniform samplerBuffer sceneObjects;
 
-//Scene instantiation
-Scene globalScene = Scene(Object[sceneObjectNumber](
-	Object(vec3(0.0,-2.0,0.0),2,1,vec3(1.2,1.2,1.2),0.0,0,0),
-	Object(vec3(0,0.5,0.0),1.75,8,vec3(0,0,0),0.4,1,1)
-));
+Object getSceneObject(int index){
+	vec4 geometry = texelFetch(sceneObjects,index*3);
+	vec4 material = texelFetch(sceneObjects,index*3+1);
+	vec4 ids = texelFetch(sceneObjects,index*3+2);
+	return Object(geometry.xyz,geometry.w,int(ids.x),material.xyz,material.w,int(ids.y),int(ids.z),int(ids.w));
+}
 
-vec3 lightSource = vec3(5.0,10.0,40.0);
-vec3 lightColor = vec3(0.977,0.836,0.645);
+uniform vec3 lightSource;
+uniform vec3 lightColor;
 
 struct SceneCollision {
 	float distance;
@@ -92,33 +147,124 @@ float opSubtraction( float d1, float d2 ) { return max(-d1,d2); }
 
 float opIntersection( float d1, float d2 ) { return max(d1,d2); }
 
-//Simple shapes
+//Smooth operations blend the surfaces where both distances are within k of each other (Quilez)
+float opSmoothUnion(float d1, float d2, float k){
+	float h = clamp(0.5 + 0.5*(d2-d1)/k,0.0,1.0);
+	return mix(d2,d1,h) - k*h*(1.0-h);
+}
+
+float opSmoothSubtraction(float d1, float d2, float k){
+	float h = clamp(0.5 - 0.5*(d2+d1)/k,0.0,1.0);
+	return mix(d2,-d1,h) + k*h*(1.0-h);
+}
+
+float opSmoothIntersection(float d1, float d2, float k){
+	float h = clamp(0.5 - 0.5*(d2-d1)/k,0.0,1.0);
+	return mix(d2,d1,h) + k*h*(1.0-h);
+}
+
+//Without a scene specialized by the host every distance function can be called,
+//a specialized scene defines SCENE_OBJECT_DISTANCES and the functions its objects use.
+//The host defines SCENE_USES_CSG for generic scenes with csg objects alone, some drivers run every case of a
+//switch under a mask of its invocations, and the interpreter would cost every distance evaluation a pass through it.
+#ifndef SCENE_OBJECT_DISTANCES
+#define SCENE_USES_SPHERE
+#define SCENE_USES_CUBE
+#define SCENE_USES_WALL
+#define SCENE_USES_PLANE
+#define SCENE_USES_TORUS
+#define SCENE_USES_PRISM
+#define SCENE_USES_PYRAMID
+#define SCENE_USES_CYLINDER
+#define SCENE_USES_JULIA
+#define SCENE_USES_MANDELBOX
+#define SCENE_USES_MANDELBULB
+#define SCENE_USES_BOX
+#endif
+
+//Simple shapes, with their gradients, the unit normal of the surface closest to the point
+
+//Outside of a box away from the closest point of the box, inside of it along the axis of the closest face
+vec3 boxGradient(vec3 currentPoint, vec3 center, vec3 halfSize){
+	vec3 offset = currentPoint-center;
+	vec3 q = abs(offset) - halfSize;
+	vec3 gradient;
+	if(max(q.x,max(q.y,q.z)) > 0.0){
+		gradient = normalize(max(q,0.0));
+	} else if(q.x > q.y && q.x > q.z){
+		gradient = vec3(1.0,0.0,0.0);
+	} else {
+		gradient = q.y > q.z ? vec3(0.0,1.0,0.0) : vec3(0.0,0.0,1.0);
+	}
+	return gradient*sign(offset);
+}
+
+#ifdef SCENE_USES_BOX
+float boxDistance(vec3 currentPoint, vec3 center, vec3 halfSize){
+	vec3 q = abs(currentPoint-center) - halfSize;
+	return length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)),0.0);
+}
+#endif
 
+#ifdef SCENE_USES_SPHERE
 float sphereDistance(vec3 currentPoint, vec3 center, float radius){
 	return length(currentPoint-center) - radius;
 }
 
+vec3 sphereGradient(vec3 currentPoint, vec3 center){
+	return normalize(currentPoint-center);
+}
+#endif
+
+#ifdef SCENE_USES_CUBE
 float cubeDistance(vec3 currentPoint, vec3 center, float sideLength){
 	vec3 q = abs(currentPoint-center) - vec3(sideLength);
 	return length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)),0.0);
 }
 
+vec3 cubeGradient(vec3 currentPoint, vec3 center, float sideLength){
+	return boxGradient(currentPoint,center,vec3(sideLength));
+}
+#endif
+
+#ifdef SCENE_USES_WALL
 float wallDistance(vec3 currentPoint, vec3 center, float sideLength){
 	vec3 q = abs(currentPoint-center) - vec3(sideLength,sideLength,0.1);
 	return length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)),0.0);
 }
 
+vec3 wallGradient(vec3 currentPoint, vec3 center, float sideLength){
+	return boxGradient(currentPoint,center,vec3(sideLength,sideLength,0.1));
+}
+#endif
+
+#ifdef SCENE_USES_PLANE
 float planeDistance(vec3 currentPoint, vec3 center, float size){
 	vec3 q = abs(currentPoint-center) - vec3(size,0.01,size);
 	return length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)),0.0);
 }
 
+vec3 planeGradient(vec3 currentPoint, vec3 center, float size){
+	return boxGradient(currentPoint,center,vec3(size,0.01,size));
+}
+#endif
+
+#ifdef SCENE_USES_TORUS
 float torusDistance(vec3 currentPoint, vec3 center, vec2 size){
 	currentPoint = currentPoint - center;
 	vec2 q = vec2(length(currentPoint.xz)-size.x,currentPoint.y);
   	return length(q)-size.y/2;
 }
 
+//Away from the closest point of the ring through the middle of the torus
+vec3 torusGradient(vec3 currentPoint, vec3 center, vec2 size){
+	currentPoint = currentPoint - center;
+	vec2 ring = normalize(currentPoint.xz)*size.x;
+	return normalize(currentPoint - vec3(ring.x,0.0,ring.y));
+}
+#endif
+
+#ifdef SCENE_USES_PRISM
 float prismDistance( vec3 currentPoint, vec3 center, vec2 size){
 	currentPoint = currentPoint - center;
   const float k = sqrt(3.0);
@@ -132,7 +278,9 @@ float prismDistance( vec3 currentPoint, vec3 center, vec2 size){
   float d2 = abs(currentPoint.z)-size.y;
   return length(max(vec2(d1,d2),0.0)) + min(max(d1,d2), 0.);
 }
+#endif
 
+#ifdef SCENE_USES_PYRAMID
 float pyramidDistance( vec3 currentPoint, vec3 center, float size){
 	currentPoint = currentPoint - center;
   float m2 = size*size + 0.25;
@@ -153,7 +301,9 @@ float pyramidDistance( vec3 currentPoint, vec3 center, float size){
     
   return sqrt( (d2+q.z*q.z)/m2 ) * sign(max(q.z,-currentPoint.y));
 }
+#endif
 
+#ifdef SCENE_USES_CYLINDER
 float cylinderDistance( vec3 currentPoint, vec3 center, float size ){
 	float height = size;
 	float radius = size/2;
@@ -162,32 +312,58 @@ float cylinderDistance( vec3 currentPoint, vec3 center, float size ){
   return min(max(d.x,d.y),0.0) + length(max(d,0.0));
 }
 
+//The gradient of the box distance in the plane through the axis and the point, turned around the axis
+vec3 cylinderGradient(vec3 currentPoint, vec3 center, float size){
+	currentPoint = currentPoint - center;
+	vec2 radial = normalize(currentPoint.xz);
+	vec2 d = abs(vec2(length(currentPoint.xz),currentPoint.y)) - vec2(size/2,size);
+	vec2 gradient;
+	if(max(d.x,d.y) > 0.0){
+		gradient = normalize(max(d,0.0));
+	} else {
+		gradient = d.x > d.y ? vec2(1.0,0.0) : vec2(0.0,1.0);
+	}
+	return vec3(gradient.x*radial.x,gradient.y*sign(currentPoint.y),gradient.x*radial.y);
+}
+#endif
+
+
+//Fractals, they take fewer iterations the wider the footprint is. A footprint of 0 asks for full detail.
+//They only write their orbit trap to orbitTrap if isOrbitTrapped, callers pass a constant so it is compiled out of the
+//copies that only need the distance.
+int getFractalIterations(float footprint, vec2 error){
+	if(footprint <= 0.0) return FRACTAL_ITERATIONS;
+	return clamp(int(ceil(log(error.x/(0.1*footprint))/log(error.y))),MIN_FRACTAL_ITERATIONS,FRACTAL_ITERATIONS);
+}
 
-//Fractals
-float juliaFractalDistance(vec3 currentPoint, vec3 center, float size) {
+#ifdef SCENE_USES_JULIA
+float juliaFractalDistance(vec3 currentPoint, vec3 center, float size, bool isOrbitTrapped) {
 	currentPoint = currentPoint - center;
-	orbitTrap = vec4(MAX_DIST);
+	if (isOrbitTrapped) orbitTrap = vec4(maxDist);
 	const float BAILOUT = 10.0;
+	int iterations = getFractalIterations(footprint/size,JULIA_ERROR);
 	vec4 p = vec4(currentPoint, 0.0);
 	vec4 dp = vec4(1.0,0.0,0.0,0.0);
-	for (int i = 0; i < 10; i++) {
+	for (int i = 0; i < iterations; i++) {
 		dp = 2.0* vec4(p.x*dp.x-dot(p.yzw, dp.yzw), p.x*dp.yzw+dp.x*p.yzw+cross(p.yzw, dp.yzw));
 		p = vec4(p.x*p.x-dot(p.yzw, p.yzw), vec3(2.0*p.x*p.yzw))-0.38;
 		float p2 = dot(p,p);
-		if (i<COLORITERATIONS) orbitTrap = min(orbitTrap, abs(vec4(p.xyz,p2)));
+		if (isOrbitTrapped && i<COLORITERATIONS) orbitTrap = min(orbitTrap, abs(vec4(p.xyz,p2)));
 		if (p2 > BAILOUT) break;
 	}
 	float r = length(p);
 	return  0.5 * r * log(r) / length(dp);
 }
+#endif
 
-float mandelboxFractalDistance(vec3 currentPoint, vec3 center, float size) {
+#ifdef SCENE_USES_MANDELBOX
+float mandelboxFractalDistance(vec3 currentPoint, vec3 center, float size, bool isOrbitTrapped) {
 	currentPoint = currentPoint - center;
   float SCALE = 2.7;
   float MR2 = 0.1;
-  int ITERATIONS = 10;
+  int ITERATIONS = getFractalIterations(footprint,MANDELBOX_ERROR);
 
-	orbitTrap = vec4(MAX_DIST);
+	if (isOrbitTrapped) orbitTrap = vec4(maxDist);
 
   vec4 scalevec = vec4(SCALE, SCALE, SCALE, abs(SCALE)) / MR2;
   float C1 = abs(SCALE-1.0), C2 = pow(abs(SCALE), float(1-ITERATIONS));
@@ -198,117 +374,717 @@ float mandelboxFractalDistance(vec3 currentPoint, vec3 center, float size) {
   for (int i=0; i<ITERATIONS; i++) {
     p.xyz = clamp(p.xyz, -1.0, 1.0) * 2.0 - p.xyz;  // box fold: min3, max3, mad3
     float r2 = dot(p.xyz, p.xyz);  // dp3
-		if (i<COLORITERATIONS) orbitTrap = min(orbitTrap, abs(vec4(p.xyz,r2)));
+		if (isOrbitTrapped && i<COLORITERATIONS) orbitTrap = min(orbitTrap, abs(vec4(p.xyz,r2)));
     p.xyzw *= clamp(max(MR2/r2, MR2), 0.0, 1.0);  // sphere fold: div1, max1.sat, mul4
     p.xyzw = p*scalevec + p0;  // mad4
   }
   return ((length(p.xyz) - C1) / p.w) - C2;
 }
+#endif
 
-float mandelbulbFractalDistance(vec3 currentPoint, vec3 center, float size) {
+#ifdef SCENE_USES_MANDELBULB
+/*
+ * Power 8 mandelbulb iteration in triplex algebra.
+ * z^8 is expanded with the binomial theorem on (z + i*rho)^8 for the polar angle and on
+ * (x + i*y)^8 for the azimuth, which gives the same point as the polar form
+ * r^8*(sin(8*theta)*cos(8*phi), sin(8*theta)*sin(8*phi), cos(8*theta)) without any trigonometry.
+ */
+float mandelbulbFractalDistance(vec3 currentPoint, vec3 center, float size, bool isOrbitTrapped) {
 	currentPoint = currentPoint - center;
-	int ITERATIONS = 10;
+	int ITERATIONS = getFractalIterations(footprint/size,MANDELBULB_ERROR);
 	float BAILOUT = 10.0;
-	int POWER = 8;
 
-	orbitTrap = vec4(MAX_DIST);
+	if (isOrbitTrapped) orbitTrap = vec4(maxDist);
 
 	vec3 z = currentPoint;
 	float dr = 1.0;
 	float r = 0.0;
 	for (int i = 0; i < ITERATIONS ; i++) {
-		r = length(z);
+		float r2 = dot(z,z);
+		r = sqrt(r2);
 
 		if (r>BAILOUT) break;
 
-		// convert to polar coordinates
-		float theta = acos(z.z/r);
-		float phi = atan(z.y,z.x);
-		dr =  pow( r, POWER-1.0 )*POWER*dr + 1.0;
-		
-		// scale and rotate the point
-		float zr = pow( r,POWER);
-		theta = theta*POWER;
-		phi = phi*POWER;
-		
-		// convert back to cartesian coordinates
-		z = zr*vec3(sin(theta)*cos(phi), sin(phi)*sin(theta), cos(theta));
+		dr = r2*r2*r2*r*8.0*dr + 1.0;
+
+		// azimuth: (x + i*y)^8 on the unit circle gives cos(8*phi) and sin(8*phi)
+		float rho2 = z.x*z.x + z.y*z.y;
+		float rho = sqrt(rho2);
+		vec2 azimuth = rho2 > 0.0 ? z.xy/rho : vec2(0.0);
+		float ax2 = azimuth.x*azimuth.x;
+		float ay2 = azimuth.y*azimuth.y;
+		float cos8Phi = ax2*ax2*ax2*ax2 - 28.0*ax2*ax2*ax2*ay2 + 70.0*ax2*ax2*ay2*ay2 - 28.0*ax2*ay2*ay2*ay2 + ay2*ay2*ay2*ay2;
+		float sin8Phi = 8.0*azimuth.x*azimuth.y*(ax2-ay2)*(ax2*ax2 - 6.0*ax2*ay2 + ay2*ay2);
+
+		// polar angle: (z + i*rho)^8 gives r^8*cos(8*theta) and r^8*sin(8*theta)
+		float z2 = z.z*z.z;
+		float z4 = z2*z2;
+		float rho4 = rho2*rho2;
+		float zr8Cos = z4*z4 - 28.0*z4*z2*rho2 + 70.0*z4*rho4 - 28.0*z2*rho4*rho2 + rho4*rho4;
+		float zr8Sin = 8.0*z.z*rho*(z4*z2 - 7.0*z4*rho2 + 7.0*z2*rho4 - rho4*rho2);
+
+		z = vec3(zr8Sin*cos8Phi, zr8Sin*sin8Phi, zr8Cos);
 
 		z+=currentPoint;
 
-		if (i<COLORITERATIONS) orbitTrap = min(orbitTrap,abs(vec4(z.x,z.y,z.z,r*r)));
+		if (isOrbitTrapped && i<COLORITERATIONS) orbitTrap = min(orbitTrap,abs(vec4(z.x,z.y,z.z,r2)));
 	}
 	return 0.5*log(r)*r/dr;
 }
+#endif
+
+#if defined(SCENE_USES_JULIA) || defined(SCENE_USES_MANDELBULB)
+//Dual numbers for forward mode automatic differentiation, see dual.h. A vec4 holds a value in x and its partial
+//derivatives by the x, y and z of the point in yzw, sums and products with constants are the ones of vec4.
+vec4 dualMultiply(vec4 a, vec4 b){
+	return vec4(a.x*b.x,a.x*b.yzw + b.x*a.yzw);
+}
+
+vec4 dualDivide(vec4 a, vec4 b){
+	float quotient = a.x/b.x;
+	return vec4(quotient,(a.yzw - quotient*b.yzw)/b.x);
+}
+
+//The square root has no derivative at 0, it is taken as 0 there
+vec4 dualSqrt(vec4 a){
+	float root = sqrt(a.x);
+	return vec4(root,root > 0.0 ? a.yzw*0.5/root : vec3(0.0));
+}
+
+vec4 dualLog(vec4 a){
+	return vec4(log(a.x),a.yzw/a.x);
+}
+
+//The distance estimate 0.5*log(r)*r/dr of the fractals
+vec3 getFractalGradient(vec4 r, vec4 dr){
+	return 0.5*dualDivide(dualMultiply(dualLog(r),r),dr).yzw;
+}
+#endif
+
+#ifdef SCENE_USES_JULIA
+//Gradient of juliaFractalDistance in forward mode, every component of the quaternion p and of its derivative dp is
+//a dual number
+vec3 juliaFractalGradient(vec3 currentPoint, vec3 center, float size) {
+	currentPoint = currentPoint - center;
+	const float BAILOUT = 10.0;
+	int iterations = getFractalIterations(footprint/size,JULIA_ERROR);
+	vec4 px = vec4(currentPoint.x,1.0,0.0,0.0), py = vec4(currentPoint.y,0.0,1.0,0.0), pz = vec4(currentPoint.z,0.0,0.0,1.0), pw = vec4(0.0);
+	vec4 dpx = vec4(1.0,0.0,0.0,0.0), dpy = vec4(0.0), dpz = vec4(0.0), dpw = vec4(0.0);
+	for (int i = 0; i < iterations; i++) {
+		vec4 nextDpx = 2.0*(dualMultiply(px,dpx) - dualMultiply(py,dpy) - dualMultiply(pz,dpz) - dualMultiply(pw,dpw));
+		vec4 nextDpy = 2.0*(dualMultiply(px,dpy) + dualMultiply(dpx,py) + dualMultiply(pz,dpw) - dualMultiply(pw,dpz));
+		vec4 nextDpz = 2.0*(dualMultiply(px,dpz) + dualMultiply(dpx,pz) + dualMultiply(pw,dpy) - dualMultiply(py,dpw));
+		dpw = 2.0*(dualMultiply(px,dpw) + dualMultiply(dpx,pw) + dualMultiply(py,dpz) - dualMultiply(pz,dpy));
+		dpx = nextDpx;
+		dpy = nextDpy;
+		dpz = nextDpz;
+		vec4 nextPx = dualMultiply(px,px) - dualMultiply(py,py) - dualMultiply(pz,pz) - dualMultiply(pw,pw);
+		py = 2.0*dualMultiply(px,py);
+		pz = 2.0*dualMultiply(px,pz);
+		pw = 2.0*dualMultiply(px,pw);
+		px = nextPx;
+		px.x -= 0.38;
+		py.x -= 0.38;
+		pz.x -= 0.38;
+		pw.x -= 0.38;
+		float p2 = px.x*px.x + py.x*py.x + pz.x*pz.x + pw.x*pw.x;
+		if (p2 > BAILOUT) break;
+	}
+	vec4 r = dualSqrt(dualMultiply(px,px) + dualMultiply(py,py) + dualMultiply(pz,pz) + dualMultiply(pw,pw));
+	vec4 dr = dualSqrt(dualMultiply(dpx,dpx) + dualMultiply(dpy,dpy) + dualMultiply(dpz,dpz) + dualMultiply(dpw,dpw));
+	return getFractalGradient(r,dr);
+}
+#endif
+
+#ifdef SCENE_USES_MANDELBULB
+//Gradient of mandelbulbFractalDistance in forward mode, every coordinate of z and the running derivative dr are
+//dual numbers
+vec3 mandelbulbFractalGradient(vec3 currentPoint, vec3 center, float size) {
+	currentPoint = currentPoint - center;
+	int ITERATIONS = getFractalIterations(footprint/size,MANDELBULB_ERROR);
+	float BAILOUT = 10.0;
+
+	vec4 cx = vec4(currentPoint.x,1.0,0.0,0.0), cy = vec4(currentPoint.y,0.0,1.0,0.0), cz = vec4(currentPoint.z,0.0,0.0,1.0);
+	vec4 zx = cx, zy = cy, zz = cz;
+	vec4 dr = vec4(1.0,0.0,0.0,0.0);
+	vec4 r = vec4(0.0);
+	for (int i = 0; i < ITERATIONS ; i++) {
+		vec4 rho2 = dualMultiply(zx,zx) + dualMultiply(zy,zy);
+		vec4 z2 = dualMultiply(zz,zz);
+		vec4 r2 = rho2 + z2;
+		r = dualSqrt(r2);
+
+		if (r.x>BAILOUT) break;
+
+		vec4 r4 = dualMultiply(r2,r2);
+		dr = 8.0*dualMultiply(dualMultiply(dualMultiply(r4,r2),r),dr);
+		dr.x += 1.0;
+
+		// azimuth: (x + i*y)^8 on the unit circle gives cos(8*phi) and sin(8*phi)
+		vec4 rho = dualSqrt(rho2);
+		vec4 ax = rho2.x > 0.0 ? dualDivide(zx,rho) : vec4(0.0);
+		vec4 ay = rho2.x > 0.0 ? dualDivide(zy,rho) : vec4(0.0);
+		vec4 ax2 = dualMultiply(ax,ax);
+		vec4 ay2 = dualMultiply(ay,ay);
+		vec4 ax4 = dualMultiply(ax2,ax2);
+		vec4 ay4 = dualMultiply(ay2,ay2);
+		vec4 ax2ay2 = dualMultiply(ax2,ay2);
+		vec4 cos8Phi = dualMultiply(ax4,ax4) - 28.0*dualMultiply(ax4,ax2ay2) + 70.0*dualMultiply(ax2ay2,ax2ay2) - 28.0*dualMultiply(ax2ay2,ay4) + dualMultiply(ay4,ay4);
+		vec4 sin8Phi = 8.0*dualMultiply(dualMultiply(dualMultiply(ax,ay),ax2 - ay2),ax4 - 6.0*ax2ay2 + ay4);
+
+		// polar angle: (z + i*rho)^8 gives r^8*cos(8*theta) and r^8*sin(8*theta)
+		vec4 z4 = dualMultiply(z2,z2);
+		vec4 rho4 = dualMultiply(rho2,rho2);
+		vec4 z4rho4 = dualMultiply(z4,rho4);
+		vec4 zr8Cos = dualMultiply(z4,z4) - 28.0*dualMultiply(dualMultiply(z4,z2),rho2) + 70.0*z4rho4 - 28.0*dualMultiply(dualMultiply(z2,rho4),rho2) + dualMultiply(rho4,rho4);
+		vec4 zr8Sin = 8.0*dualMultiply(dualMultiply(zz,rho),dualMultiply(z4,z2) - 7.0*dualMultiply(z4,rho2) + 7.0*dualMultiply(z2,rho4) - dualMultiply(rho4,rho2));
+
+		zx = dualMultiply(zr8Sin,cos8Phi) + cx;
+		zy = dualMultiply(zr8Sin,sin8Phi) + cy;
+		zz = zr8Cos + cz;
+	}
+	return getFractalGradient(r,dr);
+}
+#endif
+
+//Sparse brick maps of the fractals baked by the host, see brickmap.h. Every object has two texels in brickMapObjects,
+//(boundsMin, cellSize) and (firstCell, 0, 0, 0) with a first cell of -1 for objects without a grid. Every cell of
+//brickMapCells holds its brick or -1 and a lower bound of the distance from the cell. The bricks are BRICK_SIZE samples
+//per side in the brickAtlas 3D texture, which the hardware filters trilinearly.
+uniform samplerBuffer brickMapObjects;
+uniform samplerBuffer brickMapCells;
+uniform sampler3D brickAtlas;
+uniform int brickMapObjectCount; // 0 without brick maps
+const int BRICK_MAP_CELLS = 16;
+const int BRICK_SIZE = 8;
+const int ATLAS_BRICKS = 32;
+const float NEAR_VOXELS = 2.0;
+
+/*
+ * Lower bound of the distance from a point to an object. Returns false when the point is too close to the surface
+ * for the bound to stand in for the distance estimate of the object, or the object has no grid.
+ */
+bool getDistanceBound(vec3 ray, int id, out float distanceBound){
+	distanceBound = maxDist;
+	if(id >= brickMapObjectCount) return false;
+	vec4 grid = texelFetch(brickMapObjects,id*2);
+	int firstCell = int(texelFetch(brickMapObjects,id*2+1).x);
+	if(firstCell < 0) return false;
+
+	//A point outside of the grid is bounded through the closest point inside of it
+	vec3 gridPoint = (ray-grid.xyz)/grid.w;
+	vec3 insidePoint = clamp(gridPoint,0.0,float(BRICK_MAP_CELLS));
+	float outsideDistance = length(gridPoint-insidePoint)*grid.w;
+	ivec3 cell = clamp(ivec3(insidePoint),0,BRICK_MAP_CELLS-1);
+	vec2 entry = texelFetch(brickMapCells,firstCell + (cell.z*BRICK_MAP_CELLS + cell.y)*BRICK_MAP_CELLS + cell.x).xy;
+
+	float voxelSize = grid.w/float(BRICK_SIZE-1);
+	float bound = entry.y;
+	if(entry.x >= 0.0){
+		//The texel centers of the brick are its samples
+		int brick = int(entry.x);
+		vec3 brickOrigin = vec3(brick % ATLAS_BRICKS,brick / ATLAS_BRICKS % ATLAS_BRICKS,brick / (ATLAS_BRICKS*ATLAS_BRICKS))*float(BRICK_SIZE);
+		vec3 texel = brickOrigin + 0.5 + (insidePoint-vec3(cell))*float(BRICK_SIZE-1);
+		bound = texture(brickAtlas,texel/vec3(textureSize(brickAtlas,0))).r - sqrt(3.0)*voxelSize;
+	}
+
+	//The bound at the closest point less the way there bounds the distance from the point as well
+	distanceBound = max(outsideDistance,bound-outsideDistance);
+	return distanceBound > NEAR_VOXELS*voxelSize;
+}
+
+//Constructive solid geometry, see csg.h. The opcodes match CsgOpcode.
+const int CSG_END = 0;
+const int CSG_UNION = 1;
+const int CSG_SUBTRACTION = 2;
+const int CSG_INTERSECTION = 3;
+const int CSG_SMOOTH_UNION = 4;
+const int CSG_SMOOTH_SUBTRACTION = 5;
+const int CSG_SMOOTH_INTERSECTION = 6;
+const int CSG_SPHERE = 7;
+const int CSG_BOX = 8;
+const int CSG_TORUS = 9;
+const int CSG_PRISM = 10;
+const int CSG_PYRAMID = 11;
+const int CSG_CYLINDER = 12;
+const int CSG_MANDELBULB = 13;
+const int CSG_MANDELBOX = 14;
+const int CSG_JULIA = 15;
+const int CSG_ROTATED = 16;
+const int CSG_STACK_SIZE = 8;
+
+//Fractal primitive of a shape at the origin of its frame, at the detail of the footprint in that frame
+float getCsgFractalDistance(int opcode, vec3 p, float primitiveFootprint){
+	float objectDistance = 0.0;
+	float worldFootprint = footprint;
+	footprint = primitiveFootprint;
+#ifdef SCENE_USES_MANDELBULB
+	if(opcode == CSG_MANDELBULB) objectDistance = mandelbulbFractalDistance(p,vec3(0.0),1.0,false);
+#endif
+#ifdef SCENE_USES_MANDELBOX
+	if(opcode == CSG_MANDELBOX) objectDistance = mandelboxFractalDistance(p,vec3(0.0),1.0,false);
+#endif
+#ifdef SCENE_USES_JULIA
+	if(opcode == CSG_JULIA) objectDistance = juliaFractalDistance(p,vec3(0.0),1.0,false);
+#endif
+	footprint = worldFootprint;
+	return objectDistance;
+}
+
+#ifdef SCENE_USES_CSG
+//Programs of the shapes of the scene, one instruction per texel
+uniform samplerBuffer csgProgram;
+
+float getCsgPrimitiveDistance(int opcode, vec4 instruction, vec3 p, float primitiveFootprint){
+	switch(opcode){
+		case CSG_SPHERE:
+				return sphereDistance(p,vec3(0.0),instruction.y);
+		case CSG_BOX:
+				return boxDistance(p,vec3(0.0),instruction.yzw);
+		case CSG_TORUS:
+				return torusDistance(p,vec3(0.0),instruction.yz);
+		case CSG_PRISM:
+				return prismDistance(p,vec3(0.0),instruction.yz);
+		case CSG_PYRAMID:
+				return pyramidDistance(p,vec3(0.0),instruction.y);
+		case CSG_CYLINDER:
+				return cylinderDistance(p,vec3(0.0),instruction.y);
+	}
+	return getCsgFractalDistance(opcode,p,primitiveFootprint);
+}
+
+/*
+ * Stack machine that runs the program of a shape on a point in the frame of the shape. Operations pop two distances
+ * and push their combination, primitives push their distance at the point of their placement texel, which is followed
+ * by the rows of their rotation if they are rotated. The footprint is in the frame of the shape as well.
+ */
+float getCsgDistance(vec3 ray, int program, float shapeFootprint){
+	float stack[CSG_STACK_SIZE];
+	int stackSize = 0;
+	int pc = program;
+	while(true){
+		vec4 instruction = texelFetch(csgProgram,pc++);
+		int opcode = int(instruction.x);
+		if(opcode == CSG_END) break;
+
+		if(opcode <= CSG_SMOOTH_INTERSECTION){
+			//The second operand is on top of the stack and the result replaces the first one
+			float b = stack[--stackSize];
+			float a = stack[stackSize-1];
+			switch(opcode){
+				case CSG_UNION: a = opUnion(a,b); break;
+				case CSG_SUBTRACTION: a = opSubtraction(b,a); break;
+				case CSG_INTERSECTION: a = opIntersection(a,b); break;
+				case CSG_SMOOTH_UNION: a = opSmoothUnion(a,b,instruction.y); break;
+				case CSG_SMOOTH_SUBTRACTION: a = opSmoothSubtraction(b,a,instruction.y); break;
+				case CSG_SMOOTH_INTERSECTION: a = opSmoothIntersection(a,b,instruction.y); break;
+			}
+			stack[stackSize-1] = a;
+			continue;
+		}
+
+		vec4 placement = texelFetch(csgProgram,pc++);
+		vec3 p = ray - placement.xyz;
+		if(opcode >= CSG_ROTATED){
+			p = vec3(dot(texelFetch(csgProgram,pc).xyz,p),dot(texelFetch(csgProgram,pc+1).xyz,p),dot(texelFetch(csgProgram,pc+2).xyz,p));
+			pc += 3;
+			opcode -= CSG_ROTATED;
+		}
+		stack[stackSize++] = getCsgPrimitiveDistance(opcode,instruction,p/placement.w,shapeFootprint/placement.w)*placement.w;
+	}
+	return stack[0];
+}
+#endif
+
+#ifdef SCENE_OBJECT_DISTANCES
+//Every object of the specialized scene is a distance expression with its constants folded in, the host generates
+//a SCENE_OBJECT line for each one. Its fractals pass ORBIT_TRAPPED, which each expansion defines for itself.
+//The orbit trap left in orbitTrap is the one of the closest object.
+#define ORBIT_TRAPPED true
+#define SCENE_OBJECT(expression,albedo,id) { float objectDistance = expression; if(minimumCollision.distance > objectDistance){ minimumCollision = SceneCollision(objectDistance,albedo,id); closestOrbitTrap = orbitTrap; } }
+//Fractals only evaluate their distance estimate when their brick map does not bound them
+#define SCENE_FRACTAL(expression,albedo,id) { float objectDistance; if(getDistanceBound(ray,id,objectDistance)) orbitTrap = vec4(maxDist); else objectDistance = expression; if(minimumCollision.distance > objectDistance){ minimumCollision = SceneCollision(objectDistance,albedo,id); closestOrbitTrap = orbitTrap; } }
+
+SceneCollision getClosestSceneObjectAsCollision(vec3 ray){
+	SceneCollision minimumCollision = SceneCollision(maxDist,sceneBackgroundColor,-1);
+	vec4 closestOrbitTrap = orbitTrap;
+
+	SCENE_OBJECT_DISTANCES
+
+	orbitTrap = closestOrbitTrap;
+	return minimumCollision;
+}
+
+//The same lines once more for the distance to the closest object alone, without its color, id or orbit trap
+#undef ORBIT_TRAPPED
+#undef SCENE_OBJECT
+#undef SCENE_FRACTAL
+#define ORBIT_TRAPPED false
+#define SCENE_OBJECT(expression,albedo,id) { minimumDistance = min(minimumDistance,expression); }
+#define SCENE_FRACTAL(expression,albedo,id) { float objectDistance; if(!getDistanceBound(ray,id,objectDistance)) objectDistance = expression; minimumDistance = min(minimumDistance,objectDistance); }
+
+float getSceneDistance(vec3 ray){
+	float minimumDistance = maxDist;
+
+	SCENE_OBJECT_DISTANCES
+
+	return minimumDistance;
+}
+#else
+//Fractals write their orbit trap to orbitTrap if isOrbitTrapped
+float getObjectDistance(vec3 ray, Object object, bool isOrbitTrapped){
+	//Far from a fractal the bound of its brick map stands in for the distance estimate
+	float distanceBound;
+	//Csg objects without a fractal in their shape have no grid
+	if((object.type == 6 || object.type == 8 || object.type == 11 || object.type == 12) && getDistanceBound(ray,object.id,distanceBound)){
+		if (isOrbitTrapped) orbitTrap = vec4(maxDist);
+		return distanceBound;
+	}
 
-SceneCollision getObjectDistanceAsCollision(vec3 ray, Object object){
 	switch (object.type) {
 		case 0: //sphere
-				return SceneCollision(abs(sphereDistance(ray,object.center,object.size/2)),object.albedo,object.id);
+				return abs(sphereDistance(ray,object.center,object.size/2));
 		case 1: //cube
-				return SceneCollision(abs(cubeDistance(ray,object.center,object.size)),object.albedo,object.id);
+				return abs(cubeDistance(ray,object.center,object.size));
 		case 2: //plane
-				return SceneCollision(planeDistance(ray,object.center,object.size),object.albedo,object.id);
+				return planeDistance(ray,object.center,object.size);
 		case 3: //torus
-				return SceneCollision(abs(torusDistance(ray,object.center,vec2(object.size))),object.albedo,object.id);
+				return abs(torusDistance(ray,object.center,vec2(object.size)));
 		case 4: //prism
-				return SceneCollision(abs(prismDistance(ray,object.center,vec2(object.size))),object.albedo,object.id);
+				return abs(prismDistance(ray,object.center,vec2(object.size)));
 		case 5: //pyramid
-				return SceneCollision(pyramidDistance(ray,object.center,object.size),object.albedo,object.id);
+				return pyramidDistance(ray,object.center,object.size);
 		case 6: //mandelbulb
-				return SceneCollision(object.size*mandelbulbFractalDistance(ray/object.size,object.center,object.size),object.albedo,object.id);
+				return object.size*mandelbulbFractalDistance(ray/object.size,object.center,object.size,isOrbitTrapped);
 		case 7: //wall
-				return SceneCollision(abs(wallDistance(ray,object.center,object.size)),object.albedo,object.id);
+				return abs(wallDistance(ray,object.center,object.size));
 		case 8: //Mandelbox
-				return SceneCollision(opIntersection(mandelboxFractalDistance(ray,object.center,object.size),cubeDistance(ray,object.center,object.size)),object.albedo,object.id);
+				return opIntersection(mandelboxFractalDistance(ray,object.center,object.size,isOrbitTrapped),cubeDistance(ray,object.center,object.size));
 		case 9: //open room
-				return SceneCollision(
-					opSubtraction(wallDistance(ray,object.center+vec3(0.0,0.5,0.0),object.size/1.5),wallDistance(ray,object.center,object.size))
-					,object.albedo,object.id);
+				return opSubtraction(wallDistance(ray,object.center+vec3(0.0,0.5,0.0),object.size/1.5),wallDistance(ray,object.center,object.size));
 		case 10: //cylinder
-				return SceneCollision(abs(opSubtraction(cylinderDistance(ray,object.center+vec3(0.0,0.003,0.0),object.size),cylinderDistance(ray,object.center,object.size))),object.albedo,object.id);
+				return abs(opSubtraction(cylinderDistance(ray,object.center+vec3(0.0,0.003,0.0),object.size),cylinderDistance(ray,object.center,object.size)));
 		case 11: //julia
-				return SceneCollision(object.size*juliaFractalDistance(ray/object.size,object.center,object.size),object.albedo,object.id);
+				return object.size*juliaFractalDistance(ray/object.size,object.center,object.size,isOrbitTrapped);
+#ifdef SCENE_USES_CSG
+		case 12: //csg, an instance of a shape scaled by its size
+				return object.size*getCsgDistance((ray-object.center)/object.size,object.program,footprint/object.size);
+#endif
 	}
-	return SceneCollision(MAX_DIST,sceneBackgroundColor,-1);
+	return maxDist;
+}
+
+SceneCollision getObjectDistanceAsCollision(vec3 ray, Object object){
+	return SceneCollision(getObjectDistance(ray,object,true),object.albedo,object.id);
+}
+
+//Bounding volume hierarchy over the scene objects, built on the CPU. Every node is two texels:
+//(boundsMin, leftFirst) and (boundsMax, count). Internal nodes have a count of 0 and their
+//children at leftFirst and leftFirst+1, leaves reference count entries of bvhObjects from leftFirst.
+uniform samplerBuffer bvhNodes;
+uniform isamplerBuffer bvhObjects;
+uniform int bvhNodeCount; // 0 when there is no hierarchy, the objects are then looped over
+const int BVH_STACK_SIZE = 32;
+
+float boundsDistance(vec3 point, vec3 boundsMin, vec3 boundsMax){
+	return length(max(max(boundsMin-point,point-boundsMax),0.0));
+}
+
+SceneCollision getClosestSceneObjectInBvh(vec3 ray){
+
+	SceneCollision minimumCollision = SceneCollision(maxDist,sceneBackgroundColor,-1);
+	vec4 closestOrbitTrap = orbitTrap;
+
+	int nodeStack[BVH_STACK_SIZE];
+	float distanceStack[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	vec4 root = texelFetch(bvhNodes,0);
+	nodeStack[stackSize] = 0;
+	distanceStack[stackSize++] = boundsDistance(ray,root.xyz,texelFetch(bvhNodes,1).xyz);
+
+	while(stackSize > 0){
+		stackSize--;
+		//Points inside the bounds are always evaluated, otherwise nothing in the node can be closer
+		if(distanceStack[stackSize] > 0.0 && distanceStack[stackSize] >= minimumCollision.distance) continue;
+
+		int node = nodeStack[stackSize];
+		int leftFirst = int(texelFetch(bvhNodes,node*2).w);
+		int count = int(texelFetch(bvhNodes,node*2+1).w);
+
+		if(count > 0){
+			for(int i = leftFirst; i < leftFirst + count; i++){
+				SceneCollision currentCollision = getObjectDistanceAsCollision(ray,getSceneObject(texelFetch(bvhObjects,i).r));
+				if(minimumCollision.distance > currentCollision.distance){
+					minimumCollision = currentCollision;
+					closestOrbitTrap = orbitTrap;
+				}
+			}
+		} else {
+			int nearChild = leftFirst;
+			int farChild = leftFirst + 1;
+			float nearDistance = boundsDistance(ray,texelFetch(bvhNodes,nearChild*2).xyz,texelFetch(bvhNodes,nearChild*2+1).xyz);
+			float farDistance = boundsDistance(ray,texelFetch(bvhNodes,farChild*2).xyz,texelFetch(bvhNodes,farChild*2+1).xyz);
+			if(nearDistance > farDistance){
+				nearChild = leftFirst + 1;
+				farChild = leftFirst;
+				float swapDistance = nearDistance;
+				nearDistance = farDistance;
+				farDistance = swapDistance;
+			}
+			//Nearest child on top of the stack so it shrinks the distance before the far one is tested
+			nodeStack[stackSize] = farChild;
+			distanceStack[stackSize++] = farDistance;
+			nodeStack[stackSize] = nearChild;
+			distanceStack[stackSize++] = nearDistance;
+		}
+	}
+
+	orbitTrap = closestOrbitTrap;
+	return minimumCollision;
 }
 
+//The orbit trap left in orbitTrap is the one of the closest object
 SceneCollision getClosestSceneObjectAsCollision(vec3 ray){
 
-	SceneCollision minimumCollision = SceneCollision(MAX_DIST,sceneBackgroundColor,-1);
+	if(bvhNodeCount > 0) return getClosestSceneObjectInBvh(ray);
 
-	for(int i = 0; i < globalScene.sceneObjects.length(); i++){
-		SceneCollision currentCollision = getObjectDistanceAsCollision(ray,globalScene.sceneObjects[i]);
+	SceneCollision minimumCollision = SceneCollision(maxDist,sceneBackgroundColor,-1);
+	vec4 closestOrbitTrap = orbitTrap;
+
+	for(int i = 0; i < sceneObjectCount; i++){
+		SceneCollision currentCollision = getObjectDistanceAsCollision(ray,getSceneObject(i));
 		if(minimumCollision.distance > currentCollision.distance){
 			minimumCollision = currentCollision;
+			closestOrbitTrap = orbitTrap;
 		}
 	}
+
+	orbitTrap = closestOrbitTrap;
 	return minimumCollision;
 }
 
+//The walk of getClosestSceneObjectInBvh for the distance to the closest object alone
+float getSceneDistanceInBvh(vec3 ray){
+
+	float minimumDistance = maxDist;
+
+	int nodeStack[BVH_STACK_SIZE];
+	float distanceStack[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	vec4 root = texelFetch(bvhNodes,0);
+	nodeStack[stackSize] = 0;
+	distanceStack[stackSize++] = boundsDistance(ray,root.xyz,texelFetch(bvhNodes,1).xyz);
+
+	while(stackSize > 0){
+		stackSize--;
+		if(distanceStack[stackSize] > 0.0 && distanceStack[stackSize] >= minimumDistance) continue;
+
+		int node = nodeStack[stackSize];
+		int leftFirst = int(texelFetch(bvhNodes,node*2).w);
+		int count = int(texelFetch(bvhNodes,node*2+1).w);
+
+		if(count > 0){
+			for(int i = leftFirst; i < leftFirst + count; i++){
+				minimumDistance = min(minimumDistance,getObjectDistance(ray,getSceneObject(texelFetch(bvhObjects,i).r),false));
+			}
+		} else {
+			int nearChild = leftFirst;
+			int farChild = leftFirst + 1;
+			float nearDistance = boundsDistance(ray,texelFetch(bvhNodes,nearChild*2).xyz,texelFetch(bvhNodes,nearChild*2+1).xyz);
+			float farDistance = boundsDistance(ray,texelFetch(bvhNodes,farChild*2).xyz,texelFetch(bvhNodes,farChild*2+1).xyz);
+			if(nearDistance > farDistance){
+				nearChild = leftFirst + 1;
+				farChild = leftFirst;
+				float swapDistance = nearDistance;
+				nearDistance = farDistance;
+				farDistance = swapDistance;
+			}
+			nodeStack[stackSize] = farChild;
+			distanceStack[stackSize++] = farDistance;
+			nodeStack[stackSize] = nearChild;
+			distanceStack[stackSize++] = nearDistance;
+		}
+	}
+
+	return minimumDistance;
+}
+
+//Distance to the closest object alone, without its color, id or orbit trap
+float getSceneDistance(vec3 ray){
+	float minimumDistance = maxDist;
+
+	if(bvhNodeCount > 0){
+		minimumDistance = getSceneDistanceInBvh(ray);
+	} else {
+		for(int i = 0; i < sceneObjectCount; i++){
+			minimumDistance = min(minimumDistance,getObjectDistance(ray,getSceneObject(i),false));
+		}
+	}
+
+	return minimumDistance;
+}
+#endif
+
 /*
  * Ray marching algorithm.
  * Returns aprox. distance to the scene from a certain point with a certain direction.
+ * Steps are over-relaxed by omega (Keinert et al., Enhanced Sphere Tracing). When the unbounding spheres of two
+ * consecutive points do not overlap the relaxed step may have skipped a surface, the march then steps back
+ * and goes on without relaxation. Rays that run out of steps are judged by their closest approach to the scene.
+ * The scene is evaluated at the footprint of a pixel radius wide per unit of distance, the ray hits within it.
+ * The steps only take the distance to the scene, the surface is evaluated with its color and orbit trap once it is hit.
+ */
+SceneCollision rayMarchScene(vec3 from, vec3 direction, float maxLength, float omega, float radius) {
+	float totalDistance = 0.0;
+	float sceneDistance = 0.0;
+	float stepLength = 0.0;
+	float previousDistance = 0.0;
+	float closestDistance = maxDist;
+	float closestTotalDistance = 0.0;
+	bool isEscaped = false;
+	int steps;
+	for (steps = 0; steps < maxMarchingSteps; steps++){
+		footprint = FOOTPRINT_PER_PIXEL*radius*totalDistance;
+		sceneDistance = getSceneDistance(from + totalDistance * direction);
+
+		//A relaxed step that ended inside an object crossed its surface as well
+		float unbounding = abs(sceneDistance);
+		if(omega > 1.0 && stepLength > 0.0 && (unbounding + previousDistance < stepLength || sceneDistance < 0.0)){
+			totalDistance += previousDistance - stepLength;
+			omega = 1.0;
+			continue;
+		}
+
+		if(sceneDistance < closestDistance){
+			closestDistance = sceneDistance;
+			closestTotalDistance = totalDistance;
+		}
+		//Past maxLength the ray escapes whatever it is closest to
+		if(sceneDistance > maxDist || totalDistance + sceneDistance > maxLength){
+			isEscaped = true;
+			break;
+		}
+		if(sceneDistance < max(epsilon,footprint)) break;
+
+		stepLength = omega * sceneDistance;
+		previousDistance = unbounding;
+		totalDistance += stepLength;
+	}
+	marchedSteps = steps;
+	marchedRays++;
+	totalMarchedSteps += steps;
+	if(isEscaped){
+		return SceneCollision(totalDistance + sceneDistance,sceneBackgroundColor,-1);
+	}
+	if(steps == maxMarchingSteps){
+		//Within a cone of epsilon per unit of distance or of two footprints the closest approach is a hit
+		footprint = FOOTPRINT_PER_PIXEL*radius*closestTotalDistance;
+		if(closestDistance >= max(epsilon * (1.0 + closestTotalDistance),2.0*footprint)){
+			return SceneCollision(max(totalDistance,maxDist),sceneBackgroundColor,-1);
+		}
+		totalDistance = closestTotalDistance;
+		sceneDistance = closestDistance;
+	}
+
+	//The color, id and orbit trap of the surface are only evaluated where the ray hit it
+	SceneCollision surface = getClosestSceneObjectAsCollision(from + totalDistance * direction);
+	return SceneCollision(totalDistance + sceneDistance,surface.color,surface.objectId);
+}
+
+/*
+ * Occlusion query.
+ * Marches towards a point maxLength away and returns the distance to the first surface in the way, or the distance
+ * past maxLength its last unbounding sphere reached once the way is clear. Only the distance to the scene is
+ * evaluated, at full detail, with plain sphere tracing steps. A ray that runs out of steps is occluded if it came
+ * within a cone of epsilon per unit of distance of the scene.
  */
-SceneCollision rayMarchScene(vec3 from, vec3 direction) {
+float rayMarchOcclusion(vec3 from, vec3 direction, float maxLength){
 	float totalDistance = 0.0;
-	SceneCollision sceneCollision;
+	float closestDistance = maxDist;
+	float closestTotalDistance = 0.0;
+	float occluderDistance = -1.0;
 	int steps;
-	for (steps = 0; steps < MAX_MARCHING_STEPS; steps++){
-		vec3 ray = from + totalDistance * direction;
-		sceneCollision = getClosestSceneObjectAsCollision(ray);
-		totalDistance += sceneCollision.distance;
-		if(sceneCollision.distance > MAX_DIST || sceneCollision.distance < EPSILON) break;
+	for (steps = 0; steps < maxMarchingSteps; steps++){
+		float sceneDistance = getSceneDistance(from + totalDistance * direction);
+		if(sceneDistance < closestDistance){
+			closestDistance = sceneDistance;
+			closestTotalDistance = totalDistance;
+		}
+		if(totalDistance + sceneDistance >= maxLength || sceneDistance > maxDist){
+			occluderDistance = max(totalDistance + sceneDistance,maxLength);
+			break;
+		}
+		if(sceneDistance < epsilon){
+			occluderDistance = totalDistance + sceneDistance;
+			break;
+		}
+		totalDistance += sceneDistance;
 	}
 	marchedSteps = steps;
-	return SceneCollision(totalDistance,sceneCollision.color,sceneCollision.objectId);
+	marchedRays++;
+	totalMarchedSteps += steps;
+	if(steps == maxMarchingSteps){
+		return closestDistance < epsilon * (1.0 + closestTotalDistance) ? closestTotalDistance + closestDistance : max(totalDistance,maxLength);
+	}
+	return occluderDistance;
 }
 
 /*
- * Utilizes a vec2 seed in order to produce a random floating point value
+ * Returns the distance a plain sphere tracing march reaches once it has taken all of its steps, for a ray that is
+ * clear up to totalDistance after the given steps, or the distance it hits a surface at past that. The distances
+ * to the scene are capped at maxDist, so once the ray is that far from the scene every step left is maxDist long
+ * and only the steps until then are marched.
  */
-float random(vec2 seed) {
-	return fract(sin(dot(seed.xy,vec2(20.234234,23490.234234)))*4002.12);
+float rayMarchEscape(vec3 from, vec3 direction, float totalDistance, int steps){
+	for (; steps < maxMarchingSteps; steps++){
+		float sceneDistance = getSceneDistance(from + totalDistance * direction);
+		totalMarchedSteps++;
+		if(sceneDistance < epsilon){
+			return totalDistance + sceneDistance;
+		}
+		if(sceneDistance >= maxDist){
+			return totalDistance + float(maxMarchingSteps - steps) * maxDist;
+		}
+		totalDistance += sceneDistance;
+	}
+	return totalDistance;
+}
+
+//Low discrepancy samples generated by the host, see sampler.h. Every bounce takes a point of its own Owen
+//scrambled Sobol sequence, rotated by a blue noise mask read at an offset that depends on the bounce and the seed.
+uniform samplerBuffer sobolSequences; // SEQUENCE_COUNT rows of SEQUENCE_LENGTH points
+uniform samplerBuffer blueNoise; // blueNoiseSlices slices of blueNoiseSize rows of blueNoiseSize rotations
+uniform int blueNoiseSize;
+uniform int blueNoiseSlices;
+uniform int sequenceSeed; // counts the restarts of the accumulation
+const int SEQUENCE_LENGTH = 4096;
+const int SEQUENCE_COUNT = 8;
+int sampleIndex = 0; // paths the pixel took since the accumulation restarted, dropped ones included
+
+uint hashInteger(uint x){
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/*
+ * 2D sample of a bounce of the current path.
+ */
+vec2 getSample(int bounce){
+	vec2 point = texelFetch(sobolSequences,(bounce % SEQUENCE_COUNT)*SEQUENCE_LENGTH + sampleIndex % SEQUENCE_LENGTH).xy;
+
+	//Consecutive accumulations take consecutive slices at the same offset. Every bounce, cycle through the
+	//slices and pass over the sequence reads the mask at another offset
+	uint size = uint(blueNoiseSize);
+	uint slice = uint(sequenceSeed) % uint(blueNoiseSlices);
+	uint offset = hashInteger(uint(sequenceSeed)/uint(blueNoiseSlices)*0x9e3779b9u ^ uint(bounce)*0x85ebca6bu ^ uint(sampleIndex/SEQUENCE_LENGTH)*0xc2b2ae35u);
+	uvec2 maskPixel = (uvec2(gl_FragCoord.xy) + uvec2(offset % size,offset / size % size)) % size;
+	return fract(point + texelFetch(blueNoise,int((slice*size + maskPixel.y)*size + maskPixel.x)).xy);
 }
 
 mat3 getTangentSpace(vec3 normal){
@@ -341,29 +1117,106 @@ vec3 sampleHemisphere(float u1, float u2, vec3 normal){
 }
 
 /*
- * Returns an aprox. normal vector a given surface point.
+ * Returns an aprox. normal vector a given surface point from central differences of the scene, 6 evaluations.
+ * The differences are taken a footprint apart, at least 0.001.
  */
-vec3 getNormal(vec3 surfacePoint){
-	vec2 e = vec2(.001,0); //epsilon vector
+vec3 getCentralDifferenceNormal(vec3 surfacePoint){
+	vec2 e = vec2(max(.001,footprint),0); //epsilon vector
 	vec3 normal = vec3(
-        getClosestSceneObjectAsCollision(surfacePoint+e.xyy).distance - getClosestSceneObjectAsCollision(surfacePoint-e.xyy).distance,
-        getClosestSceneObjectAsCollision(surfacePoint+e.yxy).distance - getClosestSceneObjectAsCollision(surfacePoint-e.yxy).distance,
-        getClosestSceneObjectAsCollision(surfacePoint+e.yyx).distance - getClosestSceneObjectAsCollision(surfacePoint-e.yyx).distance
+        getSceneDistance(surfacePoint+e.xyy) - getSceneDistance(surfacePoint-e.xyy),
+        getSceneDistance(surfacePoint+e.yxy) - getSceneDistance(surfacePoint-e.yxy),
+        getSceneDistance(surfacePoint+e.yyx) - getSceneDistance(surfacePoint-e.yyx)
     );
 	return normalize(normal);
 }
 
+/*
+ * Returns an aprox. normal vector a given surface point from the differences of the scene at the corners of a
+ * tetrahedron around it, 4 evaluations as far from the point as the central differences are.
+ */
+vec3 getTetrahedralNormal(vec3 surfacePoint){
+	vec2 k = vec2(1,-1)*max(.001,footprint)/sqrt(3.0);
+	vec3 normal = k.xyy*getSceneDistance(surfacePoint+k.xyy) + k.yyx*getSceneDistance(surfacePoint+k.yyx) +
+	              k.yxy*getSceneDistance(surfacePoint+k.yxy) + k.xxx*getSceneDistance(surfacePoint+k.xxx);
+	return normalize(normal);
+}
+
+//The objects wrapped in abs are shells, inside of them the normal faces inwards like the gradient of abs does
+vec3 getShellNormal(float objectDistance, vec3 gradient){
+	return objectDistance < 0.0 ? -gradient : gradient;
+}
+
+/*
+ * Normal of the surface of an object hit at a surface point. The simple shapes have their gradient in closed form,
+ * the mandelbulb and the julia set take theirs in forward mode like the CPU backend does. The mandelbox keeps the
+ * central differences a footprint apart, which average out the folds below the footprint, and so do the csg shapes,
+ * which may have a fractal in them. The other objects take the tetrahedral differences.
+ */
+vec3 getNormal(vec3 surfacePoint, Object object){
+	switch (object.type) {
+#ifdef SCENE_USES_SPHERE
+		case 0: //sphere
+				return getShellNormal(sphereDistance(surfacePoint,object.center,object.size/2),sphereGradient(surfacePoint,object.center));
+#endif
+#ifdef SCENE_USES_CUBE
+		case 1: //cube
+				return getShellNormal(cubeDistance(surfacePoint,object.center,object.size),cubeGradient(surfacePoint,object.center,object.size));
+#endif
+#ifdef SCENE_USES_PLANE
+		case 2: //plane
+				return planeGradient(surfacePoint,object.center,object.size);
+#endif
+#ifdef SCENE_USES_TORUS
+		case 3: //torus
+				return getShellNormal(torusDistance(surfacePoint,object.center,vec2(object.size)),torusGradient(surfacePoint,object.center,vec2(object.size)));
+#endif
+#ifdef SCENE_USES_WALL
+		case 7: //wall
+				return getShellNormal(wallDistance(surfacePoint,object.center,object.size),wallGradient(surfacePoint,object.center,object.size));
+#endif
+#ifdef SCENE_USES_CYLINDER
+		case 10: { //cylinder, the inner one is subtracted where it is closer than the outer one
+				vec3 innerCenter = object.center+vec3(0.0,0.003,0.0);
+				float inner = cylinderDistance(surfacePoint,innerCenter,object.size);
+				float outer = cylinderDistance(surfacePoint,object.center,object.size);
+				vec3 gradient = -inner > outer ? -cylinderGradient(surfacePoint,innerCenter,object.size) : cylinderGradient(surfacePoint,object.center,object.size);
+				return getShellNormal(opSubtraction(inner,outer),gradient);
+		}
+#endif
+#ifdef SCENE_USES_MANDELBULB
+		case 6: //mandelbulb
+				return normalize(mandelbulbFractalGradient(surfacePoint/object.size,object.center,object.size));
+#endif
+#ifdef SCENE_USES_JULIA
+		case 11: //julia
+				return normalize(juliaFractalGradient(surfacePoint/object.size,object.center,object.size));
+#endif
+		case 8: //mandelbox
+		case 12: //csg, the fractals in a shape are not differentiated
+				return getCentralDifferenceNormal(surfacePoint);
+	}
+	return getTetrahedralNormal(surfacePoint);
+}
+
+/*
+ * Penumbra of the light at a surface point, 0 in shadow and 1 in full light. The shadow ray is marched to the light
+ * like an occlusion query and the closest it passes to the scene relative to the distance marched darkens it.
+ */
 float getSoftShadow(vec3 surfacePoint, vec3 normal){
-	vec3 origin = surfacePoint + normal * EPSILON * 4;
+	const float PENUMBRA_SHARPNESS = 16.0;
+	vec3 origin = surfacePoint + normal * epsilon * 4;
 	vec3 direction = normalize(lightSource-origin);
+	float maxLength = length(lightSource-origin);
 	float shadowValue = 1.0;
 
-	for( float t = 0.0; t < MAX_DIST;){
-		float distanceToScene = getClosestSceneObjectAsCollision(origin+direction*t).distance;
-		if(distanceToScene < 0.0005){
+	//The ratio is undefined at the origin of the ray, the march starts an epsilon away from it
+	float t = epsilon;
+	for(int steps = 0; steps < maxMarchingSteps && t < maxLength; steps++){
+		float distanceToScene = getSceneDistance(origin+direction*t);
+		if(distanceToScene < epsilon){
 			return 0.0;
 		}
-		shadowValue = min(shadowValue,16*distanceToScene/t);
+		shadowValue = min(shadowValue,PENUMBRA_SHARPNESS*distanceToScene/t);
 		t += distanceToScene;
 	}
 
@@ -373,24 +1226,49 @@ float getSoftShadow(vec3 surfacePoint, vec3 normal){
 /*
  * "Path marching" algorithm.
  */
-void march(vec3 from, vec3 direction, int depth, int sampleNumber) {
+void march(vec3 from, vec3 direction, int depth) {
+
+	bool isPrimaryRay = true;
+	int bounce = 0;
+
+	while(depth <= maxMarchDepth){
+
+	Object intersectedObject;
+	vec4 storedOrbitTrap = vec4(0.0,0.0,0.0,0.0);
+	vec3 hitpoint;
+	vec3 normal;
+
+	if(isPrimaryRay && isPrimaryHitCached){
+		ivec2 pixel = ivec2(gl_FragCoord.xy);
+		vec4 cachedHit = texelFetch(gBufferHit,pixel,0);
+		vec4 cachedSurface = texelFetch(gBufferSurface,pixel,0);
+
+		if(cachedSurface.x < 0.0){
+			samplePixelColor = sceneBackgroundColor;
+			return;
+		}
 
-	while(depth <= MAX_MARCH_DEPTH){
+		intersectedObject = getSceneObject(int(cachedSurface.x));
+		storedOrbitTrap.yz = cachedSurface.yz;
+		distanceToScene = cachedHit.w;
+		hitpoint = from + (cachedHit.w-2*epsilon) * direction;
+		normal = cachedHit.xyz;
+		samplePixelColor = texelFetch(gBufferLight,pixel,0).xyz;
+	} else {
 
-	SceneCollision intersectionWithScene = rayMarchScene(from,direction);
+	SceneCollision intersectionWithScene = rayMarchScene(from,direction,maxDist,relaxation,pixelRadius);
 
 	if(intersectionWithScene.objectId == -1){
 		samplePixelColor = mix(samplePixelColor,sceneBackgroundColor,1.0/depth);
 		if(depth == 1){
-			glow = glowColor*marchedSteps/(MAX_MARCHING_STEPS*8);
+			glow = glowColor*marchedSteps/(maxMarchingSteps*8);
 		}
 		return;
 	};
 
-	Object intersectedObject = globalScene.sceneObjects[intersectionWithScene.objectId];
+	intersectedObject = getSceneObject(intersectionWithScene.objectId);
 
 	bool isFractal = intersectedObject.type == 6 || intersectedObject.type == 8 || intersectedObject.type == 11;
-	vec4 storedOrbitTrap = vec4(0.0,0.0,0.0,0.0);
 
 	if(isFractal && depth == 1){
 		storedOrbitTrap = orbitTrap.xyzw;
@@ -400,50 +1278,61 @@ void march(vec3 from, vec3 direction, int depth, int sampleNumber) {
 		distanceToScene = intersectionWithScene.distance;
 	}
 
-	vec3 hitpoint = from + (intersectionWithScene.distance-2*EPSILON) * direction;
+	hitpoint = from + (intersectionWithScene.distance-2*epsilon) * direction;
 
-	vec3 normal = getNormal(hitpoint);
+	normal = getNormal(hitpoint,intersectedObject);
 
 	//next event estimation
 	vec3 directionToLightSource = normalize(lightSource-hitpoint);
-	SceneCollision intersectionWithLight = rayMarchScene(hitpoint + normal * 4 * EPSILON,directionToLightSource);
-
-	Object intersectedObjectMarchingLight = globalScene.sceneObjects[intersectionWithLight.objectId];
-
-	bool isOccluded = intersectionWithLight.distance < length(lightSource-hitpoint);
-
-	if(isOccluded && intersectedObjectMarchingLight.surfaceType == 2){
-		vec3 glassHitpoint = hitpoint + directionToLightSource * intersectionWithLight.distance;
-		vec3 normalAtGlass = getNormal(glassHitpoint);
-		samplePixelColor += lightColor * abs(clamp(dot(normalAtGlass,normal),-1.0,1.0)) * 0.4;
+	float distanceToLightSource = length(lightSource-hitpoint);
+	vec3 shadowRayOrigin = hitpoint + normal * 4 * epsilon;
+	float occluderDistance = rayMarchOcclusion(shadowRayOrigin,directionToLightSource,distanceToLightSource);
+
+	bool isOccluded = occluderDistance < distanceToLightSource;
+
+	if(isOccluded){
+		//Only the occluder is evaluated with its payload, to tell whether it is glass
+		vec3 glassHitpoint = hitpoint + directionToLightSource * occluderDistance;
+		SceneCollision occluder = getClosestSceneObjectAsCollision(glassHitpoint);
+		if(occluder.objectId != -1 && getSceneObject(occluder.objectId).surfaceType == 2){
+			vec3 normalAtGlass = getNormal(glassHitpoint,getSceneObject(occluder.objectId));
+			samplePixelColor += lightColor * abs(clamp(dot(normalAtGlass,normal),-1.0,1.0)) * 0.4;
+		}
 	}
 
 	if(!isOccluded){
 		float lightIntensity = clamp(dot(normal,directionToLightSource),0.0,1.0);
-		float lightAttenuation = intersectionWithLight.distance*0.0001;
+		//The light is attenuated by the distance the shadow ray reaches with all of its steps, past the light
+		//only the few until it is maxDist away from the scene are marched
+		float lightAttenuation = rayMarchEscape(shadowRayOrigin,directionToLightSource,occluderDistance,marchedSteps + 1)*0.0001;
 		vec3 lightFactor = lightIntensity*lightColor*lightAttenuation;
 		samplePixelColor = mix(samplePixelColor,lightFactor,1/depth);
 	}
+
+	if(isPrimaryRay){
+		primaryHit = vec4(normal,intersectionWithScene.distance);
+		primarySurface = vec4(float(intersectionWithScene.objectId),storedOrbitTrap.yz,0.0);
+		primaryLight = vec4(samplePixelColor,0.0);
+	}
+
+	}
+
+	isPrimaryRay = false;
 	
 	if(intersectedObject.surfaceType == 0){
 		
-		float sample1 = random( gl_FragCoord.yx*sampleNumber/v_resolution.xy*v_time/10000 );
-		float sample2 = random( v_resolution.xy*sampleNumber/gl_FragCoord.xy*v_time/10000 );
-		//vec4 blueNoiseSample = texture2D(blueNoise,vec2(vec2(gl_FragCoord.yx*sampleNumber/v_resolution.xy*v_time/10000).x,vec2(v_resolution.xy*sampleNumber/gl_FragCoord.xy*v_time/10000).y));
-		//float sample1 = blueNoiseSample.x;
-		//float sample2 = blueNoiseSample.y;
-		vec3 newRayDirection = sampleHemisphere(sample1,sample2,normal);
+		vec2 bounceSample = getSample(bounce);
+		vec3 newRayDirection = sampleHemisphere(bounceSample.x,bounceSample.y,normal);
 		float cost = dot(newRayDirection,normal);
 		samplePixelColor = mix(samplePixelColor,intersectedObject.albedo+vec3(storedOrbitTrap.z,storedOrbitTrap.y,storedOrbitTrap.z),cost*0.4/depth);
 		samplePixelColor *= vec3(1.0) + vec3(intersectedObject.emission)*1/depth;
-		from = hitpoint + normal * EPSILON * 4;
+		from = hitpoint + normal * epsilon * 4;
 		direction = newRayDirection;
 
 	} else if(intersectedObject.surfaceType == 1){
 
-		float sample1 = random( gl_FragCoord.yx*sampleNumber/v_resolution.xy*v_time/10000 );
-		float sample2 = random( v_resolution.xy*sampleNumber/gl_FragCoord.xy*v_time/10000 );
-		vec3 random_unit = sampleHemisphere(sample2,sample1,normal);
+		vec2 bounceSample = getSample(bounce);
+		vec3 random_unit = sampleHemisphere(bounceSample.y,bounceSample.x,normal);
 
 		vec3 newRayDirection = reflect(direction,normal);
 
@@ -453,7 +1342,7 @@ void march(vec3 from, vec3 direction, int depth, int sampleNumber) {
 		float cost = clamp(dot(newRayDirection,normal),0.0,1.0);
 		samplePixelColor = mix(samplePixelColor,intersectedObject.albedo,cost*0.4/depth);
 
-		from = hitpoint + normal * EPSILON * 4;
+		from = hitpoint + normal * epsilon * 4;
 		direction = newRayDirection;
 
 	} else if(intersectedObject.surfaceType == 2){
@@ -474,7 +1363,7 @@ void march(vec3 from, vec3 direction, int depth, int sampleNumber) {
 		float Rprob = R0 + (1.0-R0) * pow(1.0-cosin,5.0); 
 		float cost2 = 1.0-n*n*(1.0-cosin*cosin);
 
-		float random2 = random(vec2(cosin,cost2)*v_time/1000);
+		float random2 = getSample(bounce).x;
 
 		if( cost2 > 0 && random2 > Rprob){
 			direction = normalize(direction*n + normal*(n*cosin-sqrt(cost2)));
@@ -483,11 +1372,12 @@ void march(vec3 from, vec3 direction, int depth, int sampleNumber) {
 			direction = reflect(direction,normal);
 		}
 
-		from = hitpoint - normal * EPSILON * 4;
+		from = hitpoint - normal * epsilon * 4;
 		
 	}
 	
 	depth += 1;
+	bounce += 1;
 	}
 }
 
@@ -520,31 +1410,136 @@ vec3 rayDirection(float fov, vec2 size, vec2 fragCoord, mat3 cameraMatrix){
     return ( cameraMatrix * normalize(vec3(xy,z)));
 }
 
+/*
+ * Standard error of the mean luminance of a pixel relative to its mean luminance, as of the previous frame.
+ * Until the pixel has MIN_ADAPTIVE_SAMPLES samples the estimate is not trusted and the error is huge.
+ */
+float getRelativeError(ivec2 pixel){
+	vec4 previousPixel = texelFetch(inputTexture,pixel,0);
+	float samples = previousPixel.w;
+	if(samples < float(MIN_ADAPTIVE_SAMPLES)) return 1e20;
+	float standardError = sqrt(texelFetch(inputMoments,pixel,0).x/(samples-1.0)/samples);
+	return standardError/max(dot(previousPixel.xyz,LUMINANCE),RELATIVE_ERROR_FLOOR);
+}
+
+/*
+ * History of the previous frame at the primary hit of this pixel, its mean color and sample count.
+ * The squared luminance deviations of the history are returned in squaredDeviations.
+ * The sample count is 0 when the hit was disoccluded.
+ */
+vec4 reprojectHistory(vec3 hitpoint, float maxSamples, out float squaredDeviations){
+	squaredDeviations = 0.0;
+	vec4 previousClip = previousViewProjection*vec4(hitpoint,1.0);
+	if(previousClip.w <= 0.0) return vec4(0.0);
+
+	//Bilinear footprint around the hit, the texel centers are half a pixel off the integer coordinates
+	vec2 previousCoord = (previousClip.xy/previousClip.w*0.5+0.5)*previousResolution - 0.5;
+	ivec2 corner = ivec2(floor(previousCoord));
+	vec2 fraction = previousCoord - floor(previousCoord);
+	float previousDistance = distance(hitpoint,previousCameraPosition);
+
+	vec4 history = vec4(0.0);
+	float totalWeight = 0.0;
+	for(int y = 0; y <= 1; y++){
+		for(int x = 0; x <= 1; x++){
+			ivec2 tap = corner + ivec2(x,y);
+			if(any(lessThan(tap,ivec2(0))) || any(greaterThanEqual(tap,ivec2(previousResolution)))) continue;
+
+			vec4 previousHit = texelFetch(gBufferHit,tap,0);
+			if(texelFetch(gBufferSurface,tap,0).x != primarySurface.x) continue;
+			if(dot(previousHit.xyz,primaryHit.xyz) < REPROJECTION_NORMAL_TOLERANCE) continue;
+			if(abs(previousHit.w-previousDistance) > REPROJECTION_DEPTH_TOLERANCE*previousDistance) continue;
+
+			float weight = (x == 1 ? fraction.x : 1.0-fraction.x)*(y == 1 ? fraction.y : 1.0-fraction.y);
+			history += weight*texelFetch(inputTexture,tap,0);
+			squaredDeviations += weight*texelFetch(inputMoments,tap,0).x;
+			totalWeight += weight;
+		}
+	}
+	if(totalWeight < 1e-3) return vec4(0.0);
+
+	history /= totalWeight;
+	squaredDeviations /= totalWeight;
+
+	//Whole samples like the accumulation counts them, the deviations shrink with the count to keep the variance
+	float samples = min(floor(history.w+0.5),maxSamples);
+	squaredDeviations *= history.w > 0.0 ? samples/history.w : 0.0;
+	return vec4(history.rgb,samples);
+}
+
 void main(){	
 
+	distanceToScene = maxDist;
+	orbitTrap = vec4(maxDist);
+
+	//Statistics of every sample since the accumulation restarted
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 previousPixel = accumulatedSamples > 0 ? texelFetch(inputTexture,pixel,0) : vec4(0.0);
+	vec4 previousMoments = accumulatedSamples > 0 ? texelFetch(inputMoments,pixel,0) : vec4(0.0);
+	float squaredDeviations = previousMoments.x;
+	sampleIndex = int(previousMoments.w);
+	vec3 mean = previousPixel.xyz;
+	float samples = previousPixel.w;
+
+	int samplesThisFrame = NUM_OF_SAMPLES;
+	if(noiseThreshold > 0.0 && samples >= float(MIN_ADAPTIVE_SAMPLES)){
+		//The largest error around the pixel decides. A dark pixel whose first samples all missed a rare
+		//light path has no variance and looks converged on its own, but not next to its noisy neighbours.
+		float relativeError = 0.0;
+		ivec2 lastPixel = ivec2(v_resolution) - 1;
+		for(int y = -1; y <= 1; y++){
+			for(int x = -1; x <= 1; x++){
+				relativeError = max(relativeError,getRelativeError(clamp(pixel + ivec2(x,y),ivec2(0),lastPixel)));
+			}
+		}
+		samplesThisFrame = relativeError < noiseThreshold ? 0 : int(min(ceil(relativeError/noiseThreshold),float(MAX_SAMPLES_PER_FRAME)));
+	}
+
     vec3 direction = rayDirection(v_fov,v_resolution,gl_FragCoord.xy, v_cameraMatrix);
+    //One pixel is tan(fov/2)/height wide at a unit of distance, see rayDirection
+    pixelRadius = 0.5*tan(radians(v_fov)/2.0)/v_resolution.y;
     vec3 eye = v_cameraPosition;
 
-	for (int sampleNumber = 1; sampleNumber < NUM_OF_SAMPLES+1; sampleNumber++){
-		march(eye,direction,1,sampleNumber);
+	for (int sampleNumber = 1; sampleNumber < samplesThisFrame+1; sampleNumber++){
+		march(eye,direction,1);
+		sampleIndex++;
 		//samplePixelColor += glow;
 		//samplePixelColor = mix(samplePixelColor,fogColor,clamp(distanceToScene/20,0.0,1.0));
-		pixelColor += samplePixelColor;
+
+		//A path that degenerates, e.g. on a normal of a point the march never converged to, would poison the mean for good
+		bool isFinite = !any(isnan(samplePixelColor)) && !any(isinf(samplePixelColor));
+
+		//Welford's algorithm keeps the running mean and squared deviations stable in single precision
+		if(isFinite){
+			samples += 1.0;
+			float previousLuminance = dot(mean,LUMINANCE);
+			float sampleLuminance = dot(samplePixelColor,LUMINANCE);
+			mean = mix(mean,samplePixelColor,1.0/samples);
+			squaredDeviations += (sampleLuminance-previousLuminance)*(sampleLuminance-dot(mean,LUMINANCE));
+		}
+
 		samplePixelColor = vec3(0.0,0.0,0.0);
 		glow = vec3(0.0,0.0,0.0);
 	}
 
-	pixelColor = pixelColor/NUM_OF_SAMPLES;
-	
-	vec3 finalColor;
-
-	if(v_hasCameraChanged > 0.5){
-		finalColor = pixelColor;
-	} else {
-		vec4 previousPixel = texture(inputTexture,texCoords.xy);
-		vec3 mixedColor = mix(previousPixel.xyz,pixelColor,0.05);
-		finalColor = mixedColor;
+	//The samples of this frame are merged with the reprojected history, Chan's update of the Welford statistics
+	if(isHistoryReprojected && primarySurface.x >= 0.0){
+		float historyDeviations;
+		bool isGlossy = getSceneObject(int(primarySurface.x)).surfaceType != 0;
+		vec4 history = reprojectHistory(eye + primaryHit.w*direction,isGlossy ? MAX_REPROJECTED_GLOSSY_SAMPLES : MAX_REPROJECTED_SAMPLES,historyDeviations);
+		if(history.w > 0.0){
+			float totalSamples = history.w + samples;
+			float delta = dot(mean,LUMINANCE) - dot(history.rgb,LUMINANCE);
+			squaredDeviations += historyDeviations + delta*delta*history.w*samples/totalSamples;
+			mean = mix(history.rgb,mean,samples/totalSamples);
+			samples = totalSamples;
+		}
 	}
-	gl_FragColor = vec4(finalColor,1.0);
+
+	fragColor = vec4(mean,samples);
+	momentsOutput = vec4(squaredDeviations,float(marchedRays),float(totalMarchedSteps),float(sampleIndex));
+	gBufferHitOutput = primaryHit;
+	gBufferSurfaceOutput = primarySurface;
+	gBufferLightOutput = primaryLight;
 		
-} 
\ No newline at end of file
+}
\ No newline at end of file
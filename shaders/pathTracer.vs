@@ -11,14 +11,12 @@ uniform vec3 cameraFront;
 uniform vec3 cameraUp;
 uniform float fov;
 uniform float time;
-uniform float hasCameraChanged;
 
 varying vec2 v_resolution;
 varying vec3 v_cameraPosition;
 varying mat3 v_cameraMatrix;
 varying float v_fov;
 varying float v_time;
-varying float v_hasCameraChanged;
 
 void main(){
     gl_Position = position;
@@ -28,6 +26,5 @@ void main(){
     v_cameraPosition = cameraPosition;
     v_fov = fov;
     v_time = time;
-    v_hasCameraChanged = hasCameraChanged;
     texCoords = vec2(inTexCoords.x,-1*inTexCoords.y);
 }
\ No newline at end of file
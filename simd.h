@@ -0,0 +1,220 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//Thin wrapper over the widest float SIMD registers the compiler targets.
+//AVX-512 packets hold 16 lanes, AVX/AVX2 packets 8 and SSE packets 4.
+//Build with -march=native (or -mavx2 / -mavx512f) to get the wide versions.
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <cmath>
+
+#if defined(__AVX512F__)
+
+#define PACKET_WIDTH 16
+
+struct PacketMask {
+    __mmask16 m;
+    PacketMask(){}
+    PacketMask(__mmask16 mask) : m(mask) {}
+    static PacketMask all(){ return PacketMask((__mmask16)0xFFFF); }
+    static PacketMask none(){ return PacketMask((__mmask16)0); }
+    bool any() const { return m != 0; }
+    bool lane(int i) const { return (m >> i) & 1; }
+};
+
+inline PacketMask operator&(PacketMask a, PacketMask b){ return PacketMask((__mmask16)(a.m & b.m)); }
+inline PacketMask operator|(PacketMask a, PacketMask b){ return PacketMask((__mmask16)(a.m | b.m)); }
+inline PacketMask operator!(PacketMask a){ return PacketMask((__mmask16)~a.m); }
+
+struct FloatPacket {
+    __m512 v;
+    FloatPacket(){}
+    FloatPacket(__m512 value) : v(value) {}
+    FloatPacket(float value) : v(_mm512_set1_ps(value)) {}
+    static FloatPacket load(const float* values){ return FloatPacket(_mm512_loadu_ps(values)); }
+    void store(float* values) const { _mm512_storeu_ps(values,v); }
+};
+
+inline FloatPacket operator+(FloatPacket a, FloatPacket b){ return _mm512_add_ps(a.v,b.v); }
+inline FloatPacket operator-(FloatPacket a, FloatPacket b){ return _mm512_sub_ps(a.v,b.v); }
+inline FloatPacket operator*(FloatPacket a, FloatPacket b){ return _mm512_mul_ps(a.v,b.v); }
+inline FloatPacket operator/(FloatPacket a, FloatPacket b){ return _mm512_div_ps(a.v,b.v); }
+inline FloatPacket operator-(FloatPacket a){ return _mm512_sub_ps(_mm512_setzero_ps(),a.v); }
+inline PacketMask operator<(FloatPacket a, FloatPacket b){ return _mm512_cmp_ps_mask(a.v,b.v,_CMP_LT_OQ); }
+inline PacketMask operator>(FloatPacket a, FloatPacket b){ return _mm512_cmp_ps_mask(a.v,b.v,_CMP_GT_OQ); }
+inline PacketMask operator<=(FloatPacket a, FloatPacket b){ return _mm512_cmp_ps_mask(a.v,b.v,_CMP_LE_OQ); }
+inline PacketMask operator>=(FloatPacket a, FloatPacket b){ return _mm512_cmp_ps_mask(a.v,b.v,_CMP_GE_OQ); }
+inline FloatPacket min(FloatPacket a, FloatPacket b){ return _mm512_min_ps(a.v,b.v); }
+inline FloatPacket max(FloatPacket a, FloatPacket b){ return _mm512_max_ps(a.v,b.v); }
+inline FloatPacket abs(FloatPacket a){ return _mm512_abs_ps(a.v); }
+inline FloatPacket sqrt(FloatPacket a){ return _mm512_sqrt_ps(a.v); }
+//Picks a where the mask is set and b everywhere else
+inline FloatPacket select(PacketMask mask, FloatPacket a, FloatPacket b){ return _mm512_mask_blend_ps(mask.m,b.v,a.v); }
+
+#elif defined(__AVX__)
+
+#define PACKET_WIDTH 8
+
+struct PacketMask {
+    __m256 m;
+    PacketMask(){}
+    PacketMask(__m256 mask) : m(mask) {}
+    static PacketMask all(){ return PacketMask(_mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    static PacketMask none(){ return PacketMask(_mm256_setzero_ps()); }
+    bool any() const { return _mm256_movemask_ps(m) != 0; }
+    bool lane(int i) const { return (_mm256_movemask_ps(m) >> i) & 1; }
+};
+
+inline PacketMask operator&(PacketMask a, PacketMask b){ return _mm256_and_ps(a.m,b.m); }
+inline PacketMask operator|(PacketMask a, PacketMask b){ return _mm256_or_ps(a.m,b.m); }
+inline PacketMask operator!(PacketMask a){ return _mm256_xor_ps(a.m,PacketMask::all().m); }
+
+struct FloatPacket {
+    __m256 v;
+    FloatPacket(){}
+    FloatPacket(__m256 value) : v(value) {}
+    FloatPacket(float value) : v(_mm256_set1_ps(value)) {}
+    static FloatPacket load(const float* values){ return FloatPacket(_mm256_loadu_ps(values)); }
+    void store(float* values) const { _mm256_storeu_ps(values,v); }
+};
+
+inline FloatPacket operator+(FloatPacket a, FloatPacket b){ return _mm256_add_ps(a.v,b.v); }
+inline FloatPacket operator-(FloatPacket a, FloatPacket b){ return _mm256_sub_ps(a.v,b.v); }
+inline FloatPacket operator*(FloatPacket a, FloatPacket b){ return _mm256_mul_ps(a.v,b.v); }
+inline FloatPacket operator/(FloatPacket a, FloatPacket b){ return _mm256_div_ps(a.v,b.v); }
+inline FloatPacket operator-(FloatPacket a){ return _mm256_sub_ps(_mm256_setzero_ps(),a.v); }
+inline PacketMask operator<(FloatPacket a, FloatPacket b){ return _mm256_cmp_ps(a.v,b.v,_CMP_LT_OQ); }
+inline PacketMask operator>(FloatPacket a, FloatPacket b){ return _mm256_cmp_ps(a.v,b.v,_CMP_GT_OQ); }
+inline PacketMask operator<=(FloatPacket a, FloatPacket b){ return _mm256_cmp_ps(a.v,b.v,_CMP_LE_OQ); }
+inline PacketMask operator>=(FloatPacket a, FloatPacket b){ return _mm256_cmp_ps(a.v,b.v,_CMP_GE_OQ); }
+inline FloatPacket min(FloatPacket a, FloatPacket b){ return _mm256_min_ps(a.v,b.v); }
+inline FloatPacket max(FloatPacket a, FloatPacket b){ return _mm256_max_ps(a.v,b.v); }
+inline FloatPacket abs(FloatPacket a){ return _mm256_andnot_ps(_mm256_set1_ps(-0.0f),a.v); }
+inline FloatPacket sqrt(FloatPacket a){ return _mm256_sqrt_ps(a.v); }
+//Picks a where the mask is set and b everywhere else
+inline FloatPacket select(PacketMask mask, FloatPacket a, FloatPacket b){ return _mm256_blendv_ps(b.v,a.v,mask.m); }
+
+#elif defined(__SSE2__)
+
+#define PACKET_WIDTH 4
+
+struct PacketMask {
+    __m128 m;
+    PacketMask(){}
+    PacketMask(__m128 mask) : m(mask) {}
+    static PacketMask all(){ return PacketMask(_mm_castsi128_ps(_mm_set1_epi32(-1))); }
+    static PacketMask none(){ return PacketMask(_mm_setzero_ps()); }
+    bool any() const { return _mm_movemask_ps(m) != 0; }
+    bool lane(int i) const { return (_mm_movemask_ps(m) >> i) & 1; }
+};
+
+inline PacketMask operator&(PacketMask a, PacketMask b){ return _mm_and_ps(a.m,b.m); }
+inline PacketMask operator|(PacketMask a, PacketMask b){ return _mm_or_ps(a.m,b.m); }
+inline PacketMask operator!(PacketMask a){ return _mm_xor_ps(a.m,PacketMask::all().m); }
+
+struct FloatPacket {
+    __m128 v;
+    FloatPacket(){}
+    FloatPacket(__m128 value) : v(value) {}
+    FloatPacket(float value) : v(_mm_set1_ps(value)) {}
+    static FloatPacket load(const float* values){ return FloatPacket(_mm_loadu_ps(values)); }
+    void store(float* values) const { _mm_storeu_ps(values,v); }
+};
+
+inline FloatPacket operator+(FloatPacket a, FloatPacket b){ return _mm_add_ps(a.v,b.v); }
+inline FloatPacket operator-(FloatPacket a, FloatPacket b){ return _mm_sub_ps(a.v,b.v); }
+inline FloatPacket operator*(FloatPacket a, FloatPacket b){ return _mm_mul_ps(a.v,b.v); }
+inline FloatPacket operator/(FloatPacket a, FloatPacket b){ return _mm_div_ps(a.v,b.v); }
+inline FloatPacket operator-(FloatPacket a){ return _mm_sub_ps(_mm_setzero_ps(),a.v); }
+inline PacketMask operator<(FloatPacket a, FloatPacket b){ return _mm_cmplt_ps(a.v,b.v); }
+inline PacketMask operator>(FloatPacket a, FloatPacket b){ return _mm_cmpgt_ps(a.v,b.v); }
+inline PacketMask operator<=(FloatPacket a, FloatPacket b){ return _mm_cmple_ps(a.v,b.v); }
+inline PacketMask operator>=(FloatPacket a, FloatPacket b){ return _mm_cmpge_ps(a.v,b.v); }
+inline FloatPacket min(FloatPacket a, FloatPacket b){ return _mm_min_ps(a.v,b.v); }
+inline FloatPacket max(FloatPacket a, FloatPacket b){ return _mm_max_ps(a.v,b.v); }
+inline FloatPacket abs(FloatPacket a){ return _mm_andnot_ps(_mm_set1_ps(-0.0f),a.v); }
+inline FloatPacket sqrt(FloatPacket a){ return _mm_sqrt_ps(a.v); }
+//Picks a where the mask is set and b everywhere else
+inline FloatPacket select(PacketMask mask, FloatPacket a, FloatPacket b){ return _mm_or_ps(_mm_and_ps(mask.m,a.v),_mm_andnot_ps(mask.m,b.v)); }
+
+#else
+
+//Portable fallback for targets without x86 SIMD, the compiler may still auto-vectorize the loops
+#define PACKET_WIDTH 4
+
+struct PacketMask {
+    bool m[PACKET_WIDTH];
+    static PacketMask all(){ PacketMask r; for(int i = 0; i < PACKET_WIDTH; i++) r.m[i] = true; return r; }
+    static PacketMask none(){ PacketMask r; for(int i = 0; i < PACKET_WIDTH; i++) r.m[i] = false; return r; }
+    bool any() const { for(int i = 0; i < PACKET_WIDTH; i++) if(m[i]) return true; return false; }
+    bool lane(int i) const { return m[i]; }
+};
+
+struct FloatPacket {
+    float v[PACKET_WIDTH];
+    FloatPacket(){}
+    FloatPacket(float value){ for(int i = 0; i < PACKET_WIDTH; i++) v[i] = value; }
+    static FloatPacket load(const float* values){ FloatPacket r; for(int i = 0; i < PACKET_WIDTH; i++) r.v[i] = values[i]; return r; }
+    void store(float* values) const { for(int i = 0; i < PACKET_WIDTH; i++) values[i] = v[i]; }
+};
+
+#define PACKET_LANEWISE(expression) for(int i = 0; i < PACKET_WIDTH; i++) expression; return r
+
+inline PacketMask operator&(PacketMask a, PacketMask b){ PacketMask r; PACKET_LANEWISE(r.m[i] = a.m[i] && b.m[i]); }
+inline PacketMask operator|(PacketMask a, PacketMask b){ PacketMask r; PACKET_LANEWISE(r.m[i] = a.m[i] || b.m[i]); }
+inline PacketMask operator!(PacketMask a){ PacketMask r; PACKET_LANEWISE(r.m[i] = !a.m[i]); }
+inline FloatPacket operator+(FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = a.v[i] + b.v[i]); }
+inline FloatPacket operator-(FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = a.v[i] - b.v[i]); }
+inline FloatPacket operator*(FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = a.v[i] * b.v[i]); }
+inline FloatPacket operator/(FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = a.v[i] / b.v[i]); }
+inline FloatPacket operator-(FloatPacket a){ FloatPacket r; PACKET_LANEWISE(r.v[i] = -a.v[i]); }
+inline PacketMask operator<(FloatPacket a, FloatPacket b){ PacketMask r; PACKET_LANEWISE(r.m[i] = a.v[i] < b.v[i]); }
+inline PacketMask operator>(FloatPacket a, FloatPacket b){ PacketMask r; PACKET_LANEWISE(r.m[i] = a.v[i] > b.v[i]); }
+inline PacketMask operator<=(FloatPacket a, FloatPacket b){ PacketMask r; PACKET_LANEWISE(r.m[i] = a.v[i] <= b.v[i]); }
+inline PacketMask operator>=(FloatPacket a, FloatPacket b){ PacketMask r; PACKET_LANEWISE(r.m[i] = a.v[i] >= b.v[i]); }
+inline FloatPacket min(FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]); }
+inline FloatPacket max(FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]); }
+inline FloatPacket abs(FloatPacket a){ FloatPacket r; PACKET_LANEWISE(r.v[i] = std::fabs(a.v[i])); }
+inline FloatPacket sqrt(FloatPacket a){ FloatPacket r; PACKET_LANEWISE(r.v[i] = std::sqrt(a.v[i])); }
+//Picks a where the mask is set and b everywhere else
+inline FloatPacket select(PacketMask mask, FloatPacket a, FloatPacket b){ FloatPacket r; PACKET_LANEWISE(r.v[i] = mask.m[i] ? a.v[i] : b.v[i]); }
+
+#undef PACKET_LANEWISE
+
+#endif
+
+inline FloatPacket clamp(FloatPacket value, FloatPacket low, FloatPacket high){
+    return min(max(value,low),high);
+}
+
+//There is no vector logarithm instruction, so it is evaluated one lane at a time
+inline FloatPacket log(FloatPacket value){
+    float values[PACKET_WIDTH];
+    value.store(values);
+    for(int i = 0; i < PACKET_WIDTH; i++)
+        values[i] = std::log(values[i]);
+    return FloatPacket::load(values);
+}
+
+inline FloatPacket sign(FloatPacket value){
+    return select(value > FloatPacket(0.0f),FloatPacket(1.0f),select(value < FloatPacket(0.0f),FloatPacket(-1.0f),FloatPacket(0.0f)));
+}
+
+//Structure of arrays vector, each component holds one value per lane
+struct Vec3Packet {
+    FloatPacket x, y, z;
+    Vec3Packet(){}
+    Vec3Packet(FloatPacket px, FloatPacket py, FloatPacket pz) : x(px), y(py), z(pz) {}
+};
+
+inline Vec3Packet operator+(const Vec3Packet& a, const Vec3Packet& b){ return Vec3Packet(a.x+b.x,a.y+b.y,a.z+b.z); }
+inline Vec3Packet operator-(const Vec3Packet& a, const Vec3Packet& b){ return Vec3Packet(a.x-b.x,a.y-b.y,a.z-b.z); }
+inline Vec3Packet operator*(const Vec3Packet& a, FloatPacket s){ return Vec3Packet(a.x*s,a.y*s,a.z*s); }
+inline Vec3Packet operator/(const Vec3Packet& a, FloatPacket s){ return Vec3Packet(a.x/s,a.y/s,a.z/s); }
+inline FloatPacket dot(const Vec3Packet& a, const Vec3Packet& b){ return a.x*b.x + a.y*b.y + a.z*b.z; }
+inline FloatPacket length(const Vec3Packet& a){ return sqrt(dot(a,a)); }
+
+#endif // SIMD_H
@@ -0,0 +1,74 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads){
+    if(numThreads == 0){
+        numThreads = std::thread::hardware_concurrency();
+        if(numThreads == 0) numThreads = 1;
+    }
+
+    m_task = nullptr;
+    m_nextIndex = 0;
+    m_count = 0;
+    m_activeWorkers = 0;
+    m_generation = 0;
+    m_isStopping = false;
+
+    //The thread calling parallelFor also works, so one thread less is spawned
+    for(unsigned int i = 1; i < numThreads; i++)
+        m_workers.emplace_back(&ThreadPool::workerLoop,this);
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+    m_wakeWorkers.notify_all();
+    for(unsigned int i = 0; i < m_workers.size(); i++)
+        m_workers[i].join();
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& task){
+    if(count <= 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_nextIndex = 0;
+        m_activeWorkers = (int)m_workers.size();
+        m_generation++;
+    }
+    m_wakeWorkers.notify_all();
+
+    runTasks();
+
+    //Wait for the workers to finish the items they already picked up
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobFinished.wait(lock,[this]{ return m_activeWorkers == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::runTasks(){
+    for(int i = m_nextIndex++; i < m_count; i = m_nextIndex++)
+        (*m_task)(i);
+}
+
+void ThreadPool::workerLoop(){
+    unsigned long seenGeneration = 0;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeWorkers.wait(lock,[this,seenGeneration]{ return m_isStopping || m_generation != seenGeneration; });
+            if(m_isStopping) return;
+            seenGeneration = m_generation;
+        }
+
+        runTasks();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(--m_activeWorkers == 0)
+            m_jobFinished.notify_one();
+    }
+}
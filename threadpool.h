@@ -0,0 +1,40 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+//Fixed pool of worker threads that run parallel for loops.
+//Work items are handed out one at a time through an atomic counter so that
+//expensive items (a tile inside a fractal) do not hold back the rest of the workers.
+class ThreadPool {
+    public:
+        //A thread count of 0 uses every hardware thread available
+        ThreadPool(unsigned int numThreads = 0);
+        //Runs task(i) for every i in [0,count) and blocks until all of them finished
+        void parallelFor(int count, const std::function<void(int)>& task);
+        unsigned int getThreadCount(){
+            return (unsigned int)m_workers.size() + 1;
+        }
+        virtual ~ThreadPool();
+    private:
+        void workerLoop();
+        void runTasks();
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_wakeWorkers;
+        std::condition_variable m_jobFinished;
+        const std::function<void(int)>* m_task;
+        std::atomic<int> m_nextIndex;
+        int m_count;
+        int m_activeWorkers;
+        unsigned long m_generation;
+        bool m_isStopping;
+};
+
+#endif // THREADPOOL_H
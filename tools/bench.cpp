@@ -0,0 +1,938 @@
+//Micro benchmarks for the CPU backend, every benchmark runs on a single thread.
+//
+//Build from the repository root:
+//  g++ -O2 -march=native -pthread tools/bench.cpp marcher.cpp packetmarcher.cpp scene.cpp csg.cpp bvh.cpp brickmap.cpp threadpool.cpp -I include/ -I . -o bench.out
+//Run:
+//  ./bench.out primitives
+//  ./bench.out mandelbulb
+//  ./bench.out bvh
+//  ./bench.out brickmap
+//  ./bench.out csg
+//  ./bench.out steps scenes/*.scene
+//  ./bench.out lod scenes/mandelbulb.scene
+//  ./bench.out shadows scenes/*.scene
+//  ./bench.out normals scenes/*.scene
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "sdf.h"
+#include "sdfpacket.h"
+#include "marcher.h"
+#include "packetmarcher.h"
+#include "threadpool.h"
+
+static const int RAY_GRID_SIZE = 256;
+static const double MIN_BENCHMARK_SECONDS = 0.5;
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Grid of rays from a pinhole in front of the origin, about half of them hit an object of unit size
+static void createRays(std::vector<glm::vec3>& directions, glm::vec3& origin){
+    origin = glm::vec3(0.0f,0.0f,-4.0f);
+    directions.clear();
+    for(int y = 0; y < RAY_GRID_SIZE; y++){
+        for(int x = 0; x < RAY_GRID_SIZE; x++){
+            glm::vec2 uv = (glm::vec2(x,y) + 0.5f) / (float)RAY_GRID_SIZE * 2.0f - 1.0f;
+            directions.push_back(glm::normalize(glm::vec3(uv*0.5f,1.0f)));
+        }
+    }
+}
+
+//Marches every ray one at a time, returns rays per second and counts the hits and the steps of the rays.
+//Rays hit within epsilon unless they are given the radius of their pixel.
+static double benchmarkScalar(const Scene& scene, const std::vector<glm::vec3>& directions, glm::vec3 origin, int& hits, long& steps, float pixelRadius = 0.0f){
+    glm::vec4 orbitTrap;
+    int marchedSteps;
+    long rays = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    do {
+        hits = 0;
+        steps = 0;
+        for(unsigned int i = 0; i < directions.size(); i++){
+            SceneCollision collision = rayMarchScene(origin,directions[i],scene,orbitTrap,marchedSteps,scene.getMarchSettings().maxDist,scene.getMarchSettings().relaxation,pixelRadius);
+            if(collision.objectId != -1) hits++;
+            steps += marchedSteps;
+        }
+        rays += directions.size();
+    } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+    return rays / secondsSince(start);
+}
+
+//Marches the rays in packets of PACKET_WIDTH, returns rays per second and counts the hits
+static double benchmarkPacket(const Scene& scene, const std::vector<glm::vec3>& directions, glm::vec3 origin, int& hits, float pixelRadius = 0.0f){
+    std::vector<float> directionX, directionY, directionZ;
+    for(unsigned int i = 0; i < directions.size(); i++){
+        directionX.push_back(directions[i].x);
+        directionY.push_back(directions[i].y);
+        directionZ.push_back(directions[i].z);
+    }
+
+    Vec3Packet from = Vec3Packet(origin.x,origin.y,origin.z);
+    long rays = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    do {
+        hits = 0;
+        for(unsigned int i = 0; i + PACKET_WIDTH <= directions.size(); i += PACKET_WIDTH){
+            Vec3Packet direction = Vec3Packet(FloatPacket::load(&directionX[i]),FloatPacket::load(&directionY[i]),FloatPacket::load(&directionZ[i]));
+            PacketCollision collision = rayMarchScenePacket(from,direction,scene,PacketMask::all(),pixelRadius);
+            float objectId[PACKET_WIDTH];
+            collision.objectId.store(objectId);
+            for(int lane = 0; lane < PACKET_WIDTH; lane++)
+                if(objectId[lane] != -1.0f) hits++;
+        }
+        rays += directions.size();
+    } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+    return rays / secondsSince(start);
+}
+
+//Scalar against packet marching throughput for each primitive with a vectorized distance function
+static int benchmarkPrimitives(){
+    struct Primitive { const char* name; int type; glm::vec3 center; float size; };
+    const Primitive primitives[] = {
+        {"sphere",OBJECT_SPHERE,glm::vec3(0.0f),2.0f},
+        {"cube",OBJECT_CUBE,glm::vec3(0.0f),0.8f},
+        {"torus",OBJECT_TORUS,glm::vec3(0.0f),0.7f},
+        {"prism",OBJECT_PRISM,glm::vec3(0.0f),0.8f},
+        {"pyramid",OBJECT_PYRAMID,glm::vec3(0.0f,-0.5f,0.0f),1.0f},
+        {"cylinder",OBJECT_CYLINDER,glm::vec3(0.0f),0.6f}
+    };
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 origin;
+    createRays(directions,origin);
+
+    printf("Packet width: %d lanes\n",PACKET_WIDTH);
+    printf("%-10s %16s %16s %8s %8s\n","primitive","scalar rays/s","packet rays/s","speedup","hits");
+
+    int mismatches = 0;
+    for(unsigned int i = 0; i < sizeof(primitives)/sizeof(primitives[0]); i++){
+        Scene scene;
+        scene.clear();
+        scene.addObject(primitives[i].center,primitives[i].size,primitives[i].type,glm::vec3(1.0f),0.0f,SURFACE_DIFFUSE);
+
+        int scalarHits, packetHits;
+        long scalarSteps;
+        double scalarRate = benchmarkScalar(scene,directions,origin,scalarHits,scalarSteps);
+        double packetRate = benchmarkPacket(scene,directions,origin,packetHits);
+
+        printf("%-10s %16.0f %16.0f %7.2fx %8d\n",primitives[i].name,scalarRate,packetRate,packetRate/scalarRate,scalarHits);
+        if(scalarHits != packetHits){
+            printf("  hit count differs: scalar %d, packet %d\n",scalarHits,packetHits);
+            mismatches++;
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+//Polar form of the power 8 mandelbulb the shader used before the triplex version, kept as the accuracy reference
+template<typename Real>
+static Real polarMandelbulbDistance(Real x, Real y, Real z, Real* orbitTrap){
+    const int ITERATIONS = 10;
+    const Real BAILOUT = 10;
+    const Real POWER = 8;
+
+    for(int i = 0; i < 4; i++) orbitTrap[i] = ORBIT_TRAP_START;
+
+    Real cx = x, cy = y, cz = z;
+    Real dr = 1, r = 0;
+    for(int i = 0; i < ITERATIONS; i++){
+        r = std::sqrt(x*x + y*y + z*z);
+        if(r > BAILOUT) break;
+
+        Real theta = std::acos(z/r)*POWER;
+        Real phi = std::atan2(y,x)*POWER;
+        dr = std::pow(r,POWER-1)*POWER*dr + 1;
+        Real zr = std::pow(r,POWER);
+
+        x = zr*std::sin(theta)*std::cos(phi) + cx;
+        y = zr*std::sin(phi)*std::sin(theta) + cy;
+        z = zr*std::cos(theta) + cz;
+
+        if(i < COLOR_ITERATIONS){
+            Real trap[4] = {std::abs(x),std::abs(y),std::abs(z),r*r};
+            for(int j = 0; j < 4; j++) orbitTrap[j] = std::min(orbitTrap[j],trap[j]);
+        }
+    }
+    return Real(0.5)*std::log(r)*r/dr;
+}
+
+//Accuracy of the triplex mandelbulb against the polar formula and distance estimates per second of each version
+static int benchmarkMandelbulb(){
+    const int NUM_POINTS = 1 << 16;
+
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> coordinate(-1.3f,1.3f);
+    std::vector<float> x(NUM_POINTS), y(NUM_POINTS), z(NUM_POINTS);
+    for(int i = 0; i < NUM_POINTS; i++){
+        x[i] = coordinate(generator);
+        y[i] = coordinate(generator);
+        z[i] = coordinate(generator);
+    }
+
+    //Errors are measured against the polar formula evaluated in double precision
+    double polarError = 0.0, triplexError = 0.0, packetError = 0.0, polarTrapError = 0.0, trapError = 0.0;
+    double polarErrorSum = 0.0, triplexErrorSum = 0.0;
+    for(int i = 0; i < NUM_POINTS; i += PACKET_WIDTH){
+        FloatPacket packetTrap[4];
+        Vec3Packet point = Vec3Packet(FloatPacket::load(&x[i]),FloatPacket::load(&y[i]),FloatPacket::load(&z[i]));
+        float packetDistance[PACKET_WIDTH];
+        mandelbulbFractalDistance(point,glm::vec3(0.0f),1.0f,packetTrap).store(packetDistance);
+
+        for(int lane = 0; lane < PACKET_WIDTH; lane++){
+            double referenceTrap[4];
+            float polarTrap[4];
+            double reference = polarMandelbulbDistance<double>(x[i+lane],y[i+lane],z[i+lane],referenceTrap);
+            float polar = polarMandelbulbDistance<float>(x[i+lane],y[i+lane],z[i+lane],polarTrap);
+
+            glm::vec4 orbitTrap;
+            float triplex = mandelbulbFractalDistance(glm::vec3(x[i+lane],y[i+lane],z[i+lane]),glm::vec3(0.0f),1.0f,&orbitTrap);
+
+            polarError = std::max(polarError,std::abs(polar - reference));
+            triplexError = std::max(triplexError,std::abs(triplex - reference));
+            packetError = std::max(packetError,std::abs((double)packetDistance[lane] - triplex));
+            polarErrorSum += std::abs(polar - reference);
+            triplexErrorSum += std::abs(triplex - reference);
+            for(int j = 0; j < 4; j++){
+                polarTrapError = std::max(polarTrapError,std::abs(polarTrap[j] - referenceTrap[j]));
+                trapError = std::max(trapError,std::abs(orbitTrap[j] - referenceTrap[j]));
+            }
+        }
+    }
+
+    printf("Distance estimate error against the polar formula in double precision, %d points\n",NUM_POINTS);
+    printf("  polar float:   max %.3e mean %.3e\n",polarError,polarErrorSum/NUM_POINTS);
+    printf("  triplex float: max %.3e mean %.3e\n",triplexError,triplexErrorSum/NUM_POINTS);
+    printf("  packet against scalar triplex: max %.3e\n",packetError);
+    printf("  orbit trap: polar float max %.3e, triplex float max %.3e\n",polarTrapError,trapError);
+
+    //Throughput of each version
+    volatile float sink = 0.0f;
+    long evaluations = 0;
+    float trap[4];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    do {
+        for(int i = 0; i < NUM_POINTS; i++)
+            sink = sink + polarMandelbulbDistance<float>(x[i],y[i],z[i],trap);
+        evaluations += NUM_POINTS;
+    } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+    double polarRate = evaluations / secondsSince(start);
+
+    evaluations = 0;
+    glm::vec4 orbitTrap;
+    start = std::chrono::steady_clock::now();
+    do {
+        for(int i = 0; i < NUM_POINTS; i++)
+            sink = sink + mandelbulbFractalDistance(glm::vec3(x[i],y[i],z[i]),glm::vec3(0.0f),1.0f,&orbitTrap);
+        evaluations += NUM_POINTS;
+    } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+    double triplexRate = evaluations / secondsSince(start);
+
+    evaluations = 0;
+    FloatPacket packetSink = FloatPacket(0.0f);
+    start = std::chrono::steady_clock::now();
+    do {
+        for(int i = 0; i < NUM_POINTS; i += PACKET_WIDTH){
+            Vec3Packet point = Vec3Packet(FloatPacket::load(&x[i]),FloatPacket::load(&y[i]),FloatPacket::load(&z[i]));
+            packetSink = packetSink + mandelbulbFractalDistance(point,glm::vec3(0.0f),1.0f);
+        }
+        evaluations += NUM_POINTS;
+    } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+    double packetRate = evaluations / secondsSince(start);
+    float packetValues[PACKET_WIDTH];
+    packetSink.store(packetValues);
+    sink = sink + packetValues[0];
+
+    printf("Distance estimates per second\n");
+    printf("  polar:   %12.0f\n",polarRate);
+    printf("  triplex: %12.0f (%.2fx)\n",triplexRate,triplexRate/polarRate);
+    printf("  packet:  %12.0f (%.2fx, %d lanes)\n",packetRate,packetRate/polarRate,PACKET_WIDTH);
+
+    //The triplex form must not be less accurate than the formula it replaces
+    bool isAccurate = triplexError <= 2.0*polarError + 1e-5 && trapError <= 2.0*polarTrapError + 1e-5 && packetError <= 1e-4;
+    if(!isAccurate) printf("Triplex mandelbulb is less accurate than the polar formula\n");
+    return isAccurate ? 0 : 1;
+}
+
+//Closest object queries per second for a given query function, the results of the last pass are kept
+template<typename Query>
+static double benchmarkQueries(int numPoints, Query query){
+    long queries = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    do {
+        for(int i = 0; i < numPoints; i += PACKET_WIDTH)
+            query(i);
+        queries += numPoints;
+    } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+    return queries / secondsSince(start);
+}
+
+//Linear object loop against the bounding volume hierarchy as the scene grows
+static int benchmarkBvh(){
+    const int NUM_POINTS = 1 << 12;
+    const int objectCounts[] = {2,16,128,1024,10000};
+
+    printf("Closest object queries per second at clustered random points, scalar and %d lane packets\n",PACKET_WIDTH);
+    printf("%8s %10s %14s %14s %8s %14s %14s %8s\n","objects","build ms","scalar linear","scalar bvh","speedup","packet linear","packet bvh","speedup");
+
+    int mismatches = 0;
+    for(unsigned int c = 0; c < sizeof(objectCounts)/sizeof(objectCounts[0]); c++){
+        int objectCount = objectCounts[c];
+
+        //Spheres and cubes spread so that the density of the scene stays the same as it grows
+        float extent = 2.0f*std::cbrt((float)objectCount);
+        std::mt19937 generator(11);
+        std::uniform_real_distribution<float> coordinate(-extent,extent);
+        std::uniform_real_distribution<float> size(0.2f,0.8f);
+
+        Scene linearScene;
+        linearScene.clear();
+        for(int i = 0; i < objectCount; i++){
+            glm::vec3 center = glm::vec3(coordinate(generator),coordinate(generator),coordinate(generator));
+            linearScene.addObject(center,size(generator),i % 2 == 0 ? OBJECT_SPHERE : OBJECT_CUBE,glm::vec3(1.0f),0.0f,SURFACE_DIFFUSE);
+        }
+        Scene bvhScene = linearScene;
+        std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+        bvhScene.buildBvh();
+        double buildTime = secondsSince(buildStart) * 1000.0;
+
+        //Points come in packet sized clusters like the samples of neighbouring pixels do
+        std::uniform_real_distribution<float> offset(-0.1f,0.1f);
+        std::vector<float> x(NUM_POINTS), y(NUM_POINTS), z(NUM_POINTS);
+        for(int i = 0; i < NUM_POINTS; i += PACKET_WIDTH){
+            glm::vec3 cluster = glm::vec3(coordinate(generator),coordinate(generator),coordinate(generator));
+            for(int lane = i; lane < i + PACKET_WIDTH; lane++){
+                x[lane] = cluster.x + offset(generator);
+                y[lane] = cluster.y + offset(generator);
+                z[lane] = cluster.z + offset(generator);
+            }
+        }
+
+        //Both paths have to agree on the closest object and its distance
+        std::vector<SceneCollision> linearResult(NUM_POINTS), bvhResult(NUM_POINTS);
+        std::vector<float> linearPacket(NUM_POINTS), bvhPacket(NUM_POINTS);
+        glm::vec4 orbitTrap;
+
+        double scalarLinearRate = benchmarkQueries(NUM_POINTS,[&](int first){
+            for(int i = first; i < first + PACKET_WIDTH; i++)
+                linearResult[i] = getClosestSceneObjectAsCollision(glm::vec3(x[i],y[i],z[i]),linearScene,orbitTrap);
+        });
+        double scalarBvhRate = benchmarkQueries(NUM_POINTS,[&](int first){
+            for(int i = first; i < first + PACKET_WIDTH; i++)
+                bvhResult[i] = getClosestSceneObjectAsCollision(glm::vec3(x[i],y[i],z[i]),bvhScene,orbitTrap);
+        });
+        double packetLinearRate = benchmarkQueries(NUM_POINTS,[&](int first){
+            FloatPacket objectId;
+            Vec3Packet point = Vec3Packet(FloatPacket::load(&x[first]),FloatPacket::load(&y[first]),FloatPacket::load(&z[first]));
+            getClosestSceneObjectDistance(point,linearScene,PacketMask::all(),objectId).store(&linearPacket[first]);
+        });
+        double packetBvhRate = benchmarkQueries(NUM_POINTS,[&](int first){
+            FloatPacket objectId;
+            Vec3Packet point = Vec3Packet(FloatPacket::load(&x[first]),FloatPacket::load(&y[first]),FloatPacket::load(&z[first]));
+            getClosestSceneObjectDistance(point,bvhScene,PacketMask::all(),objectId).store(&bvhPacket[first]);
+        });
+
+        printf("%8d %10.2f %14.0f %14.0f %7.2fx %14.0f %14.0f %7.2fx\n",objectCount,buildTime,
+            scalarLinearRate,scalarBvhRate,scalarBvhRate/scalarLinearRate,packetLinearRate,packetBvhRate,packetBvhRate/packetLinearRate);
+
+        for(int i = 0; i < NUM_POINTS; i++){
+            if(linearResult[i].distance != bvhResult[i].distance || linearPacket[i] != bvhPacket[i] || std::abs(linearPacket[i] - linearResult[i].distance) > 1e-4f)
+                mismatches++;
+        }
+    }
+
+    if(mismatches > 0) printf("%d queries returned a different distance with the hierarchy\n",mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
+
+//March steps per second through each fractal with its distance estimate everywhere and with a brick map
+static int benchmarkBrickMap(){
+    struct Fractal { const char* name; int type; };
+    const Fractal fractals[] = {
+        {"mandelbulb",OBJECT_MANDELBULB},
+        {"mandelbox",OBJECT_MANDELBOX},
+        {"julia",OBJECT_JULIA}
+    };
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 origin;
+    createRays(directions,origin);
+    ThreadPool threadPool;
+
+    printf("Scalar march steps per second, the brick maps are built on %u threads\n",threadPool.getThreadCount());
+    printf("%-10s %9s %7s %7s %14s %14s %8s %10s %10s %8s\n","fractal","build ms","bricks","MB","exact steps/s","cached steps/s","speedup","exact/ray","cached/ray","hits");
+
+    int mismatches = 0;
+    for(unsigned int i = 0; i < sizeof(fractals)/sizeof(fractals[0]); i++){
+        Scene exactScene;
+        exactScene.clear();
+        exactScene.addObject(glm::vec3(0.0f),1.0f,fractals[i].type,glm::vec3(1.0f),0.0f,SURFACE_DIFFUSE);
+        Scene cachedScene = exactScene;
+        std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+        cachedScene.buildBrickMap(threadPool);
+        double buildTime = secondsSince(buildStart) * 1000.0;
+        const BrickMap& brickMap = cachedScene.getBrickMap();
+        double megabytes = (brickMap.getCells().size()*sizeof(BrickMapCell) + (size_t)brickMap.getBrickCount()*BrickMap::BRICK_SIZE*BrickMap::BRICK_SIZE*BrickMap::BRICK_SIZE*sizeof(float))/1e6;
+
+        int exactHits, cachedHits;
+        long exactSteps, cachedSteps;
+        double exactRate = benchmarkScalar(exactScene,directions,origin,exactHits,exactSteps);
+        double cachedRate = benchmarkScalar(cachedScene,directions,origin,cachedHits,cachedSteps);
+        double exactStepRate = exactRate*exactSteps/directions.size();
+        double cachedStepRate = cachedRate*cachedSteps/directions.size();
+
+        printf("%-10s %9.1f %7d %7.1f %14.0f %14.0f %7.2fx %10.1f %10.1f %8d\n",fractals[i].name,buildTime,brickMap.getBrickCount(),megabytes,
+            exactStepRate,cachedStepRate,cachedStepRate/exactStepRate,(double)exactSteps/directions.size(),(double)cachedSteps/directions.size(),cachedHits);
+        printf("%-10s rays/s exact %.0f, cached %.0f (%.2fx)\n","",exactRate,cachedRate,cachedRate/exactRate);
+
+        //The march ends with the distance estimate either way, only grazing rays may end up elsewhere
+        if(std::abs(exactHits - cachedHits) > (int)directions.size()/100){
+            printf("  hit count differs: exact %d, cached %d\n",exactHits,cachedHits);
+            mismatches++;
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+//Camera rays of the renderers from their default camera at 1 0.5 2 looking down -z with a field of view of 120 degrees,
+//returns the radius of their pixels
+static float createCameraRays(std::vector<glm::vec3>& directions, glm::vec3& origin, int width = 320, int height = 180){
+    const float halfWidth = std::tan(glm::radians(60.0f));
+    origin = glm::vec3(1.0f,0.5f,2.0f);
+    directions.clear();
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            glm::vec2 uv = (glm::vec2(x,y) + 0.5f) / glm::vec2(width,height) * 2.0f - 1.0f;
+            directions.push_back(glm::normalize(glm::vec3(uv.x*halfWidth,uv.y*halfWidth*height/width,-1.0f)));
+        }
+    }
+    return halfWidth/width;
+}
+
+//Histogram of the steps the camera rays of every scene take, marched as they were before rays had a length,
+//with plain sphere tracing steps and with the over-relaxed steps of the scene
+static int benchmarkSteps(int sceneCount, char* sceneFiles[]){
+    const int BUCKET_COUNT = 6;
+    const char* bucketNames[BUCKET_COUNT] = {"<8","<16","<32","<64","<max","max"};
+    if(sceneCount == 0){
+        printf("Give the scene files to march, e.g. scenes/*.scene\n");
+        return 1;
+    }
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 origin;
+    createCameraRays(directions,origin);
+
+    printf("Steps of %d camera rays per scene, the share of rays in each bucket of steps taken\n",(int)directions.size());
+    printf("%-18s %10s %10s %10s","scene","length","relaxation","steps/ray");
+    for(int b = 0; b < BUCKET_COUNT; b++) printf(" %7s",bucketNames[b]);
+    printf(" %8s %12s\n","hits","rays/s");
+
+    int mismatches = 0;
+    for(int i = 0; i < sceneCount; i++){
+        Scene scene;
+        if(!scene.loadFromFile(sceneFiles[i])) return 1;
+        const MarchSettings& settings = scene.getMarchSettings();
+        const char* name = strrchr(sceneFiles[i],'/') != NULL ? strrchr(sceneFiles[i],'/') + 1 : sceneFiles[i];
+
+        struct March { float maxLength; float relaxation; };
+        const March marches[3] = {{std::numeric_limits<float>::infinity(),1.0f},{settings.maxDist,1.0f},{settings.maxDist,settings.relaxation}};
+        int hits[3];
+        for(int m = 0; m < 3; m++){
+            long buckets[BUCKET_COUNT] = {0};
+            long steps = 0;
+            hits[m] = 0;
+            glm::vec4 orbitTrap;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for(unsigned int r = 0; r < directions.size(); r++){
+                int marchedSteps;
+                SceneCollision collision = rayMarchScene(origin,directions[r],scene,orbitTrap,marchedSteps,marches[m].maxLength,marches[m].relaxation,0.0f);
+                if(collision.objectId != -1) hits[m]++;
+                steps += marchedSteps;
+                int bucket = marchedSteps >= settings.maxMarchingSteps ? 5 : marchedSteps < 8 ? 0 : marchedSteps < 16 ? 1 : marchedSteps < 32 ? 2 : marchedSteps < 64 ? 3 : 4;
+                buckets[bucket]++;
+            }
+            double rate = directions.size() / secondsSince(start);
+
+            printf("%-18s %10.0f %10.2f %10.1f",m == 0 ? name : "",marches[m].maxLength,marches[m].relaxation,(double)steps/directions.size());
+            for(int b = 0; b < BUCKET_COUNT; b++) printf(" %6.1f%%",100.0*buckets[b]/directions.size());
+            printf(" %8d %12.0f\n",hits[m],rate);
+        }
+
+        //Only rays at the horizon may change their hit, and the packets march the same steps as the scalar march
+        int packetHits;
+        benchmarkPacket(scene,directions,origin,packetHits);
+        if(std::abs(hits[0] - hits[2]) > (int)directions.size()/100 || packetHits != hits[2]){
+            printf("  hit count differs: unbounded %d, relaxed %d, relaxed packets %d\n",hits[0],hits[2],packetHits);
+            mismatches++;
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+//Camera rays of every scene marched at full detail and within the footprint of their pixel, at 1280x720, from the
+//default camera and from 6 units behind it. The quality is how far the hits and their normals move, the distance
+//in footprints and the angle in degrees.
+static int benchmarkLevelOfDetail(int sceneCount, char* sceneFiles[]){
+    if(sceneCount == 0){
+        printf("Give the scene files to march, e.g. scenes/mandelbulb.scene\n");
+        return 1;
+    }
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 defaultOrigin;
+    float pixelRadius = createCameraRays(directions,defaultOrigin,1280,720);
+    const char* viewNames[2] = {"near","far"};
+    const glm::vec3 origins[2] = {defaultOrigin,defaultOrigin + glm::vec3(0.0f,0.0f,6.0f)};
+
+    printf("Level of detail of %d camera rays per scene, pixel radius %g per unit of distance\n",(int)directions.size(),pixelRadius);
+    printf("%-18s %5s %7s %10s %13s %13s %8s %12s %12s %12s\n","scene","view","detail","steps/ray","scalar rays/s","packet rays/s","hits","distance p90","normal mean","normal p90");
+
+    int failures = 0;
+    for(int i = 0; i < sceneCount; i++){
+        Scene scene;
+        if(!scene.loadFromFile(sceneFiles[i])) return 1;
+        ThreadPool threadPool;
+        scene.buildBrickMap(threadPool);
+        const MarchSettings& settings = scene.getMarchSettings();
+        const char* name = strrchr(sceneFiles[i],'/') != NULL ? strrchr(sceneFiles[i],'/') + 1 : sceneFiles[i];
+
+        for(int v = 0; v < 2; v++){
+            glm::vec3 origin = origins[v];
+            const float pixelRadii[2] = {0.0f,pixelRadius};
+            std::vector<SceneCollision> collisions[2];
+            std::vector<glm::vec3> normals[2];
+            for(int c = 0; c < 2; c++){
+                int hits, packetHits;
+                long steps;
+                double scalarRate = benchmarkScalar(scene,directions,origin,hits,steps,pixelRadii[c]);
+                double packetRate = benchmarkPacket(scene,directions,origin,packetHits,pixelRadii[c]);
+
+                glm::vec4 orbitTrap;
+                int marchedSteps;
+                for(unsigned int r = 0; r < directions.size(); r++){
+                    SceneCollision collision = rayMarchScene(origin,directions[r],scene,orbitTrap,marchedSteps,settings.maxDist,settings.relaxation,pixelRadii[c]);
+                    collisions[c].push_back(collision);
+                    glm::vec3 hitpoint = origin + (collision.distance - 2.0f*settings.epsilon)*directions[r];
+                    normals[c].push_back(collision.objectId != -1 ? getNormal(hitpoint,scene.getObject(collision.objectId),scene,getFootprint(pixelRadii[c],collision.distance)) : glm::vec3(0.0f));
+                }
+
+                if(c == 0){
+                    printf("%-18s %5s %7s %10.1f %13.0f %13.0f %8d\n",v == 0 ? name : "",viewNames[v],"full",(double)steps/directions.size(),scalarRate,packetRate,hits);
+                    continue;
+                }
+
+                //Only the rays both marches hit the same object with are compared
+                std::vector<float> distanceErrors, normalErrors;
+                double normalErrorSum = 0.0;
+                for(unsigned int r = 0; r < directions.size(); r++){
+                    if(collisions[0][r].objectId == -1 || collisions[0][r].objectId != collisions[1][r].objectId) continue;
+                    distanceErrors.push_back(std::abs(collisions[1][r].distance - collisions[0][r].distance)/getFootprint(pixelRadius,collisions[0][r].distance));
+                    float normalError = glm::degrees(std::acos(glm::clamp(glm::dot(normals[0][r],normals[1][r]),-1.0f,1.0f)));
+                    normalErrors.push_back(normalError);
+                    normalErrorSum += normalError;
+                }
+                if(distanceErrors.empty()) continue;
+                //The silhouettes, where a ray grazes an edge it passes at full detail, are left to the last tenth
+                size_t p90 = distanceErrors.size()*9/10;
+                std::nth_element(distanceErrors.begin(),distanceErrors.begin() + p90,distanceErrors.end());
+                std::nth_element(normalErrors.begin(),normalErrors.begin() + p90,normalErrors.end());
+                printf("%-18s %5s %7s %10.1f %13.0f %13.0f %8d %12.2f %12.2f %12.2f\n","","","pixel",(double)steps/directions.size(),scalarRate,packetRate,hits,
+                       distanceErrors[p90],normalErrorSum/normalErrors.size(),normalErrors[p90]);
+
+                //Packets evaluate the fractals at the detail of their nearest lane, so a few of their rays may hit otherwise.
+                //The hits stay within a pixel radius of the full ones.
+                if(std::abs(packetHits - hits) > (int)directions.size()/1000 || distanceErrors[p90] > 1.0f/FOOTPRINT_PER_PIXEL){
+                    printf("  level of detail differs: scalar hits %d, packet hits %d\n",hits,packetHits);
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+//Shadow rays from the hits of the camera rays of every scene to its light, marched in one go as the renderers did
+//before they had occlusion queries and with an occlusion query that stops at the light. The unoccluded rays of the
+//query go on to the distance the light is attenuated by.
+static int benchmarkShadows(int sceneCount, char* sceneFiles[]){
+    if(sceneCount == 0){
+        printf("Give the scene files to march, e.g. scenes/*.scene\n");
+        return 1;
+    }
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 origin;
+    createCameraRays(directions,origin);
+
+    printf("Shadow rays from the hits of %d camera rays per scene\n",(int)directions.size());
+    printf("%-18s %10s %8s %10s %12s %10s %16s\n","scene","march","rays","steps/ray","rays/s","occluded","attenuation err");
+
+    int mismatches = 0;
+    for(int i = 0; i < sceneCount; i++){
+        Scene scene;
+        if(!scene.loadFromFile(sceneFiles[i])) return 1;
+        ThreadPool threadPool;
+        scene.buildBrickMap(threadPool);
+        const MarchSettings& settings = scene.getMarchSettings();
+        const glm::vec3 lightSource = scene.getLightSource();
+        const char* name = strrchr(sceneFiles[i],'/') != NULL ? strrchr(sceneFiles[i],'/') + 1 : sceneFiles[i];
+
+        //The shadow rays leave the hits the way they do in the renderers
+        std::vector<glm::vec3> hitpoints, shadowOrigins;
+        glm::vec4 orbitTrap;
+        int marchedSteps;
+        for(unsigned int r = 0; r < directions.size(); r++){
+            SceneCollision collision = rayMarchScene(origin,directions[r],scene,orbitTrap,marchedSteps,settings.maxDist,settings.relaxation,0.0f);
+            if(collision.objectId == -1) continue;
+            glm::vec3 hitpoint = origin + (collision.distance - 2.0f*settings.epsilon)*directions[r];
+            hitpoints.push_back(hitpoint);
+            shadowOrigins.push_back(hitpoint + getNormal(hitpoint,scene.getObject(collision.objectId),scene)*4.0f*settings.epsilon);
+        }
+        int count = (int)hitpoints.size();
+        if(count == 0) continue;
+
+        std::vector<float> marchDistances(count), queryDistances(count);
+        long marchSteps = 0, querySteps = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int r = 0; r < count; r++){
+            marchDistances[r] = rayMarchScene(shadowOrigins[r],glm::normalize(lightSource-hitpoints[r]),scene,orbitTrap,marchedSteps,std::numeric_limits<float>::infinity(),1.0f,0.0f).distance;
+            marchSteps += marchedSteps;
+        }
+        double marchRate = count / secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for(int r = 0; r < count; r++){
+            glm::vec3 direction = glm::normalize(lightSource-hitpoints[r]);
+            float distanceToLightSource = glm::length(lightSource-hitpoints[r]);
+            queryDistances[r] = rayMarchOcclusion(shadowOrigins[r],direction,scene,marchedSteps,distanceToLightSource);
+            querySteps += marchedSteps;
+            if(queryDistances[r] >= distanceToLightSource){
+                int escapeSteps;
+                queryDistances[r] = rayMarchEscape(shadowOrigins[r],direction,scene,escapeSteps,queryDistances[r],marchedSteps + 1);
+                querySteps += escapeSteps;
+            }
+        }
+        double queryRate = count / secondsSince(start);
+
+        //The verdicts of both marches, and the attenuation of the rays both let through
+        int marchOccluded = 0, queryOccluded = 0, verdictMismatches = 0, lit = 0;
+        double attenuationError = 0.0;
+        for(int r = 0; r < count; r++){
+            float distanceToLightSource = glm::length(lightSource-hitpoints[r]);
+            bool isMarchOccluded = marchDistances[r] < distanceToLightSource, isQueryOccluded = queryDistances[r] < distanceToLightSource;
+            marchOccluded += isMarchOccluded;
+            queryOccluded += isQueryOccluded;
+            if(isMarchOccluded != isQueryOccluded){
+                verdictMismatches++;
+            } else if(!isMarchOccluded){
+                attenuationError += std::abs(queryDistances[r] - marchDistances[r])/marchDistances[r];
+                lit++;
+            }
+        }
+        attenuationError = lit > 0 ? attenuationError/lit : 0.0;
+
+        printf("%-18s %10s %8d %10.1f %12.0f %10d\n",name,"one go",count,(double)marchSteps/count,marchRate,marchOccluded);
+        printf("%-18s %10s %8d %10.1f %12.0f %10d %15.4f%%\n","","occlusion",count,(double)querySteps/count,queryRate,queryOccluded,100.0*attenuationError);
+
+        //Rays that graze a surface on their way may be judged otherwise by their closest approach
+        if(verdictMismatches > count/100 || attenuationError > 0.001){
+            printf("  shadows differ: %d verdicts differ\n",verdictMismatches);
+            mismatches++;
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+//The arc tangent keeps its precision for the small angles that the arc cosine of the dot product loses
+static float getAngleInDegrees(glm::vec3 a, glm::vec3 b){
+    return glm::degrees(std::atan2(glm::length(glm::cross(a,b)),glm::dot(a,b)));
+}
+
+//Independent reference for the objects without a closed form normal: central differences of the object evaluated in
+//double precision, so close together that they give the gradient of the distance the object is marched by
+static glm::vec3 getDoublePrecisionNormal(glm::vec3 surfacePoint, const Object& object, const Scene& scene){
+    const double h = 1e-6;
+    glm::dvec3 point = glm::dvec3(surfacePoint);
+    glm::dvec3 gradient = glm::dvec3(
+        getObjectDistanceInDouble(point+glm::dvec3(h,0,0),object,scene) - getObjectDistanceInDouble(point-glm::dvec3(h,0,0),object,scene),
+        getObjectDistanceInDouble(point+glm::dvec3(0,h,0),object,scene) - getObjectDistanceInDouble(point-glm::dvec3(0,h,0),object,scene),
+        getObjectDistanceInDouble(point+glm::dvec3(0,0,h),object,scene) - getObjectDistanceInDouble(point-glm::dvec3(0,0,h),object,scene)
+    );
+    return glm::vec3(glm::normalize(gradient));
+}
+
+//Forward mode normals of hits ordered by their object, a packet at a time. The last packet of an object is filled up
+//with copies of its last point.
+static void computePacketNormals(const std::vector<std::pair<int,glm::vec3> >& hits, const Scene& scene, std::vector<glm::vec3>& normals){
+    int count = (int)hits.size();
+    float x[PACKET_WIDTH], y[PACKET_WIDTH], z[PACKET_WIDTH];
+    for(int first = 0; first < count;){
+        int objectId = hits[first].first;
+        int lanes = 0;
+        while(lanes < PACKET_WIDTH && first + lanes < count && hits[first + lanes].first == objectId) lanes++;
+        for(int lane = 0; lane < PACKET_WIDTH; lane++){
+            glm::vec3 hitpoint = hits[first + std::min(lane,lanes - 1)].second;
+            x[lane] = hitpoint.x;
+            y[lane] = hitpoint.y;
+            z[lane] = hitpoint.z;
+        }
+        Vec3Packet packetNormals = getForwardModeNormals(Vec3Packet(FloatPacket::load(x),FloatPacket::load(y),FloatPacket::load(z)),scene.getObject(objectId),scene);
+        packetNormals.x.store(x);
+        packetNormals.y.store(y);
+        packetNormals.z.store(z);
+        for(int lane = 0; lane < lanes; lane++) normals[first + lane] = glm::vec3(x[lane],y[lane],z[lane]);
+        first += lanes;
+    }
+}
+
+//Normals at the hits of the camera rays of every scene, for each type of object hit, from central differences of the
+//scene, from its tetrahedral differences, from the gradient of the object in forward mode one point and one packet of
+//points at a time, and from getNormal, which has the closed form of the simple shapes. The rays are marched at full
+//detail, so the differences are 0.001 apart. The error is the angle in degrees to the closed form normal where there
+//is one and to the differences of the object in double precision otherwise.
+static int benchmarkNormals(int sceneCount, char* sceneFiles[]){
+    const int METHOD_COUNT = 5;
+    const char* methodNames[METHOD_COUNT] = {"central","tetrahedral","forward","packets","per type"};
+    const bool isClosedForm[NUM_OBJECT_TYPES] = {true,true,true,true,false,false,false,true,false,false,true,false};
+    if(sceneCount == 0){
+        printf("Give the scene files to march, e.g. scenes/*.scene\n");
+        return 1;
+    }
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 origin;
+    createCameraRays(directions,origin);
+
+    printf("Normals at the hits of %d camera rays per scene, the error in degrees to the closed form or the double precision gradient\n",(int)directions.size());
+    printf("%-18s %-11s %-12s %8s %12s %12s %12s\n","scene","object","normal","hits","normals/s","error mean","error p99");
+
+    int failures = 0;
+    for(int i = 0; i < sceneCount; i++){
+        Scene scene;
+        if(!scene.loadFromFile(sceneFiles[i])) return 1;
+        ThreadPool threadPool;
+        scene.buildBrickMap(threadPool);
+        const MarchSettings& settings = scene.getMarchSettings();
+        const char* name = strrchr(sceneFiles[i],'/') != NULL ? strrchr(sceneFiles[i],'/') + 1 : sceneFiles[i];
+
+        //The hits are pulled back from the surface the way the renderers do. They are kept in the order of their
+        //objects, so the packets are filled with the points of a single object.
+        std::vector<std::pair<int,glm::vec3> > hits[NUM_OBJECT_TYPES];
+        glm::vec4 orbitTrap;
+        int marchedSteps;
+        for(unsigned int r = 0; r < directions.size(); r++){
+            SceneCollision collision = rayMarchScene(origin,directions[r],scene,orbitTrap,marchedSteps,settings.maxDist,settings.relaxation,0.0f);
+            if(collision.objectId == -1) continue;
+            int type = scene.getObject(collision.objectId).type;
+            hits[type].push_back(std::make_pair(collision.objectId,origin + (collision.distance - 2.0f*settings.epsilon)*directions[r]));
+        }
+
+        bool isFirstRow = true;
+        for(int type = 0; type < NUM_OBJECT_TYPES; type++){
+            int count = (int)hits[type].size();
+            if(count == 0) continue;
+            std::stable_sort(hits[type].begin(),hits[type].end(),[](const std::pair<int,glm::vec3>& a, const std::pair<int,glm::vec3>& b){ return a.first < b.first; });
+
+            std::vector<glm::vec3> normals[METHOD_COUNT];
+            double rates[METHOD_COUNT];
+            for(int m = 0; m < METHOD_COUNT; m++){
+                normals[m].resize(count);
+                long computed = 0;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                do {
+                    if(m == 3){
+                        computePacketNormals(hits[type],scene,normals[m]);
+                    } else {
+                        for(int r = 0; r < count; r++){
+                            glm::vec3 hitpoint = hits[type][r].second;
+                            const Object& object = scene.getObject(hits[type][r].first);
+                            if(m == 0) normals[m][r] = getCentralDifferenceNormal(hitpoint,scene);
+                            else if(m == 1) normals[m][r] = getTetrahedralNormal(hitpoint,scene);
+                            else if(m == 2) normals[m][r] = getForwardModeNormal(hitpoint,object,scene);
+                            else normals[m][r] = getNormal(hitpoint,object,scene);
+                        }
+                    }
+                    computed += count;
+                } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+                rates[m] = computed / secondsSince(start);
+            }
+
+            std::vector<glm::vec3> reference = normals[4];
+            if(!isClosedForm[type]){
+                for(int r = 0; r < count; r++) reference[r] = getDoublePrecisionNormal(hits[type][r].second,scene.getObject(hits[type][r].first),scene);
+            }
+            double packetError = 0.0;
+            for(int m = 0; m < METHOD_COUNT; m++){
+                std::vector<float> errors(count);
+                double errorSum = 0.0;
+                for(int r = 0; r < count; r++){
+                    errors[r] = getAngleInDegrees(normals[m][r],reference[r]);
+                    errorSum += errors[r];
+                    //The compiler contracts the products of single points into fused multiply-adds and not those of packets,
+                    //so the two round differently. Where rounding alone already turns forward mode more than 0.1 degrees from
+                    //the double precision gradient they may part by as much, the other points are held to 0.1 degrees.
+                    if(m == 3 && getAngleInDegrees(normals[2][r],reference[r]) < 0.1f)
+                        packetError = std::max(packetError,(double)getAngleInDegrees(normals[3][r],normals[2][r]));
+                }
+                size_t p99 = errors.size()*99/100;
+                std::nth_element(errors.begin(),errors.begin() + p99,errors.end());
+                printf("%-18s %-11s %-12s %8d %12.0f %12.3f %12.3f\n",isFirstRow ? name : "",m == 0 ? Scene::objectTypeNames[type] : "",methodNames[m],count,rates[m],errorSum/count,errors[p99]);
+                isFirstRow = false;
+
+                //Differences of the scene blend the normals of touching objects, away from those the closed form agrees
+                if(isClosedForm[type] && m == 0 && errorSum/count > 1.0){
+                    printf("  closed form normals of %s differ from the central differences\n",Scene::objectTypeNames[type]);
+                    failures++;
+                }
+                //Both are exact gradients of the same distance, they only part at the edges of the shapes
+                if(isClosedForm[type] && m == 2 && errorSum/count > 0.01){
+                    printf("  forward mode normals of %s differ from the closed form\n",Scene::objectTypeNames[type]);
+                    failures++;
+                }
+                //Forward mode in float only parts from the differences in double precision by its rounding
+                if(!isClosedForm[type] && m == 2 && errorSum/count > 0.1){
+                    printf("  forward mode normals of %s differ from the double precision gradient\n",Scene::objectTypeNames[type]);
+                    failures++;
+                }
+            }
+            if(packetError > 0.1){
+                printf("  forward mode normals of %s differ between points and packets by up to %.3f degrees\n",Scene::objectTypeNames[type],packetError);
+                failures++;
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+//The object types written by hand that combine shapes against the same shapes as csg objects run by the interpreter of
+//csginterpreter.h: distance evaluations per second one point and one packet at a time, and rays per second. Both must
+//give the same distances up to rounding and hit the same rays.
+static int benchmarkCsg(){
+    struct CsgCase { const char* name; int type; float size; const char* expression; };
+    const CsgCase cases[] = {
+        {"mandelbox",OBJECT_MANDELBOX,1.75f,"(intersection (mandelbox) (cube 1.75))"},
+        {"room",OBJECT_ROOM,1.5f,"(subtraction (wall 1.5) (translate 0 0.5 0 (wall 1)))"}
+    };
+    const int NUM_POINTS = 1 << 14;
+
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> coordinate(-2.0f,2.0f);
+    std::vector<float> x(NUM_POINTS), y(NUM_POINTS), z(NUM_POINTS);
+    for(int i = 0; i < NUM_POINTS; i++){
+        x[i] = coordinate(generator);
+        y[i] = coordinate(generator);
+        z[i] = coordinate(generator);
+    }
+
+    std::vector<glm::vec3> directions;
+    glm::vec3 origin;
+    createRays(directions,origin);
+
+    printf("%-10s %-6s %16s %16s %16s %8s %12s\n","shape","code","scalar evals/s","packet evals/s","rays/s","hits","max error");
+
+    int mismatches = 0;
+    for(unsigned int c = 0; c < sizeof(cases)/sizeof(cases[0]); c++){
+        //The shape of the csg object has a size of 1, the size of the object written by hand is in its expression
+        Scene scenes[2];
+        std::string error;
+        scenes[0].clear();
+        scenes[0].addObject(glm::vec3(0.0f),cases[c].size,cases[c].type,glm::vec3(1.0f),0.0f,SURFACE_DIFFUSE);
+        scenes[1].clear();
+        int shape = scenes[1].addShape(cases[c].name,cases[c].expression,error);
+        if(shape == -1){
+            printf("Invalid shape %s: %s\n",cases[c].expression,error.c_str());
+            return 1;
+        }
+        scenes[1].addObject(glm::vec3(0.0f),1.0f,OBJECT_CSG,glm::vec3(1.0f),0.0f,SURFACE_DIFFUSE,shape);
+
+        std::vector<float> distances[2];
+        int hits[2];
+        for(int s = 0; s < 2; s++){
+            const Scene& scene = scenes[s];
+            const Object& object = scene.getObject(0);
+            distances[s].resize(NUM_POINTS);
+            for(int i = 0; i < NUM_POINTS; i++) distances[s][i] = getObjectDistance(glm::vec3(x[i],y[i],z[i]),object,scene);
+
+            volatile float sink = 0.0f;
+            long evaluations = 0;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            do {
+                for(int i = 0; i < NUM_POINTS; i++)
+                    sink = sink + getObjectDistance(glm::vec3(x[i],y[i],z[i]),object,scene);
+                evaluations += NUM_POINTS;
+            } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+            double scalarRate = evaluations / secondsSince(start);
+
+            evaluations = 0;
+            FloatPacket packetSink = FloatPacket(0.0f), objectId;
+            start = std::chrono::steady_clock::now();
+            do {
+                for(int i = 0; i < NUM_POINTS; i += PACKET_WIDTH){
+                    Vec3Packet point = Vec3Packet(FloatPacket::load(&x[i]),FloatPacket::load(&y[i]),FloatPacket::load(&z[i]));
+                    packetSink = packetSink + getClosestSceneObjectDistance(point,scene,PacketMask::all(),objectId);
+                }
+                evaluations += NUM_POINTS;
+            } while(secondsSince(start) < MIN_BENCHMARK_SECONDS);
+            double packetRate = evaluations / secondsSince(start);
+            float packetValues[PACKET_WIDTH];
+            packetSink.store(packetValues);
+            sink = sink + packetValues[0];
+
+            long steps;
+            double rayRate = benchmarkScalar(scene,directions,origin,hits[s],steps);
+
+            double maxError = 0.0;
+            for(int i = 0; i < NUM_POINTS; i++) maxError = std::max(maxError,(double)std::abs(distances[s][i] - distances[0][i]));
+            printf("%-10s %-6s %16.0f %16.0f %16.0f %8d %12.3e\n",s == 0 ? cases[c].name : "",s == 0 ? "hand" : "csg",scalarRate,packetRate,rayRate,hits[s],maxError);
+            if(s == 1 && maxError > 1e-4){
+                printf("  distances of the csg %s differ\n",cases[c].name);
+                mismatches++;
+            }
+        }
+        //Rays that graze an edge may be judged otherwise by the rounding of the distances
+        if(std::abs(hits[1] - hits[0]) > (int)directions.size()/1000){
+            printf("  hit count differs: hand %d, csg %d\n",hits[0],hits[1]);
+            mismatches++;
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        printf("Usage: %s primitives|mandelbulb|bvh|brickmap|csg|steps scene...|lod scene...|shadows scene...|normals scene...\n",argv[0]);
+        return 1;
+    }
+
+    if(strcmp(argv[1],"primitives") == 0)
+        return benchmarkPrimitives();
+    if(strcmp(argv[1],"mandelbulb") == 0)
+        return benchmarkMandelbulb();
+    if(strcmp(argv[1],"bvh") == 0)
+        return benchmarkBvh();
+    if(strcmp(argv[1],"brickmap") == 0)
+        return benchmarkBrickMap();
+    if(strcmp(argv[1],"csg") == 0)
+        return benchmarkCsg();
+    if(strcmp(argv[1],"steps") == 0)
+        return benchmarkSteps(argc - 2,argv + 2);
+    if(strcmp(argv[1],"lod") == 0)
+        return benchmarkLevelOfDetail(argc - 2,argv + 2);
+    if(strcmp(argv[1],"shadows") == 0)
+        return benchmarkShadows(argc - 2,argv + 2);
+    if(strcmp(argv[1],"normals") == 0)
+        return benchmarkNormals(argc - 2,argv + 2);
+
+    printf("Unknown benchmark: %s\n",argv[1]);
+    return 1;
+}
@@ -0,0 +1,72 @@
+//Blue noise mask generator. It makes tileable 2D or spatiotemporal (2D and time) void and cluster masks and writes
+//them as 16 bit PNG with the slices stacked from top to bottom, the format the renderers load. The renderers read
+//blue_noise.png from the working directory and use its first two channels.
+//
+//Build from the repository root:
+//  g++ -O2 -march=native -pthread tools/bluenoise.cpp bluenoise.cpp imagewriter.cpp threadpool.cpp -I include/ -I . -o bluenoise.out
+//Run:
+//  ./bluenoise.out --size 128 --depth 32 --channels 2 --output blue_noise.png
+//  ./bluenoise.out --size 256 --depth 64 --channels 1 --output stbn.png
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "bluenoise.h"
+#include "threadpool.h"
+
+static void printUsage(const char* program){
+    printf("Usage: %s [options]\n",program);
+    printf("  --size pixels            pixels per side of a slice (default 64)\n");
+    printf("  --depth slices           slices in time, 1 makes a 2D mask (default 1)\n");
+    printf("  --channels count         independent masks, 1 to 4 (default 2)\n");
+    printf("  --seed value             seed of the initial random patterns (default 1)\n");
+    printf("  --threads count          worker threads, 0 uses every hardware thread (default 0)\n");
+    printf("  --output file.png        (default %s)\n",BLUE_NOISE_FILE);
+}
+
+int main(int argc, char* argv[]){
+    int size = 64, depth = 1, channels = 2;
+    unsigned int seed = 1;
+    unsigned int numThreads = 0;
+    std::string outputFile = BLUE_NOISE_FILE;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i],"--size") == 0 && i + 1 < argc){
+            size = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--depth") == 0 && i + 1 < argc){
+            depth = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--channels") == 0 && i + 1 < argc){
+            channels = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--seed") == 0 && i + 1 < argc){
+            seed = (unsigned int)strtoul(argv[++i],NULL,10);
+        } else if(strcmp(argv[i],"--threads") == 0 && i + 1 < argc){
+            numThreads = (unsigned int)atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--output") == 0 && i + 1 < argc){
+            outputFile = argv[++i];
+        } else {
+            fprintf(stderr,"Unknown argument: %s\n",argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(size < 2 || depth < 1 || channels < 1 || channels > 4){
+        fprintf(stderr,"The size has to be at least 2, the depth positive and the channels between 1 and 4\n");
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    ThreadPool threadPool(numThreads);
+    printf("Generating %d channels of %dx%dx%d blue noise on %u threads\n",channels,size,size,depth,threadPool.getThreadCount());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<float> mask;
+    generateBlueNoise(size,depth,channels,seed,threadPool,mask);
+    printf("Generated in %.2f s\n",std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    if(!writeBlueNoise(outputFile,mask,size,depth,channels)) return 1;
+    printf("Wrote %s\n",outputFile.c_str());
+    return 0;
+}
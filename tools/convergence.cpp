@@ -0,0 +1,135 @@
+//Convergence benchmark of the samplers of the CPU backend. It renders a reference image with many samples, then
+//accumulates the scene with the low discrepancy sampler and with the sin hash it replaced and reports the RMSE of
+//both against the reference, and how many samples the low discrepancy sampler needs to reach the RMSE the hash
+//has after each power of two. The samplers are the same as the ones of the path tracer shader.
+//
+//Build from the repository root:
+//  g++ -O2 -march=native -pthread tools/convergence.cpp cpurenderer.cpp cpudenoiser.cpp sampler.cpp bluenoise.cpp imagewriter.cpp marcher.cpp packetmarcher.cpp scene.cpp csg.cpp bvh.cpp brickmap.cpp threadpool.cpp camera.cpp -I include/ -I . -o convergence.out
+//Run:
+//  ./convergence.out --scene scenes/primitives.scene --size 160 90 --spp 64 --reference-spp 1024
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "camera.h"
+#include "cpurenderer.h"
+
+static const glm::vec3 LUMINANCE = glm::vec3(0.2126f,0.7152f,0.0722f);
+
+static void printUsage(const char* program){
+    printf("Usage: %s [options]\n",program);
+    printf("  --scene file             scene to render, the built in default scene otherwise\n");
+    printf("  --camera x y z yaw pitch camera position and orientation in degrees (default 1 0.5 2 -90 0)\n");
+    printf("  --fov degrees            field of view (default 120)\n");
+    printf("  --size width height      resolution in pixels (default 160 90)\n");
+    printf("  --spp samples            samples per pixel of the compared runs (default 64)\n");
+    printf("  --reference-spp samples  samples per pixel of the reference (default 1024)\n");
+    printf("  --threads count          worker threads, 0 uses every hardware thread (default 0)\n");
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double getRmse(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference){
+    double sumOfSquares = 0.0;
+    for(unsigned int i = 0; i < image.size(); i++){
+        double difference = glm::dot(image[i] - reference[i],LUMINANCE);
+        sumOfSquares += difference*difference;
+    }
+    return std::sqrt(sumOfSquares/image.size());
+}
+
+/*
+ * RMSE against the reference after every sample of a run. Every run restarts the accumulation, which rotates the
+ * low discrepancy samples by another offset of the blue noise mask, so the error of the reference is independent.
+ */
+static std::vector<double> getConvergence(CpuRenderer& renderer, const Scene& scene, Camera& camera, int samplesPerPixel, const std::vector<glm::vec3>& reference){
+    std::vector<double> rmse;
+    for(int frame = 0; frame < samplesPerPixel; frame++){
+        renderer.render(scene,camera,16.0f*(frame + 1),frame == 0);
+        rmse.push_back(getRmse(renderer.getAccumulation(),reference));
+    }
+    return rmse;
+}
+
+int main(int argc, char* argv[]){
+    std::string sceneFile;
+    glm::vec3 cameraPosition = glm::vec3(1.0f,0.5f,2.0f);
+    float yaw = -90.0f, pitch = 0.0f, fov = 120.0f;
+    int width = 160, height = 90;
+    int samplesPerPixel = 64;
+    int referenceSamples = 1024;
+    unsigned int numThreads = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i],"--scene") == 0 && i + 1 < argc){
+            sceneFile = argv[++i];
+        } else if(strcmp(argv[i],"--camera") == 0 && i + 5 < argc){
+            cameraPosition = glm::vec3(atof(argv[i + 1]),atof(argv[i + 2]),atof(argv[i + 3]));
+            yaw = atof(argv[i + 4]);
+            pitch = atof(argv[i + 5]);
+            i += 5;
+        } else if(strcmp(argv[i],"--fov") == 0 && i + 1 < argc){
+            fov = atof(argv[++i]);
+        } else if(strcmp(argv[i],"--size") == 0 && i + 2 < argc){
+            width = atoi(argv[i + 1]);
+            height = atoi(argv[i + 2]);
+            i += 2;
+        } else if(strcmp(argv[i],"--spp") == 0 && i + 1 < argc){
+            samplesPerPixel = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--reference-spp") == 0 && i + 1 < argc){
+            referenceSamples = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--threads") == 0 && i + 1 < argc){
+            numThreads = (unsigned int)atoi(argv[++i]);
+        } else {
+            fprintf(stderr,"Unknown argument: %s\n",argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(width <= 0 || height <= 0 || samplesPerPixel <= 0 || referenceSamples <= 0){
+        fprintf(stderr,"The resolution and samples per pixel have to be positive\n");
+        return 1;
+    }
+
+    Scene scene;
+    if(!sceneFile.empty() && !scene.loadFromFile(sceneFile)) return 1;
+
+    Camera camera(cameraPosition,glm::vec3(0.0f,0.0f,1.0f),glm::vec3(0.0f,1.0f,0.0f),yaw,pitch,fov,0.0f);
+    camera.updateYawAndPitch(0.0f);
+
+    CpuRenderer renderer(width,height,numThreads);
+    printf("Rendering the reference at %dx%d with %d samples per pixel on %u threads\n",width,height,referenceSamples,renderer.getThreadCount());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int frame = 0; frame < referenceSamples; frame++)
+        renderer.render(scene,camera,16.0f*(frame + 1),frame == 0);
+    std::vector<glm::vec3> reference = renderer.getAccumulation();
+    printf("Reference done in %.1f s\n",secondsSince(start));
+
+    renderer.setHashSampling(true);
+    std::vector<double> hashRmse = getConvergence(renderer,scene,camera,samplesPerPixel,reference);
+    renderer.setHashSampling(false);
+    std::vector<double> sobolRmse = getConvergence(renderer,scene,camera,samplesPerPixel,reference);
+
+    //The samples the low discrepancy sampler needed to first get at least as close to the reference as the hash
+    printf("%8s %12s %12s %14s %9s\n","spp","hash RMSE","sobol RMSE","sobol spp","speedup");
+    for(int samples = 1; samples <= samplesPerPixel; samples *= 2){
+        double target = hashRmse[samples - 1];
+        int equalSamples = -1;
+        for(int i = 0; i < samplesPerPixel && equalSamples < 0; i++){
+            if(sobolRmse[i] <= target) equalSamples = i + 1;
+        }
+        printf("%8d %12.5f %12.5f ",samples,target,sobolRmse[samples - 1]);
+        if(equalSamples > 0) printf("%14d %8.2fx\n",equalSamples,(double)samples/equalSamples);
+        else printf("%14s %9s\n","-","-");
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+//Headless batch renderer. It renders a scene on the CPU backend and writes the result to a PNG
+//or OpenEXR image, it never creates a window or touches SDL and OpenGL so it runs on machines without a display.
+//
+//Build from the repository root:
+//  g++ -O2 -march=native -pthread tools/render.cpp cpurenderer.cpp cpudenoiser.cpp sampler.cpp bluenoise.cpp marcher.cpp packetmarcher.cpp scene.cpp csg.cpp bvh.cpp brickmap.cpp threadpool.cpp camera.cpp imagewriter.cpp -I include/ -I . -o pathmarcher-render
+//Run:
+//  ./pathmarcher-render --scene scenes/default.scene --size 1920 1080 --spp 256 --output frame.exr
+//  ./pathmarcher-render --camera 1 0.5 2 -90 0 --fov 120 --output frame.png
+//  ./pathmarcher-render --noise-target 0.02 --spp 1024 --output frame.exr
+//  ./pathmarcher-render --spp 8 --denoise 5 --output frame.png
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "threadpool.h"
+#include "camera.h"
+#include "cpurenderer.h"
+#include "imagewriter.h"
+
+static void printUsage(const char* program){
+    printf("Usage: %s [options] --output image.png|image.exr\n",program);
+    printf("  --scene file             scene to render, the built in default scene otherwise\n");
+    printf("  --camera x y z yaw pitch camera position and orientation in degrees (default 1 0.5 2 -90 0)\n");
+    printf("  --fov degrees            field of view (default 120)\n");
+    printf("  --size width height      resolution in pixels (default 1280 720)\n");
+    printf("  --spp samples            samples per pixel, the most any pixel takes with --noise-target (default 64)\n");
+    printf("  --noise-target error     sample adaptively until the relative error of every pixel is below the target\n");
+    printf("  --denoise iterations     filter the image with the given a-trous iterations, 5 is a good start (default 0)\n");
+    printf("  --threads count          worker threads, 0 uses every hardware thread (default 0)\n");
+    printf("  --no-brick-map           evaluate the fractals exactly instead of through their brick maps\n");
+    printf("  --full-detail            hit every surface within epsilon and evaluate the fractals at full detail at any distance\n");
+}
+
+static bool hasExtension(const std::string& fileName, const char* extension){
+    size_t length = strlen(extension);
+    return fileName.size() >= length && fileName.compare(fileName.size() - length,length,extension) == 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string sceneFile;
+    std::string outputFile;
+    glm::vec3 cameraPosition = glm::vec3(1.0f,0.5f,2.0f);
+    float yaw = -90.0f, pitch = 0.0f, fov = 120.0f;
+    int width = 1280, height = 720;
+    int samplesPerPixel = 64;
+    float noiseTarget = 0.0f;
+    int denoiseIterations = 0;
+    unsigned int numThreads = 0;
+    bool useBrickMap = true;
+    bool isLevelOfDetailEnabled = true;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i],"--scene") == 0 && i + 1 < argc){
+            sceneFile = argv[++i];
+        } else if(strcmp(argv[i],"--output") == 0 && i + 1 < argc){
+            outputFile = argv[++i];
+        } else if(strcmp(argv[i],"--camera") == 0 && i + 5 < argc){
+            cameraPosition = glm::vec3(atof(argv[i + 1]),atof(argv[i + 2]),atof(argv[i + 3]));
+            yaw = atof(argv[i + 4]);
+            pitch = atof(argv[i + 5]);
+            i += 5;
+        } else if(strcmp(argv[i],"--fov") == 0 && i + 1 < argc){
+            fov = atof(argv[++i]);
+        } else if(strcmp(argv[i],"--size") == 0 && i + 2 < argc){
+            width = atoi(argv[i + 1]);
+            height = atoi(argv[i + 2]);
+            i += 2;
+        } else if(strcmp(argv[i],"--spp") == 0 && i + 1 < argc){
+            samplesPerPixel = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--noise-target") == 0 && i + 1 < argc){
+            noiseTarget = atof(argv[++i]);
+        } else if(strcmp(argv[i],"--denoise") == 0 && i + 1 < argc){
+            denoiseIterations = atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--threads") == 0 && i + 1 < argc){
+            numThreads = (unsigned int)atoi(argv[++i]);
+        } else if(strcmp(argv[i],"--no-brick-map") == 0){
+            useBrickMap = false;
+        } else if(strcmp(argv[i],"--full-detail") == 0){
+            isLevelOfDetailEnabled = false;
+        } else {
+            fprintf(stderr,"Unknown argument: %s\n",argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    bool isExr = hasExtension(outputFile,".exr");
+    if(!isExr && !hasExtension(outputFile,".png")){
+        fprintf(stderr,"The output has to be a .png or .exr file\n");
+        printUsage(argv[0]);
+        return 1;
+    }
+    if(width <= 0 || height <= 0 || samplesPerPixel <= 0){
+        fprintf(stderr,"The resolution and samples per pixel have to be positive\n");
+        return 1;
+    }
+
+    Scene scene;
+    if(!sceneFile.empty() && !scene.loadFromFile(sceneFile)) return 1;
+    if(useBrickMap){
+        std::chrono::steady_clock::time_point bakeStart = std::chrono::steady_clock::now();
+        ThreadPool threadPool(numThreads);
+        scene.buildBrickMap(threadPool);
+        if(!scene.getBrickMap().isEmpty())
+            printf("Baked %d bricks in %.0f ms\n",scene.getBrickMap().getBrickCount(),std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - bakeStart).count());
+    }
+
+    //Front and up are derived from yaw and pitch, without mouse movement the angles are used as given
+    Camera camera(cameraPosition,glm::vec3(0.0f,0.0f,1.0f),glm::vec3(0.0f,1.0f,0.0f),yaw,pitch,fov,0.0f);
+    camera.updateYawAndPitch(0.0f);
+
+    CpuRenderer renderer(width,height,numThreads);
+    renderer.setNoiseThreshold(noiseTarget,samplesPerPixel);
+    renderer.setDenoiseIterations(denoiseIterations);
+    renderer.setLevelOfDetail(isLevelOfDetailEnabled);
+    if(noiseTarget > 0.0f){
+        printf("Rendering %dx%d to a relative error of %g with at most %d samples per pixel on %u threads\n",width,height,noiseTarget,samplesPerPixel,renderer.getThreadCount());
+    } else {
+        printf("Rendering %dx%d at %d samples per pixel on %u threads\n",width,height,samplesPerPixel,renderer.getThreadCount());
+    }
+
+    //Every pixel that still samples takes at least one sample per frame, so no more frames than samples are needed
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int frames = 0;
+    while(frames < samplesPerPixel && renderer.getActivePixelCount() > 0){
+        //The time seeds the random numbers of every frame, as in the interactive renderer
+        renderer.render(scene,camera,16.0f*(frames + 1),frames == 0);
+        frames++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    float meanSamples = renderer.getMeanSampleCount();
+    printf("Rendered %d frames in %.2f s, %.1f samples per pixel on average, %.2f ms per sample\n",frames,seconds,meanSamples,seconds*1000.0/meanSamples);
+    if(noiseTarget > 0.0f && renderer.getActivePixelCount() > 0)
+        printf("%d pixels reached %d samples above the noise target\n",renderer.getActivePixelCount(),samplesPerPixel);
+
+    bool isWritten;
+    if(isExr){
+        //The image is stored bottom row first, images are written top row first
+        const std::vector<glm::vec3>& image = renderer.getImage();
+        std::vector<glm::vec3> pixels(image.size());
+        for(int y = 0; y < height; y++){
+            std::copy(image.begin() + (size_t)(height - 1 - y)*width,image.begin() + (size_t)(height - y)*width,pixels.begin() + (size_t)y*width);
+        }
+        isWritten = writeExr(outputFile,pixels,width,height);
+    } else {
+        std::vector<unsigned char> pixels;
+        renderer.getPixels(pixels);
+        isWritten = writePng(outputFile,pixels,width,height);
+    }
+    if(!isWritten) return 1;
+
+    printf("Wrote %s\n",outputFile.c_str());
+    return 0;
+}